@@ -3178,23 +3178,25 @@ namespace dxvk {
   template<DxbcProgramType ShaderStage>
   void D3D11DeviceContext::BindShader(
     const D3D11CommonShader*    pShaderModule) {
-    // Bind the shader and the ICB at once
+    // Bind the shader and the ICB at once. The shader object
+    // is resolved on the CS thread so that the application
+    // does not have to wait for asynchronous translation.
     EmitCs([
-      cSlice  = pShaderModule           != nullptr
-             && pShaderModule->GetIcb() != nullptr
-        ? DxvkBufferSlice(pShaderModule->GetIcb())
-        : DxvkBufferSlice(),
-      cShader = pShaderModule != nullptr
-        ? pShaderModule->GetShader()
-        : nullptr
+      cModule = pShaderModule != nullptr
+        ? *pShaderModule
+        : D3D11CommonShader()
     ] (DxvkContext* ctx) {
       VkShaderStageFlagBits stage = GetShaderStage(ShaderStage);
 
       uint32_t slotId = computeConstantBufferBinding(ShaderStage,
         D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
 
-      ctx->bindShader        (stage,  cShader);
-      ctx->bindResourceBuffer(slotId, cSlice);
+      Rc<DxvkBuffer> icb = cModule.GetIcb();
+
+      ctx->bindShader        (stage,  cModule.GetShader());
+      ctx->bindResourceBuffer(slotId, icb != nullptr
+        ? DxvkBufferSlice(icb)
+        : DxvkBufferSlice());
     });
   }
 
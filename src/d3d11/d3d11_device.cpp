@@ -2021,16 +2021,6 @@ namespace dxvk {
     if (FAILED(hr))
       return hr;
 
-    auto shader = commonShader.GetShader();
-
-    if (shader->flags().test(DxvkShaderFlag::ExportsStencilRef)
-     && !m_dxvkDevice->extensions().extShaderStencilExport)
-      return E_INVALIDARG;
-
-    if (shader->flags().test(DxvkShaderFlag::ExportsViewportIndexLayerFromVertexStage)
-     && !m_dxvkDevice->extensions().extShaderViewportIndexLayer)
-      return E_INVALIDARG;
-
     *pShaderModule = std::move(commonShader);
     return S_OK;
   }
@@ -101,6 +101,11 @@ namespace dxvk {
     /// performs the required shader and resolve fixups.
     bool disableMsaa;
 
+    /// Translate shaders on worker threads. Shader creation
+    /// returns immediately, and the first draw or dispatch
+    /// using the shader waits for translation to finish.
+    bool asyncShaderTranslation;
+
     /// Apitrace mode: Maps all buffers in cached memory.
     /// Enabled automatically if dxgitrace.dll is attached.
     bool apitraceMode;
@@ -3,8 +3,72 @@
 
 namespace dxvk {
   
+  D3D11ShaderCompileTask::D3D11ShaderCompileTask(
+          D3D11Device*    pDevice,
+    const DxvkShaderKey*  pShaderKey,
+    const DxbcModuleInfo* pDxbcModuleInfo,
+          DxbcModule&&    Module)
+  : m_device    (pDevice),
+    m_shaderKey (*pShaderKey),
+    m_moduleInfo(*pDxbcModuleInfo),
+    m_tessInfo  (),
+    m_module    (std::move(Module)) {
+    // The module info may point to data owned by the caller
+    if (m_moduleInfo.tess != nullptr) {
+      m_tessInfo = *m_moduleInfo.tess;
+      m_moduleInfo.tess = &m_tessInfo;
+    }
+  }
+
+
+  D3D11ShaderCompileTask::~D3D11ShaderCompileTask() {
+
+  }
+
+
+  void D3D11ShaderCompileTask::Run() {
+    try {
+      D3D11CommonShader shader(m_device, &m_shaderKey,
+        &m_moduleInfo, *m_module, false);
+
+      m_shader = shader.GetShader();
+      m_buffer = shader.GetIcb();
+    } catch (const DxvkError& e) {
+      Logger::err(str::format("D3D11: Failed to translate shader ", GetName(), ":"));
+      Logger::err(e.message());
+      m_failed = true;
+    }
+
+    // The parsed module is no longer needed
+    m_module.reset();
+
+    { std::lock_guard<dxvk::mutex> lock(m_mutex);
+      m_done.store(true, std::memory_order_release);
+    }
+
+    m_cond.notify_all();
+  }
+
+
+  void D3D11ShaderCompileTask::Wait() {
+    if (likely(m_done.load(std::memory_order_acquire)))
+      return;
+
+    std::unique_lock<dxvk::mutex> lock(m_mutex);
+
+    m_cond.wait(lock, [this] {
+      return m_done.load(std::memory_order_acquire);
+    });
+  }
+
+
   D3D11CommonShader:: D3D11CommonShader() { }
   D3D11CommonShader::~D3D11CommonShader() { }
+
+
+  D3D11CommonShader::D3D11CommonShader(
+    const Rc<D3D11ShaderCompileTask>& Task)
+  : m_task(Task) { }
   
   
   D3D11CommonShader::D3D11CommonShader(
@@ -13,9 +77,6 @@ namespace dxvk {
     const DxbcModuleInfo* pDxbcModuleInfo,
     const void*           pShaderBytecode,
           size_t          BytecodeLength) {
-    const std::string name = pShaderKey->toString();
-    Logger::debug(str::format("Compiling shader ", name));
-    
     DxbcReader reader(
       reinterpret_cast<const char*>(pShaderBytecode),
       BytecodeLength);
@@ -24,25 +85,41 @@ namespace dxvk {
     
     // If requested by the user, dump both the raw DXBC
     // shader and the compiled SPIR-V module to a file.
-    const std::string dumpPath = env::getEnvVar("DXVK_SHADER_DUMP_PATH");
-    
-    if (dumpPath.size() != 0) {
-      reader.store(std::ofstream(str::tows(str::format(dumpPath, "/", name, ".dxbc").c_str()).c_str(),
-        std::ios_base::binary | std::ios_base::trunc));
-    }
+    DumpBytecode(pShaderKey, reader);
     
-    // Decide whether we need to create a pass-through
-    // geometry shader for vertex shader stream output
-    bool passthroughShader = pDxbcModuleInfo->xfb != nullptr
-      && (module.programInfo().type() == DxbcProgramType::VertexShader
-       || module.programInfo().type() == DxbcProgramType::DomainShader);
+    bool passthroughShader = ValidateModule(
+      pDevice, pShaderKey, pDxbcModuleInfo, module);
+
+    CreateShader(pDevice, pShaderKey,
+      pDxbcModuleInfo, module, passthroughShader);
+  }
+
+
+  D3D11CommonShader::D3D11CommonShader(
+          D3D11Device*    pDevice,
+    const DxvkShaderKey*  pShaderKey,
+    const DxbcModuleInfo* pDxbcModuleInfo,
+    const DxbcModule&     Module,
+          bool            Passthrough) {
+    CreateShader(pDevice, pShaderKey,
+      pDxbcModuleInfo, Module, Passthrough);
+  }
 
-    if (module.programInfo().shaderStage() != pShaderKey->type() && !passthroughShader)
-      throw DxvkError("Mismatching shader type.");
 
-    m_shader = passthroughShader
-      ? module.compilePassthroughShader(*pDxbcModuleInfo, name)
-      : module.compile                 (*pDxbcModuleInfo, name);
+  void D3D11CommonShader::CreateShader(
+          D3D11Device*    pDevice,
+    const DxvkShaderKey*  pShaderKey,
+    const DxbcModuleInfo* pDxbcModuleInfo,
+    const DxbcModule&     Module,
+          bool            Passthrough) {
+    const std::string name = pShaderKey->toString();
+    Logger::debug(str::format("Compiling shader ", name));
+    
+    const std::string dumpPath = env::getEnvVar("DXVK_SHADER_DUMP_PATH");
+
+    m_shader = Passthrough
+      ? Module.compilePassthroughShader(*pDxbcModuleInfo, name)
+      : Module.compile                 (*pDxbcModuleInfo, name);
     m_shader->setShaderKey(*pShaderKey);
     
     if (dumpPath.size() != 0) {
@@ -76,9 +153,79 @@ namespace dxvk {
     pDevice->GetDXVKDevice()->registerShader(m_shader);
   }
 
+
+  bool D3D11CommonShader::ValidateModule(
+          D3D11Device*    pDevice,
+    const DxvkShaderKey*  pShaderKey,
+    const DxbcModuleInfo* pDxbcModuleInfo,
+    const DxbcModule&     Module) {
+    const DxbcProgramType type = Module.programInfo().type();
+
+    // Decide whether we need to create a pass-through
+    // geometry shader for vertex shader stream output
+    bool passthroughShader = pDxbcModuleInfo->xfb != nullptr
+      && (type == DxbcProgramType::VertexShader
+       || type == DxbcProgramType::DomainShader);
+
+    if (Module.programInfo().shaderStage() != pShaderKey->type() && !passthroughShader)
+      throw DxvkError("Mismatching shader type.");
+
+    // Check for outputs that require optional extensions. This uses
+    // the output signature rather than the compiled shader, so that
+    // it does not have to wait for asynchronous translation.
+    const auto& extensions = pDevice->GetDXVKDevice()->extensions();
+    const Rc<DxbcIsgn> osgn = Module.osgn();
+
+    if (osgn != nullptr) {
+      if (type == DxbcProgramType::PixelShader
+       && !extensions.extShaderStencilExport
+       && osgn->find("SV_StencilRef", 0, 0) != nullptr)
+        throw DxvkError("Stencil export not supported.");
+
+      if ((type == DxbcProgramType::VertexShader || type == DxbcProgramType::DomainShader)
+       && !extensions.extShaderViewportIndexLayer && !passthroughShader) {
+        for (const auto& entry : *osgn) {
+          if (entry.systemValue == DxbcSystemValue::RenderTargetId
+           || entry.systemValue == DxbcSystemValue::ViewportId)
+            throw DxvkError("Viewport index and layer export from vertex stages not supported.");
+        }
+      }
+    }
+
+    return passthroughShader;
+  }
+
+
+  void D3D11CommonShader::DumpBytecode(
+    const DxvkShaderKey*  pShaderKey,
+    const DxbcReader&     Reader) {
+    const std::string dumpPath = env::getEnvVar("DXVK_SHADER_DUMP_PATH");
+
+    if (dumpPath.size() != 0) {
+      Reader.store(std::ofstream(str::tows(str::format(dumpPath, "/", pShaderKey->toString(), ".dxbc").c_str()).c_str(),
+        std::ios_base::binary | std::ios_base::trunc));
+    }
+  }
+
   
-  D3D11ShaderModuleSet:: D3D11ShaderModuleSet() { }
-  D3D11ShaderModuleSet::~D3D11ShaderModuleSet() { }
+  D3D11ShaderModuleSet::D3D11ShaderModuleSet() {
+
+  }
+
+
+  D3D11ShaderModuleSet::~D3D11ShaderModuleSet() {
+    // Shader objects cannot outlive the device, so nothing
+    // can wait for tasks that have not started yet anymore.
+    { std::lock_guard<dxvk::mutex> lock(m_workerLock);
+      m_workersStopped = true;
+      m_workerQueue = { };
+    }
+
+    m_workerCond.notify_all();
+
+    for (auto& thread : m_workerThreads)
+      thread.join();
+  }
   
   
   HRESULT D3D11ShaderModuleSet::GetShaderModule(
@@ -100,11 +247,35 @@ namespace dxvk {
     
     // This shader has not been compiled yet, so we have to create a
     // new module. This takes a while, so we won't lock the structure.
+    // Stream output shaders are rare and reference application-owned
+    // strings, so those are always compiled synchronously.
+    bool async = pDevice->GetOptions()->asyncShaderTranslation
+      && pDxbcModuleInfo->xfb == nullptr;
+
     D3D11CommonShader module;
+    Rc<D3D11ShaderCompileTask> task;
     
     try {
-      module = D3D11CommonShader(pDevice, pShaderKey,
-        pDxbcModuleInfo, pShaderBytecode, BytecodeLength);
+      if (async) {
+        // Parse the module up front so that we can
+        // still reject invalid shaders immediately,
+        // and hand the parsed module to the worker.
+        DxbcReader reader(
+          reinterpret_cast<const char*>(pShaderBytecode),
+          BytecodeLength);
+
+        DxbcModule dxbcModule(reader);
+        D3D11CommonShader::DumpBytecode(pShaderKey, reader);
+        D3D11CommonShader::ValidateModule(
+          pDevice, pShaderKey, pDxbcModuleInfo, dxbcModule);
+
+        task = new D3D11ShaderCompileTask(pDevice, pShaderKey,
+          pDxbcModuleInfo, std::move(dxbcModule));
+        module = D3D11CommonShader(task);
+      } else {
+        module = D3D11CommonShader(pDevice, pShaderKey,
+          pDxbcModuleInfo, pShaderBytecode, BytecodeLength);
+      }
     } catch (const DxvkError& e) {
       Logger::err(e.message());
       return E_INVALIDARG;
@@ -121,9 +292,71 @@ namespace dxvk {
         return S_OK;
       }
     }
+
+    if (task != nullptr)
+      EnqueueTask(task);
     
     *pShader = std::move(module);
     return S_OK;
   }
+
+
+  void D3D11ShaderModuleSet::EnqueueTask(
+    const Rc<D3D11ShaderCompileTask>& Task) {
+    std::lock_guard<dxvk::mutex> lock(m_workerLock);
+
+    // Start worker threads on first use, so that
+    // we don't waste resources if we never need them
+    if (m_workerThreads.empty()) {
+      uint32_t numCpuCores = dxvk::thread::hardware_concurrency();
+      uint32_t numWorkers  = std::max(1u, numCpuCores) - 1;
+
+      if (numWorkers <  1) numWorkers =  1;
+      if (numWorkers > 16) numWorkers = 16;
+
+      Logger::info(str::format("D3D11: Using ", numWorkers, " shader translation threads"));
+
+      for (uint32_t i = 0; i < numWorkers; i++)
+        m_workerThreads.emplace_back([this] () { RunWorker(); });
+    }
+
+    m_workerQueue.push(Task);
+    m_workerCond.notify_one();
+  }
+
+
+  void D3D11ShaderModuleSet::RunWorker() {
+    env::setThreadName("dxvk-shader");
+
+    while (true) {
+      Rc<D3D11ShaderCompileTask> task;
+
+      { std::unique_lock<dxvk::mutex> lock(m_workerLock);
+
+        m_workerCond.wait(lock, [this] {
+          return m_workersStopped || !m_workerQueue.empty();
+        });
+
+        // Pending tasks are dropped on shutdown
+        if (m_workersStopped)
+          return;
+
+        task = std::move(m_workerQueue.front());
+        m_workerQueue.pop();
+      }
+
+      task->Run();
+
+      // Don't keep failed shaders in the cache, so that
+      // creating the same shader again reports the error
+      // instead of returning a shader object without code.
+      // Entries are only ever replaced after removal, so
+      // the entry with this key still belongs to the task.
+      if (task->Failed()) {
+        std::unique_lock<dxvk::mutex> lock(m_mutex);
+        m_modules.erase(task->GetShaderKey());
+      }
+    }
+  }
   
 }
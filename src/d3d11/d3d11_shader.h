@@ -1,6 +1,8 @@
 #pragma once
 
 #include <mutex>
+#include <optional>
+#include <queue>
 #include <unordered_map>
 
 #include "../dxbc/dxbc_module.h"
@@ -19,6 +21,83 @@ namespace dxvk {
   
   class D3D11Device;
   
+  /**
+   * \brief Shader compile task
+   *
+   * Stores the parsed DXBC module and compile options
+   * so that a shader can be translated on a worker
+   * thread. Accessing the compiled shader will block
+   * until translation has finished.
+   */
+  class D3D11ShaderCompileTask : public RcObject {
+
+  public:
+
+    D3D11ShaderCompileTask(
+            D3D11Device*    pDevice,
+      const DxvkShaderKey*  pShaderKey,
+      const DxbcModuleInfo* pDxbcModuleInfo,
+            DxbcModule&&    Module);
+    ~D3D11ShaderCompileTask();
+
+    /**
+     * \brief Translates the shader
+     *
+     * Must be called exactly once. Errors are
+     * logged, and will result in a null shader.
+     */
+    void Run();
+
+    /**
+     * \brief Checks whether translation failed
+     *
+     * Only valid after \ref Run has returned.
+     * \returns \c true if no shader was created
+     */
+    bool Failed() const {
+      return m_failed;
+    }
+
+    const DxvkShaderKey& GetShaderKey() const {
+      return m_shaderKey;
+    }
+
+    Rc<DxvkShader> GetShader() {
+      Wait();
+      return m_shader;
+    }
+
+    Rc<DxvkBuffer> GetIcb() {
+      Wait();
+      return m_buffer;
+    }
+
+    std::string GetName() const {
+      return m_shaderKey.toString();
+    }
+
+  private:
+
+    D3D11Device*      m_device;
+    DxvkShaderKey     m_shaderKey;
+    DxbcModuleInfo    m_moduleInfo;
+    DxbcTessInfo      m_tessInfo;
+
+    std::optional<DxbcModule> m_module;
+
+    bool                      m_failed = false;
+    std::atomic<bool>         m_done = { false };
+    dxvk::mutex               m_mutex;
+    dxvk::condition_variable  m_cond;
+
+    Rc<DxvkShader>    m_shader;
+    Rc<DxvkBuffer>    m_buffer;
+
+    void Wait();
+
+  };
+
+
   /**
    * \brief Common shader object
    * 
@@ -37,24 +116,80 @@ namespace dxvk {
       const DxbcModuleInfo* pDxbcModuleInfo,
       const void*           pShaderBytecode,
             size_t          BytecodeLength);
+    D3D11CommonShader(
+            D3D11Device*    pDevice,
+      const DxvkShaderKey*  pShaderKey,
+      const DxbcModuleInfo* pDxbcModuleInfo,
+      const DxbcModule&     Module,
+            bool            Passthrough);
+    D3D11CommonShader(
+      const Rc<D3D11ShaderCompileTask>& Task);
     ~D3D11CommonShader();
 
     Rc<DxvkShader> GetShader() const {
+      if (unlikely(m_task != nullptr))
+        return m_task->GetShader();
+
       return m_shader;
     }
 
     Rc<DxvkBuffer> GetIcb() const {
+      if (unlikely(m_task != nullptr))
+        return m_task->GetIcb();
+
       return m_buffer;
     }
     
     std::string GetName() const {
+      if (unlikely(m_task != nullptr))
+        return m_task->GetName();
+
       return m_shader->debugName();
     }
+
+    /**
+     * \brief Validates DXBC module
+     *
+     * Checks whether the shader type matches the requested
+     * type, and whether the device supports all outputs the
+     * shader writes. Throws an error if it does not.
+     * \param [in] pDevice The device
+     * \param [in] pShaderKey Shader key
+     * \param [in] pDxbcModuleInfo Module info
+     * \param [in] Module The DXBC module
+     * \returns \c true if a pass-through shader is needed
+     */
+    static bool ValidateModule(
+            D3D11Device*    pDevice,
+      const DxvkShaderKey*  pShaderKey,
+      const DxbcModuleInfo* pDxbcModuleInfo,
+      const DxbcModule&     Module);
+
+    /**
+     * \brief Dumps DXBC byte code
+     *
+     * Writes the byte code to \c DXVK_SHADER_DUMP_PATH
+     * if the environment variable is set.
+     * \param [in] pShaderKey Shader key
+     * \param [in] Reader Reader for the byte code
+     */
+    static void DumpBytecode(
+      const DxvkShaderKey*  pShaderKey,
+      const DxbcReader&     Reader);
     
   private:
     
     Rc<DxvkShader> m_shader;
     Rc<DxvkBuffer> m_buffer;
+
+    Rc<D3D11ShaderCompileTask> m_task;
+
+    void CreateShader(
+            D3D11Device*    pDevice,
+      const DxvkShaderKey*  pShaderKey,
+      const DxbcModuleInfo* pDxbcModuleInfo,
+      const DxbcModule&     Module,
+            bool            Passthrough);
     
   };
   
@@ -128,6 +263,10 @@ namespace dxvk {
    * times, so we should cache the resulting shader modules
    * and reuse them rather than creating new ones. This
    * class is thread-safe.
+   *
+   * If asynchronous shader translation is enabled, shaders
+   * are translated on a pool of worker threads, and binding
+   * a shader will wait for translation to complete.
    */
   class D3D11ShaderModuleSet {
     
@@ -153,6 +292,17 @@ namespace dxvk {
       D3D11CommonShader,
       DxvkHash, DxvkEq> m_modules;
     
+    dxvk::mutex                                 m_workerLock;
+    dxvk::condition_variable                    m_workerCond;
+    std::queue<Rc<D3D11ShaderCompileTask>>      m_workerQueue;
+    std::vector<dxvk::thread>                   m_workerThreads;
+    bool                                        m_workersStopped = false;
+
+    void EnqueueTask(
+      const Rc<D3D11ShaderCompileTask>& Task);
+
+    void RunWorker();
+
   };
   
 }
@@ -333,8 +333,10 @@ namespace dxvk {
       m_device->submitCommandList(cCommandList,
         cSync.acquire, cSync.present);
 
-      if (cHud != nullptr && !cFrameId)
+      if (cHud != nullptr && !cFrameId) {
+        cHud->setFrameRateLimit(m_presenter->getFrameRateLimit());
         cHud->update();
+      }
 
       m_device->presentImage(m_presenter, &m_presentStatus);
     });
@@ -17,6 +17,13 @@ namespace dxvk {
 
     if (m_desc.Pool != D3DPOOL_DEFAULT)
       m_dirtyRange = D3D9Range(0, m_desc.Size);
+
+    m_parent->ChangeMappedMemory(D3D9MappedMemoryType::Buffers, int64_t(m_desc.Size));
+  }
+
+
+  D3D9CommonBuffer::~D3D9CommonBuffer() {
+    m_parent->ChangeMappedMemory(D3D9MappedMemoryType::Buffers, -int64_t(m_desc.Size));
   }
 
 
@@ -7,6 +7,58 @@
 
 namespace dxvk {
 
+  static D3D9MappedMemoryType GetMappedMemoryType(D3DPOOL Pool) {
+    if (IsPoolManaged(Pool))
+      return D3D9MappedMemoryType::ManagedTextures;
+
+    if (Pool == D3DPOOL_DEFAULT)
+      return D3D9MappedMemoryType::DefaultTextures;
+
+    return D3D9MappedMemoryType::SystemMemTextures;
+  }
+
+
+  void D3D9DirtyBoxList::Add(const D3DBOX& Box) {
+    D3DBOX box = Box;
+
+    // Absorb all boxes the new one touches. This
+    // needs to be repeated since the box may grow.
+    for (uint32_t i = 0; i < m_count; ) {
+      if (Touch(m_boxes[i], box)) {
+        box = Union(m_boxes[i], box);
+        m_boxes[i] = m_boxes[--m_count];
+        i = 0;
+      } else {
+        i++;
+      }
+    }
+
+    if (m_count < MaxBoxes) {
+      m_boxes[m_count++] = box;
+      return;
+    }
+
+    // Merge with the box that grows the least, then add
+    // the result again since it may touch other boxes now
+    uint32_t bestIndex = 0;
+    uint64_t bestCost  = ~0ull;
+
+    for (uint32_t i = 0; i < m_count; i++) {
+      uint64_t cost = Volume(Union(m_boxes[i], box)) - Volume(m_boxes[i]);
+
+      if (cost < bestCost) {
+        bestIndex = i;
+        bestCost  = cost;
+      }
+    }
+
+    D3DBOX merged = Union(m_boxes[bestIndex], box);
+    m_boxes[bestIndex] = m_boxes[--m_count];
+
+    Add(merged);
+  }
+
+
   D3D9CommonTexture::D3D9CommonTexture(
           D3D9DeviceEx*             pDevice,
     const D3D9_COMMON_TEXTURE_DESC* pDesc,
@@ -74,6 +126,14 @@ namespace dxvk {
   D3D9CommonTexture::~D3D9CommonTexture() {
     if (m_size != 0)
       m_device->ChangeReportedMemory(m_size);
+
+    if (IsManaged() || IsDynamic()) {
+      auto lock = m_device->LockDevice();
+      m_device->RemoveMappedTexture(this);
+    }
+
+    // Keep the mapped memory statistics accurate
+    EvictBuffers();
   }
 
 
@@ -179,10 +239,38 @@ namespace dxvk {
     m_buffers[Subresource] = m_device->GetDXVKDevice()->createBuffer(info, memType);
     m_mappedSlices[Subresource] = m_buffers[Subresource]->getSliceHandle();
 
+    ChangeMappedBufferSize(int64_t(info.size));
+
     return true;
   }
 
 
+  void D3D9CommonTexture::DestroyBufferSubresource(UINT Subresource) {
+    if (m_buffers[Subresource] != nullptr)
+      ChangeMappedBufferSize(-int64_t(m_buffers[Subresource]->info().size));
+
+    m_buffers[Subresource] = nullptr;
+    SetWrittenByGPU(Subresource, true);
+  }
+
+
+  void D3D9CommonTexture::EvictBuffers() {
+    for (uint32_t i = 0; i < CountSubresources(); i++) {
+      if (m_buffers[i] != nullptr)
+        DestroyBufferSubresource(i);
+    }
+  }
+
+
+  void D3D9CommonTexture::ChangeMappedBufferSize(int64_t Delta) {
+    m_mappedBufferSize += Delta;
+    m_device->ChangeMappedMemory(GetMappedMemoryType(m_desc.Pool), Delta);
+
+    if (m_mappedListEntry)
+      m_device->ChangeEvictableMemory(this, Delta);
+  }
+
+
   VkDeviceSize D3D9CommonTexture::GetMipSize(UINT Subresource) const {
     const UINT MipLevel = Subresource % m_desc.MipLevels;
 
@@ -8,9 +8,22 @@
 
 #include "../util/util_bit.h"
 
+#include <list>
+#include <optional>
+
 namespace dxvk {
 
   class D3D9DeviceEx;
+  class D3D9CommonTexture;
+
+  /**
+   * \brief Mapped texture list
+   *
+   * Ordered from least to most recently locked. Used
+   * to pick textures whose mapping buffers can be
+   * released when exceeding the configured budgets.
+   */
+  using D3D9MappedTextureList = std::list<D3D9CommonTexture*>;
 
   /**
    * \brief Image memory mapping mode
@@ -59,6 +72,66 @@ namespace dxvk {
     Rc<DxvkImageView> Srgb;
   };
 
+  /**
+   * \brief Dirty regions of a texture face
+   *
+   * Keeps a few separate boxes so that updates to distant parts
+   * of a texture do not cause everything in between to be uploaded.
+   * Touching boxes are merged, and once the list is full, the new
+   * box is merged with whichever box grows the least from it.
+   */
+  class D3D9DirtyBoxList {
+
+  public:
+
+    static constexpr uint32_t MaxBoxes = 4;
+
+    /**
+     * \brief Adds a box
+     * \param [in] Box Non-empty box to add
+     */
+    void Add(const D3DBOX& Box);
+
+    void Clear() {
+      m_count = 0;
+    }
+
+    bool Empty() const {
+      return m_count == 0;
+    }
+
+    const D3DBOX* begin() const {
+      return m_boxes.data();
+    }
+
+    const D3DBOX* end() const {
+      return m_boxes.data() + m_count;
+    }
+
+  private:
+
+    uint32_t                      m_count = 0;
+    std::array<D3DBOX, MaxBoxes>  m_boxes;
+
+    static bool Touch(const D3DBOX& a, const D3DBOX& b) {
+      return a.Left  <= b.Right  && b.Left  <= a.Right
+          && a.Top   <= b.Bottom && b.Top   <= a.Bottom
+          && a.Front <= b.Back   && b.Front <= a.Back;
+    }
+
+    static D3DBOX Union(const D3DBOX& a, const D3DBOX& b) {
+      return D3DBOX {
+        std::min(a.Left,   b.Left),   std::min(a.Top,    b.Top),
+        std::max(a.Right,  b.Right),  std::max(a.Bottom, b.Bottom),
+        std::min(a.Front,  b.Front),  std::max(a.Back,   b.Back) };
+    }
+
+    static uint64_t Volume(const D3DBOX& a) {
+      return uint64_t(a.Right - a.Left) * uint64_t(a.Bottom - a.Top) * uint64_t(a.Back - a.Front);
+    }
+
+  };
+
   template <typename T>
   using D3D9SubresourceArray = std::array<T, caps::MaxSubresources>;
 
@@ -229,9 +302,63 @@ namespace dxvk {
      * \brief Destroys a buffer
      * Destroys mapping and staging buffers for a given subresource
      */
-    void DestroyBufferSubresource(UINT Subresource) {
-      m_buffers[Subresource] = nullptr;
-      SetWrittenByGPU(Subresource, true);
+    void DestroyBufferSubresource(UINT Subresource);
+
+    /**
+     * \brief Evicts mapping buffers
+     *
+     * Destroys the mapping buffers of all subresources.
+     * Their contents will be read back from the image
+     * the next time they are locked. Must only be used
+     * if no subresource is locked or pending an upload.
+     */
+    void EvictBuffers();
+
+    /**
+     * \brief Checks whether mapping buffers can be evicted
+     *
+     * Buffers can only be evicted if their contents can
+     * be restored from the image without loss.
+     * \returns Whether \c EvictBuffers may be used
+     */
+    bool CanEvictBuffers() const {
+      return m_image != nullptr
+          && m_mapping.ConversionFormatInfo.FormatType == D3D9ConversionFormat_None;
+    }
+
+    /**
+     * \brief Size of all mapping buffers
+     * \returns Mapping buffer memory in bytes
+     */
+    int64_t GetMappedBufferSize() const {
+      return m_mappedBufferSize;
+    }
+
+    /**
+     * \brief Position in the mapped texture list
+     * \returns List entry, empty if not in the list
+     */
+    std::optional<D3D9MappedTextureList::iterator>& MappedListEntry() {
+      return m_mappedListEntry;
+    }
+
+    /**
+     * \brief Whether mapping buffers are kept after unlocking
+     *
+     * Managed textures keep a system memory copy, and dynamic
+     * textures keep their buffers around for the next lock.
+     * Those buffers may be evicted when exceeding a budget.
+     * \param [in] EvictManagedOnUnlock Whether managed texture
+     *    buffers get destroyed on unlock anyway
+     * \returns Whether the texture keeps its buffers
+     */
+    bool KeepsMappingBuffers(bool EvictManagedOnUnlock) const {
+      if (m_mapMode != D3D9_COMMON_TEXTURE_MAP_MODE_BACKED)
+        return false;
+
+      return IsManaged()
+        ? !EvictManagedOnUnlock
+        : IsDynamic();
     }
 
     bool IsDynamic() const {
@@ -395,29 +522,25 @@ namespace dxvk {
         box.Bottom = std::min(box.Bottom, m_desc.Height);
         box.Back = std::min(box.Back, m_desc.Depth);
 
-        D3DBOX& dirtyBox = m_dirtyBoxes[layer];
-        if (dirtyBox.Left == dirtyBox.Right) {
-          dirtyBox = box;
-        } else {
-          dirtyBox.Left    = std::min(dirtyBox.Left,   box.Left);
-          dirtyBox.Right   = std::max(dirtyBox.Right,  box.Right);
-          dirtyBox.Top     = std::min(dirtyBox.Top,    box.Top);
-          dirtyBox.Bottom  = std::max(dirtyBox.Bottom, box.Bottom);
-          dirtyBox.Front   = std::min(dirtyBox.Front,  box.Front);
-          dirtyBox.Back    = std::max(dirtyBox.Back,   box.Back);
-        }
+        if (box.Right <= box.Left
+          || box.Bottom <= box.Top
+          || box.Back <= box.Front)
+          return;
+
+        m_dirtyBoxes[layer].Add(box);
       } else {
-        m_dirtyBoxes[layer] = { 0, 0, m_desc.Width, m_desc.Height, 0, m_desc.Depth };
+        m_dirtyBoxes[layer].Clear();
+        m_dirtyBoxes[layer].Add({ 0, 0, m_desc.Width, m_desc.Height, 0, m_desc.Depth });
       }
     }
 
     void ClearDirtyBoxes() {
       for (uint32_t i = 0; i < m_dirtyBoxes.size(); i++) {
-        m_dirtyBoxes[i] = { 0, 0, 0, 0, 0, 0 };
+        m_dirtyBoxes[i].Clear();
       }
     }
 
-    const D3DBOX& GetDirtyBox(uint32_t layer) const {
+    const D3D9DirtyBoxList& GetDirtyBoxes(uint32_t layer) const {
       return m_dirtyBoxes[layer];
     }
 
@@ -466,7 +589,14 @@ namespace dxvk {
 
     D3DTEXTUREFILTERTYPE          m_mipFilter = D3DTEXF_LINEAR;
 
-    std::array<D3DBOX, 6>         m_dirtyBoxes;
+    std::array<D3D9DirtyBoxList, 6> m_dirtyBoxes;
+
+    std::optional<
+      D3D9MappedTextureList::iterator> m_mappedListEntry;
+
+    int64_t                       m_mappedBufferSize = 0;
+
+    void ChangeMappedBufferSize(int64_t Delta);
 
     /**
      * \brief Mip level
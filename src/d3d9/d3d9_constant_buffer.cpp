@@ -0,0 +1,100 @@
+#include "d3d9_constant_buffer.h"
+#include "d3d9_device.h"
+
+namespace dxvk {
+
+  D3D9ConstantBuffer::D3D9ConstantBuffer() {
+
+  }
+
+
+  D3D9ConstantBuffer::D3D9ConstantBuffer(
+          D3D9DeviceEx*         pDevice,
+          bool                  SSBO,
+          VkDeviceSize          Size,
+          DxsoProgramType       ShaderStage,
+          DxsoConstantBuffers   BufferType)
+  : m_device  (pDevice),
+    m_binding (computeResourceSlotId(ShaderStage, DxsoBindingType::ConstantBuffer, BufferType)),
+    m_usage   (SSBO ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT),
+    m_stages  (ShaderStage == DxsoProgramType::VertexShader
+      ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+      : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT),
+    m_access  (SSBO ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_UNIFORM_READ_BIT),
+    m_size    (Size),
+    m_align   (GetAlignment()) {
+
+  }
+
+
+  D3D9ConstantBuffer::~D3D9ConstantBuffer() {
+
+  }
+
+
+  void* D3D9ConstantBuffer::Alloc(VkDeviceSize Size) {
+    if (unlikely(m_buffer == nullptr))
+      this->CreateBuffer();
+
+    // Every allocation is bound with the full constant buffer
+    // size as its range, so that only the dynamic offset needs
+    // to change. Rename the buffer if that range does not fit.
+    if (unlikely(m_offset + m_size > m_buffer->info().size)) {
+      m_slice  = m_buffer->allocSlice();
+      m_offset = 0;
+
+      m_device->EmitCs([
+        cBuffer = m_buffer,
+        cSlice  = m_slice
+      ] (DxvkContext* ctx) {
+        ctx->invalidateBuffer(cBuffer, cSlice);
+      });
+    }
+
+    m_device->EmitCs([
+      cBuffer = m_buffer,
+      cSlot   = m_binding,
+      cOffset = m_offset,
+      cLength = m_size
+    ] (DxvkContext* ctx) {
+      ctx->bindResourceBuffer(cSlot,
+        DxvkBufferSlice(cBuffer, cOffset, cLength));
+    });
+
+    void* mapPtr = reinterpret_cast<char*>(m_slice.mapPtr) + m_offset;
+    m_offset = align(m_offset + Size, m_align);
+    return mapPtr;
+  }
+
+
+  void D3D9ConstantBuffer::CreateBuffer() {
+    // Make room for a reasonable number of allocations
+    // even if the shader uses the entire constant range
+    constexpr VkDeviceSize MinBufferSize = 1 << 18;
+
+    DxvkBufferCreateInfo info;
+    info.size   = std::max(MinBufferSize, align(m_size, m_align) * 4);
+    info.usage  = m_usage;
+    info.access = m_access;
+    info.stages = m_stages;
+
+    VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    if (m_device->GetOptions()->deviceLocalConstantBuffers)
+      memoryFlags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    m_buffer = m_device->GetDXVKDevice()->createBuffer(info, memoryFlags);
+    m_slice  = m_buffer->getSliceHandle();
+  }
+
+
+  VkDeviceSize D3D9ConstantBuffer::GetAlignment() const {
+    const auto& limits = m_device->GetDXVKDevice()->properties().core.properties.limits;
+
+    return (m_usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+      ? limits.minStorageBufferOffsetAlignment
+      : limits.minUniformBufferOffsetAlignment;
+  }
+
+}
\ No newline at end of file
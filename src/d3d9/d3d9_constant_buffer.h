@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../dxvk/dxvk_buffer.h"
+
+#include "../dxso/dxso_util.h"
+
+#include "../util/util_math.h"
+
+#include "d3d9_include.h"
+
+namespace dxvk {
+
+  class D3D9DeviceEx;
+
+  /**
+   * \brief Shader constant buffer
+   *
+   * Suballocates constant data from a larger buffer and
+   * binds each allocation with a dynamic offset, so that
+   * updating constants does not require renaming the
+   * buffer for every draw. The buffer is only renamed
+   * once all of its memory has been used.
+   */
+  class D3D9ConstantBuffer {
+
+  public:
+
+    D3D9ConstantBuffer();
+
+    D3D9ConstantBuffer(
+            D3D9DeviceEx*         pDevice,
+            bool                  SSBO,
+            VkDeviceSize          Size,
+            DxsoProgramType       ShaderStage,
+            DxsoConstantBuffers   BufferType);
+
+    ~D3D9ConstantBuffer();
+
+    /**
+     * \brief Allocates constant data
+     *
+     * The returned memory is bound to the shader stage
+     * right away, using the size passed to the constructor
+     * as the binding range. Only the first \c Size bytes
+     * of that range are guaranteed to be owned by the
+     * allocation, the rest must not be read by shaders.
+     * \param [in] Size Number of bytes to allocate
+     * \returns Pointer to mapped memory
+     */
+    void* Alloc(VkDeviceSize Size);
+
+  private:
+
+    D3D9DeviceEx*         m_device  = nullptr;
+
+    uint32_t              m_binding = 0;
+    VkBufferUsageFlags    m_usage   = 0;
+    VkPipelineStageFlags  m_stages  = 0;
+    VkAccessFlags         m_access  = 0;
+
+    VkDeviceSize          m_size    = 0;
+    VkDeviceSize          m_align   = 0;
+    VkDeviceSize          m_offset  = 0;
+
+    Rc<DxvkBuffer>        m_buffer  = nullptr;
+    DxvkBufferSliceHandle m_slice   = { };
+
+    void CreateBuffer();
+
+    VkDeviceSize GetAlignment() const;
+
+  };
+
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "d3d9_caps.h"
+#include "d3d9_constant_buffer.h"
 
 #include "../dxvk/dxvk_buffer.h"
 
@@ -9,6 +10,7 @@
 #include "../util/util_math.h"
 #include "../util/util_vector.h"
 
+#include <algorithm>
 #include <cstdint>
 
 namespace dxvk {
@@ -38,10 +40,50 @@ namespace dxvk {
     uint32_t bConsts[1];
   };
 
+  /**
+   * \brief Dirty constant register range
+   *
+   * Tracks the smallest range containing all registers
+   * of a given type that were written since the last
+   * upload, so that writes to registers that the bound
+   * shader does not read do not trigger an upload.
+   */
+  struct D3D9ConstantRange {
+    uint32_t first = 0;
+    uint32_t last  = 0;
+
+    bool empty() const {
+      return first >= last;
+    }
+
+    void add(uint32_t start, uint32_t count) {
+      if (empty()) {
+        first = start;
+        last  = start + count;
+      } else {
+        first = std::min(first, start);
+        last  = std::max(last,  start + count);
+      }
+    }
+
+    bool overlaps(uint32_t count) const {
+      return !empty() && first < count;
+    }
+
+    void clear() {
+      first = 0;
+      last  = 0;
+    }
+  };
+
   struct D3D9ConstantSets {
-    Rc<DxvkBuffer>            buffer;
+    D3D9ConstantBuffer        buffer;
     DxsoShaderMetaInfo        meta  = {};
     bool                      dirty = true;
+
+    D3D9ConstantRange         dirtyF;
+    D3D9ConstantRange         dirtyI;
+    D3D9ConstantRange         dirtyB;
   };
 
 }
\ No newline at end of file
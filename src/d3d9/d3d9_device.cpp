@@ -80,6 +80,15 @@ namespace dxvk {
     CreateConstantBuffers();
 
     m_availableMemory = DetermineInitialTextureMemory();
+
+    // Recreate cached fixed-function shaders on the CS thread
+    // so that their pipelines get compiled before first use
+    EmitCs([
+      this,
+     &cShaders = m_ffModules
+    ] (DxvkContext* ctx) {
+      cShaders.InitShaderCache(this);
+    });
   }
 
 
@@ -760,64 +769,62 @@ namespace dxvk {
       mipLevels = 1;
 
     for (uint32_t a = 0; a < arraySlices; a++) {
-      const D3DBOX& box = srcTexInfo->GetDirtyBox(a);
-      if (box.Left >= box.Right || box.Top >= box.Bottom || box.Front >= box.Back)
-        continue;
-
-      for (uint32_t m = 0; m < mipLevels; m++) {
-        VkImageSubresourceLayers dstLayers = { VK_IMAGE_ASPECT_COLOR_BIT, m, a, 1 };
-
-        VkOffset3D scaledBoxOffset = {
-          int32_t(alignDown(box.Left  >> m, formatInfo->blockSize.width)),
-          int32_t(alignDown(box.Top   >> m, formatInfo->blockSize.height)),
-          int32_t(alignDown(box.Front >> m, formatInfo->blockSize.depth))
-        };
-        VkExtent3D scaledBoxExtent = util::computeMipLevelExtent({
-          uint32_t(box.Right  - int32_t(alignDown(box.Left, formatInfo->blockSize.width))),
-          uint32_t(box.Bottom - int32_t(alignDown(box.Top, formatInfo->blockSize.height))),
-          uint32_t(box.Back   - int32_t(alignDown(box.Front, formatInfo->blockSize.depth)))
-        }, m);
-        VkExtent3D scaledBoxExtentBlockCount = util::computeBlockCount(scaledBoxExtent, formatInfo->blockSize);
-        VkExtent3D scaledAlignedBoxExtent = util::computeBlockExtent(scaledBoxExtentBlockCount, formatInfo->blockSize);
-
-        VkExtent3D texLevelExtent = dstImage->mipLevelExtent(m);
-        VkExtent3D texLevelExtentBlockCount = util::computeBlockCount(texLevelExtent, formatInfo->blockSize);
-
-        scaledAlignedBoxExtent.width = std::min<uint32_t>(texLevelExtent.width - scaledBoxOffset.x, scaledAlignedBoxExtent.width);
-        scaledAlignedBoxExtent.height = std::min<uint32_t>(texLevelExtent.height - scaledBoxOffset.y, scaledAlignedBoxExtent.height);
-        scaledAlignedBoxExtent.depth = std::min<uint32_t>(texLevelExtent.depth - scaledBoxOffset.z, scaledAlignedBoxExtent.depth);
-
-        VkDeviceSize dirtySize = scaledBoxExtentBlockCount.width * scaledBoxExtentBlockCount.height * scaledBoxExtentBlockCount.depth * formatInfo->elementSize;
-        D3D9BufferSlice slice = AllocTempBuffer<false>(dirtySize);
-        VkOffset3D boxOffsetBlockCount = util::computeBlockOffset(scaledBoxOffset, formatInfo->blockSize);
-        VkDeviceSize pitch = align(texLevelExtentBlockCount.width * formatInfo->elementSize, 4);
-        VkDeviceSize copySrcOffset = boxOffsetBlockCount.z * texLevelExtentBlockCount.height * pitch
-            + boxOffsetBlockCount.y * pitch
-            + boxOffsetBlockCount.x * formatInfo->elementSize;
-
-        void* srcData = reinterpret_cast<uint8_t*>(srcTexInfo->GetMappedSlice(srcTexInfo->CalcSubresource(a, m)).mapPtr) + copySrcOffset;
-        util::packImageData(
-          slice.mapPtr, srcData, scaledBoxExtentBlockCount, formatInfo->elementSize,
-          pitch, pitch * texLevelExtentBlockCount.height);
+      for (const D3DBOX& box : srcTexInfo->GetDirtyBoxes(a)) {
+        for (uint32_t m = 0; m < mipLevels; m++) {
+          VkImageSubresourceLayers dstLayers = { VK_IMAGE_ASPECT_COLOR_BIT, m, a, 1 };
+
+          VkOffset3D scaledBoxOffset = {
+            int32_t(alignDown(box.Left  >> m, formatInfo->blockSize.width)),
+            int32_t(alignDown(box.Top   >> m, formatInfo->blockSize.height)),
+            int32_t(alignDown(box.Front >> m, formatInfo->blockSize.depth))
+          };
+          VkExtent3D scaledBoxExtent = util::computeMipLevelExtent({
+            uint32_t(box.Right  - int32_t(alignDown(box.Left, formatInfo->blockSize.width))),
+            uint32_t(box.Bottom - int32_t(alignDown(box.Top, formatInfo->blockSize.height))),
+            uint32_t(box.Back   - int32_t(alignDown(box.Front, formatInfo->blockSize.depth)))
+          }, m);
+          VkExtent3D scaledBoxExtentBlockCount = util::computeBlockCount(scaledBoxExtent, formatInfo->blockSize);
+          VkExtent3D scaledAlignedBoxExtent = util::computeBlockExtent(scaledBoxExtentBlockCount, formatInfo->blockSize);
+
+          VkExtent3D texLevelExtent = dstImage->mipLevelExtent(m);
+          VkExtent3D texLevelExtentBlockCount = util::computeBlockCount(texLevelExtent, formatInfo->blockSize);
+
+          scaledAlignedBoxExtent.width = std::min<uint32_t>(texLevelExtent.width - scaledBoxOffset.x, scaledAlignedBoxExtent.width);
+          scaledAlignedBoxExtent.height = std::min<uint32_t>(texLevelExtent.height - scaledBoxOffset.y, scaledAlignedBoxExtent.height);
+          scaledAlignedBoxExtent.depth = std::min<uint32_t>(texLevelExtent.depth - scaledBoxOffset.z, scaledAlignedBoxExtent.depth);
+
+          VkDeviceSize dirtySize = scaledBoxExtentBlockCount.width * scaledBoxExtentBlockCount.height * scaledBoxExtentBlockCount.depth * formatInfo->elementSize;
+          D3D9BufferSlice slice = AllocTempBuffer<false>(dirtySize);
+          VkOffset3D boxOffsetBlockCount = util::computeBlockOffset(scaledBoxOffset, formatInfo->blockSize);
+          VkDeviceSize pitch = align(texLevelExtentBlockCount.width * formatInfo->elementSize, 4);
+          VkDeviceSize copySrcOffset = boxOffsetBlockCount.z * texLevelExtentBlockCount.height * pitch
+              + boxOffsetBlockCount.y * pitch
+              + boxOffsetBlockCount.x * formatInfo->elementSize;
+
+          void* srcData = reinterpret_cast<uint8_t*>(srcTexInfo->GetMappedSlice(srcTexInfo->CalcSubresource(a, m)).mapPtr) + copySrcOffset;
+          util::packImageData(
+            slice.mapPtr, srcData, scaledBoxExtentBlockCount, formatInfo->elementSize,
+            pitch, pitch * texLevelExtentBlockCount.height);
+
+          scaledAlignedBoxExtent.width  = std::min<uint32_t>(texLevelExtent.width, scaledAlignedBoxExtent.width);
+          scaledAlignedBoxExtent.height = std::min<uint32_t>(texLevelExtent.height, scaledAlignedBoxExtent.height);
+          scaledAlignedBoxExtent.depth  = std::min<uint32_t>(texLevelExtent.depth, scaledAlignedBoxExtent.depth);
 
-        scaledAlignedBoxExtent.width  = std::min<uint32_t>(texLevelExtent.width, scaledAlignedBoxExtent.width);
-        scaledAlignedBoxExtent.height = std::min<uint32_t>(texLevelExtent.height, scaledAlignedBoxExtent.height);
-        scaledAlignedBoxExtent.depth  = std::min<uint32_t>(texLevelExtent.depth, scaledAlignedBoxExtent.depth);
-
-        EmitCs([
-          cDstImage  = dstImage,
-          cSrcSlice  = slice.slice,
-          cDstLayers = dstLayers,
-          cExtent    = scaledAlignedBoxExtent,
-          cOffset    = scaledBoxOffset
-        ] (DxvkContext* ctx) {
-          ctx->copyBufferToImage(
-            cDstImage,  cDstLayers,
-            cOffset, cExtent,
-            cSrcSlice.buffer(), cSrcSlice.offset(), 0, 0);
-        });
+          EmitCs([
+            cDstImage  = dstImage,
+            cSrcSlice  = slice.slice,
+            cDstLayers = dstLayers,
+            cExtent    = scaledAlignedBoxExtent,
+            cOffset    = scaledBoxOffset
+          ] (DxvkContext* ctx) {
+            ctx->copyBufferToImage(
+              cDstImage,  cDstLayers,
+              cOffset, cExtent,
+              cSrcSlice.buffer(), cSrcSlice.offset(), 0, 0);
+          });
 
-        dstTexInfo->SetWrittenByGPU(dstTexInfo->CalcSubresource(a, m), true);
+          dstTexInfo->SetWrittenByGPU(dstTexInfo->CalcSubresource(a, m), true);
+        }
       }
     }
 
@@ -2450,6 +2457,14 @@ namespace dxvk {
 
     auto drawInfo = GenerateDrawInfo(PrimitiveType, PrimitiveCount, 0);
 
+    if (BatchUPDraw(PrimitiveType, PrimitiveCount, drawInfo.vertexCount,
+          pVertexStreamZeroData, VertexStreamZeroStride, nullptr, D3DFMT_UNKNOWN)) {
+      m_state.vertexBuffers[0].vertexBuffer = nullptr;
+      m_state.vertexBuffers[0].offset       = 0;
+      m_state.vertexBuffers[0].stride       = 0;
+      return D3D_OK;
+    }
+
     const uint32_t dataSize = GetUPDataSize(drawInfo.vertexCount, VertexStreamZeroStride);
     const uint32_t bufferSize = GetUPBufferSize(drawInfo.vertexCount, VertexStreamZeroStride);
 
@@ -2503,6 +2518,16 @@ namespace dxvk {
 
     auto drawInfo = GenerateDrawInfo(PrimitiveType, PrimitiveCount, 0);
 
+    if (BatchUPDraw(PrimitiveType, PrimitiveCount, MinVertexIndex + NumVertices,
+          pVertexStreamZeroData, VertexStreamZeroStride, pIndexData, IndexDataFormat)) {
+      m_state.vertexBuffers[0].vertexBuffer = nullptr;
+      m_state.vertexBuffers[0].offset       = 0;
+      m_state.vertexBuffers[0].stride       = 0;
+
+      m_state.indices = nullptr;
+      return D3D_OK;
+    }
+
     const uint32_t vertexDataSize = GetUPDataSize(MinVertexIndex + NumVertices, VertexStreamZeroStride);
     const uint32_t vertexBufferSize = GetUPBufferSize(MinVertexIndex + NumVertices, VertexStreamZeroStride);
 
@@ -2562,20 +2587,9 @@ namespace dxvk {
     if (unlikely(pDestBuffer == nullptr || pVertexDecl == nullptr))
       return D3DERR_INVALIDCALL;
 
-    if (!SupportsSWVP()) {
-      static bool s_errorShown = false;
-
-      if (!std::exchange(s_errorShown, true))
-        Logger::err("D3D9DeviceEx::ProcessVertices: SWVP emu unsupported (vertexPipelineStoresAndAtomics)");
-
-      return D3D_OK;
-    }
-
     D3D9CommonBuffer* dst  = static_cast<D3D9VertexBuffer*>(pDestBuffer)->GetCommonBuffer();
     D3D9VertexDecl*   decl = static_cast<D3D9VertexDecl*>  (pVertexDecl);
 
-    PrepareDraw(D3DPT_FORCE_DWORD);
-
     if (decl == nullptr) {
       DWORD FVF = dst->Desc()->FVF;
 
@@ -2589,6 +2603,22 @@ namespace dxvk {
         decl = iter->second.ptr();
     }
 
+    // Plain fixed-function transforms can be done on the CPU, which
+    // saves a round-trip since apps usually read the results back.
+    if (ProcessVerticesCPU(SrcStartIndex, DestIndex, VertexCount, dst, decl, Flags))
+      return D3D_OK;
+
+    if (!SupportsSWVP()) {
+      static bool s_errorShown = false;
+
+      if (!std::exchange(s_errorShown, true))
+        Logger::err("D3D9DeviceEx::ProcessVertices: SWVP emu unsupported (vertexPipelineStoresAndAtomics)");
+
+      return D3D_OK;
+    }
+
+    PrepareDraw(D3DPT_FORCE_DWORD);
+
     uint32_t offset = DestIndex * decl->GetSize();
 
     auto slice = dst->GetBufferSlice<D3D9_COMMON_BUFFER_TYPE_REAL>();
@@ -2656,6 +2686,176 @@ namespace dxvk {
   }
 
 
+  bool D3D9DeviceEx::ProcessVerticesCPU(
+          UINT                    SrcStartIndex,
+          UINT                    DestIndex,
+          UINT                    VertexCount,
+          D3D9CommonBuffer*       pDestBuffer,
+    const D3D9VertexDecl*         pDestDecl,
+          DWORD                   Flags) {
+    if (m_state.vertexShader != nullptr || m_state.vertexDecl == nullptr)
+      return false;
+
+    const auto& rs = m_state.renderStates;
+
+    // Only plain transforms are handled here, anything
+    // more involved is left to the GPU-based path.
+    if (rs[D3DRS_VERTEXBLEND] != D3DVBF_DISABLE || rs[D3DRS_INDEXEDVERTEXBLENDENABLE])
+      return false;
+
+    if (GetInstanceCount() != 1)
+      return false;
+
+    const bool copyData  = !(Flags & D3DPV_DONOTCOPYDATA);
+    const bool lighting  = rs[D3DRS_LIGHTING];
+    const bool vertexFog = rs[D3DRS_FOGENABLE] && rs[D3DRS_FOGVERTEXMODE] != D3DFOG_NONE;
+
+    struct Stream {
+      const uint8_t* data;
+      uint32_t       stride;
+    };
+
+    struct Copy {
+      Stream   src;
+      uint32_t dstOffset;
+      uint32_t size;
+    };
+
+    auto GetSource = [&] (BYTE Usage, BYTE UsageIndex, Stream* pStream) -> const D3DVERTEXELEMENT9* {
+      for (const auto& element : m_state.vertexDecl->GetElements()) {
+        if (element.Usage != Usage || element.UsageIndex != UsageIndex)
+          continue;
+
+        const D3D9VBO&    vbo    = m_state.vertexBuffers[element.Stream];
+        D3D9CommonBuffer* buffer = GetCommonBuffer(vbo.vertexBuffer);
+
+        // The CPU copy is stale if the GPU wrote to the buffer
+        if (buffer == nullptr || buffer->WasWrittenByGPU())
+          return nullptr;
+
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(buffer->GetMappedSlice().mapPtr);
+
+        uint64_t end = uint64_t(vbo.offset) + element.Offset
+                     + uint64_t(vbo.stride) * (SrcStartIndex + VertexCount - 1)
+                     + GetDecltypeSize(D3DDECLTYPE(element.Type));
+
+        if (data == nullptr || end > buffer->Desc()->Size)
+          return nullptr;
+
+        pStream->data   = data + vbo.offset + element.Offset + size_t(vbo.stride) * SrcStartIndex;
+        pStream->stride = vbo.stride;
+        return &element;
+      }
+
+      return nullptr;
+    };
+
+    Stream   position    = { };
+    bool     hasPositionW = false;
+    uint32_t positionOffset = ~0u;
+
+    small_vector<Copy, 16> copies;
+
+    for (const auto& element : pDestDecl->GetElements()) {
+      if (element.Usage == D3DDECLUSAGE_POSITIONT && element.UsageIndex == 0) {
+        auto src = GetSource(D3DDECLUSAGE_POSITION, 0, &position);
+
+        if (element.Type != D3DDECLTYPE_FLOAT4 || src == nullptr
+         || (src->Type != D3DDECLTYPE_FLOAT3 && src->Type != D3DDECLTYPE_FLOAT4))
+          return false;
+
+        hasPositionW   = src->Type == D3DDECLTYPE_FLOAT4;
+        positionOffset = element.Offset;
+        continue;
+      }
+
+      if (!copyData)
+        continue;
+
+      // Copied elements must come out of the pipeline unchanged
+      if (element.Usage == D3DDECLUSAGE_COLOR) {
+        if (lighting || (vertexFog && element.UsageIndex == 1))
+          return false;
+      } else if (element.Usage == D3DDECLUSAGE_TEXCOORD) {
+        if (element.UsageIndex >= caps::TextureStageCount)
+          return false;
+
+        const auto& stage = m_state.textureStages[element.UsageIndex];
+
+        if (stage[DXVK_TSS_TEXCOORDINDEX] != element.UsageIndex
+         || stage[DXVK_TSS_TEXTURETRANSFORMFLAGS] != D3DTTFF_DISABLE)
+          return false;
+      } else if (element.Usage == D3DDECLUSAGE_PSIZE) {
+        // Point scaling modifies the point size
+        if (rs[D3DRS_POINTSCALEENABLE])
+          return false;
+      } else {
+        return false;
+      }
+
+      Copy copy;
+      auto src = GetSource(element.Usage, element.UsageIndex, &copy.src);
+
+      if (src == nullptr || src->Type != element.Type)
+        return false;
+
+      copy.dstOffset = element.Offset;
+      copy.size      = GetDecltypeSize(D3DDECLTYPE(element.Type));
+      copies.push_back(copy);
+    }
+
+    if (positionOffset == ~0u)
+      return false;
+
+    const uint32_t dstStride = pDestDecl->GetSize();
+    const uint32_t dstOffset = DestIndex * dstStride;
+
+    if (uint64_t(dstOffset) + uint64_t(VertexCount) * dstStride > pDestBuffer->Desc()->Size)
+      return false;
+
+    void* mapPtr = nullptr;
+
+    if (FAILED(LockBuffer(pDestBuffer, dstOffset, VertexCount * dstStride, &mapPtr, 0)))
+      return false;
+
+    const Matrix4 wvp = m_state.transforms[GetTransformIndex(D3DTS_PROJECTION)]
+                      * m_state.transforms[GetTransformIndex(D3DTS_VIEW)]
+                      * m_state.transforms[GetTransformIndex(D3DTS_WORLD)];
+
+    const D3DVIEWPORT9& vp = m_state.viewport;
+
+    const Vector4 vpScale  = Vector4( 0.5f * float(vp.Width), -0.5f * float(vp.Height), vp.MaxZ - vp.MinZ, 1.0f);
+    const Vector4 vpOffset = Vector4(float(vp.X) + 0.5f * float(vp.Width), float(vp.Y) + 0.5f * float(vp.Height), vp.MinZ, 0.0f);
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(mapPtr);
+
+    for (uint32_t i = 0; i < VertexCount; i++) {
+      Vector4 pos;
+      std::memcpy(pos.data, position.data + size_t(i) * position.stride, hasPositionW ? 16 : 12);
+
+      if (!hasPositionW)
+        pos.w = 1.0f;
+
+      // Transform to screen space, and store 1/w as RHW
+      Vector4 clip = wvp * pos;
+      float rhw = clip.w != 0.0f ? 1.0f / clip.w : 1.0f;
+
+      Vector4 screen = clip * rhw * vpScale + vpOffset;
+      screen.w = rhw;
+
+      std::memcpy(dst + positionOffset, screen.data, sizeof(screen.data));
+
+      for (const auto& copy : copies)
+        std::memcpy(dst + copy.dstOffset, copy.src.data + size_t(i) * copy.src.stride, copy.size);
+
+      dst += dstStride;
+    }
+
+    UnlockBuffer(pDestBuffer);
+    return true;
+  }
+
+
   HRESULT STDMETHODCALLTYPE D3D9DeviceEx::CreateVertexDeclaration(
     const D3DVERTEXELEMENT9*            pVertexElements,
           IDirect3DVertexDeclaration9** ppDecl) {
@@ -4146,6 +4346,15 @@ namespace dxvk {
     bool wasWrittenByGPU = pResource->WasWrittenByGPU(Subresource) || renderable;
     pResource->SetWrittenByGPU(Subresource, false);
 
+    // If the system memory copy of a managed resource got evicted
+    // to stay within budget, restore it from the image like we do
+    // for default pool resources.
+    const bool managedEvicted = managed && alloced && wasWrittenByGPU;
+
+    if (pResource->KeepsMappingBuffers(m_d3d9Options.evictManagedOnUnlock)
+     && pResource->CanEvictBuffers())
+      TouchMappedTexture(pResource);
+
     DxvkBufferSliceHandle physSlice;
 
     if (Flags & D3DLOCK_DISCARD) {
@@ -4160,7 +4369,7 @@ namespace dxvk {
         ctx->invalidateBuffer(cImageBuffer, cBufferSlice);
       });
     }
-    else if ((managed && !m_d3d9Options.evictManagedOnUnlock) || scratch || systemmem) {
+    else if (((managed && !m_d3d9Options.evictManagedOnUnlock) || scratch || systemmem) && !managedEvicted) {
       // Managed and scratch resources
       // are meant to be able to provide readback without waiting.
       // We always keep a copy of them in system memory for this reason.
@@ -4350,9 +4559,8 @@ namespace dxvk {
 
     // Flush image contents from staging if we aren't read only
     // and we aren't deferring for managed.
-    const D3DBOX& box = pResource->GetDirtyBox(Face);
     bool shouldFlush  = pResource->GetMapMode() == D3D9_COMMON_TEXTURE_MAP_MODE_BACKED;
-         shouldFlush &= box.Left < box.Right && box.Top < box.Bottom && box.Front < box.Back;
+         shouldFlush &= !pResource->GetDirtyBoxes(Face).Empty();
          shouldFlush &= !pResource->IsManaged() || m_d3d9Options.evictManagedOnUnlock;
 
     if (shouldFlush) {
@@ -4372,6 +4580,8 @@ namespace dxvk {
       pResource->SetWrittenByGPU(Subresource, true);
     }
 
+    TrimMappedMemory(pResource);
+
     return D3D_OK;
   }
 
@@ -4399,61 +4609,86 @@ namespace dxvk {
     if (likely(convertFormat.FormatType == D3D9ConversionFormat_None)) {
       VkImageSubresourceLayers dstLayers = { VK_IMAGE_ASPECT_COLOR_BIT, subresource.mipLevel, subresource.arrayLayer, 1 };
 
-      const D3DBOX& box = pResource->GetDirtyBox(subresource.arrayLayer);
-      VkOffset3D scaledBoxOffset = {
-        int32_t(alignDown(box.Left  >> subresource.mipLevel, formatInfo->blockSize.width)),
-        int32_t(alignDown(box.Top   >> subresource.mipLevel, formatInfo->blockSize.height)),
-        int32_t(alignDown(box.Front >> subresource.mipLevel, formatInfo->blockSize.depth))
-      };
-      VkExtent3D scaledBoxExtent = util::computeMipLevelExtent({
-        uint32_t(box.Right  - int32_t(alignDown(box.Left, formatInfo->blockSize.width))),
-        uint32_t(box.Bottom - int32_t(alignDown(box.Top, formatInfo->blockSize.height))),
-        uint32_t(box.Back   - int32_t(alignDown(box.Front, formatInfo->blockSize.depth)))
-      }, subresource.mipLevel);
-      VkExtent3D scaledBoxExtentBlockCount = util::computeBlockCount(scaledBoxExtent, formatInfo->blockSize);
-      VkExtent3D scaledAlignedBoxExtent = util::computeBlockExtent(scaledBoxExtentBlockCount, formatInfo->blockSize);
+      // Upload each dirty region separately, so that small updates to
+      // distant parts of the texture do not upload everything in between.
+      for (const D3DBOX& box : pResource->GetDirtyBoxes(subresource.arrayLayer)) {
+        VkOffset3D scaledBoxOffset = {
+          int32_t(alignDown(box.Left  >> subresource.mipLevel, formatInfo->blockSize.width)),
+          int32_t(alignDown(box.Top   >> subresource.mipLevel, formatInfo->blockSize.height)),
+          int32_t(alignDown(box.Front >> subresource.mipLevel, formatInfo->blockSize.depth))
+        };
+        VkExtent3D scaledBoxExtent = util::computeMipLevelExtent({
+          uint32_t(box.Right  - int32_t(alignDown(box.Left, formatInfo->blockSize.width))),
+          uint32_t(box.Bottom - int32_t(alignDown(box.Top, formatInfo->blockSize.height))),
+          uint32_t(box.Back   - int32_t(alignDown(box.Front, formatInfo->blockSize.depth)))
+        }, subresource.mipLevel);
+        VkExtent3D scaledBoxExtentBlockCount = util::computeBlockCount(scaledBoxExtent, formatInfo->blockSize);
+        VkExtent3D scaledAlignedBoxExtent = util::computeBlockExtent(scaledBoxExtentBlockCount, formatInfo->blockSize);
 
-      VkExtent3D texLevelExtent = image->mipLevelExtent(subresource.mipLevel);
-      VkExtent3D texLevelExtentBlockCount = util::computeBlockCount(texLevelExtent, formatInfo->blockSize);
+        VkExtent3D texLevelExtent = image->mipLevelExtent(subresource.mipLevel);
+        VkExtent3D texLevelExtentBlockCount = util::computeBlockCount(texLevelExtent, formatInfo->blockSize);
 
-      scaledAlignedBoxExtent.width = std::min<uint32_t>(texLevelExtent.width - scaledBoxOffset.x, scaledAlignedBoxExtent.width);
-      scaledAlignedBoxExtent.height = std::min<uint32_t>(texLevelExtent.height - scaledBoxOffset.y, scaledAlignedBoxExtent.height);
-      scaledAlignedBoxExtent.depth = std::min<uint32_t>(texLevelExtent.depth - scaledBoxOffset.z, scaledAlignedBoxExtent.depth);
+        scaledAlignedBoxExtent.width = std::min<uint32_t>(texLevelExtent.width - scaledBoxOffset.x, scaledAlignedBoxExtent.width);
+        scaledAlignedBoxExtent.height = std::min<uint32_t>(texLevelExtent.height - scaledBoxOffset.y, scaledAlignedBoxExtent.height);
+        scaledAlignedBoxExtent.depth = std::min<uint32_t>(texLevelExtent.depth - scaledBoxOffset.z, scaledAlignedBoxExtent.depth);
 
-      VkOffset3D boxOffsetBlockCount = util::computeBlockOffset(scaledBoxOffset, formatInfo->blockSize);
-      VkDeviceSize pitch = align(texLevelExtentBlockCount.width * formatInfo->elementSize, 4);
-      VkDeviceSize copySrcOffset = boxOffsetBlockCount.z * texLevelExtentBlockCount.height * pitch
-          + boxOffsetBlockCount.y * pitch
-          + boxOffsetBlockCount.x * formatInfo->elementSize;
-
-      VkDeviceSize rowAlignment = 0;
-      DxvkBufferSlice copySrcSlice;
-      if (pResource->DoesStagingBufferUploads(Subresource)) {
-        VkDeviceSize dirtySize = scaledBoxExtentBlockCount.width * scaledBoxExtentBlockCount.height * scaledBoxExtentBlockCount.depth * formatInfo->elementSize;
-        D3D9BufferSlice slice = AllocTempBuffer<false>(dirtySize);
-        copySrcSlice = slice.slice;
-        void* srcData = reinterpret_cast<uint8_t*>(srcSlice.mapPtr) + copySrcOffset;
-        util::packImageData(
-          slice.mapPtr, srcData, scaledBoxExtentBlockCount, formatInfo->elementSize,
-          pitch, pitch * texLevelExtentBlockCount.height);
-      } else {
-        copySrcSlice = DxvkBufferSlice(pResource->GetBuffer(Subresource), copySrcOffset, srcSlice.length);
-        rowAlignment = pitch; // row alignment can act as the pitch parameter
+        VkOffset3D boxOffsetBlockCount = util::computeBlockOffset(scaledBoxOffset, formatInfo->blockSize);
+        VkDeviceSize pitch = align(texLevelExtentBlockCount.width * formatInfo->elementSize, 4);
+        VkDeviceSize copySrcOffset = boxOffsetBlockCount.z * texLevelExtentBlockCount.height * pitch
+            + boxOffsetBlockCount.y * pitch
+            + boxOffsetBlockCount.x * formatInfo->elementSize;
+
+        VkDeviceSize rowAlignment = 0;
+        DxvkBufferSlice copySrcSlice;
+        if (pResource->DoesStagingBufferUploads(Subresource)) {
+          VkDeviceSize dirtySize = scaledBoxExtentBlockCount.width * scaledBoxExtentBlockCount.height * scaledBoxExtentBlockCount.depth * formatInfo->elementSize;
+          D3D9BufferSlice slice = AllocTempBuffer<false>(dirtySize);
+          copySrcSlice = slice.slice;
+          void* srcData = reinterpret_cast<uint8_t*>(srcSlice.mapPtr) + copySrcOffset;
+          util::packImageData(
+            slice.mapPtr, srcData, scaledBoxExtentBlockCount, formatInfo->elementSize,
+            pitch, pitch * texLevelExtentBlockCount.height);
+        } else {
+          copySrcSlice = DxvkBufferSlice(pResource->GetBuffer(Subresource), copySrcOffset, srcSlice.length);
+          rowAlignment = pitch; // row alignment can act as the pitch parameter
+        }
+
+        EmitCs([
+          cSrcSlice       = std::move(copySrcSlice),
+          cDstImage       = image,
+          cDstLayers      = dstLayers,
+          cDstLevelExtent = scaledAlignedBoxExtent,
+          cOffset         = scaledBoxOffset,
+          cRowAlignment   = rowAlignment
+        ] (DxvkContext* ctx) {
+          ctx->copyBufferToImage(
+            cDstImage,  cDstLayers,
+            cOffset, cDstLevelExtent,
+            cSrcSlice.buffer(), cSrcSlice.offset(),
+            cRowAlignment, 0);
+        });
       }
+    }
+    else if (D3D9FormatHelper::CanConvertFormatCPU(convertFormat, image->mipLevelExtent(subresource.mipLevel))) {
+      // Small images are converted straight into the staging buffer,
+      // which avoids a compute dispatch and a separate submission.
+      VkExtent3D texLevelExtent = image->mipLevelExtent(subresource.mipLevel);
+      VkDeviceSize convertedSize = util::flattenImageExtent(texLevelExtent) * formatInfo->elementSize;
+
+      D3D9BufferSlice slice = AllocTempBuffer<false>(convertedSize);
+      D3D9FormatHelper::ConvertFormatCPU(convertFormat, slice.mapPtr, srcSlice.mapPtr, texLevelExtent);
 
       EmitCs([
-        cSrcSlice       = std::move(copySrcSlice),
+        cSrcSlice       = std::move(slice.slice),
         cDstImage       = image,
-        cDstLayers      = dstLayers,
-        cDstLevelExtent = scaledAlignedBoxExtent,
-        cOffset         = scaledBoxOffset,
-        cRowAlignment   = rowAlignment
+        cDstLayers      = subresourceLayers,
+        cDstLevelExtent = texLevelExtent
       ] (DxvkContext* ctx) {
         ctx->copyBufferToImage(
           cDstImage,  cDstLayers,
-          cOffset, cDstLevelExtent,
+          VkOffset3D { 0, 0, 0 }, cDstLevelExtent,
           cSrcSlice.buffer(), cSrcSlice.offset(),
-          cRowAlignment, 0);
+          0, 0);
       });
     }
     else {
@@ -4472,10 +4707,7 @@ namespace dxvk {
         slice.mapPtr, srcSlice.mapPtr, texLevelExtentBlockCount, formatInfo->elementSize,
         pitch, std::min(convertFormat.PlaneCount, 2u) * pitch * texLevelExtentBlockCount.height);
 
-      Flush();
-      SynchronizeCsThread();
-
-      m_converter->ConvertFormat(
+      EmitConvertFormat(
         convertFormat,
         image, subresourceLayers,
         slice.slice);
@@ -4821,16 +5053,18 @@ namespace dxvk {
 
   void D3D9DeviceEx::CreateConstantBuffers() {
     m_consts[DxsoProgramTypes::VertexShader].buffer =
-      CreateConstantBuffer(m_dxsoOptions.vertexConstantBufferAsSSBO,
-                           m_vsLayout.totalSize(),
-                           DxsoProgramType::VertexShader,
-                           DxsoConstantBuffers::VSConstantBuffer);
+      D3D9ConstantBuffer(this,
+                         m_dxsoOptions.vertexConstantBufferAsSSBO,
+                         m_vsLayout.totalSize(),
+                         DxsoProgramType::VertexShader,
+                         DxsoConstantBuffers::VSConstantBuffer);
 
     m_consts[DxsoProgramTypes::PixelShader].buffer =
-      CreateConstantBuffer(false,
-                           m_psLayout.totalSize(),
-                           DxsoProgramType::PixelShader,
-                           DxsoConstantBuffers::PSConstantBuffer);
+      D3D9ConstantBuffer(this,
+                         false,
+                         m_psLayout.totalSize(),
+                         DxsoProgramType::PixelShader,
+                         DxsoConstantBuffers::PSConstantBuffer);
 
     m_vsClipPlanes =
       CreateConstantBuffer(false,
@@ -4898,29 +5132,45 @@ namespace dxvk {
   inline void D3D9DeviceEx::UploadConstantSet(const SoftwareLayoutType& Src, const D3D9ConstantLayout& Layout, const ShaderType& Shader) {
     D3D9ConstantSets& constSet = m_consts[ShaderStage];
 
-    if (!constSet.dirty)
+    // Bool constants are only stored in the buffer with SWVP,
+    // otherwise they are passed to the shader as spec constants.
+    const uint32_t maxConstIndexB = Layout.bitmaskSize()
+      ? constSet.meta.maxConstIndexB
+      : 0;
+
+    // Skip the upload if no register read by the shader changed
+    if (!constSet.dirty
+     && !constSet.dirtyF.overlaps(constSet.meta.maxConstIndexF)
+     && !constSet.dirtyI.overlaps(constSet.meta.maxConstIndexI)
+     && !constSet.dirtyB.overlaps(maxConstIndexB))
       return;
 
     constSet.dirty = false;
+    constSet.dirtyF.clear();
+    constSet.dirtyI.clear();
+    constSet.dirtyB.clear();
 
-    DxvkBufferSliceHandle slice = constSet.buffer->allocSlice();
+    // Only allocate the part of the layout the shader reads.
+    // The hardware layouts match the constant layout here.
+    VkDeviceSize size = constSet.meta.maxConstIndexF * sizeof(Vector4);
 
-    EmitCs([
-      cBuffer = constSet.buffer,
-      cSlice  = slice
-    ] (DxvkContext* ctx) {
-      ctx->invalidateBuffer(cBuffer, cSlice);
-    });
+    if (constSet.meta.maxConstIndexI)
+      size = Layout.intOffset() + constSet.meta.maxConstIndexI * sizeof(Vector4i);
+
+    if (maxConstIndexB)
+      size = Layout.bitmaskOffset() + Layout.bitmaskSize();
+
+    void* mapPtr = constSet.buffer.Alloc(size);
 
     if constexpr (ShaderStage == DxsoProgramType::PixelShader)
-      UploadHardwareConstantSet<ShaderStage, HardwareLayoutType>(slice.mapPtr, Src, Shader);
+      UploadHardwareConstantSet<ShaderStage, HardwareLayoutType>(mapPtr, Src, Shader);
     else if (likely(!CanSWVP()))
-      UploadHardwareConstantSet<ShaderStage, HardwareLayoutType>(slice.mapPtr, Src, Shader);
+      UploadHardwareConstantSet<ShaderStage, HardwareLayoutType>(mapPtr, Src, Shader);
     else
-      UploadSoftwareConstantSet(slice.mapPtr, Src, Layout, Shader);
+      UploadSoftwareConstantSet(mapPtr, Src, Layout, Shader);
 
     if (constSet.meta.needsConstantCopies) {
-      Vector4* data = reinterpret_cast<Vector4*>(slice.mapPtr);
+      Vector4* data = reinterpret_cast<Vector4*>(mapPtr);
 
       auto& shaderConsts = GetCommonShader(Shader)->GetConstants();
 
@@ -5039,7 +5289,9 @@ namespace dxvk {
     D3D9DeviceLock lock = LockDevice();
 
     m_initializer->Flush();
-    m_converter->Flush();
+
+    if (m_upBatch.primCount)
+      FlushUPBatch();
 
     if (m_csIsBusy || !m_csChunk->empty()) {
       // Add commands to flush the threaded
@@ -5251,6 +5503,111 @@ namespace dxvk {
   }
 
 
+  void D3D9DeviceEx::TouchMappedTexture(D3D9CommonTexture* pResource) {
+    auto& entry = pResource->MappedListEntry();
+
+    if (entry) {
+      m_mappedTextures.splice(m_mappedTextures.end(), m_mappedTextures, *entry);
+    } else {
+      entry = m_mappedTextures.insert(m_mappedTextures.end(), pResource);
+      ChangeEvictableMemory(pResource, pResource->GetMappedBufferSize());
+    }
+  }
+
+
+  void D3D9DeviceEx::RemoveMappedTexture(D3D9CommonTexture* pResource) {
+    auto& entry = pResource->MappedListEntry();
+
+    if (entry) {
+      ChangeEvictableMemory(pResource, -pResource->GetMappedBufferSize());
+      m_mappedTextures.erase(*entry);
+      entry = std::nullopt;
+    }
+  }
+
+
+  void D3D9DeviceEx::ChangeEvictableMemory(D3D9CommonTexture* pResource, int64_t Delta) {
+    m_evictableMemory += Delta;
+
+    if (pResource->IsManaged())
+      m_evictableManagedMemory += Delta;
+  }
+
+
+  void D3D9DeviceEx::TrimMappedMemory(D3D9CommonTexture* pSkip) {
+    const int64_t mappedBudget  = int64_t(m_d3d9Options.mappingBufferBudget) << 20;
+    const int64_t managedBudget = int64_t(m_d3d9Options.managedShadowBudget) << 20;
+
+    // Memory of the texture that was just unlocked is not
+    // evictable, since it is very likely to be locked again.
+    const int64_t skipSize = pSkip->MappedListEntry() ? pSkip->GetMappedBufferSize() : 0;
+    const int64_t skipManagedSize = pSkip->IsManaged() ? skipSize : 0;
+
+    // Buffers are never released, so only texture memory counts
+    // towards the budget. Release as much as possible while over
+    // budget, but stop once nothing evictable is left, so that
+    // unlocking does not walk the whole list for nothing.
+    auto OverMappedBudget = [&] () {
+      if (!mappedBudget)
+        return false;
+
+      int64_t used = GetMappedMemory(D3D9MappedMemoryType::ManagedTextures)
+                   + GetMappedMemory(D3D9MappedMemoryType::DefaultTextures)
+                   + GetMappedMemory(D3D9MappedMemoryType::SystemMemTextures);
+
+      return used > mappedBudget
+          && m_evictableMemory > skipSize;
+    };
+
+    auto OverManagedBudget = [&] () {
+      if (!managedBudget)
+        return false;
+
+      int64_t used = GetMappedMemory(D3D9MappedMemoryType::ManagedTextures);
+
+      return used > managedBudget
+          && m_evictableManagedMemory > skipManagedSize;
+    };
+
+    auto iter = m_mappedTextures.begin();
+
+    while (iter != m_mappedTextures.end()) {
+      const bool overMapped  = OverMappedBudget();
+      const bool overManaged = OverManagedBudget();
+
+      if (!overMapped && !overManaged)
+        break;
+
+      D3D9CommonTexture* texture = *iter;
+
+      // Only managed textures count towards the managed budget
+      bool evict = overMapped || texture->IsManaged();
+
+      if (!evict || texture == pSkip || texture->IsAnySubresourceLocked()) {
+        iter++;
+        continue;
+      }
+
+      // Pending writes only exist in the system memory
+      // copy, so they need to reach the image first.
+      if (texture->IsManaged() && texture->NeedsAnyUpload()) {
+        UploadManagedTexture(texture);
+        MarkTextureUploaded(texture);
+      }
+
+      ChangeEvictableMemory(texture, -texture->GetMappedBufferSize());
+      texture->MappedListEntry() = std::nullopt;
+      texture->EvictBuffers();
+
+      iter = m_mappedTextures.erase(iter);
+      m_mappedMemoryEvictions += 1;
+
+      if (texture->IsManaged())
+        m_managedEvictions += 1;
+    }
+  }
+
+
   template <bool Points>
   void D3D9DeviceEx::UpdatePointMode() {
     if constexpr (!Points) {
@@ -5493,6 +5850,9 @@ namespace dxvk {
       : 0xffffffff;
     msState.enableAlphaToCoverage = IsAlphaToCoverageEnabled();
 
+    if (!m_emittedStates.multisample.Update(msState))
+      return;
+
     EmitCs([
       cState = msState
     ] (DxvkContext* ctx) {
@@ -5541,6 +5901,9 @@ namespace dxvk {
     for (uint32_t i = 0; i < 3; i++)
       extraWriteMasks[i] = state[ColorWriteIndex(i + 1)];
 
+    if (!m_emittedStates.blend.Update({ mode, extraWriteMasks, m_alphaSwizzleRTs }))
+      return;
+
     EmitCs([
       cMode       = mode,
       cWriteMasks = extraWriteMasks,
@@ -5581,6 +5944,9 @@ namespace dxvk {
       D3DCOLOR(m_state.renderStates[D3DRS_BLENDFACTOR]),
       reinterpret_cast<float*>(&blendConstants));
 
+    if (!m_emittedStates.blendConstants.Update(blendConstants))
+      return;
+
     EmitCs([
       cBlendConstants = blendConstants
     ](DxvkContext* ctx) {
@@ -5627,6 +5993,9 @@ namespace dxvk {
     else
       state.stencilOpBack = state.stencilOpFront;
 
+    if (!m_emittedStates.depthStencil.Update(state))
+      return;
+
     EmitCs([
       cState = state
     ](DxvkContext* ctx) {
@@ -5649,6 +6018,9 @@ namespace dxvk {
     state.conservativeMode = VK_CONSERVATIVE_RASTERIZATION_MODE_DISABLED_EXT;
     state.sampleCount     = 0;
 
+    if (!m_emittedStates.rasterizer.Update(state))
+      return;
+
     EmitCs([
       cState  = state
     ](DxvkContext* ctx) {
@@ -5670,6 +6042,9 @@ namespace dxvk {
     biases.depthBiasSlope    = slopeScaledDepthBias;
     biases.depthBiasClamp    = 0.0f;
 
+    if (!m_emittedStates.depthBias.Update(biases))
+      return;
+
     EmitCs([
       cBiases = biases
     ](DxvkContext* ctx) {
@@ -5687,6 +6062,9 @@ namespace dxvk {
       ? DecodeCompareOp(D3DCMPFUNC(rs[D3DRS_ALPHAFUNC]))
       : VK_COMPARE_OP_ALWAYS;
 
+    if (!m_emittedStates.alphaCompareOp.Update(alphaOp))
+      return;
+
     EmitCs([cAlphaOp = alphaOp] (DxvkContext* ctx) {
       ctx->setSpecConstant(VK_PIPELINE_BIND_POINT_GRAPHICS, D3D9SpecConstantId::AlphaCompareOp, cAlphaOp);
     });
@@ -5698,6 +6076,9 @@ namespace dxvk {
 
     uint32_t ref = uint32_t(rs[D3DRS_STENCILREF]) & 0xff;
 
+    if (!m_emittedStates.stencilReference.Update(ref))
+      return;
+
     EmitCs([cRef = ref] (DxvkContext* ctx) {
       ctx->setStencilReference(cRef);
     });
@@ -5732,6 +6113,9 @@ namespace dxvk {
 
     NormalizeSamplerKey(key);
 
+    if (!m_emittedStates.samplers[Sampler].Update(key))
+      return;
+
     auto samplerInfo = RemapStateSamplerShader(Sampler);
 
     const uint32_t slot = computeResourceSlotId(
@@ -5881,6 +6265,207 @@ namespace dxvk {
   }
 
 
+  bool D3D9DeviceEx::BatchUPDraw(
+          D3DPRIMITIVETYPE PrimitiveType,
+          UINT             PrimitiveCount,
+          UINT             VertexCount,
+    const void*            pVertexData,
+          UINT             VertexStride,
+    const void*            pIndexData,
+          D3DFORMAT        IndexFormat) {
+    // Keep batches small enough to not hold back draws for too long
+    constexpr size_t MaxBatchSize = 1 << 16;
+
+    // Strips and fans can not be concatenated without restarts
+    if (PrimitiveType != D3DPT_POINTLIST
+     && PrimitiveType != D3DPT_LINELIST
+     && PrimitiveType != D3DPT_TRIANGLELIST)
+      return false;
+
+    if (unlikely(!VertexStride))
+      return false;
+
+    const bool     indexed       = IndexFormat != D3DFMT_UNKNOWN;
+    const bool     index16       = IndexFormat == D3DFMT_INDEX16;
+    const uint32_t instanceCount = GetInstanceCount();
+    const uint32_t declSize      = m_state.vertexDecl->GetSize();
+    const uint32_t indexCount    = indexed ? GenerateDrawInfo(PrimitiveType, PrimitiveCount, 0).vertexCount : 0;
+
+    // If the declaration is larger than the stride, the last vertex of a draw
+    // reads past its data, so each draw needs to be padded with zeroes before
+    // the next one can be appended. Padding only works with an index buffer.
+    if (!indexed && declSize > VertexStride)
+      return false;
+
+    const uint32_t padCount = (declSize - 1) / VertexStride;
+
+    const size_t vertexSize = size_t(VertexCount) * VertexStride;
+    const size_t indexSize  = size_t(indexCount) * (index16 ? 2 : 4);
+    const size_t padSize    = size_t(padCount) * VertexStride;
+
+    if (vertexSize + indexSize > MaxBatchSize)
+      return false;
+
+    D3D9UPBatch& batch = m_upBatch;
+
+    if (batch.primCount) {
+      bool compatible = batch.primType      == PrimitiveType
+                     && batch.instanceCount == instanceCount
+                     && batch.stride        == VertexStride
+                     && batch.declSize      == declSize
+                     && batch.indexFormat   == (indexed ? IndexFormat : D3DFMT_UNKNOWN);
+
+      compatible &= batch.vertexData.size() + batch.indexData.size()
+                  + padSize + vertexSize + indexSize <= MaxBatchSize;
+
+      // Rebased 16-bit indices must neither overflow nor hit the restart index
+      if (indexed && index16)
+        compatible &= batch.vertexCount + padCount + VertexCount < 0xffff;
+
+      if (!compatible)
+        FlushUPBatch();
+    }
+
+    if (!batch.primCount) {
+      batch.primType      = PrimitiveType;
+      batch.instanceCount = instanceCount;
+      batch.stride        = VertexStride;
+      batch.declSize      = declSize;
+      batch.indexFormat   = indexed ? IndexFormat : D3DFMT_UNKNOWN;
+    } else {
+      // Zero-pad the previous draw the same way the unbatched path does
+      batch.vertexData.resize(batch.vertexData.size() + padSize);
+      batch.vertexCount += padCount;
+    }
+
+    const size_t vertexOffset = batch.vertexData.size();
+    batch.vertexData.resize(vertexOffset + vertexSize);
+    std::memcpy(&batch.vertexData[vertexOffset], pVertexData, vertexSize);
+
+    if (indexed) {
+      const size_t indexOffset = batch.indexData.size();
+      batch.indexData.resize(indexOffset + indexSize);
+
+      auto RebaseIndices = [&] (auto* dst, const auto* src) {
+        for (uint32_t i = 0; i < indexCount; i++)
+          dst[i] = src[i] + batch.vertexCount;
+      };
+
+      if (index16) {
+        RebaseIndices(
+          reinterpret_cast<uint16_t*>(&batch.indexData[indexOffset]),
+          reinterpret_cast<const uint16_t*>(pIndexData));
+      } else {
+        RebaseIndices(
+          reinterpret_cast<uint32_t*>(&batch.indexData[indexOffset]),
+          reinterpret_cast<const uint32_t*>(pIndexData));
+      }
+    }
+
+    batch.vertexCount += VertexCount;
+    batch.primCount   += PrimitiveCount;
+    return true;
+  }
+
+
+  void D3D9DeviceEx::FlushUPBatch() {
+    D3D9UPBatch& batch = m_upBatch;
+
+    // Reset this first, recording commands would flush the batch again
+    const uint32_t primCount = std::exchange(batch.primCount, 0);
+
+    const uint32_t vertexDataSize   = uint32_t(batch.vertexData.size());
+    const uint32_t vertexBufferSize = (batch.vertexCount - 1) * batch.stride + std::max(batch.declSize, batch.stride);
+    const uint32_t indicesSize      = uint32_t(batch.indexData.size());
+
+    auto upSlice = AllocTempBuffer<true>(vertexBufferSize + indicesSize);
+    uint8_t* data = reinterpret_cast<uint8_t*>(upSlice.mapPtr);
+    FillUPVertexBuffer(data, batch.vertexData.data(), vertexDataSize, vertexBufferSize);
+
+    if (indicesSize)
+      std::memcpy(data + vertexBufferSize, batch.indexData.data(), indicesSize);
+
+    EmitCs([this,
+      cVertexSize    = vertexBufferSize,
+      cBufferSlice   = std::move(upSlice.slice),
+      cPrimType      = batch.primType,
+      cPrimCount     = primCount,
+      cStride        = batch.stride,
+      cInstanceCount = batch.instanceCount,
+      cIndexed       = indicesSize != 0,
+      cIndexType     = DecodeIndexType(
+                         static_cast<D3D9Format>(batch.indexFormat))
+    ](DxvkContext* ctx) {
+      auto drawInfo = GenerateDrawInfo(cPrimType, cPrimCount, cInstanceCount);
+
+      ApplyPrimitiveType(ctx, cPrimType);
+
+      ctx->bindVertexBuffer(0, cBufferSlice.subSlice(0, cVertexSize), cStride);
+
+      if (cIndexed) {
+        ctx->bindIndexBuffer(cBufferSlice.subSlice(cVertexSize, cBufferSlice.length() - cVertexSize), cIndexType);
+        ctx->drawIndexed(
+          drawInfo.vertexCount, drawInfo.instanceCount,
+          0, 0, 0);
+        ctx->bindIndexBuffer(DxvkBufferSlice(), VK_INDEX_TYPE_UINT32);
+      } else {
+        ctx->draw(
+          drawInfo.vertexCount, drawInfo.instanceCount,
+          0, 0);
+      }
+
+      ctx->bindVertexBuffer(0, DxvkBufferSlice(), 0);
+    });
+
+    batch.vertexCount = 0;
+    batch.vertexData.clear();
+    batch.indexData.clear();
+  }
+
+
+  void D3D9DeviceEx::EmitConvertFormat(
+          D3D9_CONVERSION_FORMAT_INFO ConversionFormat,
+    const Rc<DxvkImage>&              Image,
+          VkImageSubresourceLayers    Layers,
+    const DxvkBufferSlice&            Slice) {
+    if (unlikely(m_upBatch.primCount))
+      FlushUPBatch();
+
+    // Work recorded before the first conversion of a batch must be
+    // submitted before the converter's command list. Subsequent
+    // conversions can go into the same command list.
+    bool flushContext = !m_conversionsPending;
+    m_conversionsPending = false;
+
+    EmitCs([
+      cConverter      = m_converter,
+      cFlushContext   = flushContext,
+      cFormat         = ConversionFormat,
+      cImage          = Image,
+      cLayers         = Layers,
+      cSlice          = Slice
+    ] (DxvkContext* ctx) {
+      if (cFlushContext)
+        ctx->flushCommandList();
+
+      cConverter->ConvertFormat(cFormat, cImage, cLayers, cSlice);
+    });
+
+    m_conversionsPending = true;
+  }
+
+
+  void D3D9DeviceEx::FlushConversions() {
+    m_conversionsPending = false;
+
+    EmitCs([
+      cConverter = m_converter
+    ] (DxvkContext* ctx) {
+      cConverter->Flush();
+    });
+  }
+
+
   void D3D9DeviceEx::PrepareDraw(D3DPRIMITIVETYPE PrimitiveType) {
     if (unlikely(m_activeHazardsRT != 0)) {
       EmitCs([](DxvkContext* ctx) {
@@ -6260,7 +6845,7 @@ namespace dxvk {
     m_state.vsConsts.bConsts[idx] &= ~mask;
     m_state.vsConsts.bConsts[idx] |= bits & mask;
 
-    m_consts[DxsoProgramTypes::VertexShader].dirty = true;
+    m_consts[DxsoProgramTypes::VertexShader].dirtyB.add(idx * 32, 32);
   }
 
 
@@ -6268,7 +6853,7 @@ namespace dxvk {
     m_state.psConsts.bConsts[idx] &= ~mask;
     m_state.psConsts.bConsts[idx] |= bits & mask;
 
-    m_consts[DxsoProgramTypes::PixelShader].dirty = true;
+    m_consts[DxsoProgramTypes::PixelShader].dirtyB.add(idx * 32, 32);
   }
 
 
@@ -6321,13 +6906,12 @@ namespace dxvk {
         pConstantData,
         Count);
 
-    if constexpr (ConstantType != D3D9ConstantType::Bool) {
-      uint32_t maxCount = ConstantType == D3D9ConstantType::Float
-        ? m_consts[ProgramType].meta.maxConstIndexF
-        : m_consts[ProgramType].meta.maxConstIndexI;
-
-      m_consts[ProgramType].dirty |= StartRegister < maxCount;
-    }
+    if constexpr (ConstantType == D3D9ConstantType::Float)
+      m_consts[ProgramType].dirtyF.add(StartRegister, Count);
+    else if constexpr (ConstantType == D3D9ConstantType::Int)
+      m_consts[ProgramType].dirtyI.add(StartRegister, Count);
+    else
+      m_consts[ProgramType].dirtyB.add(StartRegister, Count);
 
     UpdateStateConstants<ProgramType, ConstantType, T>(
       &m_state,
@@ -6620,12 +7204,21 @@ namespace dxvk {
       if (idx >= 1)
         key.Stages[idx - 1].Contents.ResultIsTemp = false;
 
+      // The uber shader reads the key from the constant buffer
+      if (m_d3d9Options.ffUberShader && m_ffKeyPS != key)
+        m_flags.set(D3D9DeviceFlag::DirtyFFPixelData);
+
+      m_ffKeyPS = key;
+
       EmitCs([
         this,
         cKey     = key,
+        cUber    = m_d3d9Options.ffUberShader,
        &cShaders = m_ffModules
       ](DxvkContext* ctx) {
-        auto shader = cShaders.GetShaderModule(this, cKey);
+        auto shader = cUber
+          ? cShaders.GetUberShaderModule(this, cKey)
+          : cShaders.GetShaderModule(this, cKey);
         ctx->bindShader(VK_SHADER_STAGE_FRAGMENT_BIT, shader.GetShader());
       });
     }
@@ -6648,6 +7241,9 @@ namespace dxvk {
 
       D3D9FixedFunctionPS* data = reinterpret_cast<D3D9FixedFunctionPS*>(slice.mapPtr);
       DecodeD3DCOLOR((D3DCOLOR)rs[D3DRS_TEXTUREFACTOR], data->textureFactor.data);
+
+      if (m_d3d9Options.ffUberShader)
+        PackFFShaderKeyFS(m_ffKeyPS, data);
     }
   }
 
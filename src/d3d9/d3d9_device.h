@@ -87,6 +87,115 @@ namespace dxvk {
     void*           mapPtr = nullptr;
   };
 
+  /**
+   * \brief Mapped memory type
+   *
+   * Categories of host-visible memory that the D3D9
+   * frontend keeps mapped on behalf of resources.
+   */
+  enum class D3D9MappedMemoryType : uint32_t {
+    ManagedTextures,    ///< System memory copies of managed textures
+    DefaultTextures,    ///< Mapping buffers of default pool textures
+    SystemMemTextures,  ///< System memory and scratch textures
+    Buffers,            ///< Mapped vertex and index buffers
+    Count
+  };
+
+  /**
+   * \brief Pending DrawPrimitiveUP batch
+   *
+   * Consecutive UP draws with list topologies get merged into
+   * a single draw as long as no other command gets recorded in
+   * between, i.e. as long as no state changes. The batch is
+   * submitted right before the next command is recorded.
+   */
+  struct D3D9UPBatch {
+    D3DPRIMITIVETYPE      primType      = D3DPRIMITIVETYPE(0);
+    uint32_t              primCount     = 0;
+    uint32_t              instanceCount = 0;
+    uint32_t              stride        = 0;
+    uint32_t              declSize      = 0;
+    uint32_t              vertexCount   = 0;
+    D3DFORMAT             indexFormat   = D3DFMT_UNKNOWN;
+    std::vector<uint8_t>  vertexData;
+    std::vector<uint8_t>  indexData;
+  };
+
+  /**
+   * \brief Compares state bitwise
+   *
+   * Only suitable for structs without padding.
+   */
+  template <typename T>
+  struct D3D9BitwiseEq {
+    bool operator () (const T& a, const T& b) const {
+      return !std::memcmp(&a, &b, sizeof(T));
+    }
+  };
+
+  /**
+   * \brief Last state recorded for a state group
+   *
+   * Render state changes dirty entire groups of derived DXVK
+   * state. Keeping the last value that got recorded allows
+   * skipping updates where the derived state did not change,
+   * e.g. if a render state was changed and restored between
+   * two draws, or changed in a way that does not matter.
+   */
+  template <typename T, typename Eq = D3D9BitwiseEq<T>>
+  class D3D9EmittedState {
+
+  public:
+
+    /**
+     * \brief Updates the recorded state
+     *
+     * \param [in] state New state
+     * \returns \c true if the state needs to be recorded
+     */
+    bool Update(const T& state) {
+      if (m_valid && Eq()(m_state, state))
+        return false;
+
+      m_state = state;
+      m_valid = true;
+      return true;
+    }
+
+  private:
+
+    T    m_state = { };
+    bool m_valid = false;
+
+  };
+
+  /**
+   * \brief Blend state as recorded to the context
+   */
+  struct D3D9BlendStateKey {
+    DxvkBlendMode                         mode;
+    std::array<VkColorComponentFlags, 3>  writeMasks;
+    uint32_t                              alphaSwizzleRTs;
+  };
+
+  /**
+   * \brief Derived state last recorded to the context
+   */
+  struct D3D9EmittedStates {
+    D3D9EmittedState<DxvkRasterizerState>   rasterizer;
+    D3D9EmittedState<DxvkDepthStencilState> depthStencil;
+    D3D9EmittedState<DxvkMultisampleState>  multisample;
+    D3D9EmittedState<D3D9BlendStateKey>     blend;
+    D3D9EmittedState<DxvkBlendConstants>    blendConstants;
+    D3D9EmittedState<DxvkDepthBias>         depthBias;
+    D3D9EmittedState<uint32_t>              stencilReference;
+    D3D9EmittedState<VkCompareOp>           alphaCompareOp;
+
+    std::array<
+      D3D9EmittedState<D3D9SamplerKey, D3D9SamplerKeyEq>,
+      SamplerCount>                         samplers;
+  };
+
   class D3D9DeviceEx final : public ComObjectClamp<IDirect3DDevice9Ex> {
     constexpr static uint32_t DefaultFrameLatency = 3;
     constexpr static uint32_t MaxFrameLatency     = 20;
@@ -98,6 +207,7 @@ namespace dxvk {
     constexpr static uint32_t NullStreamIdx = caps::MaxStreams;
 
     friend class D3D9SwapChainEx;
+    friend class D3D9ConstantBuffer;
   public:
 
     D3D9DeviceEx(
@@ -759,6 +869,40 @@ namespace dxvk {
 
     void MarkTextureUploaded(D3D9CommonTexture* pResource);
 
+    /**
+     * \brief Marks a mapped texture as recently locked
+     *
+     * Moves the texture to the end of the mapped texture
+     * list, so that its mapping buffers are released last.
+     * \param [in] pResource The texture
+     */
+    void TouchMappedTexture(D3D9CommonTexture* pResource);
+
+    /**
+     * \brief Removes a texture from the mapped texture list
+     * \param [in] pResource The texture
+     */
+    void RemoveMappedTexture(D3D9CommonTexture* pResource);
+
+    /**
+     * \brief Releases mapping buffers over budget
+     *
+     * Releases the mapping buffers of the least recently
+     * locked textures until texture mapped memory fits into
+     * both \c d3d9.mappingBufferBudget and, for managed textures,
+     * \c d3d9.managedShadowBudget again, or until no buffers
+     * are left to release. Released buffers are recreated
+     * from the image on the next lock.
+     * \param [in] pSkip Texture that was just unlocked
+     */
+    void TrimMappedMemory(D3D9CommonTexture* pSkip);
+
+    void ChangeMappedMemory(D3D9MappedMemoryType Type, int64_t Delta) {
+      m_mappedMemory[uint32_t(Type)] += Delta;
+    }
+
+    void ChangeEvictableMemory(D3D9CommonTexture* pResource, int64_t Delta);
+
     template <bool Points>
     void UpdatePointMode();
 
@@ -852,6 +996,74 @@ namespace dxvk {
 
     void PrepareDraw(D3DPRIMITIVETYPE PrimitiveType);
 
+    /**
+     * \brief Processes vertices on the CPU
+     *
+     * Handles \c ProcessVertices for fixed-function transforms
+     * without lighting, blending or texture coordinate generation.
+     * \returns \c false if the current state is not supported,
+     *    in which case nothing was written to the buffer
+     */
+    bool ProcessVerticesCPU(
+            UINT                    SrcStartIndex,
+            UINT                    DestIndex,
+            UINT                    VertexCount,
+            D3D9CommonBuffer*       pDestBuffer,
+      const D3D9VertexDecl*         pDestDecl,
+            DWORD                   Flags);
+
+    /**
+     * \brief Adds a UP draw to the pending batch
+     *
+     * Must be called after \c PrepareDraw. Submits the pending
+     * batch first if the draw cannot be merged into it.
+     * \param [in] PrimitiveType Primitive type
+     * \param [in] PrimitiveCount Primitive count
+     * \param [in] VertexCount Number of vertices to copy
+     * \param [in] pVertexData Vertex data
+     * \param [in] VertexStride Vertex stride
+     * \param [in] pIndexData Index data
+     * \param [in] IndexFormat Index format, or \c D3DFMT_UNKNOWN
+     *    for non-indexed draws
+     * \returns \c false if the draw can not be batched
+     */
+    bool BatchUPDraw(
+            D3DPRIMITIVETYPE PrimitiveType,
+            UINT             PrimitiveCount,
+            UINT             VertexCount,
+      const void*            pVertexData,
+            UINT             VertexStride,
+      const void*            pIndexData,
+            D3DFORMAT        IndexFormat);
+
+    /**
+     * \brief Records the pending UP draw batch
+     */
+    void FlushUPBatch();
+
+    /**
+     * \brief Records a format conversion
+     *
+     * Conversions are recorded into the format helper's own
+     * command list on the CS thread. Consecutive conversions
+     * share one submission, which is deferred until the next
+     * command that may depend on the converted images.
+     * \param [in] ConversionFormat Conversion format
+     * \param [in] Image Destination image
+     * \param [in] Layers Destination subresource
+     * \param [in] Slice Source data
+     */
+    void EmitConvertFormat(
+            D3D9_CONVERSION_FORMAT_INFO ConversionFormat,
+      const Rc<DxvkImage>&              Image,
+            VkImageSubresourceLayers    Layers,
+      const DxvkBufferSlice&            Slice);
+
+    /**
+     * \brief Submits pending format conversions
+     */
+    void FlushConversions();
+
     template <DxsoProgramType ShaderStage>
     void BindShader(
       const D3D9CommonShader*                 pShaderModule,
@@ -879,6 +1091,10 @@ namespace dxvk {
       return &m_state;
     }
 
+    bool IsRecording() const {
+      return m_recorder != nullptr;
+    }
+
     void Begin(D3D9Query* pQuery);
     void End(D3D9Query* pQuery);
 
@@ -918,6 +1134,27 @@ namespace dxvk {
       return m_samplerCount.load();
     }
 
+    int64_t GetMappedMemory(D3D9MappedMemoryType Type) const {
+      return m_mappedMemory[uint32_t(Type)].load();
+    }
+
+    int64_t GetMappedMemoryTotal() const {
+      int64_t total = 0;
+
+      for (const auto& memory : m_mappedMemory)
+        total += memory.load();
+
+      return total;
+    }
+
+    uint32_t GetMappedMemoryEvictions() const {
+      return m_mappedMemoryEvictions.load();
+    }
+
+    uint32_t GetManagedEvictions() const {
+      return m_managedEvictions.load();
+    }
+
   private:
 
     DxvkCsChunkRef AllocCsChunk() {
@@ -927,6 +1164,12 @@ namespace dxvk {
 
     template<typename Cmd>
     void EmitCs(Cmd&& command) {
+      if (unlikely(m_upBatch.primCount))
+        FlushUPBatch();
+
+      if (unlikely(m_conversionsPending))
+        FlushConversions();
+
       if (unlikely(!m_csChunk->push(command))) {
         EmitCsChunk(std::move(m_csChunk));
 
@@ -938,6 +1181,12 @@ namespace dxvk {
     void EmitCsChunk(DxvkCsChunkRef&& chunk);
 
     void FlushCsChunk() {
+      if (unlikely(m_upBatch.primCount))
+        FlushUPBatch();
+
+      if (unlikely(m_conversionsPending))
+        FlushConversions();
+
       if (likely(!m_csChunk->empty())) {
         EmitCsChunk(std::move(m_csChunk));
         m_csChunk = AllocCsChunk();
@@ -1135,6 +1384,7 @@ namespace dxvk {
 
     D3D9Initializer*                m_initializer = nullptr;
     D3D9FormatHelper*               m_converter   = nullptr;
+    bool                            m_conversionsPending = false;
 
     D3D9FFShaderModuleSet           m_ffModules;
     D3D9SWVPEmulator                m_swvpEmulator;
@@ -1151,6 +1401,8 @@ namespace dxvk {
     Rc<DxvkBuffer>                  m_psShared;
 
     D3D9BufferSlice                 m_upBuffer;
+    D3D9UPBatch                     m_upBatch;
+    D3D9EmittedStates               m_emittedStates;
     D3D9BufferSlice                 m_managedUploadBuffer;
 
     D3D9Cursor                      m_cursor;
@@ -1212,6 +1464,7 @@ namespace dxvk {
     uint32_t                        m_lastFetch4    = 0;
     uint32_t                        m_lastHazardsDS = 0;
     uint32_t                        m_lastSamplerTypesFF = 0;
+    D3D9FFShaderKeyFS               m_ffKeyPS;
 
     D3D9ShaderMasks                 m_vsShaderMasks = D3D9ShaderMasks();
     D3D9ShaderMasks                 m_psShaderMasks = FixedFunctionMask;
@@ -1239,6 +1492,15 @@ namespace dxvk {
     std::atomic<int64_t>            m_availableMemory = { 0 };
     std::atomic<int32_t>            m_samplerCount    = { 0 };
 
+    std::array<
+      std::atomic<int64_t>,
+      uint32_t(D3D9MappedMemoryType::Count)> m_mappedMemory = { };
+    std::atomic<uint32_t>           m_mappedMemoryEvictions = { 0 };
+    std::atomic<uint32_t>           m_managedEvictions      = { 0 };
+    int64_t                         m_evictableMemory        = 0;
+    int64_t                         m_evictableManagedMemory = 0;
+    D3D9MappedTextureList           m_mappedTextures;
+
     Direct3DState9                  m_state;
 
   };
@@ -17,413 +17,6 @@ namespace dxvk {
     invariantPosition = options->invariantPosition;
   }
 
-  uint32_t DoFixedFunctionFog(SpirvModule& spvModule, const D3D9FogContext& fogCtx) {
-    uint32_t floatType  = spvModule.defFloatType(32);
-    uint32_t uint32Type = spvModule.defIntType(32, 0);
-    uint32_t vec3Type   = spvModule.defVectorType(floatType, 3);
-    uint32_t vec4Type   = spvModule.defVectorType(floatType, 4);
-    uint32_t floatPtr   = spvModule.defPointerType(floatType, spv::StorageClassPushConstant);
-    uint32_t vec3Ptr    = spvModule.defPointerType(vec3Type,  spv::StorageClassPushConstant);
-
-    uint32_t fogColorMember = spvModule.constu32(uint32_t(D3D9RenderStateItem::FogColor));
-    uint32_t fogColor = spvModule.opLoad(vec3Type,
-      spvModule.opAccessChain(vec3Ptr, fogCtx.RenderState, 1, &fogColorMember));
-
-    uint32_t fogScaleMember = spvModule.constu32(uint32_t(D3D9RenderStateItem::FogScale));
-    uint32_t fogScale = spvModule.opLoad(floatType,
-      spvModule.opAccessChain(floatPtr, fogCtx.RenderState, 1, &fogScaleMember));
-
-    uint32_t fogEndMember = spvModule.constu32(uint32_t(D3D9RenderStateItem::FogEnd));
-    uint32_t fogEnd = spvModule.opLoad(floatType,
-      spvModule.opAccessChain(floatPtr, fogCtx.RenderState, 1, &fogEndMember));
-
-    uint32_t fogDensityMember = spvModule.constu32(uint32_t(D3D9RenderStateItem::FogDensity));
-    uint32_t fogDensity = spvModule.opLoad(floatType,
-      spvModule.opAccessChain(floatPtr, fogCtx.RenderState, 1, &fogDensityMember));
-
-    uint32_t fogMode = spvModule.specConst32(uint32Type, 0);
-
-    if (!fogCtx.IsPixel) {
-      spvModule.setDebugName(fogMode, "vertex_fog_mode");
-      spvModule.decorateSpecId(fogMode, getSpecId(D3D9SpecConstantId::VertexFogMode));
-    }
-    else {
-      spvModule.setDebugName(fogMode, "pixel_fog_mode");
-      spvModule.decorateSpecId(fogMode, getSpecId(D3D9SpecConstantId::PixelFogMode));
-    }
-
-    uint32_t fogEnabled = spvModule.specConstBool(false);
-    spvModule.setDebugName(fogEnabled, "fog_enabled");
-    spvModule.decorateSpecId(fogEnabled, getSpecId(D3D9SpecConstantId::FogEnabled));
-
-    uint32_t doFog   = spvModule.allocateId();
-    uint32_t skipFog = spvModule.allocateId();
-
-    uint32_t returnType     = fogCtx.IsPixel ? vec4Type : floatType;
-    uint32_t returnTypePtr  = spvModule.defPointerType(returnType, spv::StorageClassPrivate);
-    uint32_t returnValuePtr = spvModule.newVar(returnTypePtr, spv::StorageClassPrivate);
-    spvModule.opStore(returnValuePtr, fogCtx.IsPixel ? fogCtx.oColor : spvModule.constf32(0.0f));
-
-    // Actually do the fog now we have all the vars in-place.
-
-    spvModule.opSelectionMerge(skipFog, spv::SelectionControlMaskNone);
-    spvModule.opBranchConditional(fogEnabled, doFog, skipFog);
-
-    spvModule.opLabel(doFog);
-
-    uint32_t wIndex = 3;
-    uint32_t zIndex = 2;
-
-    uint32_t w = spvModule.opCompositeExtract(floatType, fogCtx.vPos, 1, &wIndex);
-    uint32_t z = spvModule.opCompositeExtract(floatType, fogCtx.vPos, 1, &zIndex);
-
-    uint32_t depth = 0;
-    if (fogCtx.IsPixel)
-      depth = spvModule.opFMul(floatType, z, spvModule.opFDiv(floatType, spvModule.constf32(1.0f), w));
-    else {
-      if (fogCtx.RangeFog) {
-        std::array<uint32_t, 3> indices = { 0, 1, 2 };
-        uint32_t pos3 = spvModule.opVectorShuffle(vec3Type, fogCtx.vPos, fogCtx.vPos, indices.size(), indices.data());
-        depth = spvModule.opLength(floatType, pos3);
-      }
-      else
-        depth = fogCtx.HasFogInput
-          ? fogCtx.vFog
-          : spvModule.opFAbs(floatType, z);
-    }
-    uint32_t fogFactor;
-    if (!fogCtx.IsPixel && fogCtx.IsFixedFunction && fogCtx.IsPositionT) {
-      fogFactor = fogCtx.HasSpecular
-        ? spvModule.opCompositeExtract(floatType, fogCtx.Specular, 1, &wIndex)
-        : spvModule.constf32(1.0f);
-    } else {
-      uint32_t applyFogFactor = spvModule.allocateId();
-
-      std::array<SpirvPhiLabel, 4> fogVariables;
-
-      std::array<SpirvSwitchCaseLabel, 4> fogCaseLabels = { {
-        { uint32_t(D3DFOG_NONE),      spvModule.allocateId() },
-        { uint32_t(D3DFOG_EXP),       spvModule.allocateId() },
-        { uint32_t(D3DFOG_EXP2),      spvModule.allocateId() },
-        { uint32_t(D3DFOG_LINEAR),    spvModule.allocateId() },
-      } };
-
-      spvModule.opSelectionMerge(applyFogFactor, spv::SelectionControlMaskNone);
-      spvModule.opSwitch(fogMode,
-        fogCaseLabels[D3DFOG_NONE].labelId,
-        fogCaseLabels.size(),
-        fogCaseLabels.data());
-
-      for (uint32_t i = 0; i < fogCaseLabels.size(); i++) {
-        spvModule.opLabel(fogCaseLabels[i].labelId);
-        
-        fogVariables[i].labelId = fogCaseLabels[i].labelId;
-        fogVariables[i].varId   = [&] {
-          auto mode = D3DFOGMODE(fogCaseLabels[i].literal);
-          switch (mode) {
-            default:
-            // vFog
-            case D3DFOG_NONE: {
-              if (fogCtx.IsPixel)
-                return fogCtx.vFog;
-
-              if (fogCtx.IsFixedFunction && fogCtx.HasSpecular)
-                return spvModule.opCompositeExtract(floatType, fogCtx.Specular, 1, &wIndex);
-
-              return spvModule.constf32(1.0f);
-            }
-
-            // (end - d) / (end - start)
-            case D3DFOG_LINEAR: {
-              uint32_t fogFactor = spvModule.opFSub(floatType, fogEnd, depth);
-              fogFactor = spvModule.opFMul(floatType, fogFactor, fogScale);
-              fogFactor = spvModule.opNClamp(floatType, fogFactor, spvModule.constf32(0.0f), spvModule.constf32(1.0f));
-              return fogFactor;
-            }
-
-            // 1 / (e^[d * density])^2
-            case D3DFOG_EXP2:
-            // 1 / (e^[d * density])
-            case D3DFOG_EXP: {
-              uint32_t fogFactor = spvModule.opFMul(floatType, depth, fogDensity);
-
-              if (mode == D3DFOG_EXP2)
-                fogFactor = spvModule.opFMul(floatType, fogFactor, fogFactor);
-
-              // Provides the rcp.
-              fogFactor = spvModule.opFNegate(floatType, fogFactor);
-              fogFactor = spvModule.opExp(floatType, fogFactor);
-              return fogFactor;
-            }
-          }
-        }();
-        
-        spvModule.opBranch(applyFogFactor);
-      }
-
-      spvModule.opLabel(applyFogFactor);
-
-      fogFactor = spvModule.opPhi(floatType,
-        fogVariables.size(),
-        fogVariables.data());
-    }
-
-    uint32_t fogRetValue = 0;
-
-    // Return the new color if we are doing this in PS
-    // or just the fog factor for oFog in VS
-    if (fogCtx.IsPixel) {
-      std::array<uint32_t, 4> indices = { 0, 1, 2, 6 };
-
-      uint32_t color = fogCtx.oColor;
-
-      uint32_t color3 = spvModule.opVectorShuffle(vec3Type, color, color, 3, indices.data());
-
-      std::array<uint32_t, 3> fogFacIndices = { fogFactor, fogFactor, fogFactor };
-      uint32_t fogFact3 = spvModule.opCompositeConstruct(vec3Type, fogFacIndices.size(), fogFacIndices.data());
-
-      uint32_t lerpedFrog = spvModule.opFMix(vec3Type, fogColor, color3, fogFact3);
-
-      fogRetValue = spvModule.opVectorShuffle(vec4Type, lerpedFrog, color, indices.size(), indices.data());
-    }
-    else
-      fogRetValue = fogFactor;
-
-    spvModule.opStore(returnValuePtr, fogRetValue);
-
-    spvModule.opBranch(skipFog);
-
-    spvModule.opLabel(skipFog);
-
-    return spvModule.opLoad(returnType, returnValuePtr);
-  }
-
-
-  uint32_t SetupRenderStateBlock(SpirvModule& spvModule, uint32_t count) {
-    uint32_t floatType = spvModule.defFloatType(32);
-    uint32_t vec3Type  = spvModule.defVectorType(floatType, 3);
-
-    std::array<uint32_t, 11> rsMembers = {{
-      vec3Type,
-      floatType,
-      floatType,
-      floatType,
-      floatType,
-
-      floatType,
-      floatType,
-      floatType,
-      floatType,
-      floatType,
-      floatType,
-    }};
-
-    uint32_t rsStruct = spvModule.defStructTypeUnique(count, rsMembers.data());
-    uint32_t rsBlock = spvModule.newVar(
-      spvModule.defPointerType(rsStruct, spv::StorageClassPushConstant),
-      spv::StorageClassPushConstant);
-    
-    spvModule.setDebugName         (rsBlock, "render_state");
-
-    spvModule.setDebugName         (rsStruct, "render_state_t");
-    spvModule.decorate             (rsStruct, spv::DecorationBlock);
-
-    uint32_t memberIdx = 0;
-    auto SetMemberName = [&](const char* name, uint32_t offset) {
-      if (memberIdx >= count)
-        return;
-
-      spvModule.setDebugMemberName   (rsStruct, memberIdx, name);
-      spvModule.memberDecorateOffset (rsStruct, memberIdx, offset);
-      memberIdx++;
-    };
-
-    SetMemberName("fog_color",      offsetof(D3D9RenderStateInfo, fogColor));
-    SetMemberName("fog_scale",      offsetof(D3D9RenderStateInfo, fogScale));
-    SetMemberName("fog_end",        offsetof(D3D9RenderStateInfo, fogEnd));
-    SetMemberName("fog_density",    offsetof(D3D9RenderStateInfo, fogDensity));
-    SetMemberName("alpha_ref",      offsetof(D3D9RenderStateInfo, alphaRef));
-    SetMemberName("point_size",     offsetof(D3D9RenderStateInfo, pointSize));
-    SetMemberName("point_size_min", offsetof(D3D9RenderStateInfo, pointSizeMin));
-    SetMemberName("point_size_max", offsetof(D3D9RenderStateInfo, pointSizeMax));
-    SetMemberName("point_scale_a",  offsetof(D3D9RenderStateInfo, pointScaleA));
-    SetMemberName("point_scale_b",  offsetof(D3D9RenderStateInfo, pointScaleB));
-    SetMemberName("point_scale_c",  offsetof(D3D9RenderStateInfo, pointScaleC));
-
-    return rsBlock;
-  }
-
-
-  D3D9PointSizeInfoVS GetPointSizeInfoVS(SpirvModule& spvModule, uint32_t vPos, uint32_t vtx, uint32_t perVertPointSize, uint32_t rsBlock, bool isFixedFunction) {
-    uint32_t floatType  = spvModule.defFloatType(32);
-    uint32_t floatPtr   = spvModule.defPointerType(floatType, spv::StorageClassPushConstant);
-    uint32_t vec3Type   = spvModule.defVectorType(floatType, 3);
-    uint32_t vec4Type   = spvModule.defVectorType(floatType, 4);
-    uint32_t uint32Type = spvModule.defIntType(32, 0);
-    uint32_t boolType   = spvModule.defBoolType();
-
-    auto LoadFloat = [&](D3D9RenderStateItem item) {
-      uint32_t index = spvModule.constu32(uint32_t(item));
-      return spvModule.opLoad(floatType, spvModule.opAccessChain(floatPtr, rsBlock, 1, &index));
-    };
-
-    uint32_t value = perVertPointSize != 0 ? perVertPointSize : LoadFloat(D3D9RenderStateItem::PointSize);
-
-    if (isFixedFunction) {
-      uint32_t pointMode = spvModule.specConst32(uint32Type, 0);
-      spvModule.setDebugName(pointMode, "point_mode");
-      spvModule.decorateSpecId(pointMode, getSpecId(D3D9SpecConstantId::PointMode));
-
-      uint32_t scaleBit  = spvModule.opBitFieldUExtract(uint32Type, pointMode, spvModule.consti32(0), spvModule.consti32(1));
-      uint32_t isScale   = spvModule.opIEqual(boolType, scaleBit, spvModule.constu32(1));
-
-      uint32_t scaleC = LoadFloat(D3D9RenderStateItem::PointScaleC);
-      uint32_t scaleB = LoadFloat(D3D9RenderStateItem::PointScaleB);
-      uint32_t scaleA = LoadFloat(D3D9RenderStateItem::PointScaleA);
-
-      std::array<uint32_t, 4> indices = { 0, 1, 2, 3 };
-
-      uint32_t vtx3;
-      if (vPos != 0) {
-        vPos = spvModule.opLoad(vec4Type, vPos);
-
-        uint32_t rhw  = spvModule.opCompositeExtract(floatType, vPos, 1, &indices[3]);
-                 rhw  = spvModule.opFDiv(floatType, spvModule.constf32(1.0f), rhw);
-        uint32_t pos3 = spvModule.opVectorShuffle(vec3Type, vPos, vPos, 3, indices.data());
-                 vtx3 = spvModule.opVectorTimesScalar(vec3Type, pos3, rhw);
-      } else {
-                 vtx3 = spvModule.opVectorShuffle(vec3Type, vtx, vtx, 3, indices.data());
-      }
-
-      uint32_t DeSqr      = spvModule.opDot (floatType, vtx3, vtx3);
-      uint32_t De         = spvModule.opSqrt(floatType, DeSqr);
-      uint32_t scaleValue = spvModule.opFMul(floatType, scaleC, DeSqr);
-               scaleValue = spvModule.opFFma(floatType, scaleB, De, scaleValue);
-               scaleValue = spvModule.opFAdd(floatType, scaleA, scaleValue);
-               scaleValue = spvModule.opSqrt(floatType, scaleValue);
-               scaleValue = spvModule.opFDiv(floatType, value, scaleValue);
-
-      value = spvModule.opSelect(floatType, isScale, scaleValue, value);
-    }
-
-    uint32_t min   = LoadFloat(D3D9RenderStateItem::PointSizeMin);
-    uint32_t max   = LoadFloat(D3D9RenderStateItem::PointSizeMax);
-
-    D3D9PointSizeInfoVS info;
-    info.defaultValue = value;
-    info.min          = min;
-    info.max          = max;
-
-    return info;
-  }
-
-
-  D3D9PointSizeInfoPS GetPointSizeInfoPS(SpirvModule& spvModule, uint32_t rsBlock) {
-    uint32_t uint32Type = spvModule.defIntType(32, 0);
-    uint32_t boolType   = spvModule.defBoolType();
-    uint32_t boolVec4   = spvModule.defVectorType(boolType, 4);
-
-    uint32_t pointMode = spvModule.specConst32(uint32Type, 0);
-    spvModule.setDebugName(pointMode, "point_mode");
-    spvModule.decorateSpecId(pointMode, getSpecId(D3D9SpecConstantId::PointMode));
-
-    uint32_t spriteBit  = spvModule.opBitFieldUExtract(uint32Type, pointMode, spvModule.consti32(1), spvModule.consti32(1));
-    uint32_t isSprite   = spvModule.opIEqual(boolType, spriteBit, spvModule.constu32(1));
-
-    std::array<uint32_t, 4> isSpriteIndices;
-    for (uint32_t i = 0; i < isSpriteIndices.size(); i++)
-      isSpriteIndices[i] = isSprite;
-
-    isSprite = spvModule.opCompositeConstruct(boolVec4, isSpriteIndices.size(), isSpriteIndices.data());
-
-    D3D9PointSizeInfoPS info;
-    info.isSprite = isSprite;
-
-    return info;
-  }
-
-
-  uint32_t GetPointCoord(SpirvModule& spvModule, std::vector<uint32_t>& entryPointInterfaces) {
-    uint32_t floatType  = spvModule.defFloatType(32);
-    uint32_t vec2Type   = spvModule.defVectorType(floatType, 2);
-    uint32_t vec4Type   = spvModule.defVectorType(floatType, 4);
-    uint32_t vec2Ptr    = spvModule.defPointerType(vec2Type, spv::StorageClassInput);
-
-    uint32_t pointCoordPtr = spvModule.newVar(vec2Ptr, spv::StorageClassInput);
-
-    spvModule.decorateBuiltIn(pointCoordPtr, spv::BuiltInPointCoord);
-    entryPointInterfaces.push_back(pointCoordPtr);
-
-    uint32_t pointCoord    = spvModule.opLoad(vec2Type, pointCoordPtr);
-
-    std::array<uint32_t, 4> indices = { 0, 1, 2, 3 };
-
-    std::array<uint32_t, 4> pointCoordIndices = {
-      spvModule.opCompositeExtract(floatType, pointCoord, 1, &indices[0]),
-      spvModule.opCompositeExtract(floatType, pointCoord, 1, &indices[1]),
-      spvModule.constf32(0.0f),
-      spvModule.constf32(0.0f)
-    };
-
-    return spvModule.opCompositeConstruct(vec4Type, pointCoordIndices.size(), pointCoordIndices.data());
-  }
-
-
-  uint32_t GetSharedConstants(SpirvModule& spvModule) {
-    uint32_t float_t = spvModule.defFloatType(32);
-    uint32_t vec2_t  = spvModule.defVectorType(float_t, 2);
-    uint32_t vec4_t  = spvModule.defVectorType(float_t, 4);
-
-    std::array<uint32_t, D3D9SharedPSStages_Count> stageMembers = {
-      vec4_t,
-
-      vec2_t,
-      vec2_t,
-
-      float_t,
-      float_t,
-    };
-
-    std::array<decltype(stageMembers), caps::TextureStageCount> members;
-
-    for (auto& member : members)
-      member = stageMembers;
-
-    const uint32_t structType =
-      spvModule.defStructType(members.size() * stageMembers.size(), members[0].data());
-
-    spvModule.decorateBlock(structType);
-
-    uint32_t offset = 0;
-    for (uint32_t stage = 0; stage < caps::TextureStageCount; stage++) {
-      spvModule.memberDecorateOffset(structType, stage * D3D9SharedPSStages_Count + D3D9SharedPSStages_Constant, offset);
-      offset += sizeof(float) * 4;
-
-      spvModule.memberDecorateOffset(structType, stage * D3D9SharedPSStages_Count + D3D9SharedPSStages_BumpEnvMat0, offset);
-      offset += sizeof(float) * 2;
-
-      spvModule.memberDecorateOffset(structType, stage * D3D9SharedPSStages_Count + D3D9SharedPSStages_BumpEnvMat1, offset);
-      offset += sizeof(float) * 2;
-
-      spvModule.memberDecorateOffset(structType, stage * D3D9SharedPSStages_Count + D3D9SharedPSStages_BumpEnvLScale, offset);
-      offset += sizeof(float);
-
-      spvModule.memberDecorateOffset(structType, stage * D3D9SharedPSStages_Count + D3D9SharedPSStages_BumpEnvLOffset, offset);
-      offset += sizeof(float);
-
-      // Padding...
-      offset += sizeof(float) * 2;
-    }
-
-    uint32_t sharedState = spvModule.newVar(
-      spvModule.defPointerType(structType, spv::StorageClassUniform),
-      spv::StorageClassUniform);
-
-    spvModule.setDebugName(sharedState, "D3D9SharedPS");
-
-    return sharedState;
-  }
-
 
   enum class D3D9FFVSMembers {
     WorldViewMatrix,
@@ -517,6 +110,7 @@ namespace dxvk {
 
   enum D3D9FFPSMembers {
     TextureFactor = 0,
+    StageData,
 
     MemberCount
   };
@@ -541,6 +135,13 @@ namespace dxvk {
       uint32_t typeId;
       uint32_t varId;
       uint32_t bound;
+
+      // Uber shader only, indexed by the texture
+      // type stored in the texture stage states
+      struct {
+        uint32_t typeId;
+        uint32_t varId;
+      } variants[3];
     } samplers[8];
 
     struct {
@@ -562,7 +163,8 @@ namespace dxvk {
             Rc<DxvkDevice>           Device,
       const D3D9FFShaderKeyFS&       Key,
       const std::string&             Name,
-            D3D9FixedFunctionOptions Options);
+            D3D9FixedFunctionOptions Options,
+            bool                     Uber);
 
     Rc<DxvkShader> compile();
 
@@ -588,8 +190,27 @@ namespace dxvk {
 
     void compilePS();
 
+    void compileUberPS();
+
     void setupPS();
 
+    template <typename GetTextureFn>
+    uint32_t emitTextureOp(
+            D3DTEXTUREOP              op,
+            uint32_t                  dst,
+            std::array<uint32_t, TextureArgCount> arg,
+            uint32_t                  diffuse,
+            uint32_t                  current,
+      const GetTextureFn&             GetTexture);
+
+    uint32_t emitScalarReplicate(uint32_t reg);
+
+    uint32_t emitAlphaReplicate(uint32_t reg);
+
+    uint32_t emitComplement(uint32_t reg);
+
+    uint32_t emitSaturate(uint32_t reg);
+
     void emitPsSharedConstants();
 
     void emitVsClipping(uint32_t vtx);
@@ -610,6 +231,7 @@ namespace dxvk {
     DxsoProgramType       m_programType;
     D3D9FFShaderKeyVS     m_vsKey;
     D3D9FFShaderKeyFS     m_fsKey;
+    bool                  m_uber = false;
 
     D3D9FFVertexData      m_vs = { };
     D3D9FFPixelData       m_ps = { };
@@ -649,10 +271,12 @@ namespace dxvk {
           Rc<DxvkDevice>           Device,
     const D3D9FFShaderKeyFS&       Key,
     const std::string&             Name,
-          D3D9FixedFunctionOptions Options)
+          D3D9FixedFunctionOptions Options,
+          bool                     Uber)
   : m_module(spvVersion(1, 3)), m_options(Options) {
     m_programType = DxsoProgramTypes::PixelShader;
     m_fsKey    = Key;
+    m_uber     = Uber;
     m_filename = Name;
   }
 
@@ -693,6 +317,8 @@ namespace dxvk {
 
     if (isVS())
       compileVS();
+    else if (m_uber)
+      compileUberPS();
     else
       compilePS();
 
@@ -1542,6 +1168,192 @@ namespace dxvk {
   }
 
 
+  template <typename GetTextureFn>
+  uint32_t D3D9FFShaderCompiler::emitTextureOp(
+          D3DTEXTUREOP              op,
+          uint32_t                  dst,
+          std::array<uint32_t, TextureArgCount> arg,
+          uint32_t                  diffuse,
+          uint32_t                  current,
+    const GetTextureFn&             GetTexture) {
+    switch (op) {
+      case D3DTOP_SELECTARG1:
+        dst = arg[1];
+        break;
+
+      case D3DTOP_SELECTARG2:
+        dst = arg[2];
+        break;
+
+      case D3DTOP_MODULATE4X:
+        dst = m_module.opFMul(m_vec4Type, arg[1], arg[2]);
+        dst = m_module.opVectorTimesScalar(m_vec4Type, dst, m_module.constf32(4.0f));
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_MODULATE2X:
+        dst = m_module.opFMul(m_vec4Type, arg[1], arg[2]);
+        dst = m_module.opVectorTimesScalar(m_vec4Type, dst, m_module.constf32(2.0f));
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_MODULATE:
+        dst = m_module.opFMul(m_vec4Type, arg[1], arg[2]);
+        break;
+
+      case D3DTOP_ADDSIGNED2X:
+        arg[2] = m_module.opFSub(m_vec4Type, arg[2],
+          m_module.constvec4f32(0.5f, 0.5f, 0.5f, 0.5f));
+
+        dst = m_module.opFAdd(m_vec4Type, arg[1], arg[2]);
+        dst = m_module.opVectorTimesScalar(m_vec4Type, dst, m_module.constf32(2.0f));
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_ADDSIGNED:
+        arg[2] = m_module.opFSub(m_vec4Type, arg[2],
+          m_module.constvec4f32(0.5f, 0.5f, 0.5f, 0.5f));
+
+        dst = m_module.opFAdd(m_vec4Type, arg[1], arg[2]);
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_ADD:
+        dst = m_module.opFAdd(m_vec4Type, arg[1], arg[2]);
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_SUBTRACT:
+        dst = m_module.opFSub(m_vec4Type, arg[1], arg[2]);
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_ADDSMOOTH:
+        dst = m_module.opFFma(m_vec4Type, emitComplement(arg[1]), arg[2], arg[1]);
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_BLENDDIFFUSEALPHA:
+        dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], emitAlphaReplicate(diffuse));
+        break;
+
+      case D3DTOP_BLENDTEXTUREALPHA:
+        dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], emitAlphaReplicate(GetTexture()));
+        break;
+
+      case D3DTOP_BLENDFACTORALPHA:
+        dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], emitAlphaReplicate(m_ps.constants.textureFactor));
+        break;
+
+      case D3DTOP_BLENDTEXTUREALPHAPM:
+        dst = m_module.opFFma(m_vec4Type, arg[2], emitComplement(emitAlphaReplicate(GetTexture())), arg[1]);
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_BLENDCURRENTALPHA:
+        dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], emitAlphaReplicate(current));
+        break;
+
+      case D3DTOP_PREMODULATE:
+        Logger::warn("D3DTOP_PREMODULATE: not implemented");
+        break;
+
+      case D3DTOP_MODULATEALPHA_ADDCOLOR:
+        dst = m_module.opFFma(m_vec4Type, emitAlphaReplicate(arg[1]), arg[2], arg[1]);
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_MODULATECOLOR_ADDALPHA:
+        dst = m_module.opFFma(m_vec4Type, arg[1], arg[2], emitAlphaReplicate(arg[1]));
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_MODULATEINVALPHA_ADDCOLOR:
+        dst = m_module.opFFma(m_vec4Type, emitComplement(emitAlphaReplicate(arg[1])), arg[2], arg[1]);
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_MODULATEINVCOLOR_ADDALPHA:
+        dst = m_module.opFFma(m_vec4Type, emitComplement(arg[1]), arg[2], emitAlphaReplicate(arg[1]));
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_BUMPENVMAPLUMINANCE:
+      case D3DTOP_BUMPENVMAP:
+        // Load texture for the next stage...
+        GetTexture();
+        break;
+
+      case D3DTOP_DOTPRODUCT3: {
+        // Get vec3 of arg1 & 2
+        uint32_t vec3Type = m_module.defVectorType(m_floatType, 3);
+        std::array<uint32_t, 3> indices = { 0, 1, 2 };
+        arg[1] = m_module.opVectorShuffle(vec3Type, arg[1], arg[1], indices.size(), indices.data());
+        arg[2] = m_module.opVectorShuffle(vec3Type, arg[2], arg[2], indices.size(), indices.data());
+
+        // Bias according to spec.
+        arg[1] = m_module.opFSub(vec3Type, arg[1], m_module.constvec3f32(0.5f, 0.5f, 0.5f));
+        arg[2] = m_module.opFSub(vec3Type, arg[2], m_module.constvec3f32(0.5f, 0.5f, 0.5f));
+
+        // Do the dotting!
+        dst = m_module.opDot(m_floatType, arg[1], arg[2]);
+
+        // Multiply by 4 and replicate -> vec4
+        dst = m_module.opFMul(m_floatType, dst, m_module.constf32(4.0f));
+        dst = emitScalarReplicate(dst);
+
+        // Saturate
+        dst = emitSaturate(dst);
+
+        break;
+      }
+
+      case D3DTOP_MULTIPLYADD:
+        dst = m_module.opFFma(m_vec4Type, arg[1], arg[2], arg[0]);
+        dst = emitSaturate(dst);
+        break;
+
+      case D3DTOP_LERP:
+        dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], arg[0]);
+        break;
+
+      default:
+        Logger::warn("Unhandled texture op!");
+        break;
+    }
+
+    return dst;
+  }
+
+
+  uint32_t D3D9FFShaderCompiler::emitScalarReplicate(uint32_t reg) {
+    std::array<uint32_t, 4> replicant = { reg, reg, reg, reg };
+    return m_module.opCompositeConstruct(m_vec4Type, replicant.size(), replicant.data());
+  }
+
+
+  uint32_t D3D9FFShaderCompiler::emitAlphaReplicate(uint32_t reg) {
+    uint32_t alphaComponentId = 3;
+    uint32_t alpha = m_module.opCompositeExtract(m_floatType, reg, 1, &alphaComponentId);
+
+    return emitScalarReplicate(alpha);
+  }
+
+
+  uint32_t D3D9FFShaderCompiler::emitComplement(uint32_t reg) {
+    return m_module.opFSub(m_vec4Type,
+      m_module.constvec4f32(1.0f, 1.0f, 1.0f, 1.0f),
+      reg);
+  }
+
+
+  uint32_t D3D9FFShaderCompiler::emitSaturate(uint32_t reg) {
+    return m_module.opFClamp(m_vec4Type, reg,
+      m_module.constvec4f32(0.0f, 0.0f, 0.0f, 0.0f),
+      m_module.constvec4f32(1.0f, 1.0f, 1.0f, 1.0f));
+  }
+
+
   void D3D9FFShaderCompiler::compilePS() {
     setupPS();
 
@@ -1670,30 +1482,6 @@ namespace dxvk {
         return texture;
       };
 
-      auto ScalarReplicate = [&](uint32_t reg) {
-        std::array<uint32_t, 4> replicant = { reg, reg, reg, reg };
-        return m_module.opCompositeConstruct(m_vec4Type, replicant.size(), replicant.data());
-      };
-
-      auto AlphaReplicate = [&](uint32_t reg) {
-        uint32_t alphaComponentId = 3;
-        uint32_t alpha = m_module.opCompositeExtract(m_floatType, reg, 1, &alphaComponentId);
-
-        return ScalarReplicate(alpha);
-      };
-
-      auto Complement = [&](uint32_t reg) {
-        return m_module.opFSub(m_vec4Type,
-          m_module.constvec4f32(1.0f, 1.0f, 1.0f, 1.0f),
-          reg);
-      };
-
-      auto Saturate = [&](uint32_t reg) {
-        return m_module.opFClamp(m_vec4Type, reg,
-          m_module.constvec4f32(0.0f, 0.0f, 0.0f, 0.0f),
-          m_module.constvec4f32(1.0f, 1.0f, 1.0f, 1.0f));
-      };
-
       auto GetArg = [&] (uint32_t arg) {
         uint32_t reg = m_module.constvec4f32(1.0f, 1.0f, 1.0f, 1.0f);
 
@@ -1730,230 +1518,422 @@ namespace dxvk {
 
         // reg = 1 - reg
         if (arg & D3DTA_COMPLEMENT)
-          reg = Complement(reg);
+          reg = emitComplement(reg);
 
         // reg = reg.wwww
         if (arg & D3DTA_ALPHAREPLICATE)
-          reg = AlphaReplicate(reg);
+          reg = emitAlphaReplicate(reg);
 
         return reg;
       };
 
       auto DoOp = [&](D3DTEXTUREOP op, uint32_t dst, std::array<uint32_t, TextureArgCount> arg) {
-        switch (op) {
-          case D3DTOP_SELECTARG1:
-            dst = arg[1];
-            break;
-
-          case D3DTOP_SELECTARG2:
-            dst = arg[2];
-            break;
+        return emitTextureOp(op, dst, arg, diffuse, current, GetTexture);
+      };
 
-          case D3DTOP_MODULATE4X:
-            dst = m_module.opFMul(m_vec4Type, arg[1], arg[2]);
-            dst = m_module.opVectorTimesScalar(m_vec4Type, dst, m_module.constf32(4.0f));
-            dst = Saturate(dst);
-            break;
+      uint32_t& dst = stage.ResultIsTemp ? temp : current;
 
-          case D3DTOP_MODULATE2X:
-            dst = m_module.opFMul(m_vec4Type, arg[1], arg[2]);
-            dst = m_module.opVectorTimesScalar(m_vec4Type, dst, m_module.constf32(2.0f));
-            dst = Saturate(dst);
-            break;
+      D3DTEXTUREOP colorOp = (D3DTEXTUREOP)stage.ColorOp;
 
-          case D3DTOP_MODULATE:
-            dst = m_module.opFMul(m_vec4Type, arg[1], arg[2]);
-            break;
+      // This cancels all subsequent stages.
+      if (colorOp == D3DTOP_DISABLE)
+        break;
 
-          case D3DTOP_ADDSIGNED2X:
-            arg[2] = m_module.opFSub(m_vec4Type, arg[2],
-              m_module.constvec4f32(0.5f, 0.5f, 0.5f, 0.5f));
+      std::array<uint32_t, TextureArgCount> colorArgs = {
+          stage.ColorArg0,
+          stage.ColorArg1,
+          stage.ColorArg2};
 
-            dst = m_module.opFAdd(m_vec4Type, arg[1], arg[2]);
-            dst = m_module.opVectorTimesScalar(m_vec4Type, dst, m_module.constf32(2.0f));
-            dst = Saturate(dst);
-            break;
+      D3DTEXTUREOP alphaOp = (D3DTEXTUREOP)stage.AlphaOp;
+      std::array<uint32_t, TextureArgCount> alphaArgs = {
+          stage.AlphaArg0,
+          stage.AlphaArg1,
+          stage.AlphaArg2};
 
-          case D3DTOP_ADDSIGNED:
-            arg[2] = m_module.opFSub(m_vec4Type, arg[2],
-              m_module.constvec4f32(0.5f, 0.5f, 0.5f, 0.5f));
+      auto ProcessArgs = [&](auto op, auto& args) {
+        for (uint32_t& arg : args)
+          arg = GetArg(arg);
+      };
 
-            dst = m_module.opFAdd(m_vec4Type, arg[1], arg[2]);
-            dst = Saturate(dst);
-            break;
+      // Fast path if alpha/color path is identical.
+      // D3DTOP_DOTPRODUCT3 also has special quirky behaviour here.
+      const bool fastPath = colorOp == alphaOp && colorArgs == alphaArgs;
+      if (fastPath || colorOp == D3DTOP_DOTPRODUCT3) {
+        if (colorOp != D3DTOP_DISABLE) {
+          ProcessArgs(colorOp, colorArgs);
+          dst = DoOp(colorOp, dst, colorArgs);
+        }
+      }
+      else {
+        std::array<uint32_t, 4> indices = { 0, 1, 2, 4 + 3 };
 
-          case D3DTOP_ADD:
-            dst = m_module.opFAdd(m_vec4Type, arg[1], arg[2]);
-            dst = Saturate(dst);
-            break;
+        uint32_t colorResult = dst;
+        uint32_t alphaResult = dst;
+        if (colorOp != D3DTOP_DISABLE) {
+          ProcessArgs(colorOp, colorArgs);
+          colorResult = DoOp(colorOp, dst, colorArgs);
+        }
 
-          case D3DTOP_SUBTRACT:
-            dst = m_module.opFSub(m_vec4Type, arg[1], arg[2]);
-            dst = Saturate(dst);
-            break;
+        if (alphaOp != D3DTOP_DISABLE) {
+          ProcessArgs(alphaOp, alphaArgs);
+          alphaResult = DoOp(alphaOp, dst, alphaArgs);
+        }
 
-          case D3DTOP_ADDSMOOTH:
-            dst = m_module.opFFma(m_vec4Type, Complement(arg[1]), arg[2], arg[1]);
-            dst = Saturate(dst);
-            break;
+        // src0.x, src0.y, src0.z src1.w
+        if (colorResult != dst)
+          dst = m_module.opVectorShuffle(m_vec4Type, colorResult, dst, indices.size(), indices.data());
 
-          case D3DTOP_BLENDDIFFUSEALPHA:
-            dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], AlphaReplicate(diffuse));
-            break;
+        // src0.x, src0.y, src0.z src1.w
+        // But we flip src0, src1 to be inverse of color.
+        if (alphaResult != dst)
+          dst = m_module.opVectorShuffle(m_vec4Type, dst, alphaResult, indices.size(), indices.data());
+      }
+    }
 
-          case D3DTOP_BLENDTEXTUREALPHA:
-            dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], AlphaReplicate(GetTexture()));
-            break;
+    if (m_fsKey.Stages[0].Contents.GlobalSpecularEnable) {
+      uint32_t specular = m_module.opFMul(m_vec4Type, m_ps.in.COLOR[1], m_module.constvec4f32(1.0f, 1.0f, 1.0f, 0.0f));
 
-          case D3DTOP_BLENDFACTORALPHA:
-            dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], AlphaReplicate(m_ps.constants.textureFactor));
-            break;
+      current = m_module.opFAdd(m_vec4Type, current, specular);
+    }
 
-          case D3DTOP_BLENDTEXTUREALPHAPM:
-            dst = m_module.opFFma(m_vec4Type, arg[2], Complement(AlphaReplicate(GetTexture())), arg[1]);
-            dst = Saturate(dst);
-            break;
+    D3D9FogContext fogCtx;
+    fogCtx.IsPixel     = true;
+    fogCtx.RangeFog    = false;
+    fogCtx.RenderState = m_rsBlock;
+    fogCtx.vPos        = m_ps.in.POS;
+    fogCtx.vFog        = m_ps.in.FOG;
+    fogCtx.oColor      = current;
+    fogCtx.IsFixedFunction = true;
+    fogCtx.IsPositionT = false;
+    fogCtx.HasSpecular = false;
+    fogCtx.Specular    = 0;
+    current = DoFixedFunctionFog(m_module, fogCtx);
 
-          case D3DTOP_BLENDCURRENTALPHA:
-            dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], AlphaReplicate(current));
-            break;
+    m_module.opStore(m_ps.out.COLOR, current);
 
-          case D3DTOP_PREMODULATE:
-            Logger::warn("D3DTOP_PREMODULATE: not implemented");
-            break;
+    alphaTestPS();
+  }
 
-          case D3DTOP_MODULATEALPHA_ADDCOLOR:
-            dst = m_module.opFFma(m_vec4Type, AlphaReplicate(arg[1]), arg[2], arg[1]);
-            dst = Saturate(dst);
-            break;
+  void D3D9FFShaderCompiler::compileUberPS() {
+    setupPS();
 
-          case D3DTOP_MODULATECOLOR_ADDALPHA:
-            dst = m_module.opFFma(m_vec4Type, arg[1], arg[2], AlphaReplicate(arg[1]));
-            dst = Saturate(dst);
-            break;
+    uint32_t boolType  = m_module.defBoolType();
+    uint32_t bvec4Type = m_module.defVectorType(boolType, 4);
+    uint32_t uvec4Type = m_module.defVectorType(m_uint32Type, 4);
 
-          case D3DTOP_MODULATEINVALPHA_ADDCOLOR:
-            dst = m_module.opFFma(m_vec4Type, Complement(AlphaReplicate(arg[1])), arg[2], arg[1]);
-            dst = Saturate(dst);
-            break;
+    uint32_t diffuse  = m_ps.in.COLOR[0];
+    uint32_t specular = m_ps.in.COLOR[1];
 
-          case D3DTOP_MODULATEINVCOLOR_ADDALPHA:
-            dst = m_module.opFFma(m_vec4Type, Complement(arg[1]), arg[2], AlphaReplicate(arg[1]));
-            dst = Saturate(dst);
-            break;
+    auto SelectVec = [&](uint32_t cond, uint32_t a, uint32_t b) {
+      std::array<uint32_t, 4> conds = { cond, cond, cond, cond };
+      uint32_t cond4 = m_module.opCompositeConstruct(bvec4Type, conds.size(), conds.data());
+      return m_module.opSelect(m_vec4Type, cond4, a, b);
+    };
 
-          case D3DTOP_BUMPENVMAPLUMINANCE:
-          case D3DTOP_BUMPENVMAP:
-            // Load texture for the next stage...
-            texture = GetTexture();
-            break;
+    auto IsEqual = [&](uint32_t value, uint32_t literal) {
+      return m_module.opIEqual(boolType, value, m_module.constu32(literal));
+    };
 
-          case D3DTOP_DOTPRODUCT3: {
-            // Get vec3 of arg1 & 2
-            uint32_t vec3Type = m_module.defVectorType(m_floatType, 3);
-            std::array<uint32_t, 3> indices = { 0, 1, 2 };
-            arg[1] = m_module.opVectorShuffle(vec3Type, arg[1], arg[1], indices.size(), indices.data());
-            arg[2] = m_module.opVectorShuffle(vec3Type, arg[2], arg[2], indices.size(), indices.data());
+    auto HasBits = [&](uint32_t value, uint32_t mask) {
+      return m_module.opINotEqual(boolType,
+        m_module.opBitwiseAnd(m_uint32Type, value, m_module.constu32(mask)),
+        m_module.constu32(0));
+    };
 
-            // Bias according to spec.
-            arg[1] = m_module.opFSub(vec3Type, arg[1], m_module.constvec3f32(0.5f, 0.5f, 0.5f));
-            arg[2] = m_module.opFSub(vec3Type, arg[2], m_module.constvec3f32(0.5f, 0.5f, 0.5f));
+    // Decodes one byte of the packed stage data,
+    // see PackFFShaderKeyFS for the layout.
+    auto GetField = [&](uint32_t stageData, uint32_t component, uint32_t byte) {
+      uint32_t value = m_module.opCompositeExtract(m_uint32Type, stageData, 1, &component);
+      return m_module.opBitFieldUExtract(m_uint32Type, value,
+        m_module.consti32(byte * 8), m_module.consti32(8));
+    };
 
-            // Do the dotting!
-            dst = m_module.opDot(m_floatType, arg[1], arg[2]);
+    auto LoadShared = [&](uint32_t type, uint32_t stage, D3D9SharedPSStages member) {
+      uint32_t offset = m_module.constu32(D3D9SharedPSStages_Count * stage + member);
+      uint32_t ptr    = m_module.opAccessChain(m_module.defPointerType(type, spv::StorageClassUniform),
+        m_ps.sharedState, 1, &offset);
+      return m_module.opLoad(type, ptr);
+    };
 
-            // Multiply by 4 and replicate -> vec4
-            dst = m_module.opFMul(m_floatType, dst, m_module.constf32(4.0f));
-            dst = ScalarReplicate(dst);
+    // Stage results are only known at runtime, so
+    // keep them in variables rather than SSA values.
+    uint32_t vec4Ptr = m_module.defPointerType(m_vec4Type, spv::StorageClassPrivate);
 
-            // Saturate
-            dst = Saturate(dst);
+    uint32_t currentVar = m_module.newVar(vec4Ptr, spv::StorageClassPrivate);
+    uint32_t tempVar    = m_module.newVar(vec4Ptr, spv::StorageClassPrivate);
+    uint32_t textureVar = m_module.newVar(vec4Ptr, spv::StorageClassPrivate);
 
-            break;
-          }
+    m_module.setDebugName(currentVar, "current");
+    m_module.setDebugName(tempVar,    "temp");
+    m_module.setDebugName(textureVar, "texture");
 
-          case D3DTOP_MULTIPLYADD:
-            dst = m_module.opFFma(m_vec4Type, arg[1], arg[2], arg[0]);
-            dst = Saturate(dst);
-            break;
+    m_module.opStore(currentVar, diffuse);
+    m_module.opStore(tempVar,    m_module.constvec4f32(0.0f, 0.0f, 0.0f, 0.0f));
+    m_module.opStore(textureVar, m_module.constvec4f32(0.0f, 0.0f, 0.0f, 1.0f));
 
-          case D3DTOP_LERP:
-            dst = m_module.opFMix(m_vec4Type, arg[2], arg[1], arg[0]);
-            break;
+    uint32_t stage0Data  = 0;
+    uint32_t prevColorOp = 0;
+    uint32_t enabled     = m_module.constBool(true);
 
-          default:
-            Logger::warn("Unhandled texture op!");
-            break;
-        }
+    for (uint32_t i = 0; i < caps::TextureStageCount; i++) {
+      std::array<uint32_t, 2> stageIndices = {
+        m_module.constu32(uint32_t(D3D9FFPSMembers::StageData)),
+        m_module.constu32(i) };
 
-        return dst;
-      };
+      uint32_t stageData = m_module.opLoad(uvec4Type,
+        m_module.opAccessChain(m_module.defPointerType(uvec4Type, spv::StorageClassUniform),
+          m_ps.constantBuffer, stageIndices.size(), stageIndices.data()));
 
-      uint32_t& dst = stage.ResultIsTemp ? temp : current;
+      if (i == 0)
+        stage0Data = stageData;
 
-      D3DTEXTUREOP colorOp = (D3DTEXTUREOP)stage.ColorOp;
+      uint32_t colorOp = GetField(stageData, 0, 0);
+      uint32_t alphaOp = GetField(stageData, 1, 0);
 
-      // This cancels all subsequent stages.
-      if (colorOp == D3DTOP_DISABLE)
-        break;
+      // A disabled stage cancels all subsequent stages.
+      enabled = m_module.opLogicalAnd(boolType, enabled,
+        m_module.opINotEqual(boolType, colorOp, m_module.constu32(D3DTOP_DISABLE)));
 
-      std::array<uint32_t, TextureArgCount> colorArgs = {
-          stage.ColorArg0,
-          stage.ColorArg1,
-          stage.ColorArg2};
+      uint32_t stageLabel = m_module.allocateId();
+      uint32_t skipLabel  = m_module.allocateId();
 
-      D3DTEXTUREOP alphaOp = (D3DTEXTUREOP)stage.AlphaOp;
-      std::array<uint32_t, TextureArgCount> alphaArgs = {
-          stage.AlphaArg0,
-          stage.AlphaArg1,
-          stage.AlphaArg2};
+      m_module.opSelectionMerge(skipLabel, spv::SelectionControlMaskNone);
+      m_module.opBranchConditional(enabled, stageLabel, skipLabel);
+      m_module.opLabel(stageLabel);
 
-      auto ProcessArgs = [&](auto op, auto& args) {
-        for (uint32_t& arg : args)
-          arg = GetArg(arg);
-      };
+      uint32_t current = m_module.opLoad(m_vec4Type, currentVar);
+      uint32_t temp    = m_module.opLoad(m_vec4Type, tempVar);
+      uint32_t texture = m_module.opLoad(m_vec4Type, textureVar);
 
-      // Fast path if alpha/color path is identical.
-      // D3DTOP_DOTPRODUCT3 also has special quirky behaviour here.
-      const bool fastPath = colorOp == alphaOp && colorArgs == alphaArgs;
-      if (fastPath || colorOp == D3DTOP_DOTPRODUCT3) {
-        if (colorOp != D3DTOP_DISABLE) {
-          ProcessArgs(colorOp, colorArgs);
-          dst = DoOp(colorOp, dst, colorArgs);
+      // Compute texture coordinates. Projection is done manually
+      // since the number of coordinates depends on the texture type.
+      uint32_t type      = GetField(stageData, 2, 0);
+      uint32_t projected = m_module.opINotEqual(boolType, GetField(stageData, 2, 2), m_module.constu32(0));
+      uint32_t projCount = GetField(stageData, 2, 3);
+
+      uint32_t projIdx = m_module.opSelect(m_uint32Type, IsEqual(projCount, 0),
+        m_module.constu32(3), m_module.opISub(m_uint32Type, projCount, m_module.constu32(1)));
+      projIdx = m_module.opUMin(m_uint32Type, projIdx, m_module.constu32(3));
+
+      uint32_t texcoord  = m_ps.in.TEXCOORD[i];
+      uint32_t projValue = m_module.opVectorExtractDynamic(m_floatType, texcoord, projIdx);
+      uint32_t projScale = m_module.opSelect(m_floatType, projected,
+        m_module.opFDiv(m_floatType, m_module.constf32(1.0f), projValue),
+        m_module.constf32(1.0f));
+
+      texcoord = m_module.opVectorTimesScalar(m_vec4Type, texcoord, projScale);
+
+      uint32_t isBumpLum = 0;
+
+      if (i != 0) {
+        uint32_t isBump = m_module.opLogicalOr(boolType,
+          IsEqual(prevColorOp, D3DTOP_BUMPENVMAP),
+          IsEqual(prevColorOp, D3DTOP_BUMPENVMAPLUMINANCE));
+
+        isBumpLum = IsEqual(prevColorOp, D3DTOP_BUMPENVMAPLUMINANCE);
+
+        std::array<uint32_t, 2> indices = { 0, 1 };
+        uint32_t t = m_module.opVectorShuffle(m_vec2Type, texture, texture, indices.size(), indices.data());
+
+        uint32_t bumped = texcoord;
+
+        for (uint32_t j = 0; j < 2; j++) {
+          uint32_t bm = LoadShared(m_vec2Type, i - 1, D3D9SharedPSStages(D3D9SharedPSStages_BumpEnvMat0 + j));
+          uint32_t tc = m_module.opCompositeExtract(m_floatType, bumped, 1, &j);
+                   tc = m_module.opFAdd(m_floatType, tc, m_module.opDot(m_floatType, bm, t));
+          bumped = m_module.opCompositeInsert(m_vec4Type, tc, bumped, 1, &j);
         }
+
+        texcoord = SelectVec(isBump, bumped, texcoord);
       }
-      else {
-        std::array<uint32_t, 4> indices = { 0, 1, 2, 4 + 3 };
 
-        uint32_t colorResult = dst;
-        uint32_t alphaResult = dst;
-        if (colorOp != D3DTOP_DISABLE) {
-          ProcessArgs(colorOp, colorArgs);
-          colorResult = DoOp(colorOp, dst, colorArgs);
-        }
+      // Sample the texture with the sampler matching its type
+      std::array<SpirvSwitchCaseLabel, 3> typeLabels;
+      std::array<SpirvPhiLabel, 3> typeResults;
 
-        if (alphaOp != D3DTOP_DISABLE) {
-          ProcessArgs(alphaOp, alphaArgs);
-          alphaResult = DoOp(alphaOp, dst, alphaArgs);
+      for (uint32_t j = 0; j < typeLabels.size(); j++)
+        typeLabels[j] = { j, m_module.allocateId() };
+
+      uint32_t typeMergeLabel = m_module.allocateId();
+
+      m_module.opSelectionMerge(typeMergeLabel, spv::SelectionControlMaskNone);
+      m_module.opSwitch(type,
+        typeLabels[0].labelId,
+        typeLabels.size(),
+        typeLabels.data());
+
+      for (uint32_t j = 0; j < typeLabels.size(); j++) {
+        const auto& variant = m_ps.samplers[i].variants[j];
+
+        m_module.opLabel(typeLabels[j].labelId);
+
+        uint32_t coordCount = D3DRESOURCETYPE(j + D3DRTYPE_TEXTURE) == D3DRTYPE_TEXTURE ? 2 : 3;
+
+        std::array<uint32_t, 3> indices = { 0, 1, 2 };
+        uint32_t coords = m_module.opVectorShuffle(m_module.defVectorType(m_floatType, coordCount),
+          texcoord, texcoord, coordCount, indices.data());
+
+        typeResults[j].varId = m_module.opImageSampleImplicitLod(m_vec4Type,
+          m_module.opLoad(variant.typeId, variant.varId), coords, SpirvImageOperands());
+        typeResults[j].labelId = typeLabels[j].labelId;
+
+        m_module.opBranch(typeMergeLabel);
+      }
+
+      m_module.opLabel(typeMergeLabel);
+
+      texture = m_module.opPhi(m_vec4Type, typeResults.size(), typeResults.data());
+
+      if (i != 0) {
+        uint32_t lScale  = LoadShared(m_floatType, i - 1, D3D9SharedPSStages_BumpEnvLScale);
+        uint32_t lOffset = LoadShared(m_floatType, i - 1, D3D9SharedPSStages_BumpEnvLOffset);
+
+        uint32_t zIndex = 2;
+        uint32_t scale = m_module.opCompositeExtract(m_floatType, texture, 1, &zIndex);
+                 scale = m_module.opFMul(m_floatType, scale, lScale);
+                 scale = m_module.opFAdd(m_floatType, scale, lOffset);
+                 scale = m_module.opFClamp(m_floatType, scale, m_module.constf32(0.0f), m_module.constf32(1.0));
+
+        texture = SelectVec(isBumpLum, m_module.opVectorTimesScalar(m_vec4Type, texture, scale), texture);
+      }
+
+      texture = SelectVec(m_ps.samplers[i].bound, texture, m_module.constvec4f32(0.0f, 0.0f, 0.0f, 1.0f));
+      m_module.opStore(textureVar, texture);
+
+      // Select arguments at runtime
+      uint32_t constant = LoadShared(m_vec4Type, i, D3D9SharedPSStages_Constant);
+
+      std::array<std::pair<uint32_t, uint32_t>, 7> sources = {{
+        { D3DTA_CONSTANT, constant },
+        { D3DTA_CURRENT,  current  },
+        { D3DTA_DIFFUSE,  diffuse  },
+        { D3DTA_SPECULAR, specular },
+        { D3DTA_TEMP,     temp     },
+        { D3DTA_TEXTURE,  texture  },
+        { D3DTA_TFACTOR,  m_ps.constants.textureFactor },
+      }};
+
+      auto GetArg = [&] (uint32_t arg) {
+        uint32_t select = m_module.opBitwiseAnd(m_uint32Type, arg, m_module.constu32(D3DTA_SELECTMASK));
+        uint32_t reg = m_module.constvec4f32(1.0f, 1.0f, 1.0f, 1.0f);
+
+        for (const auto& source : sources)
+          reg = SelectVec(IsEqual(select, source.first), source.second, reg);
+
+        // reg = 1 - reg
+        reg = SelectVec(HasBits(arg, D3DTA_COMPLEMENT), emitComplement(reg), reg);
+
+        // reg = reg.wwww
+        reg = SelectVec(HasBits(arg, D3DTA_ALPHAREPLICATE), emitAlphaReplicate(reg), reg);
+
+        return reg;
+      };
+
+      auto DoOp = [&](uint32_t op, uint32_t dst, std::array<uint32_t, TextureArgCount> arg) {
+        static constexpr std::array<D3DTEXTUREOP, 22> ops = {
+          D3DTOP_SELECTARG1,
+          D3DTOP_SELECTARG2,
+          D3DTOP_MODULATE,
+          D3DTOP_MODULATE2X,
+          D3DTOP_MODULATE4X,
+          D3DTOP_ADD,
+          D3DTOP_ADDSIGNED,
+          D3DTOP_ADDSIGNED2X,
+          D3DTOP_SUBTRACT,
+          D3DTOP_ADDSMOOTH,
+          D3DTOP_BLENDDIFFUSEALPHA,
+          D3DTOP_BLENDTEXTUREALPHA,
+          D3DTOP_BLENDFACTORALPHA,
+          D3DTOP_BLENDTEXTUREALPHAPM,
+          D3DTOP_BLENDCURRENTALPHA,
+          D3DTOP_MODULATEALPHA_ADDCOLOR,
+          D3DTOP_MODULATECOLOR_ADDALPHA,
+          D3DTOP_MODULATEINVALPHA_ADDCOLOR,
+          D3DTOP_MODULATEINVCOLOR_ADDALPHA,
+          D3DTOP_DOTPRODUCT3,
+          D3DTOP_MULTIPLYADD,
+          D3DTOP_LERP,
+        };
+
+        // Any other op, including the bump mapping ops whose
+        // texture has already been sampled, leaves dst as-is.
+        std::array<SpirvSwitchCaseLabel, ops.size()> opLabels;
+        std::array<SpirvPhiLabel, ops.size() + 1> opResults;
+
+        for (uint32_t j = 0; j < ops.size(); j++)
+          opLabels[j] = { uint32_t(ops[j]), m_module.allocateId() };
+
+        uint32_t defaultLabel = m_module.allocateId();
+        uint32_t mergeLabel   = m_module.allocateId();
+
+        m_module.opSelectionMerge(mergeLabel, spv::SelectionControlMaskNone);
+        m_module.opSwitch(op, defaultLabel, opLabels.size(), opLabels.data());
+
+        for (uint32_t j = 0; j < ops.size(); j++) {
+          m_module.opLabel(opLabels[j].labelId);
+
+          opResults[j].varId   = emitTextureOp(ops[j], dst, arg, diffuse, current, [texture] { return texture; });
+          opResults[j].labelId = opLabels[j].labelId;
+
+          m_module.opBranch(mergeLabel);
         }
 
-        // src0.x, src0.y, src0.z src1.w
-        if (colorResult != dst)
-          dst = m_module.opVectorShuffle(m_vec4Type, colorResult, dst, indices.size(), indices.data());
+        m_module.opLabel(defaultLabel);
+        opResults[ops.size()] = { dst, defaultLabel };
+        m_module.opBranch(mergeLabel);
 
-        // src0.x, src0.y, src0.z src1.w
-        // But we flip src0, src1 to be inverse of color.
-        if (alphaResult != dst)
-          dst = m_module.opVectorShuffle(m_vec4Type, dst, alphaResult, indices.size(), indices.data());
+        m_module.opLabel(mergeLabel);
+        return m_module.opPhi(m_vec4Type, opResults.size(), opResults.data());
+      };
+
+      std::array<uint32_t, TextureArgCount> colorArgs;
+      std::array<uint32_t, TextureArgCount> alphaArgs;
+
+      for (uint32_t j = 0; j < TextureArgCount; j++) {
+        colorArgs[j] = GetArg(GetField(stageData, 0, j + 1));
+        alphaArgs[j] = GetArg(GetField(stageData, 1, j + 1));
       }
-    }
 
-    if (m_fsKey.Stages[0].Contents.GlobalSpecularEnable) {
-      uint32_t specular = m_module.opFMul(m_vec4Type, m_ps.in.COLOR[1], m_module.constvec4f32(1.0f, 1.0f, 1.0f, 0.0f));
+      uint32_t isTemp = m_module.opINotEqual(boolType, GetField(stageData, 2, 1), m_module.constu32(0));
+      uint32_t dst    = SelectVec(isTemp, temp, current);
 
-      current = m_module.opFAdd(m_vec4Type, current, specular);
+      uint32_t colorResult = DoOp(colorOp, dst, colorArgs);
+      uint32_t alphaResult = DoOp(alphaOp, dst, alphaArgs);
+
+      // Color ops write all components if the alpha path is
+      // identical. D3DTOP_DOTPRODUCT3 also has special quirky
+      // behaviour here, see compilePS.
+      uint32_t colorWord = 0;
+      uint32_t alphaWord = 1;
+
+      uint32_t fullColor = m_module.opLogicalOr(boolType,
+        m_module.opIEqual(boolType,
+          m_module.opCompositeExtract(m_uint32Type, stageData, 1, &colorWord),
+          m_module.opCompositeExtract(m_uint32Type, stageData, 1, &alphaWord)),
+        IsEqual(colorOp, D3DTOP_DOTPRODUCT3));
+
+      // src0.x, src0.y, src0.z src1.w
+      std::array<uint32_t, 4> indices = { 0, 1, 2, 4 + 3 };
+      uint32_t result = m_module.opVectorShuffle(m_vec4Type,
+        colorResult, alphaResult, indices.size(), indices.data());
+      result = SelectVec(fullColor, colorResult, result);
+
+      m_module.opStore(tempVar,    SelectVec(isTemp, result, temp));
+      m_module.opStore(currentVar, SelectVec(isTemp, current, result));
+
+      m_module.opBranch(skipLabel);
+      m_module.opLabel(skipLabel);
+
+      prevColorOp = colorOp;
     }
 
+    uint32_t current = m_module.opLoad(m_vec4Type, currentVar);
+
+    uint32_t specularEnable = m_module.opINotEqual(boolType, GetField(stage0Data, 3, 0), m_module.constu32(0));
+    uint32_t specularColor  = m_module.opFMul(m_vec4Type, specular, m_module.constvec4f32(1.0f, 1.0f, 1.0f, 0.0f));
+
+    current = SelectVec(specularEnable, m_module.opFAdd(m_vec4Type, current, specularColor), current);
+
     D3D9FogContext fogCtx;
     fogCtx.IsPixel     = true;
     fogCtx.RangeFog    = false;
@@ -1972,6 +1952,7 @@ namespace dxvk {
     alphaTestPS();
   }
 
+
   void D3D9FFShaderCompiler::setupPS() {
     setupRenderStateInfo();
 
@@ -2000,23 +1981,26 @@ namespace dxvk {
     m_ps.out.COLOR   = declareIO(false, DxsoSemantic{ DxsoUsage::Color, 0 });
 
     // Constant Buffer for PS.
+    uint32_t stageDataType = m_module.defArrayTypeUnique(
+      m_module.defVectorType(m_uint32Type, 4),
+      m_module.constu32(caps::TextureStageCount));
+    m_module.decorateArrayStride(stageDataType, sizeof(uint32_t) * 4);
+
     std::array<uint32_t, uint32_t(D3D9FFPSMembers::MemberCount)> members = {
-      m_vec4Type // Texture Factor
+      m_vec4Type,   // Texture Factor
+      stageDataType // Stage Data
     };
 
     const uint32_t structType =
       m_module.defStructType(members.size(), members.data());
 
     m_module.decorateBlock(structType);
-    uint32_t offset = 0;
-
-    for (uint32_t i = 0; i < uint32_t(D3D9FFPSMembers::MemberCount); i++) {
-      m_module.memberDecorateOffset(structType, i, offset);
-      offset += sizeof(Vector4);
-    }
+    m_module.memberDecorateOffset(structType, 0, offsetof(D3D9FixedFunctionPS, textureFactor));
+    m_module.memberDecorateOffset(structType, 1, offsetof(D3D9FixedFunctionPS, stages));
 
     m_module.setDebugName(structType, "D3D9FixedFunctionPS");
     m_module.setDebugMemberName(structType, 0, "textureFactor");
+    m_module.setDebugMemberName(structType, 1, "stages");
 
     m_ps.constantBuffer = m_module.newVar(
       m_module.defPointerType(structType, spv::StorageClassUniform),
@@ -2050,58 +2034,77 @@ namespace dxvk {
     m_ps.constants.textureFactor = LoadConstant(m_vec4Type, uint32_t(D3D9FFPSMembers::TextureFactor));
 
     // Samplers
-    for (uint32_t i = 0; i < caps::TextureStageCount; i++) {
-      auto& sampler = m_ps.samplers[i];
-      D3DRESOURCETYPE type = D3DRESOURCETYPE(m_fsKey.Stages[i].Contents.Type + D3DRTYPE_TEXTURE);
-
+    auto DeclareSampler = [&](uint32_t idx, D3DRESOURCETYPE type, uint32_t bindingId, uint32_t* pTypeId, VkImageViewType* pViewType) {
       spv::Dim dimensionality;
-      VkImageViewType viewType;
 
       switch (type) {
         default:
         case D3DRTYPE_TEXTURE:
           dimensionality = spv::Dim2D;
-          sampler.texcoordCnt = 2;
-          viewType       = VK_IMAGE_VIEW_TYPE_2D;
+          *pViewType     = VK_IMAGE_VIEW_TYPE_2D;
           break;
         case D3DRTYPE_CUBETEXTURE:
           dimensionality = spv::DimCube;
-          sampler.texcoordCnt = 3;
-          viewType       = VK_IMAGE_VIEW_TYPE_CUBE;
+          *pViewType     = VK_IMAGE_VIEW_TYPE_CUBE;
           break;
         case D3DRTYPE_VOLUMETEXTURE:
           dimensionality = spv::Dim3D;
-          sampler.texcoordCnt = 3;
-          viewType       = VK_IMAGE_VIEW_TYPE_3D;
+          *pViewType     = VK_IMAGE_VIEW_TYPE_3D;
           break;
       }
 
-      sampler.typeId = m_module.defImageType(
+      uint32_t typeId = m_module.defImageType(
         m_module.defFloatType(32),
         dimensionality, 0, 0, 0, 1,
         spv::ImageFormatUnknown);
 
-      sampler.typeId = m_module.defSampledImageType(sampler.typeId);
+      typeId = m_module.defSampledImageType(typeId);
 
-      sampler.varId = m_module.newVar(
+      uint32_t varId = m_module.newVar(
         m_module.defPointerType(
-          sampler.typeId, spv::StorageClassUniformConstant),
+          typeId, spv::StorageClassUniformConstant),
         spv::StorageClassUniformConstant);
 
-      std::string name = str::format("s", i);
-      m_module.setDebugName(sampler.varId, name.c_str());
+      std::string name = str::format("s", idx);
+      m_module.setDebugName(varId, name.c_str());
+
+      m_module.decorateDescriptorSet(varId, 0);
+      m_module.decorateBinding(varId, bindingId);
+
+      *pTypeId = typeId;
+      return varId;
+    };
+
+    for (uint32_t i = 0; i < caps::TextureStageCount; i++) {
+      auto& sampler = m_ps.samplers[i];
+      D3DRESOURCETYPE type = D3DRESOURCETYPE(m_fsKey.Stages[i].Contents.Type + D3DRTYPE_TEXTURE);
+
+      sampler.texcoordCnt = type == D3DRTYPE_TEXTURE ? 2 : 3;
 
       const uint32_t bindingId = computeResourceSlotId(DxsoProgramType::PixelShader,
         DxsoBindingType::Image, i);
 
+      VkImageViewType viewType;
+
+      if (!m_uber) {
+        sampler.varId = DeclareSampler(i, type, bindingId, &sampler.typeId, &viewType);
+      } else {
+        // The texture type is only known at draw time, so
+        // declare one sampler for each type and let the
+        // view type of the bound image decide.
+        for (uint32_t j = 0; j < std::size(sampler.variants); j++) {
+          auto& variant = sampler.variants[j];
+          variant.varId = DeclareSampler(i, D3DRESOURCETYPE(j + D3DRTYPE_TEXTURE), bindingId, &variant.typeId, &viewType);
+        }
+
+        viewType = VK_IMAGE_VIEW_TYPE_MAX_ENUM;
+      }
+
       sampler.bound = m_module.specConstBool(true);
       m_module.decorateSpecId(sampler.bound, bindingId);
       m_module.setDebugName(sampler.bound,
         str::format("s", i, "_bound").c_str());
 
-      m_module.decorateDescriptorSet(sampler.varId, 0);
-      m_module.decorateBinding(sampler.varId, bindingId);
-
       // Store descriptor info for the shader interface
       DxvkResourceSlot resource;
       resource.slot   = bindingId;
@@ -2331,16 +2334,27 @@ namespace dxvk {
 
   D3D9FFShader::D3D9FFShader(
           D3D9DeviceEx*         pDevice,
-    const D3D9FFShaderKeyFS&    Key) {
-    Sha1Hash hash = Sha1Hash::compute(&Key, sizeof(Key));
+    const D3D9FFShaderKeyFS&    Key,
+          bool                  Uber) {
+    // Uber shaders must not share keys with specialized
+    // shaders, so hash a prefix along with the key.
+    static const char uberPrefix[] = "UBER";
+
+    std::array<Sha1Data, 2> hashData = {{
+      { uberPrefix, Uber ? sizeof(uberPrefix) : 0 },
+      { &Key,       sizeof(Key)                   },
+    }};
+
+    Sha1Hash hash = Sha1Hash::compute(hashData.size(), hashData.data());
     DxvkShaderKey shaderKey = { VK_SHADER_STAGE_FRAGMENT_BIT, hash };
 
-    std::string name = str::format("FF_", shaderKey.toString());
+    std::string name = str::format(Uber ? "FF_UBER_" : "FF_", shaderKey.toString());
 
     D3D9FFShaderCompiler compiler(
       pDevice->GetDXVKDevice(),
       Key, name,
-      pDevice->GetOptions());
+      pDevice->GetOptions(),
+      Uber);
 
     m_shader = compiler.compile();
     m_isgn   = compiler.isgn();
@@ -2365,6 +2379,229 @@ namespace dxvk {
   }
 
 
+  /**
+   * \brief Fixed-function shader cache header
+   *
+   * Key sizes are stored so that changes to the
+   * key layout invalidate existing cache files.
+   */
+  struct D3D9FFShaderCacheHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t vsKeySize;
+    uint32_t fsKeySize;
+  };
+
+  constexpr uint32_t D3D9FFShaderCacheVersion = 1;
+
+
+  static D3D9FFShaderCacheHeader GetFFShaderCacheHeader() {
+    D3D9FFShaderCacheHeader header;
+    std::memcpy(header.magic, "D9FF", 4);
+    header.version   = D3D9FFShaderCacheVersion;
+    header.vsKeySize = sizeof(D3D9FFShaderKeyVS);
+    header.fsKeySize = sizeof(D3D9FFShaderKeyFS);
+    return header;
+  }
+
+
+  template <typename T>
+  static bool ReadFFShaderCacheData(std::istream& Stream, T* pData) {
+    return bool(Stream.read(reinterpret_cast<char*>(pData), sizeof(T)));
+  }
+
+
+  D3D9FFShaderModuleSet::D3D9FFShaderModuleSet() {
+
+  }
+
+
+  D3D9FFShaderModuleSet::~D3D9FFShaderModuleSet() {
+
+  }
+
+
+  void D3D9FFShaderModuleSet::InitShaderCache(
+          D3D9DeviceEx*         pDevice) {
+    if (env::getEnvVar("DXVK_STATE_CACHE") == "0"
+     || !pDevice->GetDXVKDevice()->config().enableStateCache)
+      return;
+
+    std::string dir  = env::getEnvVar("DXVK_STATE_CACHE_PATH");
+    std::string path = dir;
+
+    if (!path.empty() && *path.rbegin() != '/')
+      path += '/';
+
+    path += env::getExeBaseName() + ".dxvk-ff-cache";
+
+    std::wstring fileName = str::tows(path.c_str());
+
+    // Uber shaders do not depend on any stage states, so create
+    // them right away in order for their pipelines to get built
+    if (pDevice->GetOptions()->ffUberShader) {
+      for (uint32_t flatShade = 0; flatShade < 2; flatShade++) {
+        D3D9FFShaderKeyFS key;
+        key.Stages[0].Contents.GlobalFlatShade = flatShade;
+        GetUberShaderModule(pDevice, key);
+      }
+    }
+
+    // Recreate all shaders from the cache file. Constructing
+    // the shaders registers them with the state cache, which
+    // then compiles all pipelines that use them.
+    D3D9FFShaderCacheHeader expected = GetFFShaderCacheHeader();
+    D3D9FFShaderCacheHeader header;
+
+    std::ifstream ifile(fileName.c_str(), std::ios_base::binary);
+
+    // A file without a complete header is either new or still
+    // being created by another process, so only append to it.
+    bool hasHeader = ifile && ReadFFShaderCacheData(ifile, &header);
+
+    if (hasHeader && std::memcmp(&header, &expected, sizeof(header))) {
+      Logger::warn(str::format("D3D9FFShaderModuleSet: ", path,
+        " was created by a different version, not using it"));
+      return;
+    }
+
+    uint32_t shaderCount = 0;
+    bool     corrupted   = false;
+
+    // Specialized fragment shaders are never used with the uber
+    // shader, so don't compile them, but keep them in the file.
+    const bool uberShader = pDevice->GetOptions()->ffUberShader;
+
+    std::vector<D3D9FFShaderKeyFS> skippedFsKeys;
+
+    while (hasHeader) {
+      uint32_t stage;
+      Sha1Hash hash;
+
+      if (!ReadFFShaderCacheData(ifile, &stage))
+        break;
+
+      if (!ReadFFShaderCacheData(ifile, &hash)) {
+        corrupted = true;
+        break;
+      }
+
+      if (stage == VK_SHADER_STAGE_VERTEX_BIT) {
+        D3D9FFShaderKeyVS key;
+
+        if (!ReadFFShaderCacheData(ifile, &key) || Sha1Hash::compute(key) != hash) {
+          corrupted = true;
+          break;
+        }
+
+        if (m_vsModules.find(key) != m_vsModules.end())
+          continue;
+
+        m_vsModules.insert({ key, D3D9FFShader(pDevice, key) });
+      } else if (stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+        D3D9FFShaderKeyFS key;
+
+        if (!ReadFFShaderCacheData(ifile, &key) || Sha1Hash::compute(key) != hash) {
+          corrupted = true;
+          break;
+        }
+
+        if (uberShader) {
+          skippedFsKeys.push_back(key);
+          continue;
+        }
+
+        if (m_fsModules.find(key) != m_fsModules.end())
+          continue;
+
+        m_fsModules.insert({ key, D3D9FFShader(pDevice, key) });
+      } else {
+        corrupted = true;
+        break;
+      }
+
+      shaderCount += 1;
+    }
+
+    ifile.close();
+
+    if (shaderCount) {
+      Logger::info(str::format("D3D9FFShaderModuleSet: Loaded ",
+        shaderCount, " fixed-function shaders from ", path));
+    }
+
+    // Entries following a corrupted one would never be read
+    // again, so write all valid entries to a new file and move
+    // it into place. The file itself is only ever appended to,
+    // since another process may be writing to it at the same time.
+    if (corrupted) {
+      Logger::warn(str::format("D3D9FFShaderModuleSet: Corrupted cache file ", path, ", rewriting"));
+
+      std::wstring tmpName = str::tows(str::format(path, ".", ::GetCurrentProcessId(), ".tmp").c_str());
+
+      m_cacheFile = std::ofstream(tmpName.c_str(), std::ios_base::binary | std::ios_base::trunc);
+      m_cacheFile.write(reinterpret_cast<const char*>(&expected), sizeof(expected));
+
+      for (const auto& entry : m_vsModules)
+        WriteCacheEntry(VK_SHADER_STAGE_VERTEX_BIT, entry.first);
+
+      for (const auto& entry : m_fsModules)
+        WriteCacheEntry(VK_SHADER_STAGE_FRAGMENT_BIT, entry.first);
+
+      for (const auto& key : skippedFsKeys)
+        WriteCacheEntry(VK_SHADER_STAGE_FRAGMENT_BIT, key);
+
+      bool written = bool(m_cacheFile);
+      m_cacheFile = std::ofstream();
+
+      // Replacing the file fails if another process has it open
+      if (!written || !::MoveFileExW(tmpName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        Logger::warn(str::format("D3D9FFShaderModuleSet: Failed to replace ", path));
+        ::DeleteFileW(tmpName.c_str());
+        return;
+      }
+    }
+
+    m_cacheFile = std::ofstream(fileName.c_str(), std::ios_base::binary | std::ios_base::app);
+
+    if (!m_cacheFile && env::createDirectory(dir))
+      m_cacheFile = std::ofstream(fileName.c_str(), std::ios_base::binary | std::ios_base::app);
+
+    if (!m_cacheFile) {
+      Logger::warn(str::format("D3D9FFShaderModuleSet: Failed to open ", path));
+      return;
+    }
+
+    if (!hasHeader)
+      m_cacheFile.write(reinterpret_cast<const char*>(&expected), sizeof(expected));
+  }
+
+
+  template <typename T>
+  void D3D9FFShaderModuleSet::WriteCacheEntry(
+          VkShaderStageFlagBits Stage,
+    const T&                    Key) {
+    if (!m_cacheFile.is_open())
+      return;
+
+    uint32_t stage = uint32_t(Stage);
+    Sha1Hash hash  = Sha1Hash::compute(Key);
+
+    // Write each entry with a single call so that entries
+    // appended by different processes do not interleave
+    std::array<char, sizeof(stage) + sizeof(hash) + sizeof(Key)> data;
+    std::memcpy(&data[0],                            &stage, sizeof(stage));
+    std::memcpy(&data[sizeof(stage)],                &hash,  sizeof(hash));
+    std::memcpy(&data[sizeof(stage) + sizeof(hash)], &Key,   sizeof(Key));
+
+    m_cacheFile.write(data.data(), data.size());
+
+    // New shaders are rare, so flush right away in
+    // order not to lose entries if the game crashes
+    m_cacheFile.flush();
+  }
+
+
   D3D9FFShader D3D9FFShaderModuleSet::GetShaderModule(
           D3D9DeviceEx*         pDevice,
     const D3D9FFShaderKeyVS&    ShaderKey) {
@@ -2377,6 +2614,7 @@ namespace dxvk {
       pDevice, ShaderKey);
 
     m_vsModules.insert({ShaderKey, shader});
+    WriteCacheEntry(VK_SHADER_STAGE_VERTEX_BIT, ShaderKey);
 
     return shader;
   }
@@ -2394,11 +2632,60 @@ namespace dxvk {
       pDevice, ShaderKey);
 
     m_fsModules.insert({ShaderKey, shader});
+    WriteCacheEntry(VK_SHADER_STAGE_FRAGMENT_BIT, ShaderKey);
 
     return shader;
   }
 
 
+  D3D9FFShader D3D9FFShaderModuleSet::GetUberShaderModule(
+          D3D9DeviceEx*         pDevice,
+    const D3D9FFShaderKeyFS&    ShaderKey) {
+    // Only flat shading changes the shader interface, all
+    // other states are read from the constant buffer.
+    D3D9FFShaderKeyFS uberKey;
+    uberKey.Stages[0].Contents.GlobalFlatShade = ShaderKey.Stages[0].Contents.GlobalFlatShade;
+
+    auto entry = m_fsUberModules.find(uberKey);
+    if (entry != m_fsUberModules.end())
+      return entry->second;
+
+    D3D9FFShader shader(
+      pDevice, uberKey, true);
+
+    m_fsUberModules.insert({uberKey, shader});
+    return shader;
+  }
+
+
+  void PackFFShaderKeyFS(
+    const D3D9FFShaderKeyFS&    Key,
+          D3D9FixedFunctionPS*  pData) {
+    bool disabled = false;
+
+    for (uint32_t i = 0; i < caps::TextureStageCount; i++) {
+      const auto& stage = Key.Stages[i].Contents;
+
+      // Once a stage is disabled, all subsequent stages are too.
+      // Pack them explicitly so the uber shader can stop there.
+      disabled |= stage.ColorOp == D3DTOP_DISABLE;
+
+      if (disabled) {
+        pData->stages[i][0] = D3DTOP_DISABLE;
+        pData->stages[i][1] = D3DTOP_DISABLE;
+        pData->stages[i][2] = 0;
+        pData->stages[i][3] = stage.GlobalSpecularEnable;
+        continue;
+      }
+
+      pData->stages[i][0] = stage.ColorOp   | stage.ColorArg0 << 8 | stage.ColorArg1 << 16 | stage.ColorArg2 << 24;
+      pData->stages[i][1] = stage.AlphaOp   | stage.AlphaArg0 << 8 | stage.AlphaArg1 << 16 | stage.AlphaArg2 << 24;
+      pData->stages[i][2] = stage.Type      | stage.ResultIsTemp << 8 | stage.Projected << 16 | stage.ProjectedCount << 24;
+      pData->stages[i][3] = stage.GlobalSpecularEnable;
+    }
+  }
+
+
   size_t D3D9FFShaderKeyHash::operator () (const D3D9FFShaderKeyVS& key) const {
     DxvkHashState state;
 
@@ -8,6 +8,7 @@
 
 #include "../dxso/dxso_isgn.h"
 
+#include <fstream>
 #include <unordered_map>
 #include <bitset>
 
@@ -17,6 +18,7 @@ namespace dxvk {
   class SpirvModule;
 
   struct D3D9Options;
+  struct D3D9FixedFunctionPS;
 
   struct D3D9FogContext {
     // General inputs...
@@ -175,6 +177,25 @@ namespace dxvk {
     D3D9FFShaderStage Stages[caps::TextureStageCount];
   };
 
+  /**
+   * \brief Packs texture stage states for the uber shader
+   *
+   * Writes one \c uvec4 per texture stage, storing each op
+   * or argument in its own byte so that the uber pixel shader
+   * can decode them with plain bit field extracts:
+   * - x: ColorOp, ColorArg0, ColorArg1, ColorArg2
+   * - y: AlphaOp, AlphaArg0, AlphaArg1, AlphaArg2
+   * - z: Type, ResultIsTemp, Projected, ProjectedCount
+   * - w: GlobalSpecularEnable
+   * Stages after the first disabled one are packed with
+   * \c D3DTOP_DISABLE as both their color and alpha op.
+   * \param [in] Key Pixel shader key
+   * \param [out] pData Fixed-function constant data
+   */
+  void PackFFShaderKeyFS(
+    const D3D9FFShaderKeyFS&    Key,
+          D3D9FixedFunctionPS*  pData);
+
   struct D3D9FFShaderKeyHash {
     size_t operator () (const D3D9FFShaderKeyVS& key) const;
     size_t operator () (const D3D9FFShaderKeyFS& key) const;
@@ -200,7 +221,8 @@ namespace dxvk {
 
     D3D9FFShader(
             D3D9DeviceEx*         pDevice,
-      const D3D9FFShaderKeyFS&    Key);
+      const D3D9FFShaderKeyFS&    Key,
+            bool                  Uber = false);
 
     template <typename T>
     void Dump(const T& Key, const std::string& Name);
@@ -218,10 +240,35 @@ namespace dxvk {
   };
 
 
+  /**
+   * \brief Fixed-function shader module set
+   *
+   * Stores all fixed-function shaders created by the device.
+   * If the state cache is enabled, the keys of all generated
+   * shaders are also written to a cache file, so that future
+   * runs can recreate the shaders at device creation and let
+   * the state cache compile pipelines for them in advance.
+   */
   class D3D9FFShaderModuleSet : public RcObject {
 
   public:
 
+    D3D9FFShaderModuleSet();
+
+    ~D3D9FFShaderModuleSet();
+
+    /**
+     * \brief Initializes the shader cache
+     *
+     * Creates all shaders stored in the cache file and
+     * opens the file for writing. Does nothing if the
+     * state cache is disabled. Must be called on the
+     * CS thread before any shaders are created.
+     * \param [in] pDevice The D3D9 device
+     */
+    void InitShaderCache(
+            D3D9DeviceEx*         pDevice);
+
     D3D9FFShader GetShaderModule(
             D3D9DeviceEx*         pDevice,
       const D3D9FFShaderKeyVS&    ShaderKey);
@@ -230,6 +277,21 @@ namespace dxvk {
             D3D9DeviceEx*         pDevice,
       const D3D9FFShaderKeyFS&    ShaderKey);
 
+    /**
+     * \brief Retrieves uber pixel shader
+     *
+     * The uber shader reads the texture stage states from
+     * the fixed-function constant buffer, so only states
+     * that affect the shader interface, such as flat
+     * shading, require a different shader.
+     * \param [in] pDevice The D3D9 device
+     * \param [in] ShaderKey Pixel shader key
+     * \returns Uber shader for the given key
+     */
+    D3D9FFShader GetUberShaderModule(
+            D3D9DeviceEx*         pDevice,
+      const D3D9FFShaderKeyFS&    ShaderKey);
+
   private:
 
     std::unordered_map<
@@ -242,6 +304,18 @@ namespace dxvk {
       D3D9FFShader,
       D3D9FFShaderKeyHash, D3D9FFShaderKeyEq> m_fsModules;
 
+    std::unordered_map<
+      D3D9FFShaderKeyFS,
+      D3D9FFShader,
+      D3D9FFShaderKeyHash, D3D9FFShaderKeyEq> m_fsUberModules;
+
+    std::ofstream m_cacheFile;
+
+    template <typename T>
+    void WriteCacheEntry(
+            VkShaderStageFlagBits Stage,
+      const T&                    Key);
+
   };
 
 
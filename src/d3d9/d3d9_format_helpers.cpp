@@ -9,6 +9,74 @@
 
 namespace dxvk {
 
+  // Maximum size of the converted data for CPU conversion
+  constexpr VkDeviceSize MaxCPUConversionSize = 64 << 10;
+
+
+  static uint8_t PackUnorm8(float value) {
+    return uint8_t(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+  }
+
+
+  static void ConvertPackedYUVCPU(
+          bool      uyvy,
+          uint8_t*  dstData,
+    const uint32_t* srcData,
+          VkExtent3D extent) {
+    // Same coefficients as g_yuv_to_rgb in the conversion shaders.
+    // These are integer divisions in GLSL, so do the same here in
+    // order to get identical results on either path.
+    const float m[3][4] = {
+      { float(298 / 256), float(   0 / 256), float( 409 / 256), 0.5f },
+      { float(298 / 256), float(-100 / 256), float(-208 / 256), 0.5f },
+      { float(298 / 256), float( 516 / 256), float(   0 / 256), 0.5f },
+    };
+
+    // YUY2 has a macropixel of [2, 1]
+    uint32_t macroWidth = extent.width / 2;
+
+    for (uint32_t y = 0; y < extent.height; y++) {
+      const uint32_t* srcRow = srcData + y * macroWidth;
+      uint8_t*        dstRow = dstData + y * extent.width * 4;
+
+      for (uint32_t x = 0; x < macroWidth; x++) {
+        uint32_t value = srcRow[x];
+
+        uint32_t b0 = (value >>  0) & 0xff;
+        uint32_t b1 = (value >>  8) & 0xff;
+        uint32_t b2 = (value >> 16) & 0xff;
+        uint32_t b3 = (value >> 24) & 0xff;
+
+        // Flip around stuff for UYVY
+        if (uyvy) {
+          std::swap(b0, b1);
+          std::swap(b2, b3);
+        }
+
+        float y0 = float(b0) / 255.0f - (16.0f  / 255.0f);
+        float u  = float(b1) / 255.0f - (128.0f / 255.0f);
+        float y1 = float(b2) / 255.0f - (16.0f  / 255.0f);
+        float v  = float(b3) / 255.0f - (128.0f / 255.0f);
+
+        for (uint32_t i = 0; i < 2; i++) {
+          float yuv[4] = { i ? y1 : y0, u, v, 1.0f / 255.0f };
+          float rgb[3];
+
+          for (uint32_t c = 0; c < 3; c++)
+            rgb[c] = yuv[0] * m[c][0] + yuv[1] * m[c][1] + yuv[2] * m[c][2] + yuv[3] * m[c][3];
+
+          // The image format is B8G8R8A8
+          uint8_t* dst = dstRow + (x * 2 + i) * 4;
+          dst[0] = PackUnorm8(rgb[2]);
+          dst[1] = PackUnorm8(rgb[1]);
+          dst[2] = PackUnorm8(rgb[0]);
+          dst[3] = 0xff;
+        }
+      }
+    }
+  }
+
+
   D3D9FormatHelper::D3D9FormatHelper(const Rc<DxvkDevice>& device)
     : m_device(device), m_context(m_device->createContext()) {
     m_context->beginRecording(
@@ -63,6 +131,39 @@ namespace dxvk {
   }
 
 
+  bool D3D9FormatHelper::CanConvertFormatCPU(
+          D3D9_CONVERSION_FORMAT_INFO   conversionFormat,
+          VkExtent3D                    extent) {
+    if (conversionFormat.FormatType != D3D9ConversionFormat_YUY2
+     && conversionFormat.FormatType != D3D9ConversionFormat_UYVY)
+      return false;
+
+    VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * extent.depth * 4;
+    return extent.depth == 1 && size <= MaxCPUConversionSize;
+  }
+
+
+  void D3D9FormatHelper::ConvertFormatCPU(
+          D3D9_CONVERSION_FORMAT_INFO   conversionFormat,
+          void*                         dstData,
+    const void*                         srcData,
+          VkExtent3D                    extent) {
+    switch (conversionFormat.FormatType) {
+      case D3D9ConversionFormat_YUY2:
+      case D3D9ConversionFormat_UYVY:
+        ConvertPackedYUVCPU(
+          conversionFormat.FormatType == D3D9ConversionFormat_UYVY,
+          reinterpret_cast<uint8_t*>(dstData),
+          reinterpret_cast<const uint32_t*>(srcData),
+          extent);
+        break;
+
+      default:
+        Logger::warn("Unimplemented CPU format conversion");
+    }
+  }
+
+
   void D3D9FormatHelper::ConvertGenericFormat(
           D3D9_CONVERSION_FORMAT_INFO   videoFormat,
     const Rc<DxvkImage>&                dstImage,
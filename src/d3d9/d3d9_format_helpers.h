@@ -13,6 +13,14 @@ namespace dxvk {
 
     D3D9FormatHelper(const Rc<DxvkDevice>& device);
 
+    /**
+     * \brief Submits pending conversions
+     *
+     * Conversions are recorded into a separate command
+     * list, which must be submitted before any work that
+     * reads the converted images. Like \ref ConvertFormat,
+     * this must only be called from the CS thread.
+     */
     void Flush();
 
     void ConvertFormat(
@@ -21,6 +29,34 @@ namespace dxvk {
             VkImageSubresourceLayers      dstSubresource,
       const DxvkBufferSlice&              srcSlice);
 
+    /**
+     * \brief Checks whether an image can be converted on the CPU
+     *
+     * Small images of simple formats are cheaper to convert
+     * on the CPU than with a compute dispatch.
+     * \param [in] conversionFormat Conversion format
+     * \param [in] extent Extent of the subresource
+     * \returns \c true if \ref ConvertFormatCPU can be used
+     */
+    static bool CanConvertFormatCPU(
+            D3D9_CONVERSION_FORMAT_INFO   conversionFormat,
+            VkExtent3D                    extent);
+
+    /**
+     * \brief Converts image data on the CPU
+     *
+     * Writes tightly packed data in the image format.
+     * \param [in] conversionFormat Conversion format
+     * \param [in] dstData Destination data
+     * \param [in] srcData Source data
+     * \param [in] extent Extent of the subresource
+     */
+    static void ConvertFormatCPU(
+            D3D9_CONVERSION_FORMAT_INFO   conversionFormat,
+            void*                         dstData,
+      const void*                         srcData,
+            VkExtent3D                    extent);
+
   private:
 
     void ConvertGenericFormat(
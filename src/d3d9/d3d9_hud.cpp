@@ -33,4 +33,129 @@ namespace dxvk::hud {
     return position;
   }
 
-}
\ No newline at end of file
+
+  HudManagedMemory::HudManagedMemory(D3D9DeviceEx* device)
+    : m_device    (device)
+    , m_memory    ("0 MB")
+    , m_evictions ("0") {
+
+  }
+
+
+  void HudManagedMemory::update(dxvk::high_resolution_clock::time_point time) {
+    constexpr int64_t mib = 1 << 20;
+
+    int64_t budget = m_device->GetOptions()->managedShadowBudget;
+    int64_t memory = m_device->GetMappedMemory(D3D9MappedMemoryType::ManagedTextures);
+
+    m_memory = budget
+      ? str::format(memory / mib, " MB / ", budget, " MB")
+      : str::format(memory / mib, " MB");
+
+    m_evictions = str::format(m_device->GetManagedEvictions());
+  }
+
+
+  HudPos HudManagedMemory::render(
+          HudRenderer&      renderer,
+          HudPos            position) {
+    position.y += 16.0f;
+
+    renderer.drawText(16.0f,
+      { position.x, position.y },
+      { 0.0f, 1.0f, 0.75f, 1.0f },
+      "Managed:");
+
+    renderer.drawText(16.0f,
+      { position.x + 120.0f, position.y },
+      { 1.0f, 1.0f, 1.0f, 1.0f },
+      m_memory);
+
+    position.y += 20.0f;
+
+    renderer.drawText(16.0f,
+      { position.x, position.y },
+      { 0.0f, 1.0f, 0.75f, 1.0f },
+      "Evicted:");
+
+    renderer.drawText(16.0f,
+      { position.x + 120.0f, position.y },
+      { 1.0f, 1.0f, 1.0f, 1.0f },
+      m_evictions);
+
+    position.y += 8.0f;
+    return position;
+  }
+
+
+  HudMappingBufferMemory::HudMappingBufferMemory(D3D9DeviceEx* device)
+    : m_device    (device)
+    , m_memory    ("0 MB")
+    , m_textures  ("0 MB")
+    , m_evictions ("0") {
+
+  }
+
+
+  void HudMappingBufferMemory::update(dxvk::high_resolution_clock::time_point time) {
+    constexpr int64_t mib = 1 << 20;
+
+    int64_t budget   = m_device->GetOptions()->mappingBufferBudget;
+    int64_t textures = m_device->GetMappedMemory(D3D9MappedMemoryType::ManagedTextures)
+                     + m_device->GetMappedMemory(D3D9MappedMemoryType::DefaultTextures)
+                     + m_device->GetMappedMemory(D3D9MappedMemoryType::SystemMemTextures);
+
+    m_memory = str::format(m_device->GetMappedMemoryTotal() / mib, " MB");
+
+    m_textures = budget
+      ? str::format(textures / mib, " MB / ", budget, " MB")
+      : str::format(textures / mib, " MB");
+
+    m_evictions = str::format(m_device->GetMappedMemoryEvictions());
+  }
+
+
+  HudPos HudMappingBufferMemory::render(
+          HudRenderer&      renderer,
+          HudPos            position) {
+    position.y += 16.0f;
+
+    renderer.drawText(16.0f,
+      { position.x, position.y },
+      { 0.0f, 1.0f, 0.75f, 1.0f },
+      "Map buffers:");
+
+    renderer.drawText(16.0f,
+      { position.x + 150.0f, position.y },
+      { 1.0f, 1.0f, 1.0f, 1.0f },
+      m_memory);
+
+    position.y += 20.0f;
+
+    renderer.drawText(16.0f,
+      { position.x, position.y },
+      { 0.0f, 1.0f, 0.75f, 1.0f },
+      "Textures:");
+
+    renderer.drawText(16.0f,
+      { position.x + 150.0f, position.y },
+      { 1.0f, 1.0f, 1.0f, 1.0f },
+      m_textures);
+
+    position.y += 20.0f;
+
+    renderer.drawText(16.0f,
+      { position.x, position.y },
+      { 0.0f, 1.0f, 0.75f, 1.0f },
+      "Evicted:");
+
+    renderer.drawText(16.0f,
+      { position.x + 150.0f, position.y },
+      { 1.0f, 1.0f, 1.0f, 1.0f },
+      m_evictions);
+
+    position.y += 8.0f;
+    return position;
+  }
+
+}
@@ -28,4 +28,62 @@ namespace dxvk::hud {
 
   };
 
+  /**
+   * \brief HUD item to display managed texture memory
+   *
+   * Shows the amount of system memory used for copies
+   * of managed textures, and how many textures had
+   * their copy released to stay within budget.
+   */
+  class HudManagedMemory : public HudItem {
+
+  public:
+
+    HudManagedMemory(D3D9DeviceEx* device);
+
+    void update(dxvk::high_resolution_clock::time_point time);
+
+    HudPos render(
+            HudRenderer&      renderer,
+            HudPos            position);
+
+  private:
+
+    D3D9DeviceEx* m_device;
+
+    std::string m_memory;
+    std::string m_evictions;
+
+  };
+
+  /**
+   * \brief HUD item to display mapping buffer memory
+   *
+   * Shows the total size of the buffers used for locking
+   * resources, the part of it used for textures, and how
+   * many textures had their mapping buffers released to
+   * stay within budget.
+   */
+  class HudMappingBufferMemory : public HudItem {
+
+  public:
+
+    HudMappingBufferMemory(D3D9DeviceEx* device);
+
+    void update(dxvk::high_resolution_clock::time_point time);
+
+    HudPos render(
+            HudRenderer&      renderer,
+            HudPos            position);
+
+  private:
+
+    D3D9DeviceEx* m_device;
+
+    std::string m_memory;
+    std::string m_textures;
+    std::string m_evictions;
+
+  };
+
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "d3d9_caps.h"
 
+#include "../util/util_env.h"
+
 namespace dxvk {
 
   static int32_t parsePciId(const std::string& str) {
@@ -44,6 +46,8 @@ namespace dxvk {
     this->presentInterval               = config.getOption<int32_t>     ("d3d9.presentInterval",               -1);
     this->shaderModel                   = config.getOption<int32_t>     ("d3d9.shaderModel",                   3);
     this->evictManagedOnUnlock          = config.getOption<bool>        ("d3d9.evictManagedOnUnlock",          false);
+    this->managedShadowBudget           = config.getOption<int32_t>     ("d3d9.managedShadowBudget",           env::is32BitHostPlatform() ? 256 : 0);
+    this->mappingBufferBudget           = config.getOption<int32_t>     ("d3d9.mappingBufferBudget",           env::is32BitHostPlatform() ? 1024 : 0);
     this->dpiAware                      = config.getOption<bool>        ("d3d9.dpiAware",                      true);
     this->strictConstantCopies          = config.getOption<bool>        ("d3d9.strictConstantCopies",          false);
     this->strictPow                     = config.getOption<bool>        ("d3d9.strictPow",                     true);
@@ -75,6 +79,7 @@ namespace dxvk {
     this->alphaTestWiggleRoom           = config.getOption<bool>        ("d3d9.alphaTestWiggleRoom",           false);
     this->apitraceMode                  = config.getOption<bool>        ("d3d9.apitraceMode",                  false);
     this->deviceLocalConstantBuffers    = config.getOption<bool>        ("d3d9.deviceLocalConstantBuffers",    false);
+    this->ffUberShader                  = config.getOption<bool>        ("d3d9.ffUberShader",                  false);
 
     // If we are not Nvidia, enable general hazards.
     this->generalHazards = adapter != nullptr
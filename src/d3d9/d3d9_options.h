@@ -35,6 +35,16 @@ namespace dxvk {
     /// Whether or not managed resources should stay in memory until unlock, or until manually evicted.
     bool evictManagedOnUnlock;
 
+    /// Maximum amount of memory, in MiB, used for the system memory
+    /// copies of managed textures. Least recently locked textures
+    /// lose their copy once this is exceeded. 0 means no limit.
+    int32_t managedShadowBudget;
+
+    /// Maximum amount of memory, in MiB, used for texture mapping
+    /// buffers. Mapping buffers of the least recently locked textures
+    /// are released once this is exceeded. 0 means no limit.
+    int32_t mappingBufferBudget;
+
     /// Whether or not to set the process as DPI aware in Windows when the API interface is created.
     bool dpiAware;
 
@@ -155,6 +165,11 @@ namespace dxvk {
 
     /// Use device local memory for constant buffers.
     bool deviceLocalConstantBuffers;
+
+    /// Use a single fixed-function pixel shader that reads the
+    /// texture stage states from a uniform buffer, instead of
+    /// compiling a new shader for every stage state combination.
+    bool ffUberShader;
   };
 
 }
\ No newline at end of file
@@ -139,6 +139,10 @@ namespace dxvk {
 
   struct D3D9FixedFunctionPS {
     Vector4 textureFactor;
+
+    // Packed texture stage states for the uber shader,
+    // see PackFFShaderKeyFS for the exact layout.
+    uint32_t stages[caps::TextureStageCount][4];
   };
 
   enum D3D9SharedPSStages {
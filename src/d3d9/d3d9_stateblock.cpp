@@ -50,7 +50,8 @@ namespace dxvk {
   HRESULT STDMETHODCALLTYPE D3D9StateBlock::Apply() {
     m_applying = true;
 
-    if (m_captures.flags.test(D3D9CapturedStateFlag::VertexDecl) && m_state.vertexDecl != nullptr)
+    if (m_captures.flags.test(D3D9CapturedStateFlag::VertexDecl) && m_state.vertexDecl != nullptr
+     && (m_parent->IsRecording() || m_state.vertexDecl != m_deviceState->vertexDecl))
       m_parent->SetVertexDeclaration(m_state.vertexDecl.ptr());
 
     ApplyOrCapture<D3D9StateFunction::Apply>();
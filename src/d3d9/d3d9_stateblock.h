@@ -172,36 +172,61 @@ namespace dxvk {
       Capture
     };
 
+    /**
+     * \brief Applies or captures recorded states
+     *
+     * Only states set in the capture masks are touched. If \c cur
+     * is not \c nullptr, it must point to the current state of
+     * \c dst, and values that already match it are skipped so
+     * that applying a state block does not dirty state that
+     * did not actually change.
+     * \param [in] dst Object to write states to
+     * \param [in] src State to read values from
+     * \param [in] cur Current state of \c dst, or \c nullptr
+     */
     template <typename Dst, typename Src>
-    void ApplyOrCapture(Dst* dst, const Src* src) {
+    void ApplyOrCapture(Dst* dst, const Src* src, const D3D9CapturableState* cur) {
       if (m_captures.flags.test(D3D9CapturedStateFlag::StreamFreq)) {
-        for (uint32_t idx : bit::BitMask(m_captures.streamFreq.dword(0)))
-          dst->SetStreamSourceFreq(idx, src->streamFreq[idx]);
+        for (uint32_t idx : bit::BitMask(m_captures.streamFreq.dword(0))) {
+          if (!cur || cur->streamFreq[idx] != src->streamFreq[idx])
+            dst->SetStreamSourceFreq(idx, src->streamFreq[idx]);
+        }
       }
 
-      if (m_captures.flags.test(D3D9CapturedStateFlag::Indices))
-        dst->SetIndices(src->indices.ptr());
+      if (m_captures.flags.test(D3D9CapturedStateFlag::Indices)) {
+        if (!cur || cur->indices != src->indices)
+          dst->SetIndices(src->indices.ptr());
+      }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::RenderStates)) {
         for (uint32_t i = 0; i < m_captures.renderStates.dwordCount(); i++) {
           for (uint32_t rs : bit::BitMask(m_captures.renderStates.dword(i))) {
             uint32_t idx = i * 32 + rs;
 
-            dst->SetRenderState(D3DRENDERSTATETYPE(idx), src->renderStates[idx]);
+            if (!cur || cur->renderStates[idx] != src->renderStates[idx])
+              dst->SetRenderState(D3DRENDERSTATETYPE(idx), src->renderStates[idx]);
           }
         }
       }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::SamplerStates)) {
         for (uint32_t samplerIdx : bit::BitMask(m_captures.samplers.dword(0))) {
-          for (uint32_t stateIdx : bit::BitMask(m_captures.samplerStates[samplerIdx].dword(0)))
-            dst->SetStateSamplerState(samplerIdx, D3DSAMPLERSTATETYPE(stateIdx), src->samplerStates[samplerIdx][stateIdx]);
+          for (uint32_t stateIdx : bit::BitMask(m_captures.samplerStates[samplerIdx].dword(0))) {
+            if (!cur || cur->samplerStates[samplerIdx][stateIdx] != src->samplerStates[samplerIdx][stateIdx])
+              dst->SetStateSamplerState(samplerIdx, D3DSAMPLERSTATETYPE(stateIdx), src->samplerStates[samplerIdx][stateIdx]);
+          }
         }
       }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::VertexBuffers)) {
         for (uint32_t idx : bit::BitMask(m_captures.vertexBuffers.dword(0))) {
           const auto& vbo = src->vertexBuffers[idx];
+
+          if (cur && cur->vertexBuffers[idx].vertexBuffer == vbo.vertexBuffer
+                  && cur->vertexBuffers[idx].offset       == vbo.offset
+                  && cur->vertexBuffers[idx].stride       == vbo.stride)
+            continue;
+
           dst->SetStreamSource(
             idx,
             vbo.vertexBuffer.ptr(),
@@ -210,101 +235,127 @@ namespace dxvk {
         }
       }
 
-      if (m_captures.flags.test(D3D9CapturedStateFlag::Material))
-        dst->SetMaterial(&src->material);
+      if (m_captures.flags.test(D3D9CapturedStateFlag::Material)) {
+        if (!cur || std::memcmp(&cur->material, &src->material, sizeof(D3DMATERIAL9)))
+          dst->SetMaterial(&src->material);
+      }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::Textures)) {
-        for (uint32_t idx : bit::BitMask(m_captures.textures.dword(0)))
-          dst->SetStateTexture(idx, src->textures[idx]);
+        for (uint32_t idx : bit::BitMask(m_captures.textures.dword(0))) {
+          if (!cur || cur->textures[idx] != src->textures[idx])
+            dst->SetStateTexture(idx, src->textures[idx]);
+        }
       }
 
-      if (m_captures.flags.test(D3D9CapturedStateFlag::VertexShader))
-        dst->SetVertexShader(src->vertexShader.ptr());
+      if (m_captures.flags.test(D3D9CapturedStateFlag::VertexShader)) {
+        if (!cur || cur->vertexShader != src->vertexShader)
+          dst->SetVertexShader(src->vertexShader.ptr());
+      }
 
-      if (m_captures.flags.test(D3D9CapturedStateFlag::PixelShader))
-        dst->SetPixelShader(src->pixelShader.ptr());
+      if (m_captures.flags.test(D3D9CapturedStateFlag::PixelShader)) {
+        if (!cur || cur->pixelShader != src->pixelShader)
+          dst->SetPixelShader(src->pixelShader.ptr());
+      }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::Transforms)) {
         for (uint32_t i = 0; i < m_captures.transforms.dwordCount(); i++) {
           for (uint32_t trans : bit::BitMask(m_captures.transforms.dword(i))) {
             uint32_t idx = i * 32 + trans;
 
-            dst->SetStateTransform(idx, reinterpret_cast<const D3DMATRIX*>(&src->transforms[idx]));
+            if (!cur || !(cur->transforms[idx] == src->transforms[idx]))
+              dst->SetStateTransform(idx, reinterpret_cast<const D3DMATRIX*>(&src->transforms[idx]));
           }
         }
       }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::TextureStages)) {
         for (uint32_t stageIdx : bit::BitMask(m_captures.textureStages.dword(0))) {
-          for (uint32_t stateIdx : bit::BitMask(m_captures.textureStageStates[stageIdx].dword(0)))
-            dst->SetStateTextureStageState(stageIdx, D3D9TextureStageStateTypes(stateIdx), src->textureStages[stageIdx][stateIdx]);
+          for (uint32_t stateIdx : bit::BitMask(m_captures.textureStageStates[stageIdx].dword(0))) {
+            if (!cur || cur->textureStages[stageIdx][stateIdx] != src->textureStages[stageIdx][stateIdx])
+              dst->SetStateTextureStageState(stageIdx, D3D9TextureStageStateTypes(stateIdx), src->textureStages[stageIdx][stateIdx]);
+          }
         }
       }
 
-      if (m_captures.flags.test(D3D9CapturedStateFlag::Viewport))
-        dst->SetViewport(&src->viewport);
+      if (m_captures.flags.test(D3D9CapturedStateFlag::Viewport)) {
+        if (!cur || !(cur->viewport == src->viewport))
+          dst->SetViewport(&src->viewport);
+      }
 
-      if (m_captures.flags.test(D3D9CapturedStateFlag::ScissorRect))
-        dst->SetScissorRect(&src->scissorRect);
+      if (m_captures.flags.test(D3D9CapturedStateFlag::ScissorRect)) {
+        if (!cur || !(cur->scissorRect == src->scissorRect))
+          dst->SetScissorRect(&src->scissorRect);
+      }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::ClipPlanes)) {
-        for (uint32_t idx : bit::BitMask(m_captures.clipPlanes.dword(0)))
-          dst->SetClipPlane(idx, src->clipPlanes[idx].coeff);
+        for (uint32_t idx : bit::BitMask(m_captures.clipPlanes.dword(0))) {
+          if (!cur || std::memcmp(cur->clipPlanes[idx].coeff, src->clipPlanes[idx].coeff, sizeof(D3D9ClipPlane)))
+            dst->SetClipPlane(idx, src->clipPlanes[idx].coeff);
+        }
       }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::VsConstants)) {
-        for (uint32_t i = 0; i < m_captures.vsConsts.fConsts.dwordCount(); i++) {
-          for (uint32_t consts : bit::BitMask(m_captures.vsConsts.fConsts.dword(i))) {
-            uint32_t idx = i * 32 + consts;
+        ForEachChangedConstantRange(m_captures.vsConsts.fConsts,
+          src->vsConsts.fConsts, cur ? cur->vsConsts.fConsts : nullptr,
+          [&] (uint32_t start, uint32_t count) {
+            dst->SetVertexShaderConstantF(start, (float*)&src->vsConsts.fConsts[start], count);
+          });
+
+        ForEachChangedConstantRange(m_captures.vsConsts.iConsts,
+          src->vsConsts.iConsts, cur ? cur->vsConsts.iConsts : nullptr,
+          [&] (uint32_t start, uint32_t count) {
+            dst->SetVertexShaderConstantI(start, (int*)&src->vsConsts.iConsts[start], count);
+          });
 
-            dst->SetVertexShaderConstantF(idx, (float*)&src->vsConsts.fConsts[idx], 1);
-          }
-        }
+        if (m_captures.vsConsts.bConsts.any()) {
+          for (uint32_t i = 0; i < m_captures.vsConsts.bConsts.dwordCount(); i++) {
+            uint32_t mask = m_captures.vsConsts.bConsts.dword(i);
 
-        for (uint32_t i = 0; i < m_captures.vsConsts.iConsts.dwordCount(); i++) {
-          for (uint32_t consts : bit::BitMask(m_captures.vsConsts.iConsts.dword(i))) {
-            uint32_t idx = i * 32 + consts;
+            if (cur)
+              mask &= cur->vsConsts.bConsts[i] ^ src->vsConsts.bConsts[i];
 
-            dst->SetVertexShaderConstantI(idx, (int*)&src->vsConsts.iConsts[idx], 1);
+            if (mask)
+              dst->SetVertexBoolBitfield(i, mask, src->vsConsts.bConsts[i]);
           }
         }
-
-        if (m_captures.vsConsts.bConsts.any()) {
-          for (uint32_t i = 0; i < m_captures.vsConsts.bConsts.dwordCount(); i++)
-            dst->SetVertexBoolBitfield(i, m_captures.vsConsts.bConsts.dword(i), src->vsConsts.bConsts[i]);
-        }
       }
 
       if (m_captures.flags.test(D3D9CapturedStateFlag::PsConstants)) {
-        for (uint32_t i = 0; i < m_captures.psConsts.fConsts.dwordCount(); i++) {
-          for (uint32_t consts : bit::BitMask(m_captures.psConsts.fConsts.dword(i))) {
-            uint32_t idx = i * 32 + consts;
+        ForEachChangedConstantRange(m_captures.psConsts.fConsts,
+          src->psConsts.fConsts, cur ? cur->psConsts.fConsts : nullptr,
+          [&] (uint32_t start, uint32_t count) {
+            dst->SetPixelShaderConstantF(start, (float*)&src->psConsts.fConsts[start], count);
+          });
+
+        ForEachChangedConstantRange(m_captures.psConsts.iConsts,
+          src->psConsts.iConsts, cur ? cur->psConsts.iConsts : nullptr,
+          [&] (uint32_t start, uint32_t count) {
+            dst->SetPixelShaderConstantI(start, (int*)&src->psConsts.iConsts[start], count);
+          });
 
-            dst->SetPixelShaderConstantF(idx, (float*)&src->psConsts.fConsts[idx], 1);
-          }
-        }
+        if (m_captures.psConsts.bConsts.any()) {
+          for (uint32_t i = 0; i < m_captures.psConsts.bConsts.dwordCount(); i++) {
+            uint32_t mask = m_captures.psConsts.bConsts.dword(i);
 
-        for (uint32_t i = 0; i < m_captures.psConsts.iConsts.dwordCount(); i++) {
-          for (uint32_t consts : bit::BitMask(m_captures.psConsts.iConsts.dword(i))) {
-            uint32_t idx = i * 32 + consts;
+            if (cur)
+              mask &= cur->psConsts.bConsts[i] ^ src->psConsts.bConsts[i];
 
-            dst->SetPixelShaderConstantI(idx, (int*)&src->psConsts.iConsts[idx], 1);
+            if (mask)
+              dst->SetPixelBoolBitfield(i, mask, src->psConsts.bConsts[i]);
           }
         }
-
-        if (m_captures.psConsts.bConsts.any()) {
-          for (uint32_t i = 0; i < m_captures.psConsts.bConsts.dwordCount(); i++)
-            dst->SetPixelBoolBitfield(i, m_captures.psConsts.bConsts.dword(i), src->psConsts.bConsts[i]);
-        }
       }
     }
 
     template <D3D9StateFunction Func>
     void ApplyOrCapture() {
+      // While another state block is being recorded, every
+      // applied value must reach the recorder, so we can
+      // only skip redundant values when applying directly.
       if      constexpr (Func == D3D9StateFunction::Apply)
-        ApplyOrCapture(m_parent, &m_state);
+        ApplyOrCapture(m_parent, &m_state, m_parent->IsRecording() ? nullptr : m_deviceState);
       else if constexpr (Func == D3D9StateFunction::Capture)
-        ApplyOrCapture(this, m_deviceState);
+        ApplyOrCapture(this, m_deviceState, nullptr);
     }
 
     template <
@@ -368,6 +419,49 @@ namespace dxvk {
 
     void CaptureType(D3D9StateBlockType State);
 
+    /**
+     * \brief Iterates over changed constant ranges
+     *
+     * Merges captured registers whose values differ from
+     * \c cur into contiguous ranges, so that applying a
+     * large constant set takes few setter calls.
+     * \param [in] captures Captured register mask
+     * \param [in] src Constant values to apply
+     * \param [in] cur Current constant values, or \c nullptr
+     * \param [in] fn Function called with start and count
+     */
+    template <typename Bitset, typename T, typename Fn>
+    static void ForEachChangedConstantRange(
+      const Bitset&  captures,
+      const T*       src,
+      const T*       cur,
+            Fn&&     fn) {
+      uint32_t start = 0;
+      uint32_t count = 0;
+
+      for (uint32_t i = 0; i < captures.dwordCount(); i++) {
+        for (uint32_t reg : bit::BitMask(captures.dword(i))) {
+          uint32_t idx = i * 32 + reg;
+
+          if (cur && !std::memcmp(&cur[idx], &src[idx], sizeof(T)))
+            continue;
+
+          if (count && start + count == idx) {
+            count++;
+          } else {
+            if (count)
+              fn(start, count);
+
+            start = idx;
+            count = 1;
+          }
+        }
+      }
+
+      if (count)
+        fn(start, count);
+    }
+
     D3D9CapturableState  m_state;
     D3D9StateCaptures    m_captures;
 
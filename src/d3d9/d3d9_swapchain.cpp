@@ -879,8 +879,10 @@ namespace dxvk {
       m_device->submitCommandList(cCommandList,
         cSync.acquire, cSync.present);
 
-      if (cHud != nullptr && !cFrameId)
+      if (cHud != nullptr && !cFrameId) {
+        cHud->setFrameRateLimit(m_presenter->getFrameRateLimit());
         cHud->update();
+      }
 
       m_device->presentImage(m_presenter, &m_presentStatus);
     });
@@ -1075,6 +1077,8 @@ namespace dxvk {
     if (m_hud != nullptr) {
       m_hud->addItem<hud::HudClientApiItem>("api", 1, GetApiName());
       m_hud->addItem<hud::HudSamplerCount>("samplers", -1, m_parent);
+      m_hud->addItem<hud::HudManagedMemory>("managed", -1, m_parent);
+      m_hud->addItem<hud::HudMappingBufferMemory>("mappingbuffers", -1, m_parent);
     }
   }
 
@@ -357,4 +357,86 @@ namespace dxvk {
     }
   }
   
+  
+  DxbcInstructionStream::DxbcInstructionStream(DxbcCodeSlice code) {
+    DxbcDecodeContext decoder;
+    
+    std::vector<OperandRefs> operandRefs;
+    std::vector<IndexRef>    indexRefs;
+    
+    while (!code.atEnd()) {
+      decoder.decodeInstruction(code);
+      
+      DxbcShaderInstruction ins = decoder.getInstruction();
+      
+      // Operand pointers are only resolved once all
+      // instructions are decoded since the arrays may
+      // get reallocated until then. Destination and
+      // source operands must remain contiguous.
+      OperandRefs refs;
+      refs.dst = uint32_t(m_registers.size());
+      m_registers.insert(m_registers.end(), ins.dst, ins.dst + ins.dstCount);
+      
+      refs.src = uint32_t(m_registers.size());
+      m_registers.insert(m_registers.end(), ins.src, ins.src + ins.srcCount);
+      
+      refs.imm = uint32_t(m_immediates.size());
+      m_immediates.insert(m_immediates.end(), ins.imm, ins.imm + ins.immCount);
+      
+      // Relative index registers point into the decode
+      // context, copy them as well before decoding the
+      // next instruction overwrites them
+      for (uint32_t i = 0; i < ins.dstCount + ins.srcCount; i++)
+        this->copyIndexRegisters(refs.dst + i, indexRefs);
+      
+      ins.dst = nullptr;
+      ins.src = nullptr;
+      ins.imm = nullptr;
+      
+      m_instructions.push_back(ins);
+      operandRefs.push_back(refs);
+    }
+    
+    for (const auto& ref : indexRefs)
+      m_registers[ref.reg].idx[ref.dim].relReg = &m_registers[ref.relReg];
+    
+    for (size_t i = 0; i < m_instructions.size(); i++) {
+      m_instructions[i].dst = m_registers.data()  + operandRefs[i].dst;
+      m_instructions[i].src = m_registers.data()  + operandRefs[i].src;
+      m_instructions[i].imm = m_immediates.data() + operandRefs[i].imm;
+    }
+  }
+  
+  
+  DxbcInstructionStream::~DxbcInstructionStream() {
+    
+  }
+  
+  
+  void DxbcInstructionStream::copyIndexRegisters(
+          uint32_t                reg,
+          std::vector<IndexRef>&  indexRefs) {
+    for (uint32_t i = 0; i < m_registers[reg].idxDim; i++) {
+      const DxbcRegister* relReg = m_registers[reg].idx[i].relReg;
+      
+      if (relReg == nullptr)
+        continue;
+      
+      // Copy the register before modifying the array
+      // since it may point into the decode context
+      DxbcRegister relCopy = *relReg;
+      
+      IndexRef ref;
+      ref.reg    = reg;
+      ref.dim    = i;
+      ref.relReg = uint32_t(m_registers.size());
+      
+      m_registers.push_back(relCopy);
+      m_registers[reg].idx[i].relReg = nullptr;
+      
+      indexRefs.push_back(ref);
+      this->copyIndexRegisters(ref.relReg, indexRefs);
+    }
+  }
+  
 }
\ No newline at end of file
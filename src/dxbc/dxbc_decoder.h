@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <vector>
 
 #include "dxbc_common.h"
 #include "dxbc_decoder.h"
@@ -501,4 +502,76 @@ namespace dxvk {
     
   };
   
+  
+  /**
+   * \brief Decoded instruction stream
+   * 
+   * Decodes an entire code slice in a single pass and
+   * stores all instructions and their operands in flat
+   * arrays, so that the analyzer and the compiler can
+   * both process the shader without decoding it twice.
+   * 
+   * Custom data blocks still point into the original
+   * code buffer, which must outlive the stream.
+   * 
+   * Every decoded instruction, operand register and
+   * immediate is copied, so the stream uses several
+   * times the memory of the token stream itself. It
+   * only lives for the duration of a single compile.
+   */
+  class DxbcInstructionStream {
+    
+  public:
+    
+    DxbcInstructionStream(DxbcCodeSlice code);
+    ~DxbcInstructionStream();
+    
+    DxbcInstructionStream             (const DxbcInstructionStream&) = delete;
+    DxbcInstructionStream& operator = (const DxbcInstructionStream&) = delete;
+    
+    /**
+     * \brief Number of instructions
+     * \returns Instruction count
+     */
+    size_t size() const {
+      return m_instructions.size();
+    }
+    
+    /**
+     * \brief Retrieves an instruction
+     * 
+     * \param [in] id Instruction index
+     * \returns Decoded instruction
+     */
+    const DxbcShaderInstruction& operator [] (size_t id) const {
+      return m_instructions[id];
+    }
+    
+    auto begin() const { return m_instructions.cbegin(); }
+    auto end()   const { return m_instructions.cend(); }
+    
+  private:
+    
+    struct OperandRefs {
+      uint32_t dst;
+      uint32_t src;
+      uint32_t imm;
+    };
+    
+    struct IndexRef {
+      uint32_t reg;
+      uint32_t dim;
+      uint32_t relReg;
+    };
+    
+    std::vector<DxbcShaderInstruction>  m_instructions;
+    std::vector<DxbcRegister>           m_registers;
+    std::vector<DxbcImmediate>          m_immediates;
+    
+    void copyIndexRegisters(
+            uint32_t                reg,
+            std::vector<IndexRef>&  indexRefs);
+    
+  };
+  
 }
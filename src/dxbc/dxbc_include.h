@@ -15,4 +15,5 @@
 #include "../util/util_bit.h"
 #include "../util/util_enum.h"
 #include "../util/util_error.h"
+#include "../util/util_profiler.h"
 #include "../util/util_string.h"
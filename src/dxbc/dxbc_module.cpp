@@ -46,6 +46,12 @@ namespace dxvk {
     if (m_shexChunk == nullptr)
       throw DxvkError("DxbcModule::compile: No SHDR/SHEX chunk");
     
+    ProfilerScope scope("DxbcModule::compile");
+
+    // Decode the shader once and run both the
+    // analyzer and the compiler on the result
+    DxbcInstructionStream code(m_shexChunk->slice());
+    
     DxbcAnalysisInfo analysisInfo;
     
     DxbcAnalyzer analyzer(moduleInfo,
@@ -53,7 +59,7 @@ namespace dxvk {
       m_isgnChunk, m_osgnChunk,
       m_psgnChunk, analysisInfo);
     
-    this->runAnalyzer(analyzer, m_shexChunk->slice());
+    this->runAnalyzer(analyzer, code);
     
     DxbcCompiler compiler(
       fileName, moduleInfo,
@@ -61,7 +67,7 @@ namespace dxvk {
       m_isgnChunk, m_osgnChunk,
       m_psgnChunk, analysisInfo);
     
-    this->runCompiler(compiler, m_shexChunk->slice());
+    this->runCompiler(compiler, code);
     
     return compiler.finalize();
   }
@@ -88,29 +94,17 @@ namespace dxvk {
 
   void DxbcModule::runAnalyzer(
           DxbcAnalyzer&       analyzer,
-          DxbcCodeSlice       slice) const {
-    DxbcDecodeContext decoder;
-    
-    while (!slice.atEnd()) {
-      decoder.decodeInstruction(slice);
-      
-      analyzer.processInstruction(
-        decoder.getInstruction());
-    }
+    const DxbcInstructionStream& code) const {
+    for (const auto& ins : code)
+      analyzer.processInstruction(ins);
   }
   
   
   void DxbcModule::runCompiler(
           DxbcCompiler&       compiler,
-          DxbcCodeSlice       slice) const {
-    DxbcDecodeContext decoder;
-    
-    while (!slice.atEnd()) {
-      decoder.decodeInstruction(slice);
-      
-      compiler.processInstruction(
-        decoder.getInstruction());
-    }
+    const DxbcInstructionStream& code) const {
+    for (const auto& ins : code)
+      compiler.processInstruction(ins);
   }
   
 }
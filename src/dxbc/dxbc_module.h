@@ -85,11 +85,11 @@ namespace dxvk {
     
     void runAnalyzer(
             DxbcAnalyzer&       analyzer,
-            DxbcCodeSlice       slice) const;
+      const DxbcInstructionStream& code) const;
     
     void runCompiler(
             DxbcCompiler&       compiler,
-            DxbcCodeSlice       slice) const;
+      const DxbcInstructionStream& code) const;
     
   };
   
@@ -144,11 +144,12 @@ namespace dxvk {
      * Adds a resource to the internal resource tracker.
      * Resources will be kept alive and "in use" until
      * the device can guarantee that the submission has
-     * completed.
+     * completed. Repeated uses of the same resource
+     * within the command list are only tracked once.
      */
-    template<DxvkAccess Access>
-    void trackResource(Rc<DxvkResource> rc) {
-      m_resources.trackResource<Access>(std::move(rc));
+    template<DxvkAccess Access, typename T>
+    void trackResource(const Rc<T>& rc) {
+      m_resources.trackResource<Access>(rc);
     }
     
     /**
@@ -23,6 +23,9 @@ namespace dxvk {
       m_features.set(DxvkContextFeature::NullDescriptors);
     if (m_device->features().extExtendedDynamicState.extendedDynamicState)
       m_features.set(DxvkContextFeature::ExtendedDynamicState);
+
+    if (m_device->gpuProfiler() != nullptr)
+      m_gpuProfiler = std::make_unique<DxvkGpuProfilerRecorder>(m_device, m_device->gpuProfiler());
   }
   
   
@@ -35,6 +38,10 @@ namespace dxvk {
     m_cmd = cmdList;
     m_cmd->beginRecording();
 
+    // Forward GPU profiler results from previous submissions
+    if (unlikely(m_gpuProfiler != nullptr))
+      m_gpuProfiler->readResults();
+
     // Mark all resources as untracked
     m_vbTracked.clear();
     m_rcTracked.clear();
@@ -70,6 +77,11 @@ namespace dxvk {
     this->spillRenderPass(true);
     this->flushSharedImages();
 
+    if (unlikely(m_gpuProfiler != nullptr))
+      m_gpuProfiler->endDispatchBatch(m_cmd, m_queryManager);
+
+    m_queryManager.readbackQueries(m_cmd);
+
     m_sdmaBarriers.recordCommands(m_cmd);
     m_initBarriers.recordCommands(m_cmd);
     m_execBarriers.recordCommands(m_cmd);
@@ -362,6 +374,8 @@ namespace dxvk {
     this->spillRenderPass(true);
     this->unbindComputePipeline();
 
+    DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "clearBufferView");
+
     // The view range might have been invalidated, so
     // we need to make sure the handle is up to date
     bufferView->updateView();
@@ -963,6 +977,8 @@ namespace dxvk {
 
     this->unbindComputePipeline();
 
+    DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "packDepthStencil");
+
     // Retrieve compute pipeline for the given format
     auto pipeInfo = m_common->metaPack().getPackPipeline(format);
 
@@ -1245,6 +1261,8 @@ namespace dxvk {
 
     this->unbindComputePipeline();
 
+    DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "unpackDepthStencil");
+
     if (m_execBarriers.isBufferDirty(srcBuffer->getSliceHandle(), DxvkAccess::Read)
      || m_execBarriers.isImageDirty(dstImage, vk::makeSubresourceRange(dstSubresource), DxvkAccess::Write))
       m_execBarriers.recordCommands(m_cmd);
@@ -1444,6 +1462,9 @@ namespace dxvk {
     if (this->commitComputeState()) {
       this->commitComputeInitBarriers();
 
+      if (unlikely(m_gpuProfiler != nullptr))
+        m_gpuProfiler->beginDispatchBatch(m_cmd, m_queryManager);
+
       m_queryManager.beginQueries(m_cmd,
         VK_QUERY_TYPE_PIPELINE_STATISTICS);
       
@@ -1470,6 +1491,9 @@ namespace dxvk {
     if (this->commitComputeState()) {
       this->commitComputeInitBarriers();
 
+      if (unlikely(m_gpuProfiler != nullptr))
+        m_gpuProfiler->beginDispatchBatch(m_cmd, m_queryManager);
+
       m_queryManager.beginQueries(m_cmd,
         VK_QUERY_TYPE_PIPELINE_STATISTICS);
       
@@ -1656,6 +1680,8 @@ namespace dxvk {
     
     this->spillRenderPass(false);
 
+    DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "generateMipmaps");
+
     m_execBarriers.recordCommands(m_cmd);
     
     // Create the a set of framebuffers and image views
@@ -1979,6 +2005,8 @@ namespace dxvk {
     }
     
     if (attachmentIndex < 0) {
+      DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "clearImageView");
+
       if (m_execBarriers.isImageDirty(
           imageView->image(),
           imageView->imageSubresources(),
@@ -2716,6 +2744,8 @@ namespace dxvk {
     const VkImageBlit&          region,
     const VkComponentMapping&   mapping,
           VkFilter              filter) {
+    DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "blitImage");
+
     auto dstSubresourceRange = vk::makeSubresourceRange(region.dstSubresource);
     auto srcSubresourceRange = vk::makeSubresourceRange(region.srcSubresource);
 
@@ -3190,6 +3220,8 @@ namespace dxvk {
           VkClearValue          value) {
     this->spillRenderPass(false);
     this->unbindComputePipeline();
+
+    DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "clearImageViewCs");
     
     if (m_execBarriers.isImageDirty(
           imageView->image(),
@@ -3373,6 +3405,8 @@ namespace dxvk {
           VkImageSubresourceLayers srcSubresource,
           VkOffset3D            srcOffset,
           VkExtent3D            extent) {
+    DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "copyImage");
+
     auto dstSubresourceRange = vk::makeSubresourceRange(dstSubresource);
     auto srcSubresourceRange = vk::makeSubresourceRange(srcSubresource);
     
@@ -3794,6 +3828,8 @@ namespace dxvk {
           VkFormat                  format,
           VkResolveModeFlagBitsKHR  depthMode,
           VkResolveModeFlagBitsKHR  stencilMode) {
+    DxvkGpuProfilerScope profilerScope(m_gpuProfiler.get(), m_cmd, m_queryManager, "resolveImage");
+
     auto dstSubresourceRange = vk::makeSubresourceRange(region.dstSubresource);
     auto srcSubresourceRange = vk::makeSubresourceRange(region.srcSubresource);
     
@@ -3948,6 +3984,9 @@ namespace dxvk {
 
       m_execBarriers.recordCommands(m_cmd);
 
+      if (unlikely(m_gpuProfiler != nullptr))
+        m_renderPassScope = m_gpuProfiler->beginScope(m_cmd, m_queryManager, "renderPass");
+
       this->renderPassBindFramebuffer(
         m_state.om.framebuffer,
         m_state.om.renderPassOps,
@@ -3981,6 +4020,9 @@ namespace dxvk {
       
       this->renderPassUnbindFramebuffer();
 
+      if (unlikely(m_gpuProfiler != nullptr))
+        m_gpuProfiler->endScope(m_cmd, m_queryManager, m_renderPassScope);
+
       if (suspend)
         m_flags.set(DxvkContextFlag::GpRenderPassSuspended);
       else
@@ -4876,6 +4918,8 @@ namespace dxvk {
   
   
   bool DxvkContext::commitComputeState() {
+    ProfilerScope scope("DxvkContext::commitComputeState");
+
     this->spillRenderPass(false);
 
     if (m_flags.test(DxvkContextFlag::CpDirtyPipeline)) {
@@ -4902,6 +4946,8 @@ namespace dxvk {
   
   template<bool Indexed, bool Indirect>
   bool DxvkContext::commitGraphicsState() {
+    ProfilerScope scope("DxvkContext::commitGraphicsState");
+
     if (m_flags.test(DxvkContextFlag::GpDirtyPipeline)) {
       if (unlikely(!this->updateGraphicsPipeline()))
         return false;
@@ -5,6 +5,7 @@
 #include "dxvk_cmdlist.h"
 #include "dxvk_context_state.h"
 #include "dxvk_data.h"
+#include "dxvk_gpu_profiler.h"
 #include "dxvk_objects.h"
 #include "dxvk_resource.h"
 #include "dxvk_util.h"
@@ -1090,6 +1091,9 @@ namespace dxvk {
     
     DxvkGpuQueryManager     m_queryManager;
     DxvkStagingDataAlloc    m_staging;
+
+    std::unique_ptr<DxvkGpuProfilerRecorder> m_gpuProfiler;
+    uint32_t                m_renderPassScope = 0;
     
     DxvkRenderTargetLayouts m_rtLayouts = { };
 
@@ -18,6 +18,8 @@ namespace dxvk {
 
 
   void DxvkCsChunk::executeAll(DxvkContext* ctx) {
+    ProfilerScope scope("DxvkCsChunk::executeAll");
+
     auto cmd = m_head;
     
     if (m_flags.test(DxvkCsChunkFlag::SingleUse)) {
@@ -22,6 +22,9 @@ namespace dxvk {
     auto queueFamilies = m_adapter->findQueueFamilies();
     m_queues.graphics = getQueue(queueFamilies.graphics, 0);
     m_queues.transfer = getQueue(queueFamilies.transfer, 0);
+
+    m_frameStats = DxvkFrameStatsWriter::createWriter(this);
+    m_gpuProfiler = DxvkGpuProfiler::createProfiler(this);
   }
   
   
@@ -212,8 +215,15 @@ namespace dxvk {
     presentInfo.presenter = presenter;
     m_submissionQueue.present(presentInfo, status);
     
-    std::lock_guard<sync::Spinlock> statLock(m_statLock);
-    m_statCounters.addCtr(DxvkStatCounter::QueuePresentCount, 1);
+    { std::lock_guard<sync::Spinlock> statLock(m_statLock);
+      m_statCounters.addCtr(DxvkStatCounter::QueuePresentCount, 1);
+    }
+
+    if (m_frameStats)
+      m_frameStats->recordFrame(this->getStatCounters());
+
+    if (m_gpuProfiler != nullptr)
+      m_gpuProfiler->endFrame();
   }
 
 
@@ -6,6 +6,7 @@
 #include "dxvk_constant_state.h"
 #include "dxvk_context.h"
 #include "dxvk_extensions.h"
+#include "dxvk_frame_stats.h"
 #include "dxvk_framebuffer.h"
 #include "dxvk_image.h"
 #include "dxvk_instance.h"
@@ -362,6 +363,14 @@ namespace dxvk {
      */
     DxvkStatCounters getStatCounters();
 
+    /**
+     * \brief Retrieves GPU profiler
+     * \returns GPU profiler, or \c nullptr if disabled
+     */
+    Rc<DxvkGpuProfiler> gpuProfiler() const {
+      return m_gpuProfiler;
+    }
+
     /**
      * \brief Retrieves memors statistics
      *
@@ -495,6 +504,9 @@ namespace dxvk {
     
     DxvkSubmissionQueue m_submissionQueue;
 
+    std::unique_ptr<DxvkFrameStatsWriter> m_frameStats;
+    Rc<DxvkGpuProfiler>         m_gpuProfiler;
+
     DxvkDevicePerfHints getPerfHints();
     
     void recycleCommandList(
@@ -0,0 +1,164 @@
+#include "dxvk_device.h"
+#include "dxvk_frame_stats.h"
+
+namespace dxvk {
+
+  DxvkFrameStatsWriter::DxvkFrameStatsWriter(
+          DxvkDevice*           device,
+    const std::string&          path)
+  : m_device    (device),
+    m_memory    (device->adapter()->memoryProperties()),
+    m_startTime (dxvk::high_resolution_clock::now()),
+    m_prevTime  (m_startTime),
+    m_stream    (str::tows(path.c_str()).c_str()) {
+    if (!m_stream) {
+      Logger::err(str::format("DxvkFrameStatsWriter: Failed to open ", path));
+      return;
+    }
+
+    Logger::info(str::format("DxvkFrameStatsWriter: Writing frame stats to ", path));
+
+    m_prevCounters = m_device->getStatCounters();
+
+    m_stream << "frame,time_us,frame_time_us,draw_calls,dispatch_calls,render_passes,"
+                "submissions,graphics_pipelines,compute_pipelines,compiler_busy,gpu_idle_us,"
+                "vidmem_allocated,vidmem_used,sysmem_allocated,sysmem_used" << std::endl;
+
+    m_thread = dxvk::thread([this] () { runWriter(); });
+  }
+
+
+  DxvkFrameStatsWriter::~DxvkFrameStatsWriter() {
+    if (!m_thread.joinable())
+      return;
+
+    { std::unique_lock<dxvk::mutex> lock(m_mutex);
+      m_stopped = true;
+    }
+
+    m_cond.notify_one();
+    m_thread.join();
+  }
+
+
+  void DxvkFrameStatsWriter::recordFrame(
+    const DxvkStatCounters&     counters) {
+    if (!m_thread.joinable())
+      return;
+
+    auto now = dxvk::high_resolution_clock::now();
+
+    DxvkFrameStats frame;
+    frame.frameId   = m_frameId++;
+    frame.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(now - m_startTime).count();
+    frame.frameTime = std::chrono::duration_cast<std::chrono::microseconds>(now - m_prevTime).count();
+    frame.counters  = counters.diff(m_prevCounters);
+
+    // The compiler activity flag is a state rather than a
+    // running total, so report the current value as-is
+    frame.counters.setCtr(DxvkStatCounter::PipeCompilerBusy,
+      counters.getCtr(DxvkStatCounter::PipeCompilerBusy));
+
+    frame.deviceMemory = DxvkMemoryStats();
+    frame.systemMemory = DxvkMemoryStats();
+
+    for (uint32_t i = 0; i < m_memory.memoryHeapCount; i++) {
+      DxvkMemoryStats stats = m_device->getMemoryStats(i);
+
+      DxvkMemoryStats& dst = (m_memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        ? frame.deviceMemory
+        : frame.systemMemory;
+
+      dst.memoryAllocated += stats.memoryAllocated;
+      dst.memoryUsed      += stats.memoryUsed;
+    }
+
+    m_prevCounters = counters;
+    m_prevTime     = now;
+
+    { std::unique_lock<dxvk::mutex> lock(m_mutex);
+      m_queue.push(frame);
+    }
+
+    m_cond.notify_one();
+  }
+
+
+  std::unique_ptr<DxvkFrameStatsWriter> DxvkFrameStatsWriter::createWriter(
+          DxvkDevice*           device) {
+    std::string path = env::getEnvVar("DXVK_FRAME_STATS");
+
+    if (path.empty())
+      path = device->config().frameStats;
+
+    if (path.empty() || path == "0")
+      return nullptr;
+
+    if (path == "1") {
+      path = env::getEnvVar("DXVK_LOG_PATH");
+
+      if (path == "none")
+        path.clear();
+
+      if (!path.empty() && *path.rbegin() != '/')
+        path += '/';
+
+      path += env::getExeBaseName() + "_frame_stats.csv";
+    }
+
+    return std::make_unique<DxvkFrameStatsWriter>(device, path);
+  }
+
+
+  void DxvkFrameStatsWriter::runWriter() {
+    env::setThreadName("dxvk-frame-stats");
+
+    std::unique_lock<dxvk::mutex> lock(m_mutex);
+
+    while (true) {
+      m_cond.wait(lock, [this] {
+        return m_stopped || !m_queue.empty();
+      });
+
+      if (m_queue.empty()) {
+        m_stream.flush();
+        return;
+      }
+
+      std::queue<DxvkFrameStats> frames = std::move(m_queue);
+      m_queue = std::queue<DxvkFrameStats>();
+      lock.unlock();
+
+      while (!frames.empty()) {
+        writeFrame(frames.front());
+        frames.pop();
+      }
+
+      m_stream.flush();
+
+      lock.lock();
+    }
+  }
+
+
+  void DxvkFrameStatsWriter::writeFrame(
+    const DxvkFrameStats&           frame) {
+    m_stream << frame.frameId
+      << "," << frame.timestamp
+      << "," << frame.frameTime
+      << "," << frame.counters.getCtr(DxvkStatCounter::CmdDrawCalls)
+      << "," << frame.counters.getCtr(DxvkStatCounter::CmdDispatchCalls)
+      << "," << frame.counters.getCtr(DxvkStatCounter::CmdRenderPassCount)
+      << "," << frame.counters.getCtr(DxvkStatCounter::QueueSubmitCount)
+      << "," << frame.counters.getCtr(DxvkStatCounter::PipeCountGraphics)
+      << "," << frame.counters.getCtr(DxvkStatCounter::PipeCountCompute)
+      << "," << frame.counters.getCtr(DxvkStatCounter::PipeCompilerBusy)
+      << "," << frame.counters.getCtr(DxvkStatCounter::GpuIdleTicks)
+      << "," << frame.deviceMemory.memoryAllocated
+      << "," << frame.deviceMemory.memoryUsed
+      << "," << frame.systemMemory.memoryAllocated
+      << "," << frame.systemMemory.memoryUsed
+      << "\n";
+  }
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <queue>
+
+#include "../util/thread.h"
+#include "../util/util_time.h"
+
+#include "dxvk_memory.h"
+#include "dxvk_stats.h"
+
+namespace dxvk {
+
+  class DxvkDevice;
+
+  /**
+   * \brief Per-frame statistics
+   *
+   * Counter deltas and memory usage
+   * collected for a single frame.
+   */
+  struct DxvkFrameStats {
+    uint64_t          frameId;
+    uint64_t          timestamp;
+    uint64_t          frameTime;
+    DxvkStatCounters  counters;
+    DxvkMemoryStats   deviceMemory;
+    DxvkMemoryStats   systemMemory;
+  };
+
+
+  /**
+   * \brief Frame statistics writer
+   *
+   * Records stat counter deltas, frame times and memory
+   * statistics at every present and writes them to a CSV
+   * file on a background thread, so that automated runs
+   * can compare frame time percentiles and per-frame
+   * draw counts between builds.
+   *
+   * Enabled by setting \c DXVK_FRAME_STATS, or the
+   * \c dxvk.frameStats option, to a file path. A value
+   * of \c 1 writes to the default log directory.
+   */
+  class DxvkFrameStatsWriter {
+
+  public:
+
+    DxvkFrameStatsWriter(
+            DxvkDevice*           device,
+      const std::string&          path);
+
+    ~DxvkFrameStatsWriter();
+
+    /**
+     * \brief Records a frame
+     *
+     * Computes counter deltas relative to the previous
+     * frame and queues them for writing. Must be called
+     * once per present.
+     * \param [in] counters Current device stat counters
+     */
+    void recordFrame(
+      const DxvkStatCounters&     counters);
+
+    /**
+     * \brief Creates frame stats writer if enabled
+     *
+     * \param [in] device The DXVK device
+     * \returns Frame stats writer, or \c nullptr
+     */
+    static std::unique_ptr<DxvkFrameStatsWriter> createWriter(
+            DxvkDevice*           device);
+
+  private:
+
+    DxvkDevice*                       m_device;
+
+    VkPhysicalDeviceMemoryProperties  m_memory;
+
+    DxvkStatCounters                  m_prevCounters;
+    dxvk::high_resolution_clock::time_point m_startTime;
+    dxvk::high_resolution_clock::time_point m_prevTime;
+    uint64_t                          m_frameId = 0;
+
+    dxvk::mutex                       m_mutex;
+    dxvk::condition_variable          m_cond;
+    std::queue<DxvkFrameStats>        m_queue;
+    bool                              m_stopped = false;
+
+    std::ofstream                     m_stream;
+
+    dxvk::thread                      m_thread;
+
+    void runWriter();
+
+    void writeFrame(
+      const DxvkFrameStats&           frame);
+
+  };
+
+}
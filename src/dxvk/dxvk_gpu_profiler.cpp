@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "dxvk_device.h"
+#include "dxvk_gpu_profiler.h"
+
+namespace dxvk {
+
+  DxvkGpuProfiler::DxvkGpuProfiler(DxvkDevice* device)
+  : m_timestampPeriod(device->properties().core.properties.limits.timestampPeriod),
+    m_lastUpdate(dxvk::high_resolution_clock::now()) {
+    std::string path = env::getEnvVar("DXVK_LOG_PATH");
+
+    if (path == "none")
+      path.clear();
+
+    if (!path.empty() && *path.rbegin() != '/')
+      path += '/';
+
+    path += env::getExeBaseName() + "_gpu_profile.log";
+
+    m_log = std::ofstream(str::tows(path.c_str()).c_str());
+
+    if (!m_log)
+      Logger::err(str::format("DxvkGpuProfiler: Failed to open ", path));
+    else
+      Logger::info(str::format("DxvkGpuProfiler: Writing GPU profile to ", path));
+  }
+
+
+  DxvkGpuProfiler::~DxvkGpuProfiler() {
+
+  }
+
+
+  void DxvkGpuProfiler::addSample(
+    const char*                 label,
+          uint64_t              ns) {
+    std::lock_guard<dxvk::mutex> lock(m_mutex);
+
+    auto& entry = m_samples[label];
+    entry.ns    += ns;
+    entry.count += 1;
+  }
+
+
+  void DxvkGpuProfiler::endFrame() {
+    std::lock_guard<dxvk::mutex> lock(m_mutex);
+
+    m_frameCount += 1;
+    m_frameId    += 1;
+
+    auto now = dxvk::high_resolution_clock::now();
+
+    if (now - m_lastUpdate < std::chrono::seconds(1))
+      return;
+
+    m_stats.clear();
+
+    for (const auto& sample : m_samples) {
+      DxvkGpuProfilerStat stat;
+      stat.label         = sample.first;
+      stat.msPerFrame    = double(sample.second.ns) / (1000000.0 * double(m_frameCount));
+      stat.countPerFrame = double(sample.second.count) / double(m_frameCount);
+      m_stats.push_back(std::move(stat));
+    }
+
+    std::sort(m_stats.begin(), m_stats.end(),
+      [] (const DxvkGpuProfilerStat& a, const DxvkGpuProfilerStat& b) {
+        return a.msPerFrame > b.msPerFrame;
+      });
+
+    writeStats();
+
+    m_samples.clear();
+    m_frameCount = 0;
+    m_lastUpdate = now;
+  }
+
+
+  std::vector<DxvkGpuProfilerStat> DxvkGpuProfiler::getStats() const {
+    std::lock_guard<dxvk::mutex> lock(m_mutex);
+    return m_stats;
+  }
+
+
+  Rc<DxvkGpuProfiler> DxvkGpuProfiler::createProfiler(
+          DxvkDevice*           device) {
+    std::string env = env::getEnvVar("DXVK_GPU_PROFILE");
+
+    bool enable = env.empty()
+      ? device->config().enableGpuProfiler
+      : env == "1";
+
+    if (!enable)
+      return nullptr;
+
+    if (!device->properties().core.properties.limits.timestampComputeAndGraphics) {
+      Logger::warn("DxvkGpuProfiler: Time stamps not supported by device");
+      return nullptr;
+    }
+
+    return new DxvkGpuProfiler(device);
+  }
+
+
+  void DxvkGpuProfiler::writeStats() {
+    if (!m_log)
+      return;
+
+    m_log << "Frame " << m_frameId << " (" << m_frameCount << " frames averaged):" << std::endl;
+
+    for (const auto& stat : m_stats) {
+      m_log << "  " << std::left << std::setw(32) << stat.label << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10) << stat.msPerFrame << " ms"
+            << std::setprecision(1) << std::setw(10) << stat.countPerFrame << " scopes" << std::endl;
+    }
+  }
+
+
+
+
+  DxvkGpuProfilerRecorder::DxvkGpuProfilerRecorder(
+    const Rc<DxvkDevice>&       device,
+    const Rc<DxvkGpuProfiler>&  profiler)
+  : m_device(device), m_profiler(profiler) {
+
+  }
+
+
+  DxvkGpuProfilerRecorder::~DxvkGpuProfilerRecorder() {
+
+  }
+
+
+  uint32_t DxvkGpuProfilerRecorder::beginScope(
+    const Rc<DxvkCommandList>&  cmd,
+          DxvkGpuQueryManager&  queries,
+    const char*                 label) {
+    this->endDispatchBatch(cmd, queries);
+
+    Scope scope;
+    scope.label = label;
+    scope.begin = allocQuery();
+    scope.end   = allocQuery();
+
+    queries.writeTimestamp(cmd, scope.begin);
+
+    uint32_t index;
+
+    if (!m_freeSlots.empty()) {
+      index = m_freeSlots.back();
+      m_freeSlots.pop_back();
+      m_active[index] = std::move(scope);
+    } else {
+      index = uint32_t(m_active.size());
+      m_active.push_back(std::move(scope));
+    }
+
+    return index;
+  }
+
+
+  void DxvkGpuProfilerRecorder::endScope(
+    const Rc<DxvkCommandList>&  cmd,
+          DxvkGpuQueryManager&  queries,
+          uint32_t              scope) {
+    Scope& entry = m_active[scope];
+    queries.writeTimestamp(cmd, entry.end);
+
+    m_pending.push(std::move(entry));
+    m_freeSlots.push_back(scope);
+  }
+
+
+  void DxvkGpuProfilerRecorder::beginDispatchBatch(
+    const Rc<DxvkCommandList>&  cmd,
+          DxvkGpuQueryManager&  queries) {
+    if (m_dispatchScope == ~0u)
+      m_dispatchScope = this->beginScope(cmd, queries, "dispatch");
+  }
+
+
+  void DxvkGpuProfilerRecorder::endDispatchBatch(
+    const Rc<DxvkCommandList>&  cmd,
+          DxvkGpuQueryManager&  queries) {
+    if (m_dispatchScope != ~0u) {
+      uint32_t scope = std::exchange(m_dispatchScope, ~0u);
+      this->endScope(cmd, queries, scope);
+    }
+  }
+
+
+  void DxvkGpuProfilerRecorder::readResults() {
+    while (!m_pending.empty()) {
+      Scope& scope = m_pending.front();
+
+      DxvkQueryData beginData;
+      DxvkQueryData endData;
+
+      DxvkGpuQueryStatus beginStatus = scope.begin->getData(beginData);
+      DxvkGpuQueryStatus endStatus   = scope.end->getData(endData);
+
+      // Scopes complete in submission order, so we
+      // can stop at the first one that is not ready
+      if (beginStatus == DxvkGpuQueryStatus::Pending
+       || endStatus   == DxvkGpuQueryStatus::Pending)
+        break;
+
+      if (beginStatus == DxvkGpuQueryStatus::Available
+       && endStatus   == DxvkGpuQueryStatus::Available
+       && endData.timestamp.time >= beginData.timestamp.time) {
+        m_profiler->addSample(scope.label, m_profiler->ticksToNs(
+          endData.timestamp.time - beginData.timestamp.time));
+      }
+
+      this->freeScope(scope);
+      m_pending.pop();
+    }
+  }
+
+
+  Rc<DxvkGpuQuery> DxvkGpuProfilerRecorder::allocQuery() {
+    if (m_freeQueries.empty())
+      return m_device->createGpuQuery(VK_QUERY_TYPE_TIMESTAMP, 0, 0);
+
+    Rc<DxvkGpuQuery> query = std::move(m_freeQueries.back());
+    m_freeQueries.pop_back();
+    return query;
+  }
+
+
+  void DxvkGpuProfilerRecorder::freeScope(Scope& scope) {
+    m_freeQueries.push_back(std::move(scope.begin));
+    m_freeQueries.push_back(std::move(scope.end));
+  }
+
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <fstream>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "../util/thread.h"
+#include "../util/util_time.h"
+
+#include "dxvk_gpu_query.h"
+
+namespace dxvk {
+
+  class DxvkDevice;
+
+  /**
+   * \brief GPU profiler statistics
+   *
+   * Average GPU time spent in all scopes
+   * with a given label, per frame.
+   */
+  struct DxvkGpuProfilerStat {
+    std::string label;
+    double      msPerFrame;
+    double      countPerFrame;
+  };
+
+
+  /**
+   * \brief GPU profiler
+   *
+   * Aggregates GPU time stamp deltas for labeled scopes,
+   * such as render passes, compute dispatches and meta
+   * operations. Results are averaged over one-second
+   * intervals, written to a log file, and can be
+   * displayed by the HUD.
+   *
+   * Enabled by setting \c DXVK_GPU_PROFILE=1 or
+   * the \c dxvk.enableGpuProfiler option.
+   */
+  class DxvkGpuProfiler : public RcObject {
+
+  public:
+
+    DxvkGpuProfiler(DxvkDevice* device);
+
+    ~DxvkGpuProfiler();
+
+    /**
+     * \brief Converts time stamp ticks to nanoseconds
+     *
+     * \param [in] ticks Time stamp delta
+     * \returns Time in nanoseconds
+     */
+    uint64_t ticksToNs(uint64_t ticks) const {
+      return uint64_t(double(ticks) * m_timestampPeriod);
+    }
+
+    /**
+     * \brief Adds a sample
+     *
+     * \param [in] label Scope label
+     * \param [in] ns GPU time, in nanoseconds
+     */
+    void addSample(
+      const char*                 label,
+            uint64_t              ns);
+
+    /**
+     * \brief Notifies the profiler of a new frame
+     *
+     * Updates the statistics once per second.
+     */
+    void endFrame();
+
+    /**
+     * \brief Queries most recent statistics
+     * \returns Per-label statistics, sorted by GPU time
+     */
+    std::vector<DxvkGpuProfilerStat> getStats() const;
+
+    /**
+     * \brief Creates GPU profiler if enabled
+     *
+     * \param [in] device The DXVK device
+     * \returns GPU profiler, or \c nullptr
+     */
+    static Rc<DxvkGpuProfiler> createProfiler(
+            DxvkDevice*           device);
+
+  private:
+
+    struct Accumulator {
+      uint64_t ns    = 0;
+      uint64_t count = 0;
+    };
+
+    double                      m_timestampPeriod;
+
+    mutable dxvk::mutex         m_mutex;
+    std::unordered_map<std::string, Accumulator> m_samples;
+    std::vector<DxvkGpuProfilerStat> m_stats;
+
+    uint64_t                    m_frameCount = 0;
+    uint64_t                    m_frameId    = 0;
+    dxvk::high_resolution_clock::time_point m_lastUpdate;
+
+    std::ofstream               m_log;
+
+    void writeStats();
+
+  };
+
+
+  /**
+   * \brief GPU profiler recorder
+   *
+   * Per-context helper that writes time stamps at the
+   * beginning and end of each scope, and reads back the
+   * results asynchronously once they become available.
+   * Compute dispatches are batched into a single scope
+   * until any other profiled operation starts.
+   */
+  class DxvkGpuProfilerRecorder {
+
+  public:
+
+    DxvkGpuProfilerRecorder(
+      const Rc<DxvkDevice>&       device,
+      const Rc<DxvkGpuProfiler>&  profiler);
+
+    ~DxvkGpuProfilerRecorder();
+
+    /**
+     * \brief Begins a scope
+     *
+     * Ends the current dispatch batch, if any.
+     * \param [in] cmd Command list
+     * \param [in] queries Query manager
+     * \param [in] label Scope label. Must be a string literal.
+     * \returns Scope ID to pass to \ref endScope
+     */
+    uint32_t beginScope(
+      const Rc<DxvkCommandList>&  cmd,
+            DxvkGpuQueryManager&  queries,
+      const char*                 label);
+
+    /**
+     * \brief Ends a scope
+     *
+     * \param [in] cmd Command list
+     * \param [in] queries Query manager
+     * \param [in] scope Scope ID
+     */
+    void endScope(
+      const Rc<DxvkCommandList>&  cmd,
+            DxvkGpuQueryManager&  queries,
+            uint32_t              scope);
+
+    /**
+     * \brief Begins or continues a dispatch batch
+     *
+     * \param [in] cmd Command list
+     * \param [in] queries Query manager
+     */
+    void beginDispatchBatch(
+      const Rc<DxvkCommandList>&  cmd,
+            DxvkGpuQueryManager&  queries);
+
+    /**
+     * \brief Ends the current dispatch batch
+     *
+     * \param [in] cmd Command list
+     * \param [in] queries Query manager
+     */
+    void endDispatchBatch(
+      const Rc<DxvkCommandList>&  cmd,
+            DxvkGpuQueryManager&  queries);
+
+    /**
+     * \brief Reads back available results
+     *
+     * Does not block. Should be called at the start
+     * of each command list so that results of older
+     * submissions are forwarded to the profiler.
+     */
+    void readResults();
+
+  private:
+
+    struct Scope {
+      const char*       label;
+      Rc<DxvkGpuQuery>  begin;
+      Rc<DxvkGpuQuery>  end;
+    };
+
+    Rc<DxvkDevice>                m_device;
+    Rc<DxvkGpuProfiler>           m_profiler;
+
+    std::vector<Scope>            m_active;
+    std::vector<uint32_t>         m_freeSlots;
+    std::queue<Scope>             m_pending;
+    std::vector<Rc<DxvkGpuQuery>> m_freeQueries;
+
+    uint32_t                      m_dispatchScope = ~0u;
+
+    Rc<DxvkGpuQuery> allocQuery();
+
+    void freeScope(Scope& scope);
+
+  };
+
+
+  /**
+   * \brief GPU profiler scope
+   *
+   * Convenience class that begins a scope on construction
+   * and ends it on destruction. Does nothing if profiling
+   * is disabled, i.e. if the recorder is \c nullptr.
+   */
+  class DxvkGpuProfilerScope {
+
+  public:
+
+    DxvkGpuProfilerScope(
+            DxvkGpuProfilerRecorder*  recorder,
+      const Rc<DxvkCommandList>&      cmd,
+            DxvkGpuQueryManager&      queries,
+      const char*                     label)
+    : m_recorder(recorder), m_cmd(cmd), m_queries(queries) {
+      if (unlikely(m_recorder != nullptr))
+        m_scope = m_recorder->beginScope(m_cmd, m_queries, label);
+    }
+
+    ~DxvkGpuProfilerScope() {
+      if (unlikely(m_recorder != nullptr))
+        m_recorder->endScope(m_cmd, m_queries, m_scope);
+    }
+
+    DxvkGpuProfilerScope             (const DxvkGpuProfilerScope&) = delete;
+    DxvkGpuProfilerScope& operator = (const DxvkGpuProfilerScope&) = delete;
+
+  private:
+
+    DxvkGpuProfilerRecorder*    m_recorder;
+    const Rc<DxvkCommandList>&  m_cmd;
+    DxvkGpuQueryManager&        m_queries;
+    uint32_t                    m_scope = 0;
+
+  };
+
+}
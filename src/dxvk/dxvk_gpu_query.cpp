@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstring>
 
 #include "dxvk_cmdlist.h"
 #include "dxvk_device.h"
@@ -41,6 +42,11 @@ namespace dxvk {
     if (!m_handle.queryPool)
       return DxvkGpuQueryStatus::Available;
     
+    // Results are copied to host memory at the end of each
+    // command list, so wait for all of them to complete
+    if (isInUse(DxvkAccess::Write))
+      return DxvkGpuQueryStatus::Pending;
+
     // Get query data from all associated handles
     DxvkGpuQueryStatus status = getDataForHandle(queryData, m_handle);
 
@@ -48,14 +54,6 @@ namespace dxvk {
         && status == DxvkGpuQueryStatus::Available; i++)
       status = getDataForHandle(queryData, m_handles[i]);
     
-    // Treat non-precise occlusion queries as available
-    // if we already know the result will be non-zero
-    if ((status == DxvkGpuQueryStatus::Pending)
-     && (m_type == VK_QUERY_TYPE_OCCLUSION)
-     && !(m_flags & VK_QUERY_CONTROL_PRECISE_BIT)
-     && (queryData.occlusion.samplesPassed))
-      status = DxvkGpuQueryStatus::Available;
-    
     return status;
   }
 
@@ -90,29 +88,10 @@ namespace dxvk {
     const DxvkGpuQueryHandle& handle) const {
     DxvkQueryData tmpData;
 
-    // Wait for the query to be reset first
-    VkResult result;
-    
-    if (handle.resetEvent) {
-      result = m_vkd->vkGetEventStatus(
-        m_vkd->device(), handle.resetEvent);
-    
-      if (result == VK_EVENT_RESET)
-        return DxvkGpuQueryStatus::Pending;
-      else if (result != VK_EVENT_SET)
-        return DxvkGpuQueryStatus::Failed;
-    }
-    
-    // Try to copy query data to temporary structure
-    result = m_vkd->vkGetQueryPoolResults(m_vkd->device(),
-      handle.queryPool, handle.queryId, 1,
-      sizeof(DxvkQueryData), &tmpData,
-      sizeof(DxvkQueryData), VK_QUERY_RESULT_64_BIT);
-    
-    if (result == VK_NOT_READY)
-      return DxvkGpuQueryStatus::Pending;
-    else if (result != VK_SUCCESS)
+    if (!handle.result.mapPtr)
       return DxvkGpuQueryStatus::Failed;
+
+    std::memcpy(&tmpData, handle.result.mapPtr, handle.result.length);
     
     // Add numbers to the destination structure
     switch (m_type) {
@@ -161,7 +140,8 @@ namespace dxvk {
   : m_device        (device),
     m_vkd           (device->vkd()),
     m_queryType     (queryType),
-    m_queryPoolSize (queryPoolSize) {
+    m_queryPoolSize (queryPoolSize),
+    m_queryDataSize (getQueryDataSize(queryType)) {
 
   }
 
@@ -231,7 +211,30 @@ namespace dxvk {
       return;
     }
 
+    // Create a host-visible buffer that query
+    // results will be copied to on the GPU
+    DxvkBufferCreateInfo bufferInfo;
+    bufferInfo.size   = m_queryDataSize * m_queryPoolSize;
+    bufferInfo.usage  = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    bufferInfo.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    Rc<DxvkBuffer> buffer;
+
+    try {
+      buffer = m_device->createBuffer(bufferInfo,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    } catch (const DxvkError& e) {
+      Logger::err(e.message());
+      Logger::err(str::format("DXVK: Failed to create query readback buffer (", m_queryType, "; ", m_queryPoolSize, ")"));
+      m_vkd->vkDestroyQueryPool(m_vkd->device(), queryPool, nullptr);
+      return;
+    }
+
     m_pools.push_back(queryPool);
+    m_buffers.push_back(buffer);
 
     VkEventCreateInfo eventInfo;
     eventInfo.sType = VK_STRUCTURE_TYPE_EVENT_CREATE_INFO;
@@ -247,7 +250,25 @@ namespace dxvk {
         return;
       }
 
-      m_handles.push_back({ this, event, queryPool, i });
+      m_handles.push_back({ this, event, queryPool, i,
+        buffer->getSliceHandle(m_queryDataSize * i, m_queryDataSize) });
+    }
+  }
+
+
+  VkDeviceSize DxvkGpuQueryAllocator::getQueryDataSize(
+          VkQueryType         queryType) {
+    switch (queryType) {
+      case VK_QUERY_TYPE_OCCLUSION:
+        return sizeof(DxvkQueryOcclusionData);
+      case VK_QUERY_TYPE_PIPELINE_STATISTICS:
+        return sizeof(DxvkQueryStatisticData);
+      case VK_QUERY_TYPE_TIMESTAMP:
+        return sizeof(DxvkQueryTimestampData);
+      case VK_QUERY_TYPE_TRANSFORM_FEEDBACK_STREAM_EXT:
+        return sizeof(DxvkQueryXfbStreamData);
+      default:
+        return sizeof(DxvkQueryData);
     }
   }
 
@@ -347,7 +368,9 @@ namespace dxvk {
       handle.queryPool,
       handle.queryId);
     
-    cmd->trackResource<DxvkAccess::None>(query);
+    cmd->trackResource<DxvkAccess::Write>(query);
+
+    m_readbacks.push_back(handle);
   }
 
 
@@ -418,7 +441,64 @@ namespace dxvk {
         handle.queryId);
     }
 
-    cmd->trackResource<DxvkAccess::None>(query);
+    cmd->trackResource<DxvkAccess::Write>(query);
+
+    m_readbacks.push_back(handle);
+  }
+
+
+  void DxvkGpuQueryManager::readbackQueries(
+    const Rc<DxvkCommandList>&  cmd) {
+    if (m_readbacks.empty())
+      return;
+
+    // Sort handles so that queries that are adjacent in
+    // the same pool can be copied with a single command
+    std::sort(m_readbacks.begin(), m_readbacks.end(),
+      [] (const DxvkGpuQueryHandle& a, const DxvkGpuQueryHandle& b) {
+        if (a.queryPool != b.queryPool)
+          return a.queryPool < b.queryPool;
+        return a.queryId < b.queryId;
+      });
+
+    size_t first = 0;
+
+    for (size_t i = 1; i <= m_readbacks.size(); i++) {
+      const DxvkGpuQueryHandle& base = m_readbacks[first];
+
+      if (i < m_readbacks.size()) {
+        const DxvkGpuQueryHandle& next = m_readbacks[i];
+        uint32_t count = uint32_t(i - first);
+
+        if (next.queryPool     == base.queryPool
+         && next.queryId       == base.queryId + count
+         && next.result.handle == base.result.handle
+         && next.result.offset == base.result.offset + count * base.result.length)
+          continue;
+      }
+
+      if (base.result.handle) {
+        cmd->cmdCopyQueryPoolResults(
+          base.queryPool, base.queryId, uint32_t(i - first),
+          base.result.handle, base.result.offset, base.result.length,
+          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+      }
+
+      first = i;
+    }
+
+    m_readbacks.clear();
+
+    VkMemoryBarrier barrier;
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext         = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+    cmd->cmdPipelineBarrier(DxvkCmdBuffer::ExecBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_HOST_BIT,
+      0, 1, &barrier, 0, nullptr, 0, nullptr);
   }
   
   
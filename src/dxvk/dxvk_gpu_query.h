@@ -3,6 +3,7 @@
 #include <mutex>
 #include <vector>
 
+#include "dxvk_buffer.h"
 #include "dxvk_resource.h"
 
 namespace dxvk {
@@ -98,13 +99,16 @@ namespace dxvk {
    * Stores the query allocator, as well as
    * the actual pool and query index. Since
    * query pools have to be reset on the GPU,
-   * this also comes with a reset event.
+   * this also comes with a reset event. Query
+   * results are copied to a host-visible slice
+   * at the end of each command list.
    */
   struct DxvkGpuQueryHandle {
     DxvkGpuQueryAllocator* allocator  = nullptr;
     VkEvent                resetEvent = VK_NULL_HANDLE;
     VkQueryPool            queryPool  = VK_NULL_HANDLE;
     uint32_t               queryId    = 0;
+    DxvkBufferSliceHandle  result     = { };
   };
 
 
@@ -178,7 +182,10 @@ namespace dxvk {
      * return \c DxvkGpuQueryStatus::Signaled, and
      * the destination structure will be filled
      * with the data retrieved from all associated
-     * query handles.
+     * query handles. Data only becomes available
+     * once all command lists that used the query
+     * have finished executing, and is read from
+     * host memory without any Vulkan calls.
      * \param [out] queryData Query data
      * \returns Current query status
      */
@@ -279,13 +286,18 @@ namespace dxvk {
     Rc<vk::DeviceFn>  m_vkd;
     VkQueryType       m_queryType;
     uint32_t          m_queryPoolSize;
+    VkDeviceSize      m_queryDataSize;
     
     dxvk::mutex                     m_mutex;
     std::vector<DxvkGpuQueryHandle> m_handles;
     std::vector<VkQueryPool>        m_pools;
+    std::vector<Rc<DxvkBuffer>>     m_buffers;
 
     void createQueryPool();
 
+    static VkDeviceSize getQueryDataSize(
+            VkQueryType         queryType);
+
   };
 
 
@@ -394,11 +406,25 @@ namespace dxvk {
       const Rc<DxvkCommandList>&  cmd,
             VkQueryType           type);
 
+    /**
+     * \brief Copies query results to host memory
+     * 
+     * Copies the results of all queries that ended in
+     * the given command list to their readback slices,
+     * merging queries with adjacent indices into a
+     * single copy. Must be called outside of a render
+     * pass, after all queries have been ended.
+     * \param [in] cmd Command list
+     */
+    void readbackQueries(
+      const Rc<DxvkCommandList>&  cmd);
+
   private:
 
-    DxvkGpuQueryPool*             m_pool;
-    uint32_t                      m_activeTypes;
-    std::vector<Rc<DxvkGpuQuery>> m_activeQueries;
+    DxvkGpuQueryPool*               m_pool;
+    uint32_t                        m_activeTypes;
+    std::vector<Rc<DxvkGpuQuery>>   m_activeQueries;
+    std::vector<DxvkGpuQueryHandle> m_readbacks;
 
     void beginSingleQuery(
       const Rc<DxvkCommandList>&  cmd,
@@ -123,6 +123,8 @@ namespace dxvk {
   VkPipeline DxvkGraphicsPipeline::createPipeline(
     const DxvkGraphicsPipelineStateInfo& state,
     const DxvkRenderPass*                renderPass) const {
+    ProfilerScope scope("DxvkGraphicsPipeline::createPipeline");
+
     if (Logger::logLevel() <= LogLevel::Debug) {
       Logger::debug("Compiling graphics pipeline...");
       this->logPipelineState(LogLevel::Debug, state);
@@ -2,7 +2,10 @@
 
 namespace dxvk {
   
-  DxvkLifetimeTracker:: DxvkLifetimeTracker() { }
+  DxvkLifetimeTracker::DxvkLifetimeTracker()
+  : m_trackingId(allocTrackingId()) { }
+
+
   DxvkLifetimeTracker::~DxvkLifetimeTracker() { }
   
   
@@ -10,6 +13,16 @@ namespace dxvk {
     for (const auto& resource : m_resources)
       resource.first->release(resource.second);
     m_resources.clear();
+
+    // Resources used by the next submission
+    // must not be matched against this one
+    m_trackingId = allocTrackingId();
+  }
+
+
+  uint64_t DxvkLifetimeTracker::allocTrackingId() {
+    static std::atomic<uint64_t> s_nextTrackingId = { 1ull };
+    return s_nextTrackingId++;
   }
   
-}
\ No newline at end of file
+}
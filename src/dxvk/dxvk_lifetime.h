@@ -13,6 +13,10 @@ namespace dxvk {
    * used to guarantee that resources are not destroyed
    * or otherwise accessed in an unsafe manner until the
    * device has finished using them.
+   *
+   * Each tracker is assigned a unique tracking ID every
+   * time it gets reset, so that resources used multiple
+   * times within one command list are only acquired once.
    */
   class DxvkLifetimeTracker {
     
@@ -23,12 +27,21 @@ namespace dxvk {
     
     /**
      * \brief Adds a resource to track
+     *
+     * Does nothing if the resource has already been
+     * tracked with the same access type since the
+     * last reset, which avoids redundant reference
+     * count updates for resources used in many draws.
      * \param [in] rc The resource to track
      */
-    template<DxvkAccess Access>
-    void trackResource(Rc<DxvkResource>&& rc) {
-      rc->acquire(Access);
-      m_resources.emplace_back(std::move(rc), Access);
+    template<DxvkAccess Access, typename T>
+    void trackResource(const Rc<T>& rc) {
+      DxvkResource* resource = rc.ptr();
+
+      if (resource->trackOnce(Access, m_trackingId)) {
+        resource->acquire(Access);
+        m_resources.emplace_back(resource, Access);
+      }
     }
     
     /**
@@ -41,8 +54,12 @@ namespace dxvk {
     
   private:
     
+    uint64_t m_trackingId = 0;
+
     std::vector<std::pair<Rc<DxvkResource>, DxvkAccess>> m_resources;
+
+    static uint64_t allocTrackingId();
     
   };
   
-}
\ No newline at end of file
+}
@@ -10,6 +10,8 @@ namespace dxvk {
     useRawSsbo            = config.getOption<Tristate>("dxvk.useRawSsbo",             Tristate::Auto);
     halveNvidiaHVVHeap    = config.getOption<Tristate>("dxvk.halveNvidiaHVVHeap",     Tristate::Auto);
     hud                   = config.getOption<std::string>("dxvk.hud", "");
+    frameStats            = config.getOption<std::string>("dxvk.frameStats", "");
+    enableGpuProfiler     = config.getOption<bool>    ("dxvk.enableGpuProfiler",      false);
   }
 
 }
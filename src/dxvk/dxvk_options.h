@@ -32,6 +32,12 @@ namespace dxvk {
 
     /// HUD elements
     std::string hud;
+
+    /// Per-frame statistics log file
+    std::string frameStats;
+
+    /// Enables GPU time stamp profiling
+    bool enableGpuProfiler;
   };
 
 }
@@ -97,6 +97,10 @@ namespace dxvk {
       DxvkSubmitEntry entry = std::move(m_submitQueue.front());
       lock.unlock();
 
+      ProfilerScope scope(entry.submit.cmdList != nullptr
+        ? "DxvkSubmissionQueue::submit"
+        : "DxvkSubmissionQueue::present");
+
       // Submit command buffer to device
       VkResult status = VK_NOT_READY;
 
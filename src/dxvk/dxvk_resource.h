@@ -82,12 +82,37 @@ namespace dxvk {
         return !isInUse(access);
       });
     }
+
+    /**
+     * \brief Marks resource as tracked by a command list
+     *
+     * Stores the tracking ID of the command list that last
+     * acquired the resource with the given access type.
+     * Tracking IDs are unique per command list submission,
+     * so any further uses of the resource within the same
+     * command list do not need to be tracked again.
+     * \param [in] access Resource access type
+     * \param [in] trackingId Command list tracking ID
+     * \returns \c true if the resource was not tracked
+     *    with the given ID and access type yet
+     */
+    bool trackOnce(DxvkAccess access, uint64_t trackingId) {
+      auto& id = m_trackingIds[uint32_t(access)];
+
+      if (id.load(std::memory_order_relaxed) == trackingId)
+        return false;
+
+      id.store(trackingId, std::memory_order_relaxed);
+      return true;
+    }
     
   private:
     
     std::atomic<uint32_t> m_useCountR = { 0u };
     std::atomic<uint32_t> m_useCountW = { 0u };
 
+    std::atomic<uint64_t> m_trackingIds[3] = { };
+
   };
   
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "dxvk_shader.h"
 
+#include "../spirv/spirv_optimizer.h"
+
 #include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
@@ -43,14 +45,44 @@ namespace dxvk {
   }
 
 
+  bool DxvkShaderModuleKey::eq(const DxvkShaderModuleKey& other) const {
+    return bindingIds            == other.bindingIds
+        && info.fsDualSrcBlend   == other.info.fsDualSrcBlend
+        && info.undefinedInputs  == other.info.undefinedInputs;
+  }
+
+
+  size_t DxvkShaderModuleKey::hash() const {
+    DxvkHashState state;
+
+    for (uint32_t id : bindingIds)
+      state.add(id);
+
+    state.add(uint32_t(info.fsDualSrcBlend));
+    state.add(info.undefinedInputs);
+    return state;
+  }
+
+
+  DxvkShaderModule::Handle::~Handle() {
+    vkd->vkDestroyShaderModule(vkd->device(), module, nullptr);
+  }
+
+
   DxvkShaderModule::DxvkShaderModule()
-  : m_vkd(nullptr), m_stage() {
+  : m_handle(nullptr), m_stage() {
+
+  }
+
+
+  DxvkShaderModule::DxvkShaderModule(const DxvkShaderModule& other)
+  : m_handle(other.m_handle), m_stage(other.m_stage) {
 
   }
 
 
   DxvkShaderModule::DxvkShaderModule(DxvkShaderModule&& other)
-  : m_vkd(std::move(other.m_vkd)) {
+  : m_handle(std::move(other.m_handle)) {
     this->m_stage = other.m_stage;
     other.m_stage = VkPipelineShaderStageCreateInfo();
   }
@@ -60,7 +92,9 @@ namespace dxvk {
     const Rc<vk::DeviceFn>&     vkd,
     const Rc<DxvkShader>&       shader,
     const SpirvCodeBuffer&      code)
-  : m_vkd(vkd), m_stage() {
+  : m_handle(new Handle()), m_stage() {
+    m_handle->vkd = vkd;
+
     m_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     m_stage.pNext = nullptr;
     m_stage.flags = 0;
@@ -76,27 +110,36 @@ namespace dxvk {
     info.codeSize = code.size();
     info.pCode    = code.data();
     
-    if (m_vkd->vkCreateShaderModule(m_vkd->device(), &info, nullptr, &m_stage.module) != VK_SUCCESS)
+    if (vkd->vkCreateShaderModule(vkd->device(), &info, nullptr, &m_handle->module) != VK_SUCCESS)
       throw DxvkError("DxvkComputePipeline::DxvkComputePipeline: Failed to create shader module");
+
+    m_stage.module = m_handle->module;
   }
   
   
   DxvkShaderModule::~DxvkShaderModule() {
-    if (m_vkd != nullptr) {
-      m_vkd->vkDestroyShaderModule(
-        m_vkd->device(), m_stage.module, nullptr);
-    }
+    
   }
   
   
+  DxvkShaderModule& DxvkShaderModule::operator = (const DxvkShaderModule& other) {
+    this->m_handle = other.m_handle;
+    this->m_stage  = other.m_stage;
+    return *this;
+  }
+
+
   DxvkShaderModule& DxvkShaderModule::operator = (DxvkShaderModule&& other) {
-    this->m_vkd   = std::move(other.m_vkd);
-    this->m_stage = other.m_stage;
-    other.m_stage = VkPipelineShaderStageCreateInfo();
+    this->m_handle = std::move(other.m_handle);
+    this->m_stage  = other.m_stage;
+    other.m_stage  = VkPipelineShaderStageCreateInfo();
     return *this;
   }
 
 
+  std::atomic<size_t> DxvkShader::s_cachedCodeSize = { 0ull };
+
+
   DxvkShader::DxvkShader(
           VkShaderStageFlagBits   stage,
           uint32_t                slotCount,
@@ -105,8 +148,17 @@ namespace dxvk {
           SpirvCodeBuffer         code,
     const DxvkShaderOptions&      options,
           DxvkShaderConstData&&   constData)
-  : m_stage(stage), m_code(code), m_interface(iface),
+  : m_stage(stage), m_interface(iface),
     m_options(options), m_constData(std::move(constData)) {
+    // Clean up the generated code once, so that all
+    // pipelines using this shader can benefit from it
+    static const bool s_optimize = env::getEnvVar("DXVK_SHADER_OPTIMIZE") == "1";
+
+    if (s_optimize)
+      code = SpirvOptimizer::optimize(code);
+
+    m_code = SpirvCompressedBuffer(code);
+
     // Write back resource slot infos
     for (uint32_t i = 0; i < slotCount; i++)
       m_slots.push_back(slotInfos[i]);
@@ -146,11 +198,16 @@ namespace dxvk {
           m_flags.set(DxvkShaderFlag::ExportsViewportIndexLayerFromVertexStage);
       }
     }
+
+    // Gather everything needed to replace undefined
+    // input variables so that this can be done with
+    // a single linear pass over the code later on.
+    gatherInputPatches(code);
   }
   
   
   DxvkShader::~DxvkShader() {
-    
+    s_cachedCodeSize -= m_moduleCodeSize;
   }
   
   
@@ -171,6 +228,20 @@ namespace dxvk {
     const Rc<vk::DeviceFn>&          vkd,
     const DxvkDescriptorSlotMapping& mapping,
     const DxvkShaderModuleCreateInfo& info) {
+    DxvkShaderModuleKey key;
+    key.bindingIds.reserve(m_slots.size());
+    key.info = info;
+
+    for (const auto& slot : m_slots)
+      key.bindingIds.push_back(mapping.getBindingId(slot.slot));
+
+    { std::lock_guard<dxvk::mutex> lock(m_moduleMutex);
+
+      auto entry = m_modules.find(key);
+      if (entry != m_modules.end())
+        return entry->second;
+    }
+
     SpirvCodeBuffer spirvCode = m_code.decompress();
     uint32_t* code = spirvCode.data();
     
@@ -186,10 +257,27 @@ namespace dxvk {
       std::swap(code[m_o1IdxOffset], code[m_o1LocOffset]);
     
     // Replace undefined input variables with zero
-    for (uint32_t u : bit::BitMask(info.undefinedInputs))
-      eliminateInput(spirvCode, u);
+    if (info.undefinedInputs)
+      eliminateInputs(spirvCode, info.undefinedInputs);
+
+    DxvkShaderModule module(vkd, this, spirvCode);
+
+    // Only cache the module if we are within budget. Another
+    // thread may have created the same variant in the meantime,
+    // in which case we keep the existing module.
+    std::lock_guard<dxvk::mutex> lock(m_moduleMutex);
+
+    if (m_modules.size() < MaxCachedModules
+     && s_cachedCodeSize + spirvCode.size() <= MaxCachedCodeSize) {
+      auto status = m_modules.insert({ std::move(key), module });
+
+      if (status.second) {
+        s_cachedCodeSize += spirvCode.size();
+        m_moduleCodeSize += spirvCode.size();
+      }
+    }
 
-    return DxvkShaderModule(vkd, this, spirvCode);
+    return module;
   }
   
   
@@ -198,7 +286,8 @@ namespace dxvk {
   }
 
 
-  void DxvkShader::eliminateInput(SpirvCodeBuffer& code, uint32_t location) {
+  void DxvkShader::gatherInputPatches(
+          SpirvCodeBuffer&        code) {
     struct SpirvTypeInfo {
       spv::Op           op            = spv::OpNop;
       uint32_t          baseTypeId    = 0;
@@ -208,20 +297,28 @@ namespace dxvk {
 
     std::unordered_map<uint32_t, SpirvTypeInfo> types;
     std::unordered_map<uint32_t, uint32_t>      constants;
-    std::unordered_set<uint32_t>                candidates;
+    std::unordered_map<uint32_t, uint32_t>      privatePtrTypes;
+    std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> locations;
+    std::unordered_map<uint32_t, uint32_t>      interfaceOffsets;
 
-    // Find the input variable in question
-    size_t   inputVarOffset = 0;
-    uint32_t inputVarTypeId = 0;
-    uint32_t inputVarId     = 0;
+    // Maps input variables and access chains derived from
+    // them to the patch index and access chain depth
+    std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> inputIds;
+    std::unordered_map<uint32_t, uint32_t> inputVarTypes;
 
     for (auto ins : code) {
-      if (ins.opCode() == spv::OpDecorate) {
-        if (ins.arg(2) == spv::DecorationLocation
-         && ins.arg(3) == location)
-          candidates.insert(ins.arg(1));
+      if (ins.opCode() == spv::OpEntryPoint) {
+        uint32_t argIdx = 3 + code.strLen(ins.chr(3));
+
+        m_entryPointOffset = ins.offset();
+
+        for (uint32_t i = argIdx; i < ins.length(); i++)
+          interfaceOffsets.insert({ ins.arg(i), ins.offset() + i });
       }
 
+      if (ins.opCode() == spv::OpDecorate && ins.arg(2) == spv::DecorationLocation)
+        locations.insert({ ins.arg(1), { ins.arg(3), ins.offset() }});
+
       if (ins.opCode() == spv::OpConstant)
         constants.insert({ ins.arg(2), ins.arg(3) });
 
@@ -238,149 +335,190 @@ namespace dxvk {
         types.insert({ ins.arg(1), { ins.opCode(), ins.arg(2), constant->second, spv::StorageClassMax }});
       }
 
-      if (ins.opCode() == spv::OpTypePointer)
+      if (ins.opCode() == spv::OpTypePointer) {
         types.insert({ ins.arg(1), { ins.opCode(), ins.arg(3), 0, spv::StorageClass(ins.arg(2)) }});
 
-      if (ins.opCode() == spv::OpVariable && spv::StorageClass(ins.arg(3)) == spv::StorageClassInput) {
-        if (candidates.find(ins.arg(2)) != candidates.end()) {
-          inputVarOffset = ins.offset();
-          inputVarTypeId = ins.arg(1);
-          inputVarId     = ins.arg(2);
-          break;
-        }
+        if (spv::StorageClass(ins.arg(2)) == spv::StorageClassPrivate)
+          privatePtrTypes.insert({ ins.arg(3), ins.arg(1) });
       }
-    }
 
-    if (!inputVarId)
-      return;
+      if (ins.opCode() == spv::OpVariable && spv::StorageClass(ins.arg(3)) == spv::StorageClassInput) {
+        auto location = locations.find(ins.arg(2));
 
-    // Declare private pointer types
-    auto pointerType = types.find(inputVarTypeId);
-    if (pointerType == types.end())
-      return;
+        if (location == locations.end() || location->second.first >= 32)
+          continue;
 
-    code.beginInsertion(inputVarOffset);
-    std::vector<std::pair<uint32_t, SpirvTypeInfo>> privateTypes;
-
-    for (auto p  = types.find(pointerType->second.baseTypeId);
-              p != types.end();
-              p  = types.find(p->second.baseTypeId)) {
-      std::pair<uint32_t, SpirvTypeInfo> info = *p;
-      info.first = 0;
-      info.second.baseTypeId = p->first;
-      info.second.storageClass = spv::StorageClassPrivate;
-
-      for (auto t : types) {
-        if (t.second.op           == info.second.op
-         && t.second.baseTypeId   == info.second.baseTypeId
-         && t.second.storageClass == info.second.storageClass)
-          info.first = t.first;
-      }
+        InputPatchInfo patch;
+        patch.location         = location->second.first;
+        patch.varId            = ins.arg(2);
+        patch.varOffset        = ins.offset();
+        patch.varLength        = ins.length();
+        patch.decorationOffset = location->second.second;
 
-      if (!info.first) {
-        info.first = code.allocId();
+        auto interfaceOffset = interfaceOffsets.find(patch.varId);
+        if (interfaceOffset != interfaceOffsets.end())
+          patch.interfaceOffset = interfaceOffset->second;
 
-        code.putIns(spv::OpTypePointer, 4);
-        code.putWord(info.first);
-        code.putWord(info.second.storageClass);
-        code.putWord(info.second.baseTypeId);
+        inputIds.insert({ patch.varId, { uint32_t(m_inputPatches.size()), 0u }});
+        inputVarTypes.insert({ patch.varId, ins.arg(1) });
+        m_inputPatches.push_back(std::move(patch));
       }
 
-      privateTypes.push_back(info);
-    }
+      if (ins.opCode() == spv::OpAccessChain
+       || ins.opCode() == spv::OpInBoundsAccessChain) {
+        auto base = inputIds.find(ins.arg(3));
 
-    // Define zero constants
-    uint32_t constantId = 0;
+        if (base != inputIds.end()) {
+          uint32_t depth = base->second.second + ins.length() - 4;
 
-    for (auto i = privateTypes.rbegin(); i != privateTypes.rend(); i++) {
-      if (constantId) {
-        uint32_t compositeSize = i->second.compositeSize;
-        uint32_t compositeId   = code.allocId();
+          m_inputPatches[base->second.first].accessChains.push_back({ ins.offset() + 1, depth });
+          inputIds.insert({ ins.arg(2), { base->second.first, depth }});
+        }
+      }
+    }
+
+    // Resolve the chain of types that private pointers
+    // need to be declared for, from outermost to innermost
+    for (auto& patch : m_inputPatches) {
+      auto pointerType = types.find(inputVarTypes[patch.varId]);
 
-        code.putIns(spv::OpConstantComposite, 3 + compositeSize);
-        code.putWord(i->second.baseTypeId);
-        code.putWord(compositeId);
+      if (pointerType == types.end())
+        continue;
 
-        for (uint32_t i = 0; i < compositeSize; i++)
-          code.putWord(constantId);
+      for (auto p  = types.find(pointerType->second.baseTypeId);
+                p != types.end();
+                p  = types.find(p->second.baseTypeId)) {
+        InputTypeInfo info;
+        info.typeId           = p->first;
+        info.privatePtrTypeId = 0;
+        info.compositeSize    = p->second.compositeSize;
 
-        constantId = compositeId;
-      } else {
-        constantId = code.allocId();
+        auto privatePtrType = privatePtrTypes.find(p->first);
+        if (privatePtrType != privatePtrTypes.end())
+          info.privatePtrTypeId = privatePtrType->second;
 
-        code.putIns(spv::OpConstant, 4);
-        code.putWord(i->second.baseTypeId);
-        code.putWord(constantId);
-        code.putWord(0);
+        patch.types.push_back(info);
       }
     }
+  }
 
-    // Erase and re-declare variable
-    code.erase(4);
 
-    code.putIns(spv::OpVariable, 5);
-    code.putWord(privateTypes[0].first);
-    code.putWord(inputVarId);
-    code.putWord(spv::StorageClassPrivate);
-    code.putWord(constantId);
+  void DxvkShader::eliminateInputs(
+          SpirvCodeBuffer&        code,
+          uint32_t                inputMask) const {
+    struct Edit {
+      uint32_t              offset;
+      uint32_t              skip;
+      std::vector<uint32_t> words;
+    };
 
-    code.endInsertion();
+    std::vector<Edit> edits;
+    std::vector<std::pair<uint32_t, uint32_t>> newPtrTypes;
 
-    // Remove variable from interface list
-    for (auto ins : code) {
-      if (ins.opCode() == spv::OpEntryPoint) {
-        uint32_t argIdx = 2 + code.strLen(ins.chr(2));
+    uint32_t* words = code.data();
+    uint32_t  bound = words[3];
+    uint32_t  removedInterfaceIds = 0;
 
-        while (argIdx < ins.length()) {
-          if (ins.arg(argIdx) == inputVarId) {
-            ins.setArg(0, spv::OpEntryPoint | ((ins.length() - 1) << spv::WordCountShift));
+    // Patches are stored in code order, so private pointer
+    // types declared for one variable can be reused by
+    // variables declared later on
+    for (const auto& patch : m_inputPatches) {
+      if (!(inputMask & (1u << patch.location)) || patch.types.empty())
+        continue;
 
-            code.beginInsertion(ins.offset() + argIdx);
-            code.erase(1);
-            code.endInsertion();
-            break;
-          }
+      Edit edit;
+      edit.offset = patch.varOffset;
+      edit.skip   = patch.varLength;
 
-          argIdx += 1;
+      // Declare private pointer types
+      std::vector<uint32_t> ptrTypeIds(patch.types.size());
+
+      for (size_t i = 0; i < patch.types.size(); i++) {
+        const auto& type = patch.types[i];
+        ptrTypeIds[i] = type.privatePtrTypeId;
+
+        for (size_t j = 0; j < newPtrTypes.size() && !ptrTypeIds[i]; j++) {
+          if (newPtrTypes[j].first == type.typeId)
+            ptrTypeIds[i] = newPtrTypes[j].second;
         }
-      }
-    }
 
-    // Remove location declarations
-    for (auto ins : code) {
-      if (ins.opCode() == spv::OpDecorate
-       && ins.arg(2) == spv::DecorationLocation
-       && ins.arg(1) == inputVarId) {
-        code.beginInsertion(ins.offset());
-        code.erase(4);
-        code.endInsertion();
-        break;
+        if (!ptrTypeIds[i]) {
+          ptrTypeIds[i] = bound++;
+          newPtrTypes.push_back({ type.typeId, ptrTypeIds[i] });
+
+          edit.words.insert(edit.words.end(), {
+            spv::OpTypePointer | (4u << spv::WordCountShift),
+            ptrTypeIds[i], uint32_t(spv::StorageClassPrivate), type.typeId });
+        }
       }
-    }
 
-    // Fix up pointer types used in access chain instructions
-    std::unordered_map<uint32_t, uint32_t> accessChainIds;
+      // Define zero constants, starting with the scalar type
+      uint32_t constantId = 0;
 
-    for (auto ins : code) {
-      if (ins.opCode() == spv::OpAccessChain
-       || ins.opCode() == spv::OpInBoundsAccessChain) {
-        uint32_t depth = ins.length() - 4;
+      for (auto t = patch.types.rbegin(); t != patch.types.rend(); t++) {
+        uint32_t id = bound++;
 
-        if (ins.arg(3) == inputVarId) {
-          // Access chains accessing the variable directly
-          ins.setArg(1, privateTypes.at(depth).first);
-          accessChainIds.insert({ ins.arg(2), depth });
+        if (constantId) {
+          edit.words.insert(edit.words.end(), {
+            spv::OpConstantComposite | ((3u + t->compositeSize) << spv::WordCountShift),
+            t->typeId, id });
+          edit.words.insert(edit.words.end(), t->compositeSize, constantId);
         } else {
-          // Access chains derived from the variable
-          auto entry = accessChainIds.find(ins.arg(2));
-          if (entry != accessChainIds.end()) {
-            depth += entry->second;
-            ins.setArg(1, privateTypes.at(depth).first);
-            accessChainIds.insert({ ins.arg(2), depth });
-          }
+          edit.words.insert(edit.words.end(), {
+            spv::OpConstant | (4u << spv::WordCountShift),
+            t->typeId, id, 0u });
         }
+
+        constantId = id;
+      }
+
+      // Re-declare variable as a private variable
+      edit.words.insert(edit.words.end(), {
+        spv::OpVariable | (5u << spv::WordCountShift),
+        ptrTypeIds[0], patch.varId, uint32_t(spv::StorageClassPrivate), constantId });
+
+      edits.push_back(std::move(edit));
+
+      if (patch.decorationOffset)
+        edits.push_back({ patch.decorationOffset, 4, { } });
+
+      if (patch.interfaceOffset) {
+        edits.push_back({ patch.interfaceOffset, 1, { } });
+        removedInterfaceIds += 1;
+      }
+
+      // Fix up pointer types used in access chain instructions
+      for (const auto& chain : patch.accessChains) {
+        if (chain.second < ptrTypeIds.size())
+          words[chain.first] = ptrTypeIds[chain.second];
       }
     }
+
+    if (edits.empty())
+      return;
+
+    words[3] = bound;
+
+    if (removedInterfaceIds)
+      words[m_entryPointOffset] -= removedInterfaceIds << spv::WordCountShift;
+
+    // Apply all insertions and removals in a single pass
+    std::sort(edits.begin(), edits.end(),
+      [] (const Edit& a, const Edit& b) { return a.offset < b.offset; });
+
+    std::vector<uint32_t> result;
+    result.reserve(code.dwords() + 64);
+
+    uint32_t offset = 0;
+
+    for (const auto& edit : edits) {
+      result.insert(result.end(), words + offset, words + edit.offset);
+      result.insert(result.end(), edit.words.begin(), edit.words.end());
+      offset = edit.offset + edit.skip;
+    }
+
+    result.insert(result.end(), words + offset, words + code.dwords());
+    code = SpirvCodeBuffer(uint32_t(result.size()), result.data());
   }
-  
+
 }
\ No newline at end of file
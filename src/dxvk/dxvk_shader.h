@@ -1,7 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <unordered_map>
 #include <vector>
 
+#include "dxvk_hash.h"
 #include "dxvk_include.h"
 #include "dxvk_limits.h"
 #include "dxvk_pipelayout.h"
@@ -124,6 +127,90 @@ namespace dxvk {
     bool      fsDualSrcBlend  = false;
     uint32_t  undefinedInputs = 0;
   };
+
+
+  /**
+   * \brief Shader module lookup key
+   *
+   * Stores everything that affects the SPIR-V code
+   * of a shader module, i.e. the binding IDs of all
+   * resource slots used by the shader, as well as the
+   * module create info.
+   */
+  struct DxvkShaderModuleKey {
+    std::vector<uint32_t>       bindingIds;
+    DxvkShaderModuleCreateInfo  info;
+
+    bool eq(const DxvkShaderModuleKey& other) const;
+
+    size_t hash() const;
+  };
+  
+  
+  /**
+   * \brief Shader module object
+   * 
+   * Manages a Vulkan shader module. This will not
+   * perform any shader compilation. Instead, the
+   * context will create pipeline objects on the
+   * fly when executing draw calls. Copies share
+   * the same Vulkan shader module.
+   */
+  class DxvkShaderModule {
+    
+  public:
+
+    DxvkShaderModule();
+
+    DxvkShaderModule(const DxvkShaderModule& other);
+
+    DxvkShaderModule(DxvkShaderModule&& other);
+    
+    DxvkShaderModule(
+      const Rc<vk::DeviceFn>&     vkd,
+      const Rc<DxvkShader>&       shader,
+      const SpirvCodeBuffer&      code);
+    
+    ~DxvkShaderModule();
+
+    DxvkShaderModule& operator = (const DxvkShaderModule& other);
+
+    DxvkShaderModule& operator = (DxvkShaderModule&& other);
+    
+    /**
+     * \brief Shader stage creation info
+     * 
+     * \param [in] specInfo Specialization info
+     * \returns Shader stage create info
+     */
+    VkPipelineShaderStageCreateInfo stageInfo(
+      const VkSpecializationInfo* specInfo) const {
+      VkPipelineShaderStageCreateInfo stage = m_stage;
+      stage.pSpecializationInfo = specInfo;
+      return stage;
+    }
+    
+    /**
+     * \brief Checks whether module is valid
+     * \returns \c true if module is valid
+     */
+    operator bool () const {
+      return m_stage.module != VK_NULL_HANDLE;
+    }
+    
+  private:
+
+    struct Handle : public RcObject {
+      Rc<vk::DeviceFn>  vkd;
+      VkShaderModule    module = VK_NULL_HANDLE;
+
+      ~Handle();
+    };
+    
+    Rc<Handle>                      m_handle;
+    VkPipelineShaderStageCreateInfo m_stage;
+    
+  };
   
   
   /**
@@ -294,62 +381,64 @@ namespace dxvk {
     size_t m_o1IdxOffset = 0;
     size_t m_o1LocOffset = 0;
 
-    static void eliminateInput(SpirvCodeBuffer& code, uint32_t location);
-
-  };
-  
-
-  /**
-   * \brief Shader module object
-   * 
-   * Manages a Vulkan shader module. This will not
-   * perform any shader compilation. Instead, the
-   * context will create pipeline objects on the
-   * fly when executing draw calls.
-   */
-  class DxvkShaderModule {
-    
-  public:
-
-    DxvkShaderModule();
-
-    DxvkShaderModule(DxvkShaderModule&& other);
-    
-    DxvkShaderModule(
-      const Rc<vk::DeviceFn>&     vkd,
-      const Rc<DxvkShader>&       shader,
-      const SpirvCodeBuffer&      code);
-    
-    ~DxvkShaderModule();
-
-    DxvkShaderModule& operator = (DxvkShaderModule&& other);
-    
     /**
-     * \brief Shader stage creation info
-     * 
-     * \param [in] specInfo Specialization info
-     * \returns Shader stage create info
+     * \brief Pointer type chain entry for an input
+     *
+     * Stores the type that a private pointer needs to
+     * point to, and an existing private pointer type
+     * for that type if the shader declares one.
      */
-    VkPipelineShaderStageCreateInfo stageInfo(
-      const VkSpecializationInfo* specInfo) const {
-      VkPipelineShaderStageCreateInfo stage = m_stage;
-      stage.pSpecializationInfo = specInfo;
-      return stage;
-    }
-    
+    struct InputTypeInfo {
+      uint32_t typeId;
+      uint32_t privatePtrTypeId;
+      uint32_t compositeSize;
+    };
+
     /**
-     * \brief Checks whether module is valid
-     * \returns \c true if module is valid
+     * \brief Patch info for an input variable
+     *
+     * Stores code offsets of everything that needs to be
+     * patched in order to replace an input variable with
+     * a zero-initialized private variable. Gathered once
+     * when the shader is created.
      */
-    operator bool () const {
-      return m_stage.module != VK_NULL_HANDLE;
-    }
-    
-  private:
-    
-    Rc<vk::DeviceFn>                m_vkd;
-    VkPipelineShaderStageCreateInfo m_stage;
-    
+    struct InputPatchInfo {
+      uint32_t location         = 0;
+      uint32_t varId            = 0;
+      uint32_t varOffset        = 0;
+      uint32_t varLength        = 0;
+      uint32_t decorationOffset = 0;
+      uint32_t interfaceOffset  = 0;
+      std::vector<InputTypeInfo> types;
+      std::vector<std::pair<uint32_t, uint32_t>> accessChains;
+    };
+
+    size_t                      m_entryPointOffset = 0;
+    std::vector<InputPatchInfo> m_inputPatches;
+
+    // Shader modules are cached per variant so that pipelines
+    // using the same shader do not have to decompress and patch
+    // the code every time. Cached code size is limited globally.
+    static constexpr size_t MaxCachedModules    = 64;
+    static constexpr size_t MaxCachedCodeSize   = 128ull << 20;
+
+    static std::atomic<size_t> s_cachedCodeSize;
+
+    dxvk::mutex                   m_moduleMutex;
+    size_t                        m_moduleCodeSize = 0;
+
+    std::unordered_map<
+      DxvkShaderModuleKey,
+      DxvkShaderModule,
+      DxvkHash, DxvkEq>           m_modules;
+
+    void gatherInputPatches(
+            SpirvCodeBuffer&        code);
+
+    void eliminateInputs(
+            SpirvCodeBuffer&        code,
+            uint32_t                inputMask) const;
+
   };
   
 }
\ No newline at end of file
@@ -39,12 +39,14 @@ namespace dxvk::hud {
     addItem<HudDeviceInfoItem>("devinfo", -1, m_device);
     addItem<HudFpsItem>("fps", -1);
     addItem<HudFrameTimeItem>("frametimes", -1);
+    m_framePacing = m_hudItems.add<HudFramePacingItem>("pacing", -1);
     addItem<HudSubmissionStatsItem>("submissions", -1, device);
     addItem<HudDrawCallStatsItem>("drawcalls", -1, device);
     addItem<HudPipelineStatsItem>("pipelines", -1, device);
     addItem<HudMemoryStatsItem>("memory", -1, device);
     addItem<HudGpuLoadItem>("gpuload", -1, device);
     addItem<HudCompilerActivityItem>("compiler", -1, device);
+    addItem<HudGpuProfilerItem>("gpuprofiler", -1, device);
   }
   
   
@@ -56,6 +58,12 @@ namespace dxvk::hud {
   void Hud::update() {
     m_hudItems.update();
   }
+
+
+  void Hud::setFrameRateLimit(double frameRate) {
+    if (m_framePacing != nullptr)
+      m_framePacing->setFrameRateLimit(frameRate);
+  }
   
   
   void Hud::render(
@@ -37,6 +37,15 @@ namespace dxvk::hud {
      */
     void update();
 
+    /**
+     * \brief Sets frame rate limit
+     *
+     * Used to compute frame pacing statistics
+     * relative to the limiter's target interval.
+     * \param [in] frameRate Target frame rate, or 0
+     */
+    void setFrameRateLimit(double frameRate);
+
     /**
      * \brief Render HUD
      * 
@@ -83,6 +92,8 @@ namespace dxvk::hud {
     HudRenderer           m_renderer;
     HudItemSet            m_hudItems;
 
+    Rc<HudFramePacingItem> m_framePacing;
+
     float                 m_scale;
 
     void setupRendererState(
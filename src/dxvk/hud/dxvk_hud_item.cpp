@@ -1,5 +1,6 @@
 #include "dxvk_hud_item.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <version.h>
 
@@ -296,6 +297,138 @@ namespace dxvk::hud {
   }
 
 
+  HudFramePacingItem::HudFramePacingItem() { }
+  HudFramePacingItem::~HudFramePacingItem() { }
+
+
+  void HudFramePacingItem::setFrameRateLimit(double frameRate) {
+    m_targetUs = frameRate > 0.0 ? 1'000'000.0 / frameRate : 0.0;
+  }
+
+
+  void HudFramePacingItem::update(dxvk::high_resolution_clock::time_point time) {
+    auto frameTime = std::chrono::duration_cast<std::chrono::microseconds>(time - m_lastFrame);
+
+    m_dataPoints[m_dataPointId] = float(frameTime.count());
+    m_dataPointId = (m_dataPointId + 1) % NumDataPoints;
+    m_dataPointCount = std::min<uint32_t>(m_dataPointCount + 1, NumDataPoints);
+
+    m_lastFrame = time;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(time - m_lastUpdate);
+
+    if (elapsed.count() >= UpdateInterval) {
+      computeStats();
+      m_lastUpdate = time;
+    }
+
+    elapsed = std::chrono::duration_cast<std::chrono::microseconds>(time - m_lastLog);
+
+    if (elapsed.count() >= LogInterval) {
+      logStats();
+      m_lastLog = time;
+    }
+  }
+
+
+  HudPos HudFramePacingItem::render(
+          HudRenderer&      renderer,
+          HudPos            position) {
+    std::array<std::pair<const char*, std::string>, 5> lines = {{
+      { "Frame time:",  str::format(std::fixed, std::setprecision(2), m_stats.p50, " / ", m_stats.p95, " / ", m_stats.p99, " ms") },
+      { "1% low:",      str::format(std::fixed, std::setprecision(1), m_stats.low1, " FPS") },
+      { "0.1% low:",    str::format(std::fixed, std::setprecision(1), m_stats.low01, " FPS") },
+      { "Std. dev.:",   str::format(std::fixed, std::setprecision(2), m_stats.stdDev, " ms") },
+      { "Jitter:",      m_stats.target > 0.0f
+        ? str::format(std::fixed, std::setprecision(2), m_stats.jitter, " ms (target ", m_stats.target, " ms)")
+        : str::format(std::fixed, std::setprecision(2), m_stats.jitter, " ms (no limit)") },
+    }};
+
+    for (const auto& line : lines) {
+      position.y += 16.0f;
+      renderer.drawText(16.0f,
+        { position.x, position.y },
+        { 1.0f, 0.5f, 0.25f, 1.0f },
+        line.first);
+
+      renderer.drawText(16.0f,
+        { position.x + 168.0f, position.y },
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        line.second);
+      position.y += 4.0f;
+    }
+
+    position.y += 4.0f;
+    return position;
+  }
+
+
+  void HudFramePacingItem::computeStats() {
+    if (!m_dataPointCount)
+      return;
+
+    // Frame times in descending order, so that
+    // the slowest frames are at the start
+    std::array<float, NumDataPoints> sorted;
+    uint32_t count = m_dataPointCount;
+
+    for (uint32_t i = 0; i < count; i++)
+      sorted[i] = m_dataPoints[(m_dataPointId + NumDataPoints - count + i) % NumDataPoints];
+
+    std::sort(sorted.begin(), sorted.begin() + count, std::greater<float>());
+
+    auto percentile = [&] (float p) {
+      uint32_t index = uint32_t(float(count - 1) * (1.0f - p));
+      return sorted[index] / 1000.0f;
+    };
+
+    auto low = [&] (float fraction) {
+      uint32_t n = std::max<uint32_t>(uint32_t(float(count) * fraction), 1u);
+      double sum = 0.0;
+
+      for (uint32_t i = 0; i < n; i++)
+        sum += sorted[i];
+
+      return float(1'000'000.0 * double(n) / sum);
+    };
+
+    double sum = 0.0;
+
+    for (uint32_t i = 0; i < count; i++)
+      sum += sorted[i];
+
+    double mean = sum / double(count);
+    double target = m_targetUs > 0.0 ? m_targetUs : mean;
+
+    double variance = 0.0;
+    double jitter = 0.0;
+
+    for (uint32_t i = 0; i < count; i++) {
+      double delta = double(sorted[i]) - mean;
+      variance += delta * delta;
+      jitter   += std::abs(double(sorted[i]) - target);
+    }
+
+    m_stats.p50     = percentile(0.50f);
+    m_stats.p95     = percentile(0.95f);
+    m_stats.p99     = percentile(0.99f);
+    m_stats.low1    = low(0.01f);
+    m_stats.low01   = low(0.001f);
+    m_stats.stdDev  = float(std::sqrt(variance / double(count)) / 1000.0);
+    m_stats.jitter  = float(jitter / (1000.0 * double(count)));
+    m_stats.target  = float(m_targetUs / 1000.0);
+  }
+
+
+  void HudFramePacingItem::logStats() const {
+    Logger::info(str::format(std::fixed, std::setprecision(2),
+      "Frame pacing: p50 ", m_stats.p50, " ms, p95 ", m_stats.p95, " ms, p99 ", m_stats.p99, " ms",
+      ", 1% low ", m_stats.low1, " FPS, 0.1% low ", m_stats.low01, " FPS",
+      ", std. dev. ", m_stats.stdDev, " ms, jitter ", m_stats.jitter, " ms",
+      ", target ", m_stats.target, " ms"));
+  }
+
+
   HudSubmissionStatsItem::HudSubmissionStatsItem(const Rc<DxvkDevice>& device)
   : m_device(device) {
 
@@ -602,4 +735,67 @@ namespace dxvk::hud {
     return position;
   }
 
+
+
+  HudGpuProfilerItem::HudGpuProfilerItem(const Rc<DxvkDevice>& device)
+  : m_device(device) {
+
+  }
+
+
+  HudGpuProfilerItem::~HudGpuProfilerItem() {
+
+  }
+
+
+  void HudGpuProfilerItem::update(dxvk::high_resolution_clock::time_point time) {
+    Rc<DxvkGpuProfiler> profiler = m_device->gpuProfiler();
+
+    if (profiler != nullptr)
+      m_stats = profiler->getStats();
+  }
+
+
+  HudPos HudGpuProfilerItem::render(
+          HudRenderer&      renderer,
+          HudPos            position) {
+    position.y += 16.0f;
+
+    renderer.drawText(16.0f,
+      { position.x, position.y },
+      { 0.25f, 0.5f, 1.0f, 1.0f },
+      "GPU time:");
+
+    if (m_device->gpuProfiler() == nullptr) {
+      renderer.drawText(16.0f,
+        { position.x + 168.0f, position.y },
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        "disabled");
+    }
+
+    position.y += 4.0f;
+
+    uint32_t count = std::min<uint32_t>(m_stats.size(), MaxEntries);
+
+    for (uint32_t i = 0; i < count; i++) {
+      std::string text = str::format(std::fixed, std::setprecision(2),
+        m_stats[i].msPerFrame, " ms (", std::setprecision(1), m_stats[i].countPerFrame, "x)");
+
+      position.y += 16.0f;
+      renderer.drawText(16.0f,
+        { position.x, position.y },
+        { 1.0f, 1.0f, 0.25f, 1.0f },
+        m_stats[i].label);
+
+      renderer.drawText(16.0f,
+        { position.x + 168.0f, position.y },
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        text);
+      position.y += 4.0f;
+    }
+
+    position.y += 4.0f;
+    return position;
+  }
+
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -79,9 +80,10 @@ namespace dxvk::hud {
      * \param [in] name HUD item name
      * \param [in] at Position at which to insert the item
      * \param [in] args Constructor arguments
+     * \returns The item, or \c nullptr if disabled
      */
     template<typename T, typename... Args>
-    void add(const char* name, int32_t at, Args... args) {
+    Rc<T> add(const char* name, int32_t at, Args... args) {
       bool enable = m_enableFull;
 
       if (!enable) {
@@ -92,10 +94,12 @@ namespace dxvk::hud {
       if (at < 0 || at > int32_t(m_items.size()))
         at = m_items.size();
 
-      if (enable) {
-        m_items.insert(m_items.begin() + at,
-          new T(std::forward<Args>(args)...));
-      }
+      if (!enable)
+        return nullptr;
+
+      Rc<T> item = new T(std::forward<Args>(args)...);
+      m_items.insert(m_items.begin() + at, item);
+      return item;
     }
 
     template<typename T>
@@ -237,6 +241,72 @@ namespace dxvk::hud {
   };
 
 
+  /**
+   * \brief HUD item to display frame pacing statistics
+   *
+   * Keeps a rolling window of present-to-present intervals
+   * and computes frame time percentiles, 1% and 0.1% lows,
+   * the standard deviation of frame times and the average
+   * deviation from the frame rate limiter's target interval.
+   * Results are also written to the log periodically.
+   */
+  class HudFramePacingItem : public HudItem {
+    constexpr static size_t  NumDataPoints  = 1000;
+    constexpr static int64_t UpdateInterval = 500'000;
+    constexpr static int64_t LogInterval    = 10'000'000;
+  public:
+
+    HudFramePacingItem();
+
+    ~HudFramePacingItem();
+
+    /**
+     * \brief Sets frame rate limiter target
+     * \param [in] frameRate Target frame rate, or 0
+     */
+    void setFrameRateLimit(double frameRate);
+
+    void update(dxvk::high_resolution_clock::time_point time);
+
+    HudPos render(
+            HudRenderer&      renderer,
+            HudPos            position);
+
+  private:
+
+    struct Stats {
+      float p50       = 0.0f;
+      float p95       = 0.0f;
+      float p99       = 0.0f;
+      float low1      = 0.0f;
+      float low01     = 0.0f;
+      float stdDev    = 0.0f;
+      float jitter    = 0.0f;
+      float target    = 0.0f;
+    };
+
+    dxvk::high_resolution_clock::time_point m_lastFrame
+      = dxvk::high_resolution_clock::now();
+    dxvk::high_resolution_clock::time_point m_lastUpdate
+      = dxvk::high_resolution_clock::now();
+    dxvk::high_resolution_clock::time_point m_lastLog
+      = dxvk::high_resolution_clock::now();
+
+    double                            m_targetUs    = 0.0;
+
+    std::array<float, NumDataPoints>  m_dataPoints  = {};
+    uint32_t                          m_dataPointId = 0;
+    uint32_t                          m_dataPointCount = 0;
+
+    Stats                             m_stats;
+
+    void computeStats();
+
+    void logStats() const;
+
+  };
+
+
   /**
    * \brief HUD item to display queue submissions
    */
@@ -414,4 +484,34 @@ namespace dxvk::hud {
 
   };
 
+
+  /**
+   * \brief HUD item to display GPU profiler results
+   *
+   * Shows the GPU time spent per frame in the most
+   * expensive profiler scopes. Requires the GPU
+   * profiler to be enabled.
+   */
+  class HudGpuProfilerItem : public HudItem {
+    constexpr static uint32_t MaxEntries = 8;
+  public:
+
+    HudGpuProfilerItem(const Rc<DxvkDevice>& device);
+
+    ~HudGpuProfilerItem();
+
+    void update(dxvk::high_resolution_clock::time_point time);
+
+    HudPos render(
+            HudRenderer&      renderer,
+            HudPos            position);
+
+  private:
+
+    Rc<DxvkDevice> m_device;
+
+    std::vector<DxvkGpuProfilerStat> m_stats;
+
+  };
+
 }
\ No newline at end of file
@@ -1,7 +1,46 @@
 #include "spirv_compression.h"
 
+#if defined(__SSSE3__) || defined(__AVX__)
+#define DXVK_SPIRV_DECOMPRESS_SSSE3
+#endif
+
 namespace dxvk {
 
+#ifdef DXVK_SPIRV_DECOMPRESS_SSSE3
+  /**
+   * \brief Shuffle table for SIMD decompression
+   *
+   * For each control byte, stores the shuffle mask that
+   * expands the packed bytes of four DWORDs into their
+   * full 32-bit representation, as well as the number
+   * of packed bytes consumed by these DWORDs.
+   */
+  struct SpirvDecompressTable {
+    SpirvDecompressTable() {
+      for (uint32_t c = 0; c < 256; c++) {
+        uint8_t offset = 0;
+
+        for (uint32_t w = 0; w < 4; w++) {
+          uint32_t bytes = ((c >> (2 * w)) & 3) + 1;
+
+          for (uint32_t b = 0; b < 4; b++)
+            shuffle[c][4 * w + b] = b < bytes ? offset + b : 0x80;
+
+          offset += bytes;
+        }
+
+        length[c] = offset;
+      }
+    }
+
+    alignas(16) uint8_t shuffle[256][16];
+    uint8_t length[256];
+  };
+
+  static const SpirvDecompressTable g_decompressTable;
+#endif
+
+
   SpirvCompressedBuffer::SpirvCompressedBuffer()
   : m_size(0) {
 
@@ -16,50 +55,40 @@ namespace dxvk {
     // The compression works by eliminating leading null bytes
     // from DWORDs, exploiting that SPIR-V IDs are consecutive
     // integers that usually fall into the 16-bit range. For
-    // each DWORD, a two-bit integer is stored which indicates
-    // the number of bytes it takes in the compressed buffer.
-    // This way, it can achieve a compression ratio of ~50%.
-    m_mask.reserve((m_size + NumMaskWords - 1) / NumMaskWords);
-    m_code.reserve((m_size + 1) / 2);
+    // each DWORD, a two-bit integer is stored in a separate
+    // control stream which indicates the number of bytes it
+    // takes in the data stream, four DWORDs per control byte.
+    // This way, it can achieve a compression ratio of ~50%,
+    // and groups of four DWORDs can be decoded with a single
+    // byte shuffle.
+    m_ctrl.resize((m_size + 3) / 4);
+    m_data.resize(m_size * sizeof(uint32_t));
 
-    uint64_t dstWord  = 0;
-    uint32_t dstShift = 0;
+    uint32_t dataSize = 0;
 
-    for (uint32_t i = 0; i < m_size; i += NumMaskWords) {
-      uint64_t byteCounts = 0;
+    for (uint32_t i = 0; i < m_size; i += 4) {
+      uint32_t ctrl = 0;
 
-      for (uint32_t w = 0; w < NumMaskWords && i + w < m_size; w++) {
-        uint64_t word = data[i + w];
-        uint64_t bytes = 0;
+      for (uint32_t w = 0; w < 4 && i + w < m_size; w++) {
+        uint32_t word  = data[i + w];
+        uint32_t bytes = 0;
 
-        if      (word < (1 <<  8)) bytes = 0;
-        else if (word < (1 << 16)) bytes = 1;
-        else if (word < (1 << 24)) bytes = 2;
-        else                       bytes = 3;
+        if      (word < (1u <<  8)) bytes = 0;
+        else if (word < (1u << 16)) bytes = 1;
+        else if (word < (1u << 24)) bytes = 2;
+        else                        bytes = 3;
 
-        byteCounts |= bytes << (2 * w);
+        ctrl |= bytes << (2 * w);
 
-        uint32_t bits = 8 * bytes + 8;
-        uint32_t rem  = bit::pack(dstWord, dstShift, word, bits);
-
-        if (unlikely(rem != 0)) {
-          m_code.push_back(dstWord);
-
-          dstWord  = 0;
-          dstShift = 0;
-
-          bit::pack(dstWord, dstShift, word >> (bits - rem), rem);
-        }
+        for (uint32_t b = 0; b <= bytes; b++)
+          m_data[dataSize++] = uint8_t(word >> (8 * b));
       }
 
-      m_mask.push_back(byteCounts);
+      m_ctrl[i / 4] = uint8_t(ctrl);
     }
 
-    if (dstShift)
-      m_code.push_back(dstWord);
-
-    m_mask.shrink_to_fit();
-    m_code.shrink_to_fit();
+    m_data.resize(dataSize);
+    m_data.shrink_to_fit();
   }
 
     
@@ -72,36 +101,37 @@ namespace dxvk {
     SpirvCodeBuffer code(m_size);
     uint32_t* data = code.data();
 
-    if (m_size == 0)
-      return code;
+    const uint8_t* src = m_data.data();
 
-    uint32_t maskIdx = 0;
-    uint32_t codeIdx = 0;
+    uint32_t i = 0;
 
-    uint64_t srcWord  = m_code[codeIdx++];
-    uint32_t srcShift = 0;
+#ifdef DXVK_SPIRV_DECOMPRESS_SSSE3
+    const uint8_t* srcEnd = m_data.data() + m_data.size();
 
-    for (uint32_t i = 0; i < m_size; i += NumMaskWords) {
-      uint64_t srcMask = m_mask[maskIdx++];
+    // Decode four DWORDs at a time for as long as a full
+    // 16-byte load does not read past the end of the data
+    for ( ; i + 4 <= m_size && srcEnd - src >= 16; i += 4) {
+      uint8_t ctrl = m_ctrl[i / 4];
 
-      for (uint32_t w = 0; w < NumMaskWords && i + w < m_size; w++) {
-        uint32_t bits = 8 * ((srcMask & 3) + 1);
+      __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      __m128i mask   = _mm_load_si128(reinterpret_cast<const __m128i*>(g_decompressTable.shuffle[ctrl]));
 
-        uint64_t word = 0;
-        uint32_t rem = bit::unpack(word, srcWord, srcShift, bits);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(&data[i]),
+        _mm_shuffle_epi8(packed, mask));
 
-        if (unlikely(rem != 0)) {
-          srcWord  = m_code[codeIdx++];
-          srcShift = 0;
+      src += g_decompressTable.length[ctrl];
+    }
+#endif
 
-          uint64_t tmp = 0;
-          bit::unpack(tmp, srcWord, srcShift, rem);
-          word |= tmp << (bits - rem);
-        }
+    for ( ; i < m_size; i++) {
+      uint32_t bytes = ((m_ctrl[i / 4] >> (2 * (i % 4))) & 3) + 1;
+      uint32_t word  = 0;
 
-        data[i + w] = word;
-        srcMask >>= 2;
-      }
+      for (uint32_t b = 0; b < bytes; b++)
+        word |= uint32_t(src[b]) << (8 * b);
+
+      data[i] = word;
+      src += bytes;
     }
 
     return code;
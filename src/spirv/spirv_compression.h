@@ -13,7 +13,7 @@ namespace dxvk {
    * to keep memory footprint low.
    */
   class SpirvCompressedBuffer {
-    constexpr static uint32_t NumMaskWords = 32;
+
   public:
 
     SpirvCompressedBuffer();
@@ -25,11 +25,27 @@ namespace dxvk {
     
     SpirvCodeBuffer decompress() const;
 
+    /**
+     * \brief Uncompressed code size
+     * \returns Code size, in bytes
+     */
+    size_t size() const {
+      return m_size * sizeof(uint32_t);
+    }
+
+    /**
+     * \brief Compressed code size
+     * \returns Size of stored data, in bytes
+     */
+    size_t compressedSize() const {
+      return m_ctrl.size() + m_data.size();
+    }
+
   private:
 
     uint32_t              m_size;
-    std::vector<uint64_t> m_mask;
-    std::vector<uint64_t> m_code;
+    std::vector<uint8_t>  m_ctrl;
+    std::vector<uint8_t>  m_data;
 
   };
 
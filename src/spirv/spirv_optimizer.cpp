@@ -0,0 +1,1266 @@
+#include <algorithm>
+#include <map>
+
+#include "spirv_optimizer.h"
+
+namespace dxvk {
+
+  SpirvOptimizer::SpirvOptimizer(
+    const SpirvCodeBuffer&        code)
+  : m_words(code.data(), code.data() + code.dwords()) {
+    if (m_words.size() < 5 || m_words[0] != spv::MagicNumber)
+      return;
+
+    m_bound = m_words[3];
+
+    for (uint32_t offset = 5; offset < m_words.size(); ) {
+      uint32_t length = m_words[offset] >> spv::WordCountShift;
+
+      if (!length || offset + length > m_words.size())
+        break;
+
+      m_ins.push_back({ offset, length, false });
+      offset += length;
+    }
+
+    m_insCount = uint32_t(m_ins.size());
+
+    // Any ID referenced by an instruction that we do not
+    // know the operand layout of must not be touched
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      spv::Op op = opCode(i);
+
+      if (op == spv::OpFunction && !m_functionStart)
+        m_functionStart = i;
+
+      if (!getOperandLayout(op).known) {
+        for (uint32_t a = 1; a < m_ins[i].length; a++)
+          m_pinned.insert(words(i)[a]);
+      }
+    }
+  }
+
+
+  SpirvOptimizer::~SpirvOptimizer() {
+
+  }
+
+
+  void SpirvOptimizer::removeDuplicateConstants() {
+    std::map<std::vector<uint32_t>, uint32_t> constants;
+
+    for (uint32_t i = 0; i < m_functionStart; i++) {
+      spv::Op op = opCode(i);
+
+      if (op != spv::OpConstant
+       && op != spv::OpConstantTrue
+       && op != spv::OpConstantFalse
+       && op != spv::OpConstantNull
+       && op != spv::OpConstantComposite)
+        continue;
+
+      // Composites are compared with their operands
+      // resolved, so that nested duplicates match
+      const uint32_t* w = words(i);
+      std::vector<uint32_t> key = { w[0], w[1] };
+
+      for (uint32_t a = 3; a < m_ins[i].length; a++)
+        key.push_back(op == spv::OpConstantComposite ? resolve(w[a]) : w[a]);
+
+      auto entry = constants.insert({ std::move(key), w[2] });
+
+      if (!entry.second)
+        replace(i, entry.first->second);
+    }
+  }
+
+
+  void SpirvOptimizer::promoteVariables() {
+    struct VarInfo {
+      uint32_t ins;
+      uint32_t type;
+      uint32_t init;
+      uint32_t function;
+      bool     isPrivate;
+      bool     promotable;
+    };
+
+    std::unordered_map<uint32_t, uint32_t> pointerTypes;
+    std::unordered_map<uint32_t, VarInfo>  vars;
+    std::unordered_set<uint32_t>           entryPoints;
+    std::unordered_map<uint32_t, uint32_t> callCounts;
+    std::unordered_map<uint32_t, uint32_t> callers;
+    std::unordered_set<uint32_t>           loopFunctions;
+
+    uint32_t function = 0;
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      const uint32_t* w = words(i);
+      spv::Op op = opCode(i);
+
+      switch (op) {
+        case spv::OpEntryPoint:
+          entryPoints.insert(w[2]);
+          break;
+
+        case spv::OpTypePointer:
+          pointerTypes.insert({ w[1], w[3] });
+          break;
+
+        case spv::OpFunction:
+          function = w[2];
+          break;
+
+        case spv::OpFunctionCall:
+          callCounts[w[3]] += 1;
+          callers[w[3]] = function;
+          break;
+
+        case spv::OpLoopMerge:
+          loopFunctions.insert(function);
+          break;
+
+        case spv::OpVariable: {
+          auto storage = spv::StorageClass(w[3]);
+
+          if (storage != spv::StorageClassFunction
+           && storage != spv::StorageClassPrivate)
+            break;
+
+          auto type = pointerTypes.find(w[1]);
+
+          if (type == pointerTypes.end() || m_pinned.count(w[2]))
+            break;
+
+          VarInfo info;
+          info.ins        = i;
+          info.type       = type->second;
+          info.init       = m_ins[i].length > 4 ? w[4] : 0;
+          info.function   = storage == spv::StorageClassFunction ? function : 0;
+          info.isPrivate  = storage == spv::StorageClassPrivate;
+          info.promotable = true;
+          vars.insert({ w[2], info });
+        } break;
+
+        default:
+          break;
+      }
+
+      if (op == spv::OpVariable || vars.empty())
+        continue;
+
+      // Variables must only be accessed through whole
+      // loads and stores, and loaded values must not
+      // be used by any instruction we don't know.
+      forEachIdOperand(i, [&] (uint32_t arg) {
+        auto var = vars.find(w[arg]);
+
+        if (var == vars.end())
+          return;
+
+        bool isAccess = (op == spv::OpLoad && arg == 3 && !m_pinned.count(w[2]))
+                     || (op == spv::OpStore && arg == 1);
+
+        if (!isAccess || !function)
+          var->second.promotable = false;
+
+        if (var->second.function != function) {
+          if (var->second.isPrivate && !var->second.function)
+            var->second.function = function;
+          else
+            var->second.promotable = false;
+        }
+      });
+    }
+
+    // The shader compilers emit the shader body as a function
+    // that the entry point calls once, outside of any loop.
+    auto isEntryPoint = [&] (uint32_t fn) {
+      return entryPoints.count(fn) && !callCounts.count(fn);
+    };
+
+    auto isCalledOnce = [&] (uint32_t fn) {
+      if (isEntryPoint(fn))
+        return true;
+
+      auto count = callCounts.find(fn);
+
+      if (count == callCounts.end() || count->second != 1)
+        return false;
+
+      uint32_t caller = callers[fn];
+      return isEntryPoint(caller) && !loopFunctions.count(caller);
+    };
+
+    // Group promotable variables by function
+    std::unordered_map<uint32_t, std::unordered_map<uint32_t, uint32_t>> functionVars;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> functionVarTypes;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> functionVarInits;
+
+    for (const auto& var : vars) {
+      const VarInfo& info = var.second;
+
+      if (!info.promotable || !info.function)
+        continue;
+
+      // Private variables retain their values across
+      // function calls, so only promote those that are
+      // used by a function that runs once per invocation.
+      if (info.isPrivate && !isCalledOnce(info.function))
+        continue;
+
+      auto& types = functionVarTypes[info.function];
+      functionVars[info.function].insert({ var.first, uint32_t(types.size()) });
+      functionVarInits[info.function].push_back(info.init);
+      types.push_back(info.type);
+    }
+
+    if (functionVars.empty())
+      return;
+
+    uint32_t first = 0;
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      if (opCode(i) == spv::OpFunction)
+        first = i;
+
+      if (opCode(i) == spv::OpFunctionEnd) {
+        auto entry = functionVars.find(words(first)[2]);
+
+        if (entry != functionVars.end()) {
+          promoteFunctionVariables(first, i, entry->second,
+            functionVarTypes[entry->first],
+            functionVarInits[entry->first]);
+        }
+      }
+    }
+  }
+
+
+  void SpirvOptimizer::foldBitcasts() {
+    gatherDefs();
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      if (m_ins[i].removed || opCode(i) != spv::OpBitcast)
+        continue;
+
+      uint32_t* w = words(i);
+      uint32_t src = resolve(w[3]);
+
+      auto def = m_defs.find(src);
+
+      if (def != m_defs.end() && opCode(def->second) == spv::OpBitcast)
+        src = resolve(words(def->second)[3]);
+
+      w[3] = src;
+
+      auto type = m_types.find(src);
+
+      if (type != m_types.end() && type->second == w[1])
+        replace(i, src);
+    }
+  }
+
+
+  void SpirvOptimizer::foldSwizzles() {
+    gatherDefs();
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      if (m_ins[i].removed)
+        continue;
+
+      uint32_t* w = words(i);
+      spv::Op op = opCode(i);
+
+      if (op == spv::OpVectorShuffle) {
+        uint32_t src = getShuffleSource(i);
+
+        if (!src)
+          continue;
+
+        // Merge with a shuffle that only reads one vector
+        auto def = m_defs.find(src);
+
+        if (def != m_defs.end() && opCode(def->second) == spv::OpVectorShuffle) {
+          uint32_t innerSrc = getShuffleSource(def->second);
+          uint32_t srcSize  = getVectorSize(m_types[src]);
+          uint32_t dstSize  = getVectorSize(m_types[innerSrc]);
+
+          if (innerSrc && srcSize && dstSize) {
+            const uint32_t* inner = words(def->second);
+
+            for (uint32_t a = 5; a < m_ins[i].length; a++) {
+              if (w[a] != ~0u) {
+                w[a] = inner[5 + w[a] % srcSize];
+
+                if (w[a] != ~0u)
+                  w[a] %= dstSize;
+              }
+            }
+
+            w[3] = w[4] = src = innerSrc;
+          }
+        }
+
+        // Remove shuffles that return the source vector
+        uint32_t size = getVectorSize(m_types[src]);
+        bool identity = m_types[src] == w[1] && size == m_ins[i].length - 5;
+
+        for (uint32_t a = 5; a < m_ins[i].length && identity; a++)
+          identity = w[a] != ~0u && w[a] % size == a - 5;
+
+        if (identity)
+          replace(i, src);
+      }
+
+      if (op == spv::OpCompositeExtract && m_ins[i].length == 5) {
+        uint32_t src = resolve(w[3]);
+        auto def = m_defs.find(src);
+
+        if (def != m_defs.end() && opCode(def->second) == spv::OpVectorShuffle) {
+          uint32_t innerSrc = getShuffleSource(def->second);
+          uint32_t srcSize  = getVectorSize(m_types[src]);
+          uint32_t dstSize  = getVectorSize(m_types[innerSrc]);
+          uint32_t index    = words(def->second)[5 + w[4]];
+
+          if (innerSrc && srcSize && dstSize && index != ~0u) {
+            w[3] = src = innerSrc;
+            w[4] = index % dstSize;
+            def = m_defs.find(src);
+          }
+        }
+
+        if (def != m_defs.end() && opCode(def->second) == spv::OpCompositeConstruct) {
+          const uint32_t* construct = words(def->second);
+          uint32_t count = m_ins[def->second].length - 3;
+
+          if (count == getVectorSize(construct[1]) && w[4] < count)
+            replace(i, resolve(construct[3 + w[4]]));
+        }
+      }
+
+      if (op == spv::OpCompositeConstruct) {
+        // Constructing a vector from all components
+        // of another vector of the same type
+        uint32_t count = m_ins[i].length - 3;
+        uint32_t src   = 0;
+        bool     match = count == getVectorSize(w[1]);
+
+        for (uint32_t c = 0; c < count && match; c++) {
+          auto def = m_defs.find(resolve(w[3 + c]));
+
+          match = def != m_defs.end()
+               && opCode(def->second) == spv::OpCompositeExtract
+               && m_ins[def->second].length == 5
+               && words(def->second)[4] == c;
+
+          if (match) {
+            uint32_t vec = resolve(words(def->second)[3]);
+            match = (!src || src == vec) && m_types[vec] == w[1];
+            src = vec;
+          }
+        }
+
+        if (match && src)
+          replace(i, src);
+      }
+    }
+  }
+
+
+  void SpirvOptimizer::removeDeadStores() {
+    gatherDefs();
+
+    // Gather all uses of function and private
+    // variables as well as access chains into them
+    std::unordered_map<uint32_t, uint32_t> roots;
+    std::unordered_set<uint32_t>           liveVars;
+    std::vector<uint32_t>                  stores;
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      if (m_ins[i].removed)
+        continue;
+
+      const uint32_t* w = words(i);
+      spv::Op op = opCode(i);
+
+      if (op == spv::OpVariable) {
+        auto storage = spv::StorageClass(w[3]);
+
+        if ((storage == spv::StorageClassFunction || storage == spv::StorageClassPrivate)
+         && !m_pinned.count(w[2]))
+          roots.insert({ w[2], w[2] });
+
+        continue;
+      }
+
+      forEachIdOperand(i, [&] (uint32_t arg) {
+        auto root = roots.find(resolve(w[arg]));
+
+        if (root == roots.end())
+          return;
+
+        if (op == spv::OpStore && arg == 1) {
+          stores.push_back(i);
+        } else if ((op == spv::OpAccessChain || op == spv::OpInBoundsAccessChain)
+                && arg == 3 && !m_pinned.count(w[2])) {
+          roots.insert({ w[2], root->second });
+        } else {
+          liveVars.insert(root->second);
+        }
+      });
+    }
+
+    for (uint32_t i : stores) {
+      if (!liveVars.count(roots[resolve(words(i)[1])]))
+        remove(i);
+    }
+
+    for (const auto& root : roots) {
+      if (liveVars.count(root.second))
+        continue;
+
+      auto def = m_defs.find(root.first);
+
+      if (def != m_defs.end())
+        remove(def->second);
+    }
+  }
+
+
+  void SpirvOptimizer::removeDeadCode() {
+    gatherDefs();
+
+    // Mark all values used by instructions that have
+    // side effects as live, then propagate liveness
+    std::unordered_set<uint32_t> live = m_pinned;
+    std::vector<uint32_t> worklist;
+
+    auto markLive = [&] (uint32_t ins) {
+      const uint32_t* w = words(ins);
+
+      forEachIdOperand(ins, [&] (uint32_t arg) {
+        uint32_t id = resolve(w[arg]);
+
+        if (live.insert(id).second)
+          worklist.push_back(id);
+      });
+    };
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      if (m_ins[i].removed)
+        continue;
+
+      auto layout = getOperandLayout(opCode(i));
+
+      if (!layout.known || !layout.pure || !layout.resultArg)
+        markLive(i);
+    }
+
+    for (uint32_t id : m_pinned) {
+      auto def = m_defs.find(id);
+
+      if (def != m_defs.end())
+        markLive(def->second);
+    }
+
+    while (!worklist.empty()) {
+      uint32_t id = worklist.back();
+      worklist.pop_back();
+
+      auto def = m_defs.find(id);
+
+      if (def != m_defs.end())
+        markLive(def->second);
+    }
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      if (m_ins[i].removed)
+        continue;
+
+      auto layout = getOperandLayout(opCode(i));
+
+      if (layout.known && layout.pure && layout.resultArg
+       && !live.count(words(i)[layout.resultArg]))
+        remove(i);
+    }
+  }
+
+
+  SpirvCodeBuffer SpirvOptimizer::getCode() const {
+    if (m_ins.empty())
+      return SpirvCodeBuffer(uint32_t(m_words.size()), m_words.data());
+
+    std::vector<uint32_t> code(m_words.begin(), m_words.begin() + 5);
+    code.reserve(m_words.size());
+    code[3] = m_bound;
+
+    auto emit = [&] (uint32_t i) {
+      if (m_ins[i].removed)
+        return;
+
+      const uint32_t* w = words(i);
+      spv::Op op = opCode(i);
+
+      // Drop debug names and decorations of removed IDs
+      if ((op == spv::OpName || op == spv::OpDecorate) && m_removedIds.count(w[1]))
+        return;
+
+      size_t offset = code.size();
+      code.insert(code.end(), w, w + m_ins[i].length);
+
+      forEachIdOperand(i, [&] (uint32_t arg) {
+        code[offset + arg] = resolve(w[arg]);
+      });
+    };
+
+    // Inserted instructions are stored after the original
+    // ones, but emitted in front of the given instruction
+    for (uint32_t i = 0; i < m_insCount; i++) {
+      auto inserts = m_inserts.find(i);
+
+      if (inserts != m_inserts.end()) {
+        for (uint32_t ins : inserts->second)
+          emit(ins);
+      }
+
+      emit(i);
+    }
+
+    return SpirvCodeBuffer(uint32_t(code.size()), code.data());
+  }
+
+
+  SpirvCodeBuffer SpirvOptimizer::optimize(
+    const SpirvCodeBuffer&        code) {
+    SpirvOptimizer optimizer(code);
+    optimizer.removeDuplicateConstants();
+    optimizer.promoteVariables();
+    optimizer.foldBitcasts();
+    optimizer.foldSwizzles();
+    optimizer.removeDeadStores();
+    optimizer.removeDeadCode();
+    return optimizer.getCode();
+  }
+
+
+  uint32_t SpirvOptimizer::resultId(uint32_t ins) const {
+    auto layout = getOperandLayout(opCode(ins));
+
+    return layout.resultArg && layout.resultArg < m_ins[ins].length
+      ? words(ins)[layout.resultArg]
+      : 0;
+  }
+
+
+  uint32_t SpirvOptimizer::resolve(uint32_t id) const {
+    auto entry = m_replace.find(id);
+
+    while (entry != m_replace.end()) {
+      id = entry->second;
+      entry = m_replace.find(id);
+    }
+
+    return id;
+  }
+
+
+  bool SpirvOptimizer::replace(uint32_t ins, uint32_t id) {
+    uint32_t result = resultId(ins);
+
+    if (!result || result == id || m_pinned.count(result))
+      return false;
+
+    m_replace.insert({ result, id });
+    remove(ins);
+    return true;
+  }
+
+
+  void SpirvOptimizer::remove(uint32_t ins) {
+    if (ins >= m_ins.size() || m_ins[ins].removed)
+      return;
+
+    uint32_t result = resultId(ins);
+
+    if (result && m_pinned.count(result))
+      return;
+
+    if (result)
+      m_removedIds.insert(result);
+
+    m_ins[ins].removed = true;
+  }
+
+
+  uint32_t SpirvOptimizer::addIns(
+          uint32_t              before,
+    const std::vector<uint32_t>& words) {
+    uint32_t index = uint32_t(m_ins.size());
+
+    m_ins.push_back({ uint32_t(m_words.size()), uint32_t(words.size()), false });
+    m_words.insert(m_words.end(), words.begin(), words.end());
+    m_inserts[before].push_back(index);
+    return index;
+  }
+
+
+  uint32_t SpirvOptimizer::getUndef(uint32_t typeId) {
+    auto entry = m_undefs.find(typeId);
+
+    if (entry != m_undefs.end())
+      return entry->second;
+
+    uint32_t id = m_bound++;
+
+    addIns(m_functionStart, {
+      spv::OpUndef | (3u << spv::WordCountShift),
+      typeId, id });
+
+    m_undefs.insert({ typeId, id });
+    return id;
+  }
+
+
+  uint32_t SpirvOptimizer::getVectorSize(uint32_t typeId) const {
+    auto def = m_defs.find(typeId);
+
+    if (def == m_defs.end() || opCode(def->second) != spv::OpTypeVector)
+      return 0;
+
+    return words(def->second)[3];
+  }
+
+
+  uint32_t SpirvOptimizer::getShuffleSource(uint32_t ins) {
+    const uint32_t* w = words(ins);
+
+    uint32_t a = resolve(w[3]);
+    uint32_t b = resolve(w[4]);
+
+    // Shuffles reading from two different vectors
+    // can only be folded if one of them is unused
+    if (a != b) {
+      uint32_t size = getVectorSize(m_types[a]);
+      bool usesA = false;
+      bool usesB = false;
+
+      for (uint32_t i = 5; i < m_ins[ins].length; i++) {
+        if (w[i] != ~0u) {
+          usesA |= w[i] <  size;
+          usesB |= w[i] >= size;
+        }
+      }
+
+      if (!size || (usesA && usesB))
+        return 0;
+
+      if (usesB && m_types[a] != m_types[b])
+        return 0;
+
+      a = usesB ? b : a;
+    }
+
+    return a;
+  }
+
+
+  void SpirvOptimizer::gatherDefs() {
+    m_defs.clear();
+    m_types.clear();
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      if (m_ins[i].removed)
+        continue;
+
+      auto layout = getOperandLayout(opCode(i));
+
+      if (!layout.resultArg || layout.resultArg >= m_ins[i].length)
+        continue;
+
+      const uint32_t* w = words(i);
+      m_defs.insert({ w[layout.resultArg], i });
+
+      if (layout.typeArg)
+        m_types.insert({ w[layout.resultArg], w[layout.typeArg] });
+    }
+  }
+
+
+  void SpirvOptimizer::promoteFunctionVariables(
+          uint32_t              first,
+          uint32_t              last,
+    const std::unordered_map<uint32_t, uint32_t>& vars,
+    const std::vector<uint32_t>& varTypes,
+    const std::vector<uint32_t>& varInits) {
+    gatherDefs();
+
+    // Gather basic blocks and their successors. Bail out
+    // if we encounter a terminator that we do not know.
+    std::vector<Block> blocks;
+    std::unordered_map<uint32_t, uint32_t> labels;
+
+    for (uint32_t i = first; i < last; i++) {
+      if (opCode(i) == spv::OpLabel) {
+        Block block;
+        block.label = words(i)[1];
+        block.first = i;
+        block.last  = i;
+
+        labels.insert({ block.label, uint32_t(blocks.size()) });
+        blocks.push_back(std::move(block));
+      } else if (!blocks.empty()) {
+        blocks.back().last = i;
+      }
+    }
+
+    if (blocks.empty())
+      return;
+
+    for (auto& block : blocks) {
+      const uint32_t* w = words(block.last);
+      std::vector<uint32_t> targets;
+
+      switch (opCode(block.last)) {
+        case spv::OpBranch:
+          targets = { w[1] };
+          break;
+
+        case spv::OpBranchConditional:
+          targets = { w[2], w[3] };
+          break;
+
+        case spv::OpSwitch: {
+          auto def = m_defs.find(resolve(m_types[resolve(w[1])]));
+          uint32_t literalSize = 1;
+
+          if (def != m_defs.end() && opCode(def->second) == spv::OpTypeInt)
+            literalSize = words(def->second)[2] / 32;
+          else
+            return;
+
+          targets = { w[2] };
+
+          for (uint32_t a = 3 + literalSize; a < m_ins[block.last].length; a += literalSize + 1)
+            targets.push_back(w[a]);
+        } break;
+
+        case spv::OpReturn:
+        case spv::OpReturnValue:
+        case spv::OpKill:
+        case spv::OpUnreachable:
+          break;
+
+        default:
+          return;
+      }
+
+      for (uint32_t target : targets) {
+        auto entry = labels.find(target);
+
+        if (entry == labels.end())
+          return;
+
+        if (std::find(block.succ.begin(), block.succ.end(), entry->second) == block.succ.end())
+          block.succ.push_back(entry->second);
+      }
+    }
+
+    for (uint32_t b = 0; b < blocks.size(); b++) {
+      for (uint32_t s : blocks[b].succ)
+        blocks[s].pred.push_back(b);
+    }
+
+    // Compute reverse post-order of all reachable blocks
+    std::vector<uint32_t> rpo;
+    std::vector<std::pair<uint32_t, uint32_t>> stack = {{ 0u, 0u }};
+    std::vector<bool> visited(blocks.size(), false);
+    visited[0] = true;
+
+    while (!stack.empty()) {
+      auto& top = stack.back();
+
+      if (top.second < blocks[top.first].succ.size()) {
+        uint32_t s = blocks[top.first].succ[top.second++];
+
+        if (!visited[s]) {
+          visited[s] = true;
+          stack.push_back({ s, 0u });
+        }
+      } else {
+        rpo.push_back(top.first);
+        stack.pop_back();
+      }
+    }
+
+    std::reverse(rpo.begin(), rpo.end());
+
+    for (uint32_t i = 0; i < rpo.size(); i++)
+      blocks[rpo[i]].rpoIndex = i;
+
+    // Compute dominators, see "A Simple, Fast Dominance
+    // Algorithm" by Cooper, Harvey and Kennedy
+    blocks[0].idom = 0;
+
+    for (bool changed = true; changed; ) {
+      changed = false;
+
+      for (uint32_t i = 1; i < rpo.size(); i++) {
+        Block& block = blocks[rpo[i]];
+        uint32_t idom = ~0u;
+
+        for (uint32_t p : block.pred) {
+          if (blocks[p].idom == ~0u)
+            continue;
+
+          if (idom == ~0u) {
+            idom = p;
+            continue;
+          }
+
+          uint32_t a = p;
+          uint32_t b = idom;
+
+          while (a != b) {
+            while (blocks[a].rpoIndex > blocks[b].rpoIndex) a = blocks[a].idom;
+            while (blocks[b].rpoIndex > blocks[a].rpoIndex) b = blocks[b].idom;
+          }
+
+          idom = a;
+        }
+
+        if (block.idom != idom) {
+          block.idom = idom;
+          changed = true;
+        }
+      }
+    }
+
+    for (uint32_t i = 1; i < rpo.size(); i++)
+      blocks[blocks[rpo[i]].idom].children.push_back(rpo[i]);
+
+    for (uint32_t b : rpo) {
+      if (blocks[b].pred.size() < 2)
+        continue;
+
+      for (uint32_t p : blocks[b].pred) {
+        if (blocks[p].rpoIndex == ~0u)
+          continue;
+
+        for (uint32_t r = p; r != blocks[b].idom; r = blocks[r].idom) {
+          auto& frontier = blocks[r].frontier;
+
+          if (std::find(frontier.begin(), frontier.end(), b) == frontier.end())
+            frontier.push_back(b);
+
+          if (r == 0)
+            break;
+        }
+      }
+    }
+
+    // Place phis in the iterated dominance frontier
+    // of all blocks that store to a given variable
+    std::vector<std::vector<Phi>> phis(blocks.size());
+    std::vector<std::vector<uint32_t>> defBlocks(varTypes.size());
+
+    for (uint32_t b : rpo) {
+      for (uint32_t i = blocks[b].first; i <= blocks[b].last; i++) {
+        if (!m_ins[i].removed && opCode(i) == spv::OpStore) {
+          auto var = vars.find(words(i)[1]);
+
+          if (var != vars.end())
+            defBlocks[var->second].push_back(b);
+        }
+      }
+    }
+
+    for (uint32_t v = 0; v < varTypes.size(); v++) {
+      std::vector<bool> hasPhi(blocks.size(), false);
+      std::vector<bool> isDef (blocks.size(), false);
+      std::vector<uint32_t> worklist = defBlocks[v];
+
+      for (uint32_t b : worklist)
+        isDef[b] = true;
+
+      while (!worklist.empty()) {
+        uint32_t b = worklist.back();
+        worklist.pop_back();
+
+        for (uint32_t f : blocks[b].frontier) {
+          if (hasPhi[f])
+            continue;
+
+          hasPhi[f] = true;
+          phis[f].push_back({ v, m_bound++, { } });
+
+          if (!isDef[f]) {
+            isDef[f] = true;
+            worklist.push_back(f);
+          }
+        }
+      }
+    }
+
+    // Rename variables by walking the dominator tree
+    std::vector<std::vector<uint32_t>> values(varTypes.size());
+    std::vector<uint32_t> log;
+
+    auto currentValue = [&] (uint32_t v) {
+      if (!values[v].empty())
+        return values[v].back();
+
+      return varInits[v] ? resolve(varInits[v]) : getUndef(varTypes[v]);
+    };
+
+    auto setValue = [&] (uint32_t v, uint32_t id) {
+      values[v].push_back(id);
+      log.push_back(v);
+    };
+
+    std::vector<std::pair<uint32_t, size_t>> domStack = {{ 0u, ~size_t(0) }};
+
+    while (!domStack.empty()) {
+      auto entry = domStack.back();
+      domStack.pop_back();
+
+      if (entry.second != ~size_t(0)) {
+        // Leaving the block, restore previous values
+        while (log.size() > entry.second) {
+          values[log.back()].pop_back();
+          log.pop_back();
+        }
+
+        continue;
+      }
+
+      const Block& block = blocks[entry.first];
+      domStack.push_back({ entry.first, log.size() });
+
+      for (const auto& phi : phis[entry.first])
+        setValue(phi.var, phi.id);
+
+      for (uint32_t i = block.first; i <= block.last; i++) {
+        if (m_ins[i].removed)
+          continue;
+
+        const uint32_t* w = words(i);
+
+        if (opCode(i) == spv::OpLoad) {
+          auto var = vars.find(w[3]);
+
+          if (var != vars.end())
+            replace(i, currentValue(var->second));
+        } else if (opCode(i) == spv::OpStore) {
+          auto var = vars.find(w[1]);
+
+          if (var != vars.end()) {
+            setValue(var->second, resolve(w[2]));
+            remove(i);
+          }
+        }
+      }
+
+      for (uint32_t s : block.succ) {
+        for (auto& phi : phis[s]) {
+          phi.operands.push_back(currentValue(phi.var));
+          phi.operands.push_back(block.label);
+        }
+      }
+
+      for (uint32_t c : block.children)
+        domStack.push_back({ c, ~size_t(0) });
+    }
+
+    // Values in unreachable blocks are undefined
+    for (uint32_t b = 0; b < blocks.size(); b++) {
+      if (blocks[b].rpoIndex != ~0u)
+        continue;
+
+      for (uint32_t i = blocks[b].first; i <= blocks[b].last; i++) {
+        if (m_ins[i].removed)
+          continue;
+
+        const uint32_t* w = words(i);
+
+        if (opCode(i) == spv::OpLoad && vars.count(w[3]))
+          replace(i, getUndef(varTypes[vars.at(w[3])]));
+        else if (opCode(i) == spv::OpStore && vars.count(w[1]))
+          remove(i);
+      }
+
+      for (uint32_t s : blocks[b].succ) {
+        for (auto& phi : phis[s]) {
+          phi.operands.push_back(getUndef(varTypes[phi.var]));
+          phi.operands.push_back(blocks[b].label);
+        }
+      }
+    }
+
+    // Emit phis right after the block label
+    for (uint32_t b = 0; b < blocks.size(); b++) {
+      for (const auto& phi : phis[b]) {
+        std::vector<uint32_t> ins = {
+          spv::OpPhi | uint32_t((3 + phi.operands.size()) << spv::WordCountShift),
+          varTypes[phi.var], phi.id };
+
+        ins.insert(ins.end(), phi.operands.begin(), phi.operands.end());
+        addIns(blocks[b].first + 1, ins);
+      }
+    }
+
+    // Remove the variables themselves
+    for (const auto& var : vars) {
+      auto def = m_defs.find(var.first);
+
+      if (def != m_defs.end())
+        remove(def->second);
+    }
+  }
+
+
+  template<typename Fn>
+  void SpirvOptimizer::forEachIdOperand(uint32_t ins, const Fn& fn) const {
+    uint32_t length = m_ins[ins].length;
+    spv::Op  op     = opCode(ins);
+
+    if (op == spv::OpExtInst) {
+      fn(3);
+
+      for (uint32_t a = 5; a < length; a++)
+        fn(a);
+      return;
+    }
+
+    if (op == spv::OpPhi) {
+      for (uint32_t a = 3; a < length; a += 2)
+        fn(a);
+      return;
+    }
+
+    auto layout = getOperandLayout(op);
+
+    if (!layout.known)
+      return;
+
+    uint32_t end = layout.idCount == ~0u
+      ? length
+      : std::min(length, layout.idFirst + layout.idCount);
+
+    for (uint32_t a = layout.idFirst; a < end; a++)
+      fn(a);
+
+    if (layout.imageOperands) {
+      for (uint32_t a = end + 1; a < length; a++)
+        fn(a);
+    }
+  }
+
+
+  SpirvOperandLayout SpirvOptimizer::getOperandLayout(spv::Op op) {
+    SpirvOperandLayout layout;
+
+    auto setLayout = [&layout] (bool pure, uint32_t typeArg, uint32_t resultArg, uint32_t idFirst, uint32_t idCount) {
+      layout.known     = true;
+      layout.pure      = pure;
+      layout.typeArg   = typeArg;
+      layout.resultArg = resultArg;
+      layout.idFirst   = idFirst;
+      layout.idCount   = idCount;
+    };
+
+    switch (op) {
+      case spv::OpCapability:
+      case spv::OpExtension:
+      case spv::OpMemoryModel:
+      case spv::OpName:
+      case spv::OpMemberName:
+      case spv::OpDecorate:
+      case spv::OpMemberDecorate:
+      case spv::OpSource:
+      case spv::OpSourceExtension:
+      case spv::OpFunctionEnd:
+      case spv::OpReturn:
+      case spv::OpKill:
+      case spv::OpUnreachable:
+      case spv::OpDemoteToHelperInvocationEXT:
+        setLayout(false, 0, 0, 0, 0);
+        break;
+
+      case spv::OpExtInstImport:
+      case spv::OpLabel:
+      case spv::OpTypeVoid:
+      case spv::OpTypeBool:
+      case spv::OpTypeInt:
+      case spv::OpTypeFloat:
+      case spv::OpTypeVector:
+      case spv::OpTypeMatrix:
+      case spv::OpTypeImage:
+      case spv::OpTypeSampler:
+      case spv::OpTypeSampledImage:
+      case spv::OpTypeRuntimeArray:
+      case spv::OpTypeStruct:
+      case spv::OpTypePointer:
+      case spv::OpTypeFunction:
+        setLayout(false, 0, 1, 0, 0);
+        break;
+
+      case spv::OpUndef:
+      case spv::OpConstantTrue:
+      case spv::OpConstantFalse:
+      case spv::OpConstant:
+      case spv::OpConstantNull:
+        setLayout(true, 1, 2, 0, 0);
+        break;
+
+      case spv::OpConstantComposite:
+        setLayout(true, 1, 2, 3, ~0u);
+        break;
+
+      case spv::OpFunction:
+      case spv::OpFunctionParameter:
+      case spv::OpIsHelperInvocationEXT:
+        setLayout(false, 1, 2, 0, 0);
+        break;
+
+      case spv::OpFunctionCall:
+      case spv::OpAtomicLoad:
+      case spv::OpAtomicExchange:
+      case spv::OpAtomicCompareExchange:
+      case spv::OpAtomicCompareExchangeWeak:
+      case spv::OpAtomicIIncrement:
+      case spv::OpAtomicIDecrement:
+      case spv::OpAtomicIAdd:
+      case spv::OpAtomicISub:
+      case spv::OpAtomicSMin:
+      case spv::OpAtomicUMin:
+      case spv::OpAtomicSMax:
+      case spv::OpAtomicUMax:
+      case spv::OpAtomicAnd:
+      case spv::OpAtomicOr:
+      case spv::OpAtomicXor:
+        setLayout(false, 1, 2, 3, ~0u);
+        break;
+
+      case spv::OpVariable:
+        setLayout(false, 1, 2, 4, ~0u);
+        break;
+
+      case spv::OpLoad:
+        setLayout(false, 1, 2, 3, 1);
+        break;
+
+      case spv::OpStore:
+        setLayout(false, 0, 0, 1, 2);
+        break;
+
+      case spv::OpAtomicStore:
+      case spv::OpControlBarrier:
+      case spv::OpMemoryBarrier:
+      case spv::OpReturnValue:
+        setLayout(false, 0, 0, 1, ~0u);
+        break;
+
+      case spv::OpBranch:
+      case spv::OpSwitch:
+      case spv::OpSelectionMerge:
+        setLayout(false, 0, 0, 1, 1);
+        break;
+
+      case spv::OpLoopMerge:
+        setLayout(false, 0, 0, 1, 2);
+        break;
+
+      case spv::OpBranchConditional:
+        setLayout(false, 0, 0, 1, 3);
+        break;
+
+      case spv::OpArrayLength:
+      case spv::OpCompositeExtract:
+        setLayout(true, 1, 2, 3, 1);
+        break;
+
+      case spv::OpVectorShuffle:
+      case spv::OpCompositeInsert:
+        setLayout(true, 1, 2, 3, 2);
+        break;
+
+      case spv::OpImageTexelPointer:
+      case spv::OpAccessChain:
+      case spv::OpInBoundsAccessChain:
+      case spv::OpPtrAccessChain:
+      case spv::OpVectorExtractDynamic:
+      case spv::OpVectorInsertDynamic:
+      case spv::OpCompositeConstruct:
+      case spv::OpCopyObject:
+      case spv::OpTranspose:
+      case spv::OpSampledImage:
+      case spv::OpImage:
+      case spv::OpImageQuerySizeLod:
+      case spv::OpImageQuerySize:
+      case spv::OpImageQueryLod:
+      case spv::OpImageQueryLevels:
+      case spv::OpImageQuerySamples:
+      case spv::OpImageSparseTexelsResident:
+      case spv::OpSelect:
+      case spv::OpPhi:
+        setLayout(true, 1, 2, 3, ~0u);
+        break;
+
+      case spv::OpImageSampleImplicitLod:
+      case spv::OpImageSampleExplicitLod:
+      case spv::OpImageSampleProjImplicitLod:
+      case spv::OpImageSampleProjExplicitLod:
+      case spv::OpImageFetch:
+      case spv::OpImageRead:
+      case spv::OpImageSparseSampleImplicitLod:
+      case spv::OpImageSparseSampleExplicitLod:
+      case spv::OpImageSparseSampleProjImplicitLod:
+      case spv::OpImageSparseSampleProjExplicitLod:
+      case spv::OpImageSparseFetch:
+      case spv::OpImageSparseRead:
+        setLayout(false, 1, 2, 3, 2);
+        layout.imageOperands = true;
+        break;
+
+      case spv::OpImageSampleDrefImplicitLod:
+      case spv::OpImageSampleDrefExplicitLod:
+      case spv::OpImageSampleProjDrefImplicitLod:
+      case spv::OpImageSampleProjDrefExplicitLod:
+      case spv::OpImageGather:
+      case spv::OpImageDrefGather:
+      case spv::OpImageSparseSampleDrefImplicitLod:
+      case spv::OpImageSparseSampleDrefExplicitLod:
+      case spv::OpImageSparseSampleProjDrefImplicitLod:
+      case spv::OpImageSparseSampleProjDrefExplicitLod:
+      case spv::OpImageSparseGather:
+      case spv::OpImageSparseDrefGather:
+        setLayout(false, 1, 2, 3, 3);
+        layout.imageOperands = true;
+        break;
+
+      case spv::OpImageWrite:
+        setLayout(false, 0, 0, 1, 3);
+        layout.imageOperands = true;
+        break;
+
+      case spv::OpExtInst:
+        setLayout(true, 1, 2, 3, ~0u);
+        break;
+
+      default:
+        // Conversions, arithmetic, relational,
+        // bit and derivative instructions
+        if ((op >= spv::OpConvertFToU  && op <= spv::OpGenericCastToPtr)
+         || (op == spv::OpBitcast)
+         || (op >= spv::OpSNegate      && op <= spv::OpSMulExtended)
+         || (op >= spv::OpAny          && op <= spv::OpFUnordGreaterThanEqual)
+         || (op >= spv::OpShiftRightLogical && op <= spv::OpBitCount)
+         || (op >= spv::OpDPdx         && op <= spv::OpFwidthCoarse))
+          setLayout(true, 1, 2, 3, ~0u);
+    }
+
+    return layout;
+  }
+
+}
\ No newline at end of file
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "spirv_code_buffer.h"
+
+namespace dxvk {
+
+  /**
+   * \brief SPIR-V operand layout
+   *
+   * Describes where the result type, result ID and
+   * value operands of an instruction are located.
+   * Only instructions emitted by our own shader
+   * compilers are covered.
+   */
+  struct SpirvOperandLayout {
+    /// Whether the layout is known
+    bool     known         = false;
+    /// Whether the instruction can be removed if unused
+    bool     pure          = false;
+    /// Argument index of the result type, or 0
+    uint32_t typeArg       = 0;
+    /// Argument index of the result ID, or 0
+    uint32_t resultArg     = 0;
+    /// Argument index of the first ID operand
+    uint32_t idFirst       = 0;
+    /// Number of ID operands, or ~0u for all remaining
+    uint32_t idCount       = 0;
+    /// Whether the ID operands are followed by image operands
+    bool     imageOperands = false;
+  };
+
+
+  /**
+   * \brief SPIR-V optimizer
+   *
+   * Runs a small set of passes on the code emitted by
+   * the shader compilers, which declare every register
+   * as a variable and rely on the driver to clean up
+   * redundant bitcasts, swizzles and constants:
+   *
+   * - Promotion of function and private variables that
+   *   are only loaded and stored as a whole to SSA values
+   * - Removal of duplicate constants
+   * - Folding of bitcast, shuffle and extract chains
+   * - Removal of variables that are never read
+   * - Removal of unused instructions
+   *
+   * Passes only modify instructions with a known operand
+   * layout. Any ID that is referenced by an instruction
+   * with an unknown layout is left untouched.
+   */
+  class SpirvOptimizer {
+
+  public:
+
+    SpirvOptimizer(
+      const SpirvCodeBuffer&        code);
+
+    ~SpirvOptimizer();
+
+    /**
+     * \brief Removes duplicate constants
+     */
+    void removeDuplicateConstants();
+
+    /**
+     * \brief Promotes variables to SSA values
+     *
+     * Replaces loads with the most recently stored value
+     * and inserts phi instructions where control flow
+     * merges. Private variables are only promoted if they
+     * are exclusively accessed by one function that runs
+     * once per invocation, i.e. the entry point itself or
+     * a function it calls once outside of any loop.
+     */
+    void promoteVariables();
+
+    /**
+     * \brief Folds bitcast chains
+     *
+     * Bitcasts of bitcasts are replaced with a single
+     * bitcast, or with the original value if the types
+     * match.
+     */
+    void foldBitcasts();
+
+    /**
+     * \brief Folds swizzle chains
+     *
+     * Combines nested vector shuffles, removes identity
+     * shuffles, and forwards extracts from shuffles and
+     * composite constructs to the source value.
+     */
+    void foldSwizzles();
+
+    /**
+     * \brief Removes stores to variables that are never read
+     */
+    void removeDeadStores();
+
+    /**
+     * \brief Removes unused instructions
+     *
+     * Only instructions without side effects are removed.
+     */
+    void removeDeadCode();
+
+    /**
+     * \brief Retrieves optimized code
+     * \returns Code buffer
+     */
+    SpirvCodeBuffer getCode() const;
+
+    /**
+     * \brief Runs all passes
+     *
+     * \param [in] code Input code
+     * \returns Optimized code
+     */
+    static SpirvCodeBuffer optimize(
+      const SpirvCodeBuffer&        code);
+
+  private:
+
+    struct Ins {
+      uint32_t offset;
+      uint32_t length;
+      bool     removed;
+    };
+
+    struct Block {
+      uint32_t              label;
+      uint32_t              first;
+      uint32_t              last;
+      uint32_t              idom      = ~0u;
+      uint32_t              rpoIndex  = ~0u;
+      std::vector<uint32_t> succ;
+      std::vector<uint32_t> pred;
+      std::vector<uint32_t> children;
+      std::vector<uint32_t> frontier;
+    };
+
+    struct Phi {
+      uint32_t              var;
+      uint32_t              id;
+      std::vector<uint32_t> operands;
+    };
+
+    std::vector<uint32_t> m_words;
+    std::vector<Ins>      m_ins;
+    uint32_t              m_insCount        = 0;
+    uint32_t              m_bound           = 0;
+    uint32_t              m_functionStart   = 0;
+
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_inserts;
+
+    std::unordered_set<uint32_t>           m_pinned;
+    std::unordered_set<uint32_t>           m_removedIds;
+    std::unordered_map<uint32_t, uint32_t> m_replace;
+    std::unordered_map<uint32_t, uint32_t> m_undefs;
+
+    std::unordered_map<uint32_t, uint32_t> m_defs;
+    std::unordered_map<uint32_t, uint32_t> m_types;
+
+    uint32_t* words(uint32_t ins) {
+      return &m_words[m_ins[ins].offset];
+    }
+
+    const uint32_t* words(uint32_t ins) const {
+      return &m_words[m_ins[ins].offset];
+    }
+
+    spv::Op opCode(uint32_t ins) const {
+      return spv::Op(words(ins)[0] & spv::OpCodeMask);
+    }
+
+    uint32_t resultId(uint32_t ins) const;
+
+    uint32_t resolve(uint32_t id) const;
+
+    bool replace(uint32_t ins, uint32_t id);
+
+    void remove(uint32_t ins);
+
+    uint32_t addIns(
+            uint32_t              before,
+      const std::vector<uint32_t>& words);
+
+    uint32_t getUndef(uint32_t typeId);
+
+    uint32_t getVectorSize(uint32_t typeId) const;
+
+    uint32_t getShuffleSource(uint32_t ins);
+
+    void gatherDefs();
+
+    void promoteFunctionVariables(
+            uint32_t              first,
+            uint32_t              last,
+      const std::unordered_map<uint32_t, uint32_t>& vars,
+      const std::vector<uint32_t>& varTypes,
+      const std::vector<uint32_t>& varInits);
+
+    template<typename Fn>
+    void forEachIdOperand(uint32_t ins, const Fn& fn) const;
+
+    static SpirvOperandLayout getOperandLayout(spv::Op op);
+
+  };
+
+}
\ No newline at end of file
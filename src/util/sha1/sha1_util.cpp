@@ -1,7 +1,219 @@
+#include <algorithm>
+
 #include "sha1.h"
 #include "sha1_util.h"
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+  #define DXVK_SHA1_NI
+
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define DXVK_SHA1_NI_TARGET
+  #else
+    #include <cpuid.h>
+    #include <x86intrin.h>
+    #define DXVK_SHA1_NI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+  #endif
+#endif
+
 namespace dxvk {
+
+#ifdef DXVK_SHA1_NI
+  /**
+   * \brief Checks whether SHA extensions are supported
+   *
+   * The SHA-NI code path also needs SSSE3 for the
+   * byte shuffle and SSE4.1 for the final extract.
+   */
+  static bool sha1CheckNiSupport() {
+    uint32_t ecx1 = 0, ebx7 = 0;
+
+    #ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+
+    if (regs[0] < 7)
+      return false;
+
+    __cpuid(regs, 1);
+    ecx1 = uint32_t(regs[2]);
+    __cpuidex(regs, 7, 0);
+    ebx7 = uint32_t(regs[1]);
+    #else
+    uint32_t eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, nullptr) < 7)
+      return false;
+
+    __cpuid(1, eax, ebx, ecx, edx);
+    ecx1 = ecx;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    ebx7 = ebx;
+    #endif
+
+    return (ecx1 & (1u <<  9))   // SSSE3
+        && (ecx1 & (1u << 19))   // SSE4.1
+        && (ebx7 & (1u << 29));  // SHA
+  }
+
+
+  static const bool s_sha1Ni = sha1CheckNiSupport();
+
+
+  /**
+   * \brief Processes 64-byte blocks using SHA-NI
+   *
+   * \param [in,out] state Hash state
+   * \param [in] data Block data
+   * \param [in] numBlocks Number of blocks
+   */
+  DXVK_SHA1_NI_TARGET
+  static void sha1TransformNi(
+          uint32_t  state[5],
+    const uint8_t*  data,
+          size_t    numBlocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ll, 0x08090a0b0c0d0e0fll);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(state)), 0x1b);
+    __m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+
+    for (size_t i = 0; i < numBlocks; i++, data += 64) {
+      __m128i abcdSave = abcd;
+      __m128i e0Save   = e0;
+      __m128i e1;
+      __m128i m[4];
+
+      // Each step runs four rounds and advances the message
+      // schedule for the upcoming steps. The E values for
+      // even and odd steps alternate between e0 and e1.
+      #define SHA1_LOAD(g) \
+        m[g] = _mm_shuffle_epi8(_mm_loadu_si128( \
+          reinterpret_cast<const __m128i*>(data + 16 * (g))), mask)
+
+      #define SHA1_STEP(g, eCur, eNext) \
+        eNext = abcd; \
+        if ((g) >= 3 && (g) <= 18) m[((g) + 1) & 3] = _mm_sha1msg2_epu32(m[((g) + 1) & 3], m[(g) & 3]); \
+        abcd = _mm_sha1rnds4_epu32(abcd, eCur, (g) / 5); \
+        if ((g) >= 1 && (g) <= 16) m[((g) + 3) & 3] = _mm_sha1msg1_epu32(m[((g) + 3) & 3], m[(g) & 3]); \
+        if ((g) >= 2 && (g) <= 17) m[((g) + 2) & 3] = _mm_xor_si128(m[((g) + 2) & 3], m[(g) & 3])
+
+      SHA1_LOAD(0);
+      e0 = _mm_add_epi32(e0, m[0]);
+      SHA1_STEP( 0, e0, e1);
+      SHA1_LOAD(1);
+      e1 = _mm_sha1nexte_epu32(e1, m[1]);
+      SHA1_STEP( 1, e1, e0);
+      SHA1_LOAD(2);
+      e0 = _mm_sha1nexte_epu32(e0, m[2]);
+      SHA1_STEP( 2, e0, e1);
+      SHA1_LOAD(3);
+      e1 = _mm_sha1nexte_epu32(e1, m[3]);
+      SHA1_STEP( 3, e1, e0);
+
+      #define SHA1_NEXT(g, eCur, eNext) \
+        eCur = _mm_sha1nexte_epu32(eCur, m[(g) & 3]); \
+        SHA1_STEP(g, eCur, eNext)
+
+      SHA1_NEXT( 4, e0, e1); SHA1_NEXT( 5, e1, e0);
+      SHA1_NEXT( 6, e0, e1); SHA1_NEXT( 7, e1, e0);
+      SHA1_NEXT( 8, e0, e1); SHA1_NEXT( 9, e1, e0);
+      SHA1_NEXT(10, e0, e1); SHA1_NEXT(11, e1, e0);
+      SHA1_NEXT(12, e0, e1); SHA1_NEXT(13, e1, e0);
+      SHA1_NEXT(14, e0, e1); SHA1_NEXT(15, e1, e0);
+      SHA1_NEXT(16, e0, e1); SHA1_NEXT(17, e1, e0);
+      SHA1_NEXT(18, e0, e1); SHA1_NEXT(19, e1, e0);
+
+      #undef SHA1_NEXT
+      #undef SHA1_STEP
+      #undef SHA1_LOAD
+
+      e0   = _mm_sha1nexte_epu32(e0, e0Save);
+      abcd = _mm_add_epi32(abcd, abcdSave);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+      _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = uint32_t(_mm_extract_epi32(e0, 3));
+  }
+
+
+  /**
+   * \brief Computes hash using SHA-NI
+   *
+   * Produces the same digest as the portable
+   * implementation, including padding.
+   */
+  static Sha1Digest sha1ComputeNi(
+          size_t    numChunks,
+    const Sha1Data* chunks) {
+    uint32_t state[5] = {
+      0x67452301u, 0xefcdab89u, 0x98badcfeu, 0x10325476u, 0xc3d2e1f0u };
+
+    uint8_t  buffer[64];
+    size_t   bufferSize = 0;
+    uint64_t totalSize  = 0;
+
+    for (size_t i = 0; i < numChunks; i++) {
+      auto   ptr  = reinterpret_cast<const uint8_t*>(chunks[i].data);
+      size_t size = chunks[i].size;
+
+      totalSize += size;
+
+      if (bufferSize) {
+        size_t count = std::min(size, sizeof(buffer) - bufferSize);
+
+        if (count)
+          std::memcpy(&buffer[bufferSize], ptr, count);
+
+        bufferSize += count;
+        ptr        += count;
+        size       -= count;
+
+        if (bufferSize < sizeof(buffer))
+          continue;
+
+        sha1TransformNi(state, buffer, 1);
+        bufferSize = 0;
+      }
+
+      size_t numBlocks = size / 64;
+
+      if (numBlocks)
+        sha1TransformNi(state, ptr, numBlocks);
+
+      bufferSize = size - 64 * numBlocks;
+
+      if (bufferSize)
+        std::memcpy(buffer, ptr + 64 * numBlocks, bufferSize);
+    }
+
+    buffer[bufferSize++] = 0x80;
+
+    if (bufferSize > 56) {
+      std::memset(&buffer[bufferSize], 0, sizeof(buffer) - bufferSize);
+      sha1TransformNi(state, buffer, 1);
+      bufferSize = 0;
+    }
+
+    std::memset(&buffer[bufferSize], 0, 56 - bufferSize);
+
+    uint64_t bitCount = totalSize * 8;
+
+    for (uint32_t i = 0; i < 8; i++)
+      buffer[56 + i] = uint8_t(bitCount >> (56 - 8 * i));
+
+    sha1TransformNi(state, buffer, 1);
+
+    Sha1Digest digest;
+
+    for (uint32_t i = 0; i < digest.size(); i++)
+      digest[i] = uint8_t(state[i >> 2] >> (8 * (3 - (i & 3))));
+
+    return digest;
+  }
+#endif
+
   
   std::string Sha1Hash::toString() const {
     static const char nibbles[]
@@ -31,6 +243,11 @@ namespace dxvk {
   Sha1Hash Sha1Hash::compute(
           size_t    numChunks,
     const Sha1Data* chunks) {
+#ifdef DXVK_SHA1_NI
+    if (s_sha1Ni)
+      return Sha1Hash(sha1ComputeNi(numChunks, chunks));
+#endif
+
     Sha1Digest digest;
     
     SHA1_CTX ctx;
@@ -45,4 +262,4 @@ namespace dxvk {
     return Sha1Hash(digest);
   }
   
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #include <numeric>
 
 #include "util_env.h"
+#include "util_profiler.h"
 
 #include "./com/com_include.h"
 
@@ -77,6 +78,8 @@ namespace dxvk::env {
       str::tows(name.c_str(), wideName.data(), wideName.size());
       (*proc)(::GetCurrentThread(), wideName.data());
     }
+
+    Profiler::setThreadName(name);
   }
 
 
@@ -51,6 +51,15 @@ namespace dxvk {
   }
 
 
+  double FpsLimiter::getTargetFrameRate() {
+    std::lock_guard<dxvk::mutex> lock(m_mutex);
+
+    return isEnabled()
+      ? double(NtTimerDuration::period::den) / double(m_targetInterval.count())
+      : 0.0;
+  }
+
+
   void FpsLimiter::delay(bool vsyncEnabled) {
     std::lock_guard<dxvk::mutex> lock(m_mutex);
 
@@ -38,6 +38,12 @@ namespace dxvk {
      */
     void setDisplayRefreshRate(double refreshRate);
 
+    /**
+     * \brief Queries target frame rate
+     * \returns Target frame rate, or 0 if disabled
+     */
+    double getTargetFrameRate();
+
     /**
      * \brief Stalls calling thread as necessary
      *
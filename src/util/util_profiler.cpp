@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+
+#include "util_env.h"
+#include "util_profiler.h"
+
+#include "./log/log.h"
+
+namespace dxvk {
+
+  /**
+   * \brief Thread buffer reference
+   *
+   * Retires the thread's event buffer when the
+   * thread exits, so that it can be freed.
+   */
+  struct ProfilerThreadBufferRef {
+    ProfilerThreadBuffer* buffer = nullptr;
+
+    ~ProfilerThreadBufferRef() {
+      if (buffer)
+        buffer->retire();
+    }
+  };
+
+
+  /**
+   * \brief Flushes the profiler on process exit
+   */
+  struct ProfilerExitHandler {
+    ~ProfilerExitHandler() {
+      Profiler::flush();
+    }
+  };
+
+  static ProfilerExitHandler s_profilerExitHandler;
+
+
+  Profiler::Profiler()
+  : m_processId(::GetCurrentProcessId()) {
+    std::string path = env::getEnvVar("DXVK_LOG_PATH");
+
+    if (path == "none")
+      path.clear();
+
+    if (!path.empty() && *path.rbegin() != '/')
+      path += '/';
+
+    path += str::format(env::getExeBaseName(), "_", m_processId, "_trace.json");
+
+    m_stream = std::ofstream(str::tows(path.c_str()).c_str());
+
+    if (!m_stream) {
+      Logger::err(str::format("Profiler: Failed to open ", path));
+      return;
+    }
+
+    Logger::info(str::format("Profiler: Writing trace to ", path));
+
+    m_stream << "[" << std::endl;
+    m_thread = dxvk::thread([this] () { runWriter(); });
+  }
+
+
+  Profiler::~Profiler() {
+    // The profiler is intentionally leaked since joining
+    // a thread during DLL unload is not safe on Windows.
+  }
+
+
+  void Profiler::recordEvent(const ProfilerEvent& event) {
+    // The buffer pointer is cached per thread so that we only
+    // have to take the profiler lock once for each thread
+    static thread_local ProfilerThreadBufferRef s_buffer;
+
+    if (unlikely(!s_buffer.buffer))
+      s_buffer.buffer = instance()->getThreadBuffer();
+
+    s_buffer.buffer->push(event);
+  }
+
+
+  void Profiler::setThreadName(const std::string& name) {
+    if (!isEnabled())
+      return;
+
+    Profiler* profiler = instance();
+
+    std::lock_guard<dxvk::mutex> lock(profiler->m_mutex);
+    profiler->m_threadNames.push_back({ ::GetCurrentThreadId(), name });
+  }
+
+
+  void Profiler::flush() {
+    if (!isEnabled())
+      return;
+
+    Profiler* profiler = instance();
+
+    // On process exit, the writer thread may have been terminated
+    // while holding the lock, so don't wait for it indefinitely.
+    std::unique_lock<dxvk::mutex> lock(profiler->m_writeMutex, std::defer_lock);
+
+    for (uint32_t i = 0; i < 100 && !lock.try_lock(); i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    if (!lock || profiler->m_finished)
+      return;
+
+    profiler->writeEvents();
+    profiler->m_stream << "\n]" << std::endl;
+    profiler->m_finished = true;
+  }
+
+
+  ProfilerThreadBuffer* Profiler::getThreadBuffer() {
+    auto buffer = new ProfilerThreadBuffer(::GetCurrentThreadId());
+
+    std::lock_guard<dxvk::mutex> lock(m_mutex);
+    m_buffers.push_back(buffer);
+    return buffer;
+  }
+
+
+  void Profiler::writeEvents() {
+    std::vector<ProfilerThreadBuffer*> buffers;
+    std::vector<std::pair<uint32_t, std::string>> threadNames;
+
+    { std::lock_guard<dxvk::mutex> lock(m_mutex);
+      buffers = m_buffers;
+      threadNames = std::move(m_threadNames);
+      m_threadNames.clear();
+    }
+
+    for (const auto& threadName : threadNames) {
+      m_stream << (m_firstEvent ? "" : ",\n")
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << m_processId
+        << ",\"tid\":" << threadName.first
+        << ",\"args\":{\"name\":\"" << threadName.second << "\"}}";
+      m_firstEvent = false;
+    }
+
+    std::vector<ProfilerThreadBuffer*> retired;
+
+    for (auto buffer : buffers) {
+      uint32_t threadId = buffer->threadId();
+
+      // Check this before draining so that we
+      // cannot miss events pushed right before
+      // the owning thread retired the buffer
+      if (buffer->isRetired())
+        retired.push_back(buffer);
+
+      m_dropped += buffer->drain([this, threadId] (const ProfilerEvent& event) {
+        writeEvent(threadId, event);
+      });
+    }
+
+    if (!retired.empty()) {
+      std::lock_guard<dxvk::mutex> lock(m_mutex);
+
+      for (auto buffer : retired) {
+        m_buffers.erase(std::find(m_buffers.begin(), m_buffers.end(), buffer));
+        delete buffer;
+      }
+    }
+
+    m_stream.flush();
+  }
+
+
+  void Profiler::writeEvent(
+          uint32_t                threadId,
+    const ProfilerEvent&          event) {
+    // Trace event time stamps are in microseconds
+    m_stream << (m_firstEvent ? "" : ",\n")
+      << "{\"name\":\"" << event.name << "\",\"ph\":\"X\""
+      << ",\"pid\":" << m_processId << ",\"tid\":" << threadId
+      << ",\"ts\":" << (event.start / 1000) << "." << std::setfill('0') << std::setw(3) << (event.start % 1000)
+      << ",\"dur\":" << (event.duration / 1000) << "." << std::setw(3) << (event.duration % 1000) << "}";
+    m_firstEvent = false;
+  }
+
+
+  void Profiler::runWriter() {
+    env::setThreadName("dxvk-profiler");
+
+    while (true) {
+      { std::unique_lock<dxvk::mutex> lock(m_mutex);
+        m_cond.wait_for(lock, std::chrono::milliseconds(20));
+      }
+
+      std::lock_guard<dxvk::mutex> lock(m_writeMutex);
+
+      if (m_finished)
+        return;
+
+      uint64_t dropped = m_dropped;
+      writeEvents();
+
+      if (m_dropped != dropped)
+        Logger::warn(str::format("Profiler: Dropped ", m_dropped - dropped, " events"));
+    }
+  }
+
+
+  Profiler* Profiler::instance() {
+    static Profiler* s_instance = new Profiler();
+    return s_instance;
+  }
+
+
+  bool Profiler::checkEnabled() {
+    // Don't hand out event buffers if there
+    // is no writer thread to drain them
+    return env::getEnvVar("DXVK_PROFILE") == "1"
+        && bool(instance()->m_stream);
+  }
+
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "thread.h"
+#include "util_likely.h"
+#include "util_time.h"
+
+namespace dxvk {
+
+  /**
+   * \brief Profiler event
+   *
+   * A single timed scope. Names must be string
+   * literals or otherwise outlive the profiler.
+   */
+  struct ProfilerEvent {
+    const char* name;
+    int64_t     start;
+    int64_t     duration;
+  };
+
+
+  /**
+   * \brief Per-thread profiler event buffer
+   *
+   * Single-producer single-consumer ring buffer. Only the
+   * owning thread pushes events, and only the profiler's
+   * writer thread drains them, so neither side needs to
+   * take a lock. Events are dropped if the ring is full.
+   */
+  class ProfilerThreadBuffer {
+    constexpr static uint32_t Capacity = 32768;
+  public:
+
+    ProfilerThreadBuffer(uint32_t threadId)
+    : m_threadId(threadId) { }
+
+    uint32_t threadId() const {
+      return m_threadId;
+    }
+
+    /**
+     * \brief Adds an event to the buffer
+     *
+     * Must only be called from the owning thread.
+     * \param [in] event The event
+     */
+    void push(const ProfilerEvent& event) {
+      uint32_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+      uint32_t readIndex  = m_readIndex.load(std::memory_order_acquire);
+
+      if (writeIndex - readIndex >= Capacity) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+
+      m_events[writeIndex % Capacity] = event;
+      m_writeIndex.store(writeIndex + 1, std::memory_order_release);
+    }
+
+    /**
+     * \brief Retrieves all pending events
+     *
+     * Must only be called from the writer thread.
+     * \param [in] proc Function to call for each event
+     * \returns Number of events dropped since the last call
+     */
+    template<typename Proc>
+    uint32_t drain(const Proc& proc) {
+      uint32_t readIndex  = m_readIndex.load(std::memory_order_relaxed);
+      uint32_t writeIndex = m_writeIndex.load(std::memory_order_acquire);
+
+      while (readIndex != writeIndex)
+        proc(m_events[(readIndex++) % Capacity]);
+
+      m_readIndex.store(readIndex, std::memory_order_release);
+      return m_dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Marks the buffer as no longer used
+     *
+     * Called when the owning thread exits. The writer
+     * thread frees the buffer after draining it.
+     */
+    void retire() {
+      m_retired.store(true, std::memory_order_release);
+    }
+
+    /**
+     * \brief Checks whether the owning thread has exited
+     *
+     * If this returns \c true, no further events will
+     * be pushed, so the buffer can be freed once drained.
+     * \returns \c true if the buffer is retired
+     */
+    bool isRetired() const {
+      return m_retired.load(std::memory_order_acquire);
+    }
+
+  private:
+
+    uint32_t              m_threadId;
+
+    std::atomic<uint32_t> m_readIndex  = { 0u };
+    std::atomic<uint32_t> m_writeIndex = { 0u };
+    std::atomic<uint32_t> m_dropped    = { 0u };
+    std::atomic<bool>     m_retired    = { false };
+
+    std::array<ProfilerEvent, Capacity> m_events;
+
+  };
+
+
+  /**
+   * \brief CPU timeline profiler
+   *
+   * Collects timed scopes from all threads and periodically
+   * writes them to a file in the Chrome trace event format,
+   * which can be loaded into \c chrome://tracing or Perfetto.
+   *
+   * The profiler is enabled by setting \c DXVK_PROFILE=1.
+   * The trace file is written next to the log files, as
+   * determined by \c DXVK_LOG_PATH. If the file cannot be
+   * created, the profiler remains disabled. When disabled,
+   * the overhead of a profiler scope is a single branch.
+   */
+  class Profiler {
+
+  public:
+
+    /**
+     * \brief Checks whether the profiler is enabled
+     * \returns \c true if events should be recorded
+     */
+    static bool isEnabled() {
+      static const bool s_enabled = checkEnabled();
+      return s_enabled;
+    }
+
+    /**
+     * \brief Records an event for the calling thread
+     * \param [in] event The event
+     */
+    static void recordEvent(const ProfilerEvent& event);
+
+    /**
+     * \brief Assigns a name to the calling thread
+     *
+     * The name is emitted as thread metadata so that
+     * trace viewers can display it. Does nothing if
+     * the profiler is disabled.
+     * \param [in] name Thread name
+     */
+    static void setThreadName(const std::string& name);
+
+    /**
+     * \brief Writes all pending events and closes the trace
+     *
+     * Called on process exit. Events recorded afterwards
+     * are not written anymore.
+     */
+    static void flush();
+
+    /**
+     * \brief Queries current time in nanoseconds
+     * \returns Time stamp
+     */
+    static int64_t now() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        dxvk::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+  private:
+
+    Profiler();
+    ~Profiler();
+
+    dxvk::mutex                         m_mutex;
+    dxvk::condition_variable            m_cond;
+
+    dxvk::mutex                         m_writeMutex;
+    bool                                m_finished = false;
+
+    std::vector<ProfilerThreadBuffer*>  m_buffers;
+    std::vector<std::pair<uint32_t, std::string>> m_threadNames;
+
+    std::ofstream                       m_stream;
+    uint32_t                            m_processId = 0;
+    uint64_t                            m_dropped   = 0;
+    bool                                m_firstEvent = true;
+
+    dxvk::thread                        m_thread;
+
+    ProfilerThreadBuffer* getThreadBuffer();
+
+    void writeEvents();
+
+    void writeEvent(
+            uint32_t                threadId,
+      const ProfilerEvent&          event);
+
+    void runWriter();
+
+    static Profiler* instance();
+
+    static bool checkEnabled();
+
+  };
+
+
+  /**
+   * \brief Profiler scope
+   *
+   * Records the time between construction and
+   * destruction of the object as one event.
+   */
+  class ProfilerScope {
+
+  public:
+
+    ProfilerScope(const char* name)
+    : m_name(Profiler::isEnabled() ? name : nullptr) {
+      if (unlikely(m_name != nullptr))
+        m_start = Profiler::now();
+    }
+
+    ~ProfilerScope() {
+      if (unlikely(m_name != nullptr)) {
+        ProfilerEvent event;
+        event.name     = m_name;
+        event.start    = m_start;
+        event.duration = Profiler::now() - m_start;
+        Profiler::recordEvent(event);
+      }
+    }
+
+    ProfilerScope             (const ProfilerScope&) = delete;
+    ProfilerScope& operator = (const ProfilerScope&) = delete;
+
+  private:
+
+    const char* m_name;
+    int64_t     m_start = 0;
+
+  };
+
+}
@@ -253,6 +253,11 @@ namespace dxvk::vk {
   }
 
 
+  double Presenter::getFrameRateLimit() {
+    return m_fpsLimiter.getTargetFrameRate();
+  }
+
+
   VkResult Presenter::getSupportedFormats(std::vector<VkSurfaceFormatKHR>& formats, const PresenterDesc& desc) {
     uint32_t numFormats = 0;
 
@@ -171,6 +171,14 @@ namespace dxvk::vk {
      */
     void setFrameRateLimiterRefreshRate(double refreshRate);
 
+    /**
+     * \brief Queries frame rate limit
+     *
+     * Takes the \c DXVK_FRAME_RATE override into account.
+     * \returns Target frame rate, or 0 if the limiter is disabled
+     */
+    double getFrameRateLimit();
+
     /**
      * \brief Checks whether a Vulkan swap chain exists
      *
@@ -0,0 +1,304 @@
+#include <cstring>
+#include <vector>
+
+#include <d3d9.h>
+
+#include "../test_utils.h"
+
+using namespace dxvk;
+
+struct Extent2D {
+  uint32_t w, h;
+};
+
+struct TextureType {
+  const char* name;
+  DWORD       usage;
+  D3DPOOL     pool;
+};
+
+TextureType g_TextureTypes[] = {
+  { "managed", 0,                D3DPOOL_MANAGED },
+  { "dynamic", D3DUSAGE_DYNAMIC, D3DPOOL_DEFAULT },
+};
+
+// Enough to exceed the address space of a 32-bit process
+// several times over if nothing ever gets unmapped.
+constexpr uint32_t TextureSize  = 1024;
+constexpr uint32_t TextureCount = 256;
+constexpr uint32_t BufferSize   = 4 << 20;
+constexpr uint32_t BufferCount  = 64;
+
+class MappedMemoryApp {
+
+public:
+
+  MappedMemoryApp(HINSTANCE instance, HWND window)
+  : m_window(window) {
+    HRESULT status = Direct3DCreate9Ex(D3D_SDK_VERSION, &m_d3d);
+
+    if (FAILED(status))
+      throw DxvkError("Failed to create D3D9 interface");
+
+    D3DPRESENT_PARAMETERS params;
+    getPresentParams(params);
+
+    status = m_d3d->CreateDeviceEx(
+      D3DADAPTER_DEFAULT,
+      D3DDEVTYPE_HAL,
+      m_window,
+      D3DCREATE_HARDWARE_VERTEXPROCESSING,
+      &params,
+      nullptr,
+      &m_device);
+
+    if (FAILED(status))
+      throw DxvkError("Failed to create D3D9 device");
+
+    for (const auto& type : g_TextureTypes)
+      testTextures(type);
+
+    testBuffers();
+  }
+
+  void testTextures(const TextureType& type) {
+    std::vector<Com<IDirect3DTexture9>> textures;
+
+    // Create and fill textures until we either reach the
+    // limit or run out of memory, keeping all of them alive.
+    for (uint32_t i = 0; i < TextureCount; i++) {
+      Com<IDirect3DTexture9> texture;
+
+      HRESULT status = m_device->CreateTexture(
+        TextureSize, TextureSize, 1, type.usage,
+        D3DFMT_A8R8G8B8, type.pool, &texture, nullptr);
+
+      if (FAILED(status))
+        break;
+
+      D3DLOCKED_RECT rect;
+      status = texture->LockRect(0, &rect, nullptr, 0);
+
+      if (FAILED(status)) {
+        std::cerr << "Failed to lock " << type.name << " texture " << i << std::endl;
+        break;
+      }
+
+      fillTexture(rect, i);
+      texture->UnlockRect(0);
+
+      textures.push_back(std::move(texture));
+    }
+
+    std::cerr << "Created " << textures.size() << " " << type.name << " textures" << std::endl;
+
+    // Lock everything again in order to check that textures
+    // which lost their mapping got their contents restored.
+    for (uint32_t i = 0; i < textures.size(); i++) {
+      D3DLOCKED_RECT rect;
+      HRESULT status = textures[i]->LockRect(0, &rect, nullptr, D3DLOCK_READONLY);
+
+      if (FAILED(status))
+        throw DxvkError("Failed to relock texture");
+
+      if (!checkTexture(rect, i))
+        std::cerr << "Mismatch in " << type.name << " texture " << i << std::endl;
+
+      textures[i]->UnlockRect(0);
+    }
+  }
+
+  void testBuffers() {
+    std::vector<Com<IDirect3DVertexBuffer9>> buffers;
+
+    for (uint32_t i = 0; i < BufferCount; i++) {
+      Com<IDirect3DVertexBuffer9> buffer;
+
+      HRESULT status = m_device->CreateVertexBuffer(
+        BufferSize, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+        0, D3DPOOL_DEFAULT, &buffer, nullptr);
+
+      if (FAILED(status))
+        break;
+
+      void* data = nullptr;
+      status = buffer->Lock(0, 0, &data, D3DLOCK_DISCARD);
+
+      if (FAILED(status) || data == nullptr) {
+        std::cerr << "Failed to lock buffer " << i << std::endl;
+        break;
+      }
+
+      std::memset(data, int(i), BufferSize);
+      buffer->Unlock();
+
+      buffers.push_back(std::move(buffer));
+    }
+
+    std::cerr << "Created " << buffers.size() << " buffers" << std::endl;
+  }
+
+  void fillTexture(const D3DLOCKED_RECT& rect, uint32_t seed) {
+    for (uint32_t y = 0; y < TextureSize; y++) {
+      auto row = reinterpret_cast<uint32_t*>(
+        reinterpret_cast<uint8_t*>(rect.pBits) + y * rect.Pitch);
+
+      for (uint32_t x = 0; x < TextureSize; x++)
+        row[x] = pattern(x, y, seed);
+    }
+  }
+
+  bool checkTexture(const D3DLOCKED_RECT& rect, uint32_t seed) {
+    for (uint32_t y = 0; y < TextureSize; y++) {
+      auto row = reinterpret_cast<const uint32_t*>(
+        reinterpret_cast<const uint8_t*>(rect.pBits) + y * rect.Pitch);
+
+      for (uint32_t x = 0; x < TextureSize; x++) {
+        if (row[x] != pattern(x, y, seed))
+          return false;
+      }
+    }
+
+    return true;
+  }
+
+  static uint32_t pattern(uint32_t x, uint32_t y, uint32_t seed) {
+    return (seed << 24) | ((y & 0xfff) << 12) | (x & 0xfff);
+  }
+
+  void run() {
+    this->adjustBackBuffer();
+
+    m_device->BeginScene();
+
+    m_device->Clear(
+      0,
+      nullptr,
+      D3DCLEAR_TARGET,
+      D3DCOLOR_RGBA(44, 62, 80, 0),
+      0.0f,
+      0);
+
+    m_device->EndScene();
+
+    m_device->PresentEx(
+      nullptr,
+      nullptr,
+      nullptr,
+      nullptr,
+      0);
+  }
+
+  void adjustBackBuffer() {
+    RECT windowRect = { 0, 0, 1024, 600 };
+    GetClientRect(m_window, &windowRect);
+
+    Extent2D newSize = {
+      static_cast<uint32_t>(windowRect.right - windowRect.left),
+      static_cast<uint32_t>(windowRect.bottom - windowRect.top),
+    };
+
+    if (m_windowSize.w != newSize.w
+     || m_windowSize.h != newSize.h) {
+      m_windowSize = newSize;
+
+      D3DPRESENT_PARAMETERS params;
+      getPresentParams(params);
+      HRESULT status = m_device->ResetEx(&params, nullptr);
+
+      if (FAILED(status))
+        throw DxvkError("Device reset failed");
+    }
+  }
+
+  void getPresentParams(D3DPRESENT_PARAMETERS& params) {
+    params.AutoDepthStencilFormat = D3DFMT_UNKNOWN;
+    params.BackBufferCount = 1;
+    params.BackBufferFormat = D3DFMT_X8R8G8B8;
+    params.BackBufferWidth = m_windowSize.w;
+    params.BackBufferHeight = m_windowSize.h;
+    params.EnableAutoDepthStencil = FALSE;
+    params.Flags = 0;
+    params.FullScreen_RefreshRateInHz = 0;
+    params.hDeviceWindow = m_window;
+    params.MultiSampleQuality = 0;
+    params.MultiSampleType = D3DMULTISAMPLE_NONE;
+    params.PresentationInterval = D3DPRESENT_INTERVAL_DEFAULT;
+    params.SwapEffect = D3DSWAPEFFECT_DISCARD;
+    params.Windowed = TRUE;
+  }
+
+private:
+
+  HWND                          m_window;
+  Extent2D                      m_windowSize = { 1024, 600 };
+
+  Com<IDirect3D9Ex>             m_d3d;
+  Com<IDirect3DDevice9Ex>       m_device;
+
+};
+
+LRESULT CALLBACK WindowProc(HWND hWnd,
+                            UINT message,
+                            WPARAM wParam,
+                            LPARAM lParam);
+
+int WINAPI WinMain(HINSTANCE hInstance,
+                   HINSTANCE hPrevInstance,
+                   LPSTR lpCmdLine,
+                   int nCmdShow) {
+  HWND hWnd;
+  WNDCLASSEXW wc;
+  ZeroMemory(&wc, sizeof(WNDCLASSEX));
+  wc.cbSize = sizeof(WNDCLASSEX);
+  wc.style = CS_HREDRAW | CS_VREDRAW;
+  wc.lpfnWndProc = WindowProc;
+  wc.hInstance = hInstance;
+  wc.hCursor = LoadCursor(nullptr, IDC_ARROW);
+  wc.hbrBackground = (HBRUSH)COLOR_WINDOW;
+  wc.lpszClassName = L"WindowClass1";
+  RegisterClassExW(&wc);
+
+  hWnd = CreateWindowExW(0,
+    L"WindowClass1",
+    L"Our First Windowed Program",
+    WS_OVERLAPPEDWINDOW,
+    300, 300,
+    640, 480,
+    nullptr,
+    nullptr,
+    hInstance,
+    nullptr);
+  ShowWindow(hWnd, nCmdShow);
+
+  MSG msg;
+
+  try {
+    MappedMemoryApp app(hInstance, hWnd);
+
+    while (true) {
+      if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+
+        if (msg.message == WM_QUIT)
+          return msg.wParam;
+      } else {
+        app.run();
+      }
+    }
+  } catch (const dxvk::DxvkError& e) {
+    std::cerr << e.message() << std::endl;
+    return msg.wParam;
+  }
+}
+
+LRESULT CALLBACK WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
+  switch (message) {
+    case WM_CLOSE:
+      PostQuitMessage(0);
+      return 0;
+  }
+
+  return DefWindowProc(hWnd, message, wParam, lParam);
+}
\ No newline at end of file
@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "../../src/dxbc/dxbc_module.h"
+#include "../../src/dxso/dxso_module.h"
+#include "../../src/dxvk/dxvk_shader.h"
+#include "../../src/spirv/spirv_compression.h"
+#include "../../src/util/thread.h"
+#include "../../src/util/util_time.h"
+
+#include <shellapi.h>
+#include <windows.h>
+#include <windowsx.h>
+#include <psapi.h>
+
+namespace dxvk {
+  Logger Logger::s_instance("shader-benchmark.log");
+}
+
+using namespace dxvk;
+
+/**
+ * \brief Shader blob
+ *
+ * Raw DXBC or DXSO code, as written
+ * by \c DXVK_SHADER_DUMP_PATH.
+ */
+struct ShaderBlob {
+  std::string       name;
+  bool              dxso;
+  std::vector<char> code;
+};
+
+
+/**
+ * \brief Per-shader results
+ *
+ * Times are stored per iteration so that
+ * percentiles can be computed afterwards.
+ */
+struct ShaderResult {
+  std::vector<uint64_t> compileNs;
+  std::vector<uint64_t> compressNs;
+  size_t                spirvSize      = 0;
+  size_t                compressedSize = 0;
+  uint32_t              moduleCount    = 0;
+  std::atomic<bool>     failed         = { false };
+};
+
+
+/**
+ * \brief Timing statistics
+ *
+ * Only valid if at least one sample was taken.
+ */
+struct TimingStats {
+  bool   valid  = false;
+  double meanUs = 0.0;
+  double p50Us  = 0.0;
+  double p99Us  = 0.0;
+  double maxUs  = 0.0;
+};
+
+
+static std::vector<ShaderBlob> loadCorpus(const std::wstring& path) {
+  std::vector<ShaderBlob> result;
+
+  WIN32_FIND_DATAW findData;
+  HANDLE handle = FindFirstFileW((path + L"\\*").c_str(), &findData);
+
+  if (handle == INVALID_HANDLE_VALUE)
+    return result;
+
+  do {
+    std::wstring fileName = findData.cFileName;
+    size_t extPos = fileName.rfind(L'.');
+
+    if (extPos == std::wstring::npos)
+      continue;
+
+    std::wstring ext = fileName.substr(extPos);
+
+    if (ext != L".dxbc" && ext != L".dxso")
+      continue;
+
+    std::ifstream file((path + L"\\" + fileName).c_str(), std::ios::binary);
+
+    ShaderBlob blob;
+    blob.name = str::fromws(fileName.c_str());
+    blob.dxso = ext == L".dxso";
+    blob.code = std::vector<char>(
+      std::istreambuf_iterator<char>(file),
+      std::istreambuf_iterator<char>());
+
+    if (!blob.code.empty())
+      result.push_back(std::move(blob));
+  } while (FindNextFileW(handle, &findData));
+
+  FindClose(handle);
+
+  std::sort(result.begin(), result.end(),
+    [] (const ShaderBlob& a, const ShaderBlob& b) {
+      return a.name < b.name;
+    });
+
+  return result;
+}
+
+
+static std::vector<Rc<DxvkShader>> compileShader(const ShaderBlob& blob) {
+  std::vector<Rc<DxvkShader>> result;
+
+  if (blob.dxso) {
+    DxsoReader reader(blob.code.data());
+    DxsoModule module(reader);
+
+    DxsoModuleInfo moduleInfo;
+    DxsoAnalysisInfo analysis = module.analyze();
+
+    D3D9ConstantLayout layout;
+
+    if (module.info().type() == DxsoProgramType::VertexShader) {
+      layout.floatCount = caps::MaxFloatConstantsVS;
+    } else {
+      layout.floatCount = caps::MaxFloatConstantsPS;
+    }
+
+    layout.intCount     = caps::MaxOtherConstants;
+    layout.boolCount    = caps::MaxOtherConstants;
+    layout.bitmaskCount = align(layout.boolCount, 32) / 32;
+
+    DxsoPermutations permutations = module.compile(
+      moduleInfo, blob.name, analysis, layout);
+
+    for (const auto& shader : permutations) {
+      if (shader != nullptr)
+        result.push_back(shader);
+    }
+  } else {
+    DxbcReader reader(blob.code.data(), blob.code.size());
+    DxbcModule module(reader);
+
+    DxbcModuleInfo moduleInfo;
+    moduleInfo.options.useSubgroupOpsForAtomicCounters = true;
+    moduleInfo.options.useDemoteToHelperInvocation = true;
+    moduleInfo.options.minSsboAlignment = 4;
+    moduleInfo.xfb = nullptr;
+
+    result.push_back(module.compile(moduleInfo, blob.name));
+  }
+
+  return result;
+}
+
+
+static uint64_t elapsedNs(
+        dxvk::high_resolution_clock::time_point start,
+        dxvk::high_resolution_clock::time_point end) {
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+
+static TimingStats computeStats(std::vector<uint64_t> samples) {
+  TimingStats stats;
+
+  if (samples.empty())
+    return stats;
+
+  std::sort(samples.begin(), samples.end());
+
+  uint64_t sum = 0;
+
+  for (uint64_t ns : samples)
+    sum += ns;
+
+  auto percentile = [&] (double p) {
+    size_t index = size_t(p * double(samples.size() - 1) + 0.5);
+    return double(samples[index]) / 1000.0;
+  };
+
+  stats.valid  = true;
+  stats.meanUs = double(sum) / (1000.0 * double(samples.size()));
+  stats.p50Us  = percentile(0.50);
+  stats.p99Us  = percentile(0.99);
+  stats.maxUs  = double(samples.back()) / 1000.0;
+  return stats;
+}
+
+
+static void writeStats(std::ostream& stream, const char* name, const TimingStats& stats, bool last) {
+  stream << "  \"" << name << "\": ";
+
+  if (stats.valid) {
+    stream << "{ "
+           << "\"meanUs\": " << stats.meanUs << ", "
+           << "\"p50Us\": "  << stats.p50Us  << ", "
+           << "\"p99Us\": "  << stats.p99Us  << ", "
+           << "\"maxUs\": "  << stats.maxUs  << " }";
+  } else {
+    stream << "null";
+  }
+
+  stream << (last ? "" : ",") << std::endl;
+}
+
+
+int WINAPI WinMain(HINSTANCE hInstance,
+                   HINSTANCE hPrevInstance,
+                   LPSTR lpCmdLine,
+                   int nCmdShow) {
+  int     argc = 0;
+  LPWSTR* argv = CommandLineToArgvW(
+    GetCommandLineW(), &argc);
+
+  if (argc < 2) {
+    Logger::err("Usage: shader-benchmark shader_dir [threads] [iterations] [output.json]");
+    return 1;
+  }
+
+  uint32_t threadCount = argc > 2 ? uint32_t(std::wcstoul(argv[2], nullptr, 10)) : 1;
+  uint32_t iterations  = argc > 3 ? uint32_t(std::wcstoul(argv[3], nullptr, 10)) : 10;
+  std::string outputPath = argc > 4 ? str::fromws(argv[4]) : "shader-benchmark.json";
+
+  threadCount = std::max(threadCount, 1u);
+  iterations  = std::max(iterations,  1u);
+
+  std::vector<ShaderBlob> corpus = loadCorpus(argv[1]);
+
+  if (corpus.empty()) {
+    Logger::err(str::format("No DXBC or DXSO files found in ", str::fromws(argv[1])));
+    return 1;
+  }
+
+  std::vector<ShaderResult> results(corpus.size());
+
+  for (auto& result : results) {
+    result.compileNs.resize(iterations);
+    result.compressNs.resize(iterations);
+  }
+
+  // Each job compiles one shader once. Results for a given
+  // shader and iteration are only written by one thread, so
+  // no further synchronization is required.
+  const size_t jobCount = corpus.size() * iterations;
+  std::atomic<size_t> nextJob = { 0 };
+
+  auto runJobs = [&] () {
+    size_t job;
+
+    while ((job = nextJob++) < jobCount) {
+      size_t shaderId  = job % corpus.size();
+      size_t iteration = job / corpus.size();
+
+      const ShaderBlob& blob   = corpus[shaderId];
+      ShaderResult&     result = results[shaderId];
+
+      try {
+        auto t0 = dxvk::high_resolution_clock::now();
+        std::vector<Rc<DxvkShader>> shaders = compileShader(blob);
+        auto t1 = dxvk::high_resolution_clock::now();
+
+        // Shader creation already compresses the code once, so
+        // retrieve the SPIR-V binary and compress it again in
+        // order to measure the compression cost in isolation.
+        uint64_t compressNs     = 0;
+        size_t   spirvSize      = 0;
+        size_t   compressedSize = 0;
+
+        for (const auto& shader : shaders) {
+          std::stringstream stream;
+          shader->dump(stream);
+
+          SpirvCodeBuffer code(stream);
+
+          auto t2 = dxvk::high_resolution_clock::now();
+          SpirvCompressedBuffer compressed(code);
+          auto t3 = dxvk::high_resolution_clock::now();
+
+          compressNs     += elapsedNs(t2, t3);
+          spirvSize      += code.size();
+          compressedSize += compressed.compressedSize();
+        }
+
+        result.compileNs[iteration]  = elapsedNs(t0, t1);
+        result.compressNs[iteration] = compressNs;
+
+        if (!iteration) {
+          result.spirvSize      = spirvSize;
+          result.compressedSize = compressedSize;
+          result.moduleCount    = uint32_t(shaders.size());
+        }
+      } catch (const DxvkError& e) {
+        // A shader that fails in any iteration has no valid
+        // timing for that iteration, so exclude it entirely.
+        if (!result.failed.exchange(true))
+          Logger::err(str::format(blob.name, ": ", e.message()));
+      }
+    }
+  };
+
+  auto start = dxvk::high_resolution_clock::now();
+
+  std::vector<dxvk::thread> threads;
+
+  for (uint32_t i = 0; i < threadCount; i++)
+    threads.emplace_back(runJobs);
+
+  for (auto& thread : threads)
+    thread.join();
+
+  auto end = dxvk::high_resolution_clock::now();
+
+  // Gather statistics over all shaders that compiled
+  std::vector<uint64_t> compileSamples;
+  std::vector<uint64_t> compressSamples;
+
+  uint32_t dxbcCount   = 0;
+  uint32_t dxsoCount   = 0;
+  uint32_t failedCount = 0;
+
+  size_t spirvSize      = 0;
+  size_t compressedSize = 0;
+
+  for (size_t i = 0; i < corpus.size(); i++) {
+    if (results[i].failed) {
+      failedCount += 1;
+      continue;
+    }
+
+    if (corpus[i].dxso)
+      dxsoCount += 1;
+    else
+      dxbcCount += 1;
+
+    compileSamples.insert(compileSamples.end(),
+      results[i].compileNs.begin(), results[i].compileNs.end());
+    compressSamples.insert(compressSamples.end(),
+      results[i].compressNs.begin(), results[i].compressNs.end());
+
+    spirvSize      += results[i].spirvSize;
+    compressedSize += results[i].compressedSize;
+  }
+
+  if (compileSamples.empty())
+    Logger::err("No shader compiled successfully, timing statistics are unavailable");
+
+  double wallMs = double(elapsedNs(start, end)) / 1000000.0;
+  double shadersPerSecond = double(compileSamples.size()) / (wallMs / 1000.0);
+
+  PROCESS_MEMORY_COUNTERS memory = { };
+  memory.cb = sizeof(memory);
+  K32GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory));
+
+  std::ofstream json(outputPath, std::ios::trunc);
+
+  if (!json) {
+    Logger::err(str::format("Failed to open ", outputPath));
+    return 1;
+  }
+
+  json << std::fixed << std::setprecision(3);
+  json << "{" << std::endl;
+  json << "  \"threads\": " << threadCount << "," << std::endl;
+  json << "  \"iterations\": " << iterations << "," << std::endl;
+  json << "  \"dxbcShaders\": " << dxbcCount << "," << std::endl;
+  json << "  \"dxsoShaders\": " << dxsoCount << "," << std::endl;
+  json << "  \"failedShaders\": " << failedCount << "," << std::endl;
+  json << "  \"wallMs\": " << wallMs << "," << std::endl;
+  json << "  \"shadersPerSecond\": " << shadersPerSecond << "," << std::endl;
+  json << "  \"spirvBytes\": " << spirvSize << "," << std::endl;
+  json << "  \"compressedBytes\": " << compressedSize << "," << std::endl;
+  json << "  \"peakWorkingSetBytes\": " << memory.PeakWorkingSetSize << "," << std::endl;
+  json << "  \"peakCommitBytes\": " << memory.PeakPagefileUsage << "," << std::endl;
+  writeStats(json, "compile",  computeStats(compileSamples),  false);
+  writeStats(json, "compress", computeStats(compressSamples), false);
+  json << "  \"shaders\": [" << std::endl;
+
+  for (size_t i = 0; i < corpus.size(); i++) {
+    const ShaderResult& result = results[i];
+    TimingStats compileStats = computeStats(result.compileNs);
+
+    json << "    { \"name\": \"" << corpus[i].name << "\", "
+         << "\"type\": \"" << (corpus[i].dxso ? "dxso" : "dxbc") << "\", ";
+
+    if (result.failed) {
+      json << "\"failed\": true }";
+    } else {
+      json << "\"modules\": " << result.moduleCount << ", "
+           << "\"p50Us\": " << compileStats.p50Us << ", "
+           << "\"p99Us\": " << compileStats.p99Us << ", "
+           << "\"spirvBytes\": " << result.spirvSize << ", "
+           << "\"compressedBytes\": " << result.compressedSize << " }";
+    }
+
+    json << (i + 1 < corpus.size() ? "," : "") << std::endl;
+  }
+
+  json << "  ]" << std::endl;
+  json << "}" << std::endl;
+
+  Logger::info(str::format("Compiled ", compileSamples.size(), " shaders in ", wallMs, " ms (", failedCount, " failed)"));
+  Logger::info(str::format("Results written to ", outputPath));
+  return failedCount ? 1 : 0;
+}
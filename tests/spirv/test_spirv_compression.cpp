@@ -0,0 +1,259 @@
+#include <cstring>
+#include <fstream>
+
+#include "../../src/spirv/spirv_compression.h"
+#include "../../src/util/util_bit.h"
+#include "../../src/util/util_time.h"
+#include "../../src/util/log/log.h"
+#include "../../src/util/util_string.h"
+
+#include <shellapi.h>
+#include <windows.h>
+#include <windowsx.h>
+
+namespace dxvk {
+  Logger Logger::s_instance("spirv-compression.log");
+}
+
+using namespace dxvk;
+
+/**
+ * \brief Bit-packed compressed buffer
+ *
+ * Previous scalar implementation of the SPIR-V compression,
+ * which bit-packs DWORDs into 64-bit words and stores the
+ * byte counts of 32 DWORDs in a 64-bit mask. Kept here as
+ * a reference for ratio and throughput comparisons.
+ */
+class LegacyCompressedBuffer {
+  constexpr static uint32_t NumMaskWords = 32;
+public:
+
+  LegacyCompressedBuffer(const SpirvCodeBuffer& code)
+  : m_size(code.dwords()) {
+    const uint32_t* data = code.data();
+
+    uint64_t dstWord  = 0;
+    uint32_t dstShift = 0;
+
+    for (uint32_t i = 0; i < m_size; i += NumMaskWords) {
+      uint64_t byteCounts = 0;
+
+      for (uint32_t w = 0; w < NumMaskWords && i + w < m_size; w++) {
+        uint64_t word = data[i + w];
+        uint64_t bytes = 0;
+
+        if      (word < (1 <<  8)) bytes = 0;
+        else if (word < (1 << 16)) bytes = 1;
+        else if (word < (1 << 24)) bytes = 2;
+        else                       bytes = 3;
+
+        byteCounts |= bytes << (2 * w);
+
+        uint32_t bits = 8 * bytes + 8;
+        uint32_t rem  = bit::pack(dstWord, dstShift, word, bits);
+
+        if (unlikely(rem != 0)) {
+          m_code.push_back(dstWord);
+
+          dstWord  = 0;
+          dstShift = 0;
+
+          bit::pack(dstWord, dstShift, word >> (bits - rem), rem);
+        }
+      }
+
+      m_mask.push_back(byteCounts);
+    }
+
+    if (dstShift)
+      m_code.push_back(dstWord);
+  }
+
+  SpirvCodeBuffer decompress() const {
+    SpirvCodeBuffer code(m_size);
+    uint32_t* data = code.data();
+
+    if (m_size == 0)
+      return code;
+
+    uint32_t maskIdx = 0;
+    uint32_t codeIdx = 0;
+
+    uint64_t srcWord  = m_code[codeIdx++];
+    uint32_t srcShift = 0;
+
+    for (uint32_t i = 0; i < m_size; i += NumMaskWords) {
+      uint64_t srcMask = m_mask[maskIdx++];
+
+      for (uint32_t w = 0; w < NumMaskWords && i + w < m_size; w++) {
+        uint32_t bits = 8 * ((srcMask & 3) + 1);
+
+        uint64_t word = 0;
+        uint32_t rem = bit::unpack(word, srcWord, srcShift, bits);
+
+        if (unlikely(rem != 0)) {
+          srcWord  = m_code[codeIdx++];
+          srcShift = 0;
+
+          uint64_t tmp = 0;
+          bit::unpack(tmp, srcWord, srcShift, rem);
+          word |= tmp << (bits - rem);
+        }
+
+        data[i + w] = word;
+        srcMask >>= 2;
+      }
+    }
+
+    return code;
+  }
+
+  size_t compressedSize() const {
+    return sizeof(uint64_t) * (m_mask.size() + m_code.size());
+  }
+
+private:
+
+  uint32_t              m_size;
+  std::vector<uint64_t> m_mask;
+  std::vector<uint64_t> m_code;
+
+};
+
+
+/**
+ * \brief Loads all SPIR-V binaries in a directory
+ *
+ * Intended to be used with the output of
+ * \c DXVK_SHADER_DUMP_PATH as a corpus.
+ * \param [in] path Directory path
+ * \returns Loaded code buffers
+ */
+static std::vector<SpirvCodeBuffer> loadCorpus(const std::wstring& path) {
+  std::vector<SpirvCodeBuffer> result;
+
+  WIN32_FIND_DATAW findData;
+  HANDLE handle = FindFirstFileW((path + L"\\*.spv").c_str(), &findData);
+
+  if (handle == INVALID_HANDLE_VALUE)
+    return result;
+
+  do {
+    std::ifstream file((path + L"\\" + findData.cFileName).c_str(), std::ios::binary);
+    SpirvCodeBuffer code(file);
+
+    if (code.dwords())
+      result.push_back(std::move(code));
+  } while (FindNextFileW(handle, &findData));
+
+  FindClose(handle);
+  return result;
+}
+
+
+int WINAPI WinMain(HINSTANCE hInstance,
+                   HINSTANCE hPrevInstance,
+                   LPSTR lpCmdLine,
+                   int nCmdShow) {
+  int     argc = 0;
+  LPWSTR* argv = CommandLineToArgvW(
+    GetCommandLineW(), &argc);  
+  
+  if (argc < 2) {
+    Logger::err("Usage: spirv-compression shader_dir [iterations]");
+    return 1;
+  }
+
+  uint32_t iterations = argc > 2 ? uint32_t(std::wcstoul(argv[2], nullptr, 10)) : 100;
+
+  std::vector<SpirvCodeBuffer> corpus = loadCorpus(argv[1]);
+
+  if (corpus.empty()) {
+    Logger::err(str::format("No SPIR-V files found in ", str::fromws(argv[1])));
+    return 1;
+  }
+
+  // Compress all shaders once and verify that
+  // decompression reproduces the original code
+  std::vector<SpirvCompressedBuffer> compressed;
+  compressed.reserve(corpus.size());
+
+  std::vector<LegacyCompressedBuffer> legacy;
+  legacy.reserve(corpus.size());
+
+  size_t rawSize = 0;
+  size_t packedSize = 0;
+  size_t legacySize = 0;
+
+  auto t0 = dxvk::high_resolution_clock::now();
+
+  for (const auto& code : corpus)
+    compressed.emplace_back(code);
+
+  auto t1 = dxvk::high_resolution_clock::now();
+
+  for (const auto& code : corpus)
+    legacy.emplace_back(code);
+
+  for (size_t i = 0; i < corpus.size(); i++) {
+    SpirvCodeBuffer code = compressed[i].decompress();
+
+    if (code.dwords() != corpus[i].dwords()
+     || std::memcmp(code.data(), corpus[i].data(), code.size())) {
+      Logger::err(str::format("Decompression mismatch in shader ", i));
+      return 1;
+    }
+
+    rawSize    += compressed[i].size();
+    legacySize += legacy[i].compressedSize();
+    packedSize += compressed[i].compressedSize();
+  }
+
+  // Measure decompression throughput, using a plain
+  // copy of the uncompressed code as a baseline
+  uint64_t checksum = 0;
+
+  auto t2 = dxvk::high_resolution_clock::now();
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    for (const auto& code : compressed)
+      checksum += code.decompress().data()[0];
+  }
+
+  auto t3 = dxvk::high_resolution_clock::now();
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    for (const auto& code : corpus)
+      checksum += SpirvCodeBuffer(code.dwords(), code.data()).data()[0];
+  }
+
+  auto t4 = dxvk::high_resolution_clock::now();
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    for (const auto& code : legacy)
+      checksum += code.decompress().data()[0];
+  }
+
+  auto t5 = dxvk::high_resolution_clock::now();
+
+  auto gbps = [&] (auto start, auto end) {
+    double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    return double(rawSize) * double(iterations) / ns;
+  };
+
+  double encodeMs = double(std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count()) / 1000.0;
+
+  Logger::info(str::format("Shaders:         ", corpus.size()));
+  Logger::info(str::format("Uncompressed:    ", rawSize, " bytes"));
+  Logger::info(str::format("Compressed:      ", packedSize, " bytes"));
+  Logger::info(str::format("Compressed:      ", legacySize, " bytes (legacy)"));
+  Logger::info(str::format("Ratio:           ", double(packedSize) / double(rawSize)));
+  Logger::info(str::format("Ratio:           ", double(legacySize) / double(rawSize), " (legacy)"));
+  Logger::info(str::format("Compression:     ", encodeMs, " ms"));
+  Logger::info(str::format("Decompression:   ", gbps(t2, t3), " GB/s"));
+  Logger::info(str::format("Decompression:   ", gbps(t4, t5), " GB/s (legacy)"));
+  Logger::info(str::format("Copy (baseline): ", gbps(t3, t4), " GB/s"));
+  Logger::info(str::format("Checksum:        ", checksum));
+  return 0;
+}
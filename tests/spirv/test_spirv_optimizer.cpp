@@ -0,0 +1,826 @@
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "../../src/spirv/spirv_module.h"
+#include "../../src/spirv/spirv_optimizer.h"
+#include "../../src/util/log/log.h"
+#include "../../src/util/util_string.h"
+
+#include <shellapi.h>
+#include <windows.h>
+#include <windowsx.h>
+
+namespace dxvk {
+  Logger Logger::s_instance("spirv-optimizer.log");
+}
+
+using namespace dxvk;
+
+/**
+ * \brief SPIR-V evaluator
+ *
+ * Executes the entry point of a module built from the small
+ * subset of instructions used by the test cases below, with
+ * all values represented as vectors of 32-bit integers.
+ * Original and optimized modules are run with the same input
+ * value in order to check that they write the same outputs.
+ */
+class SpirvEvaluator {
+  using Value = std::vector<uint32_t>;
+public:
+
+  SpirvEvaluator(SpirvCodeBuffer code) {
+    for (auto ins : code) {
+      Ins entry;
+      entry.op = ins.opCode();
+
+      for (uint32_t i = 0; i < ins.length(); i++)
+        entry.args.push_back(ins.arg(i));
+
+      m_ins.push_back(std::move(entry));
+    }
+  }
+
+  bool run(uint32_t input, std::vector<Value>& outputs) {
+    m_values.clear();
+    m_memory.clear();
+    m_outputs.clear();
+    m_error.clear();
+    m_steps = 0;
+
+    uint32_t entryPoint = 0;
+    bool     inFunction = false;
+
+    for (uint32_t i = 0; i < m_ins.size(); i++) {
+      const auto& a = m_ins[i].args;
+
+      switch (m_ins[i].op) {
+        case spv::OpEntryPoint:
+          entryPoint = a[2];
+          break;
+
+        case spv::OpTypeBool:
+        case spv::OpTypeInt:
+          m_sizes[a[1]] = 1;
+          break;
+
+        case spv::OpTypeVector:
+          m_sizes[a[1]] = a[3];
+          break;
+
+        case spv::OpTypePointer:
+          m_sizes[a[1]] = m_sizes[a[3]];
+          break;
+
+        case spv::OpFunction:
+          m_functions[a[2]] = i;
+          inFunction = true;
+          break;
+
+        case spv::OpLabel:
+          m_labels[a[1]] = i;
+          break;
+
+        case spv::OpConstant:
+          m_values[a[2]] = { a[3] };
+          break;
+
+        case spv::OpConstantTrue:
+        case spv::OpConstantFalse:
+          m_values[a[2]] = { m_ins[i].op == spv::OpConstantTrue ? 1u : 0u };
+          break;
+
+        case spv::OpConstantNull:
+        case spv::OpUndef:
+          m_values[a[2]] = Value(m_sizes[a[1]]);
+          break;
+
+        case spv::OpConstantComposite: {
+          Value value;
+
+          for (uint32_t j = 3; j < a.size(); j++)
+            value.push_back(m_values[a[j]].at(0));
+
+          m_values[a[2]] = value;
+        } break;
+
+        case spv::OpVariable: {
+          if (!inFunction) {
+            initVariable(m_ins[i], input);
+
+            if (a[3] == spv::StorageClassOutput)
+              m_outputs.push_back(a[2]);
+          }
+        } break;
+
+        default:
+          break;
+      }
+    }
+
+    if (!entryPoint || !m_functions.count(entryPoint))
+      return fail("No entry point");
+
+    if (!call(entryPoint, input))
+      return false;
+
+    outputs.clear();
+
+    for (uint32_t id : m_outputs)
+      outputs.push_back(m_memory[id]);
+
+    return true;
+  }
+
+  const std::string& error() const {
+    return m_error;
+  }
+
+private:
+
+  struct Ins {
+    spv::Op               op;
+    std::vector<uint32_t> args;
+  };
+
+  std::vector<Ins>                        m_ins;
+  std::unordered_map<uint32_t, uint32_t>  m_sizes;
+  std::unordered_map<uint32_t, uint32_t>  m_functions;
+  std::unordered_map<uint32_t, uint32_t>  m_labels;
+  std::unordered_map<uint32_t, Value>     m_values;
+  std::unordered_map<uint32_t, Value>     m_memory;
+  std::vector<uint32_t>                   m_outputs;
+  std::string                             m_error;
+  uint32_t                                m_steps = 0;
+
+  bool fail(const std::string& error) {
+    m_error = error;
+    return false;
+  }
+
+  void initVariable(const Ins& ins, uint32_t input) {
+    const auto& a = ins.args;
+
+    Value value(m_sizes[a[1]]);
+
+    if (a[3] == spv::StorageClassInput) {
+      for (uint32_t c = 0; c < value.size(); c++)
+        value[c] = input + c;
+    } else if (a.size() > 4) {
+      value = m_values[a[4]];
+    }
+
+    m_memory[a[2]] = value;
+  }
+
+  bool call(uint32_t function, uint32_t input) {
+    uint32_t pc = m_functions[function] + 1;
+    uint32_t prevLabel = 0;
+    uint32_t currLabel = 0;
+
+    while (pc < m_ins.size()) {
+      if (++m_steps > 100000)
+        return fail("Step limit exceeded");
+
+      const Ins& ins = m_ins[pc];
+      const auto& a = ins.args;
+
+      // Phis at the start of a block are evaluated
+      // simultaneously, using the previous block
+      if (ins.op == spv::OpPhi) {
+        std::vector<std::pair<uint32_t, Value>> phis;
+
+        for (; m_ins[pc].op == spv::OpPhi; pc++) {
+          const auto& p = m_ins[pc].args;
+          bool found = false;
+
+          for (uint32_t j = 3; j + 1 < p.size() && !found; j += 2) {
+            if (p[j + 1] == prevLabel) {
+              phis.push_back({ p[2], m_values[p[j]] });
+              found = true;
+            }
+          }
+
+          if (!found)
+            return fail(str::format("Phi ", p[2], " has no parent ", prevLabel));
+        }
+
+        for (const auto& phi : phis)
+          m_values[phi.first] = phi.second;
+
+        continue;
+      }
+
+      switch (ins.op) {
+        case spv::OpLabel:
+          prevLabel = currLabel;
+          currLabel = a[1];
+          break;
+
+        case spv::OpVariable:
+          initVariable(ins, input);
+          break;
+
+        case spv::OpUndef:
+          m_values[a[2]] = Value(m_sizes[a[1]]);
+          break;
+
+        case spv::OpLoad:
+          m_values[a[2]] = m_memory[a[3]];
+          break;
+
+        case spv::OpStore:
+          m_memory[a[1]] = m_values[a[2]];
+          break;
+
+        case spv::OpBitcast:
+        case spv::OpCopyObject:
+          m_values[a[2]] = m_values[a[3]];
+          break;
+
+        case spv::OpIAdd:
+        case spv::OpIMul:
+        case spv::OpIEqual:
+        case spv::OpULessThan: {
+          const Value& x = m_values[a[3]];
+          const Value& y = m_values[a[4]];
+          Value r(x.size());
+
+          for (uint32_t c = 0; c < r.size(); c++) {
+            switch (ins.op) {
+              case spv::OpIAdd:       r[c] = x[c] + y[c]; break;
+              case spv::OpIMul:       r[c] = x[c] * y[c]; break;
+              case spv::OpIEqual:     r[c] = x[c] == y[c]; break;
+              case spv::OpULessThan:  r[c] = x[c] <  y[c]; break;
+              default: break;
+            }
+          }
+
+          m_values[a[2]] = r;
+        } break;
+
+        case spv::OpSelect: {
+          const Value& s = m_values[a[3]];
+          const Value& x = m_values[a[4]];
+          const Value& y = m_values[a[5]];
+          Value r(x.size());
+
+          for (uint32_t c = 0; c < r.size(); c++)
+            r[c] = s[s.size() > 1 ? c : 0] ? x[c] : y[c];
+
+          m_values[a[2]] = r;
+        } break;
+
+        case spv::OpVectorShuffle: {
+          Value src = m_values[a[3]];
+          const Value& y = m_values[a[4]];
+          src.insert(src.end(), y.begin(), y.end());
+
+          Value r;
+
+          for (uint32_t j = 5; j < a.size(); j++)
+            r.push_back(a[j] < src.size() ? src[a[j]] : 0u);
+
+          m_values[a[2]] = r;
+        } break;
+
+        case spv::OpCompositeExtract:
+          m_values[a[2]] = { m_values[a[3]].at(a[4]) };
+          break;
+
+        case spv::OpCompositeConstruct: {
+          Value r;
+
+          for (uint32_t j = 3; j < a.size(); j++)
+            r.insert(r.end(), m_values[a[j]].begin(), m_values[a[j]].end());
+
+          m_values[a[2]] = r;
+        } break;
+
+        case spv::OpFunctionCall:
+          if (!call(a[3], input))
+            return false;
+          m_values[a[2]] = Value();
+          break;
+
+        case spv::OpSelectionMerge:
+        case spv::OpLoopMerge:
+        case spv::OpName:
+          break;
+
+        case spv::OpBranch:
+          pc = m_labels[a[1]];
+          continue;
+
+        case spv::OpBranchConditional:
+          pc = m_labels[m_values[a[1]].at(0) ? a[2] : a[3]];
+          continue;
+
+        case spv::OpReturn:
+        case spv::OpFunctionEnd:
+          return true;
+
+        default:
+          return fail(str::format("Unsupported instruction ", uint32_t(ins.op)));
+      }
+
+      pc += 1;
+    }
+
+    return fail("Function has no return");
+  }
+
+};
+
+
+/**
+ * \brief Test module builder
+ *
+ * Sets up a vertex shader module with one
+ * scalar input and one scalar and vector
+ * output, like the shader compilers do.
+ */
+struct TestModule {
+  SpirvModule m;
+
+  uint32_t voidType;
+  uint32_t boolType;
+  uint32_t u32Type;
+  uint32_t i32Type;
+  uint32_t vec4Type;
+  uint32_t funcType;
+
+  uint32_t input;
+  uint32_t output;
+  uint32_t outputVec;
+
+  uint32_t main;
+
+  /// Variable inspected by the test check
+  uint32_t var = 0;
+
+  TestModule()
+  : m(spvVersion(1, 3)) {
+    m.enableCapability(spv::CapabilityShader);
+    m.setMemoryModel(
+      spv::AddressingModelLogical,
+      spv::MemoryModelGLSL450);
+
+    voidType  = m.defVoidType();
+    boolType  = m.defBoolType();
+    u32Type   = m.defIntType(32, 0);
+    i32Type   = m.defIntType(32, 1);
+    vec4Type  = m.defVectorType(u32Type, 4);
+    funcType  = m.defFunctionType(voidType, 0, nullptr);
+
+    input     = m.newVar(m.defPointerType(u32Type,  spv::StorageClassInput),  spv::StorageClassInput);
+    output    = m.newVar(m.defPointerType(u32Type,  spv::StorageClassOutput), spv::StorageClassOutput);
+    outputVec = m.newVar(m.defPointerType(vec4Type, spv::StorageClassOutput), spv::StorageClassOutput);
+
+    m.decorateLocation(input,     0);
+    m.decorateLocation(output,    0);
+    m.decorateLocation(outputVec, 1);
+
+    main = m.allocateId();
+
+    const uint32_t interfaces[] = { input, output, outputVec };
+    m.addEntryPoint(main, spv::ExecutionModelVertex, "main", 3, interfaces);
+  }
+
+  void beginFunction(uint32_t id) {
+    m.functionBegin(voidType, id, funcType, spv::FunctionControlMaskNone);
+    m.opLabel(m.allocateId());
+  }
+
+  void endFunction() {
+    m.opReturn();
+    m.functionEnd();
+  }
+
+  uint32_t privateVar(uint32_t init) {
+    uint32_t ptrType = m.defPointerType(u32Type, spv::StorageClassPrivate);
+
+    return init
+      ? m.newVarInit(ptrType, spv::StorageClassPrivate, init)
+      : m.newVar(ptrType, spv::StorageClassPrivate);
+  }
+
+  uint32_t functionVar() {
+    return m.newVar(m.defPointerType(u32Type,
+      spv::StorageClassFunction), spv::StorageClassFunction);
+  }
+
+  uint32_t load(uint32_t ptr) {
+    return m.opLoad(u32Type, ptr);
+  }
+
+  uint32_t add(uint32_t a, uint32_t b) {
+    return m.opIAdd(u32Type, a, b);
+  }
+
+  uint32_t c(uint32_t v) {
+    return m.constu32(v);
+  }
+
+  /**
+   * \brief Emits a structured if/else
+   *
+   * \param [in] cond Condition
+   * \param [in] thenFn Emits the then block
+   * \param [in] elseFn Emits the else block
+   */
+  void ifElse(uint32_t cond,
+    const std::function<void ()>& thenFn,
+    const std::function<void ()>& elseFn) {
+    uint32_t thenLabel  = m.allocateId();
+    uint32_t elseLabel  = m.allocateId();
+    uint32_t mergeLabel = m.allocateId();
+
+    m.opSelectionMerge(mergeLabel, spv::SelectionControlMaskNone);
+    m.opBranchConditional(cond, thenLabel, elseLabel);
+
+    m.opLabel(thenLabel);
+    thenFn();
+    m.opBranch(mergeLabel);
+
+    m.opLabel(elseLabel);
+    elseFn();
+    m.opBranch(mergeLabel);
+
+    m.opLabel(mergeLabel);
+  }
+
+  /**
+   * \brief Emits a counted loop
+   *
+   * The counter is kept in a function variable
+   * that must be declared in the first block.
+   * \param [in] counter Counter variable
+   * \param [in] count Iteration count
+   * \param [in] bodyFn Emits the loop body
+   */
+  void loop(uint32_t counter, uint32_t count,
+    const std::function<void ()>& bodyFn) {
+    uint32_t headerLabel   = m.allocateId();
+    uint32_t bodyLabel     = m.allocateId();
+    uint32_t continueLabel = m.allocateId();
+    uint32_t mergeLabel    = m.allocateId();
+
+    m.opStore(counter, c(0));
+    m.opBranch(headerLabel);
+
+    m.opLabel(headerLabel);
+    uint32_t cond = m.opULessThan(boolType, load(counter), c(count));
+    m.opLoopMerge(mergeLabel, continueLabel, spv::LoopControlMaskNone);
+    m.opBranchConditional(cond, bodyLabel, mergeLabel);
+
+    m.opLabel(bodyLabel);
+    bodyFn();
+    m.opBranch(continueLabel);
+
+    m.opLabel(continueLabel);
+    m.opStore(counter, add(load(counter), c(1)));
+    m.opBranch(headerLabel);
+
+    m.opLabel(mergeLabel);
+  }
+};
+
+
+/**
+ * \brief Test case
+ *
+ * Builds a module, runs the given optimizer passes
+ * on it and checks the result. All modules are also
+ * run through the full optimizer.
+ */
+struct TestCase {
+  const char* name;
+  std::function<void (TestModule&)>             build;
+  std::function<void (SpirvOptimizer&)>         passes;
+  std::function<bool (const SpirvCodeBuffer&, const TestModule&)> check;
+};
+
+
+static uint32_t countOps(SpirvCodeBuffer code, spv::Op op) {
+  uint32_t count = 0;
+
+  for (auto ins : code)
+    count += ins.opCode() == op ? 1 : 0;
+
+  return count;
+}
+
+
+static uint32_t countAccesses(SpirvCodeBuffer code, uint32_t var) {
+  uint32_t count = 0;
+
+  for (auto ins : code) {
+    if ((ins.opCode() == spv::OpLoad  && ins.arg(3) == var)
+     || (ins.opCode() == spv::OpStore && ins.arg(1) == var))
+      count += 1;
+  }
+
+  return count;
+}
+
+
+static bool checkEquivalent(
+  const std::string&      name,
+  const SpirvCodeBuffer&  original,
+  const SpirvCodeBuffer&  optimized) {
+  static const uint32_t inputs[] = { 0u, 1u, 2u, 3u, 4u, 7u, 100u, ~0u };
+
+  SpirvEvaluator a(original);
+  SpirvEvaluator b(optimized);
+
+  for (uint32_t input : inputs) {
+    std::vector<std::vector<uint32_t>> outA, outB;
+
+    if (!a.run(input, outA)) {
+      Logger::err(str::format(name, ": Failed to run original module: ", a.error()));
+      return false;
+    }
+
+    if (!b.run(input, outB)) {
+      Logger::err(str::format(name, ": Failed to run optimized module: ", b.error()));
+      return false;
+    }
+
+    if (outA != outB) {
+      Logger::err(str::format(name, ": Output mismatch for input ", input));
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static void storeModule(
+  const std::wstring&     path,
+  const std::string&      name,
+  const SpirvCodeBuffer&  code) {
+  std::ofstream file((path + L"\\" + str::tows(name.c_str()) + L".spv").c_str(), std::ios::binary);
+  code.store(file);
+}
+
+
+static std::vector<TestCase> getTestCases() {
+  std::vector<TestCase> tests;
+
+  // Unused arithmetic is removed, used arithmetic is kept
+  tests.push_back({ "dead-code",
+    [] (TestModule& t) {
+      t.beginFunction(t.main);
+      uint32_t x = t.load(t.input);
+      t.add(t.m.opIMul(t.u32Type, x, x), t.c(5));
+      t.m.opStore(t.output, t.add(x, t.c(1)));
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule&) {
+      return countOps(code, spv::OpIMul) == 0
+          && countOps(code, spv::OpIAdd) == 1;
+    } });
+
+  // Stores to a private variable that is never read are removed
+  tests.push_back({ "dead-store",
+    [] (TestModule& t) {
+      t.var = t.privateVar(0);
+      t.beginFunction(t.main);
+      uint32_t x = t.load(t.input);
+      t.m.opStore(t.var, t.add(x, t.c(3)));
+      t.m.opStore(t.output, x);
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.removeDeadStores();
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule& t) {
+      return countAccesses(code, t.var) == 0
+          && countOps(code, spv::OpIAdd) == 0;
+    } });
+
+  // Function variable written on both sides of a branch
+  tests.push_back({ "promote-branch",
+    [] (TestModule& t) {
+      t.beginFunction(t.main);
+      t.var = t.functionVar();
+      uint32_t x = t.load(t.input);
+      t.m.opStore(t.var, t.c(0));
+      t.ifElse(t.m.opULessThan(t.boolType, x, t.c(4)),
+        [&] { t.m.opStore(t.var, t.add(x, t.c(10))); },
+        [&] { t.m.opStore(t.var, t.m.opIMul(t.u32Type, x, t.c(3))); });
+      t.m.opStore(t.output, t.load(t.var));
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.promoteVariables();
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule& t) {
+      return countAccesses(code, t.var) == 0
+          && countOps(code, spv::OpPhi) >= 1;
+    } });
+
+  // Function variables updated in a loop
+  tests.push_back({ "promote-loop",
+    [] (TestModule& t) {
+      t.beginFunction(t.main);
+      t.var = t.functionVar();
+      uint32_t counter = t.functionVar();
+      uint32_t x = t.load(t.input);
+      t.m.opStore(t.var, t.c(1));
+      t.loop(counter, 5, [&] {
+        t.m.opStore(t.var, t.add(t.load(t.var), x));
+      });
+      t.m.opStore(t.output, t.load(t.var));
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.promoteVariables();
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule& t) {
+      return countAccesses(code, t.var) == 0
+          && countOps(code, spv::OpPhi) >= 2;
+    } });
+
+  // Register in a body function that the entry point calls
+  // once, which is how the DXBC and DXSO compilers emit code
+  tests.push_back({ "promote-private-called-once",
+    [] (TestModule& t) {
+      uint32_t body = t.m.allocateId();
+      t.var = t.privateVar(0);
+
+      t.beginFunction(body);
+      uint32_t x = t.load(t.input);
+      t.m.opStore(t.var, x);
+      t.ifElse(t.m.opIEqual(t.boolType, x, t.c(2)),
+        [&] { t.m.opStore(t.var, t.add(t.load(t.var), t.c(7))); },
+        [&] { });
+      t.m.opStore(t.output, t.load(t.var));
+      t.endFunction();
+
+      t.beginFunction(t.main);
+      t.m.opFunctionCall(t.voidType, body, 0, nullptr);
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.promoteVariables();
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule& t) {
+      return countAccesses(code, t.var) == 0;
+    } });
+
+  // A register that accumulates across two calls must stay
+  tests.push_back({ "keep-private-called-twice",
+    [] (TestModule& t) {
+      uint32_t body = t.m.allocateId();
+      t.var = t.privateVar(t.c(0));
+
+      t.beginFunction(body);
+      uint32_t sum = t.add(t.load(t.var), t.load(t.input));
+      t.m.opStore(t.var, sum);
+      t.m.opStore(t.output, sum);
+      t.endFunction();
+
+      t.beginFunction(t.main);
+      t.m.opFunctionCall(t.voidType, body, 0, nullptr);
+      t.m.opFunctionCall(t.voidType, body, 0, nullptr);
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.promoteVariables();
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule& t) {
+      return countAccesses(code, t.var) == 2;
+    } });
+
+  // Same for a single call site inside a loop
+  tests.push_back({ "keep-private-called-in-loop",
+    [] (TestModule& t) {
+      uint32_t body = t.m.allocateId();
+      t.var = t.privateVar(t.c(0));
+
+      t.beginFunction(body);
+      uint32_t sum = t.add(t.load(t.var), t.load(t.input));
+      t.m.opStore(t.var, sum);
+      t.m.opStore(t.output, sum);
+      t.endFunction();
+
+      t.beginFunction(t.main);
+      uint32_t counter = t.functionVar();
+      t.loop(counter, 3, [&] {
+        t.m.opFunctionCall(t.voidType, body, 0, nullptr);
+      });
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.promoteVariables();
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule& t) {
+      return countAccesses(code, t.var) == 2;
+    } });
+
+  // Two shuffles that cancel out, and extracts from them
+  tests.push_back({ "fold-swizzles",
+    [] (TestModule& t) {
+      t.beginFunction(t.main);
+      uint32_t x = t.load(t.input);
+      const uint32_t members[] = { x, t.add(x, t.c(1)), t.add(x, t.c(2)), t.add(x, t.c(3)) };
+      uint32_t v = t.m.opCompositeConstruct(t.vec4Type, 4, members);
+      const uint32_t reverse[] = { 3, 2, 1, 0 };
+      uint32_t s1 = t.m.opVectorShuffle(t.vec4Type, v, v, 4, reverse);
+      uint32_t s2 = t.m.opVectorShuffle(t.vec4Type, s1, s1, 4, reverse);
+      const uint32_t index = 1;
+      t.m.opStore(t.outputVec, s2);
+      t.m.opStore(t.output, t.m.opCompositeExtract(t.u32Type, s1, 1, &index));
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.foldSwizzles();
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule&) {
+      return countOps(code, spv::OpVectorShuffle) == 0
+          && countOps(code, spv::OpCompositeExtract) == 0;
+    } });
+
+  // Round trip through a signed integer type
+  tests.push_back({ "fold-bitcasts",
+    [] (TestModule& t) {
+      t.beginFunction(t.main);
+      uint32_t x = t.load(t.input);
+      uint32_t i = t.m.opBitcast(t.i32Type, x);
+      uint32_t u = t.m.opBitcast(t.u32Type, i);
+      t.m.opStore(t.output, t.add(u, t.c(9)));
+      t.endFunction();
+    },
+    [] (SpirvOptimizer& opt) {
+      opt.foldBitcasts();
+      opt.removeDeadCode();
+    },
+    [] (const SpirvCodeBuffer& code, const TestModule&) {
+      return countOps(code, spv::OpBitcast) == 0;
+    } });
+
+  return tests;
+}
+
+
+int WINAPI WinMain(HINSTANCE hInstance,
+                   HINSTANCE hPrevInstance,
+                   LPSTR lpCmdLine,
+                   int nCmdShow) {
+  int     argc = 0;
+  LPWSTR* argv = CommandLineToArgvW(
+    GetCommandLineW(), &argc);
+
+  // Optionally write all modules to a directory
+  // so that they can be checked with spirv-val
+  std::wstring dumpPath = argc > 1 ? argv[1] : L"";
+
+  uint32_t failures = 0;
+
+  for (const auto& test : getTestCases()) {
+    TestModule module;
+    test.build(module);
+
+    SpirvCodeBuffer original = module.m.compile();
+
+    SpirvOptimizer optimizer(original);
+    test.passes(optimizer);
+
+    SpirvCodeBuffer optimized = optimizer.getCode();
+    SpirvCodeBuffer full = SpirvOptimizer::optimize(original);
+
+    bool success = checkEquivalent(test.name, original, optimized)
+                && checkEquivalent(str::format(test.name, " (all passes)"), original, full);
+
+    if (success && !test.check(optimized, module)) {
+      Logger::err(str::format(test.name, ": Optimized code does not have the expected form"));
+      success = false;
+    }
+
+    if (!dumpPath.empty()) {
+      storeModule(dumpPath, test.name, original);
+      storeModule(dumpPath, str::format(test.name, ".opt"), optimized);
+      storeModule(dumpPath, str::format(test.name, ".all"), full);
+    }
+
+    Logger::info(str::format(test.name, ": ", success ? "passed" : "FAILED"));
+    failures += success ? 0 : 1;
+  }
+
+  return failures ? 1 : 0;
+}